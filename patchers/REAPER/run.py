@@ -1,6 +1,14 @@
 #!/usr/bin/env python3
 import sys
 import os
+import argparse
+import bisect
+import ctypes
+import ctypes.util
+import errno
+import fcntl
+import json
+from concurrent.futures import ProcessPoolExecutor
 from pathlib import Path
 import soundfile as sf
 import numpy as np
@@ -12,20 +20,170 @@ SYNC_PATTERN = np.array([
     9.01e-5, -1.23e-5, 1.35e-5, -2.46e-5,
     3.57e-5, -4.68e-5, 5.79e-5, -6.80e-5
 ], dtype=np.float32)
-SYNC_TOL = 1e-6
+SYNC_THRESHOLD = 0.99  # Normalized correlation a marker must reach, see src/sync-detect.h
+# Tick markers, see src/sync-marker.h: the pattern with the signs of Walsh
+# row 6, then TICK_BITS samples of +-TICK_AMPLITUDE, most significant first
+TICK_PATTERN = SYNC_PATTERN * np.array([-1 if bin(6 & i).count('1') % 2 else 1 for i in range(16)], dtype=np.float32)
+TICK_BITS = 16
+TICK_AMPLITUDE = 5e-5
+TICK_SEARCH = 2048  # frames either side of where a tick is expected in the take, see src/take-patch.h
 DURATION_TOL = 1  # seconds
 time_margin = 1  # seconds
+INDEX_NAME = '.index.json'  # Lives in the recordings dir
+INDEX_VERSION = 1
+SIDECAR_VERSION = 1  # See src/take-sidecar.h
+# Glitch map, same as src/glitch-map.h and src/take-patch.h
+GLITCH_WINDOW = 64  # frames
+GLITCH_THRESHOLD = 1e-4  # About -80 dBFS
+GLITCH_MERGE = 256  # frames between damaged windows that still make one glitch
+CROSSFADE = 64  # frames faded into and out of each patched glitch
+UNDO_DIR = '.pw-ghost-rec-undo'  # In the project, one subdirectory per in-place run
+FICLONE = 0x40049409  # linux/fs.h: share the source's extents (btrfs, XFS, bcachefs)
+
+class NoSyncInRecording(RuntimeError):
+    """The recording has no sync marker; the index keeps it as sync -1."""
+
+
+class _SyncMatch(ctypes.Structure):
+    _fields_ = [('frame', ctypes.c_int64), ('confidence', ctypes.c_float), ('gain', ctypes.c_float)]
+
 
 def find_sync_offset(audio: np.ndarray) -> int:
-    for i in range(len(audio) - len(SYNC_PATTERN) + 1):
-        if np.all(np.abs(audio[i:i+len(SYNC_PATTERN)] - SYNC_PATTERN) < SYNC_TOL):
-            return i
+    """Find the offset of the sync pattern in a mono float32 numpy array.
+
+    Matched by normalized cross-correlation, so gain changes and dither do
+    not hide the marker. Returns -1 when no position scores SYNC_THRESHOLD.
+    """
+    audio = np.ascontiguousarray(audio, dtype=np.float32)
+    n = len(SYNC_PATTERN)
+    if len(audio) < n:
+        return -1
+    if _native is not None:
+        match = _SyncMatch()
+        found = _native.sync_detect(audio.ctypes.data, len(audio), 1, ctypes.byref(match), 1)
+        return int(match.frame) if found > 0 else -1
+    # Chunked so long recordings do not need several float64 copies at once
+    step = 1 << 20
+    for start in range(0, len(audio) - n + 1, step):
+        score, _ = match_scores(audio[start:start + step + 2 * n], SYNC_PATTERN)
+        hits = np.flatnonzero(score[:step] >= SYNC_THRESHOLD)
+        if len(hits):
+            # Best position of the first cluster of hits
+            first = hits[0]
+            return start + first + int(np.argmax(score[first:first + n]))
     return -1
 
+def match_scores(audio, pattern):
+    """Normalized correlation and gain of pattern at every position of audio."""
+    n = len(pattern)
+    x = np.asarray(audio, dtype=np.float64)
+    pattern = pattern.astype(np.float64)
+    pattern_energy = np.dot(pattern, pattern)
+    corr = np.correlate(x, pattern, mode='valid')
+    energy = np.convolve(x * x, np.ones(n), mode='valid')
+    score = np.where(energy > 0, corr / np.sqrt(np.maximum(energy, 1e-300) * pattern_energy), 0.0)
+    return score, corr / pattern_energy
+
+def find_tick(audio, predicted, sequence):
+    """Frame of tick sequence (modulo 2^TICK_BITS) in a mono array within
+    TICK_SEARCH of predicted, or None."""
+    lo = max(0, predicted - TICK_SEARCH)
+    x = audio[lo:max(lo, predicted + TICK_SEARCH + len(TICK_PATTERN) + TICK_BITS)]
+    if len(x) < len(TICK_PATTERN) + TICK_BITS:
+        return None
+    score, gain = match_scores(x, TICK_PATTERN)
+    for hit in np.flatnonzero(score[:len(x) - len(TICK_PATTERN) - TICK_BITS + 1] >= SYNC_THRESHOLD):
+        bits = x[hit + len(TICK_PATTERN):hit + len(TICK_PATTERN) + TICK_BITS]
+        expected = TICK_AMPLITUDE * gain[hit]
+        if not np.all((np.abs(bits) > 0.5 * expected) & (np.abs(bits) < 1.5 * expected)):
+            continue
+        if int(''.join('1' if b > 0 else '0' for b in bits), 2) == sequence % (1 << TICK_BITS):
+            return lo + int(hit)
+    return None
+
+def align_on_ticks(ref_audio, ref_sync, rec_sync, ticks):
+    """Anchors [(take_frame, offset)] like src/take-patch.c: take frame t
+    holds recording frame t - offset of the last anchor at or before it. The
+    first is the sync marker, then every recording tick found in the take
+    near where the interval before it puts it. Returns the anchors and the
+    drift of the ticks against the marker's alignment in ppm."""
+    anchors = [(ref_sync, ref_sync - rec_sync)]
+    sxx = sxy = 0.0
+    for frame, sequence in ticks:
+        if frame <= rec_sync:
+            continue
+        predicted = frame + anchors[-1][1]
+        if predicted >= len(ref_audio):
+            break
+        t = find_tick(ref_audio, predicted, sequence)
+        if t is None or t <= anchors[-1][0]:
+            continue
+        anchors.append((t, t - frame))
+        x = frame - rec_sync
+        sxx += x * x
+        sxy += x * (t - frame - anchors[0][1])
+    return anchors, (sxy / sxx * 1e6 if sxx else 0.0)
+
 def get_wav_duration(path):
     info = sf.info(str(path))
     return info.frames / info.samplerate
 
+def read_sidecar(wav_path):
+    """The JSON the daemon saves next to a recording (same name, .json), or None."""
+    try:
+        with open(Path(wav_path).with_suffix('.json')) as f:
+            data = json.load(f)
+    except (OSError, ValueError):
+        return None
+    return data if isinstance(data, dict) and data.get('version') == SIDECAR_VERSION else None
+
+def sidecar_sync(wav_path, samplerate):
+    """Sync marker offset of a recording from its sidecar, or None."""
+    data = read_sidecar(wav_path)
+    try:
+        if data is not None and data['sample_rate'] == samplerate:
+            return int(data['sync']['offset'])
+    except (KeyError, TypeError, ValueError):
+        pass
+    return None
+
+def sidecar_ticks(wav_path, samplerate):
+    """[(frame, sequence)] of the tick markers in a recording's sidecar, in
+    recording frames, or [] if there are none."""
+    data = read_sidecar(wav_path)
+    try:
+        if data is not None and data['sample_rate'] == samplerate:
+            return [(int(m['offset']), int(m['sequence'])) for m in data.get('markers', []) if m.get('type') == 'tick']
+    except (KeyError, TypeError, ValueError):
+        pass
+    return []
+
+def sidecar_glitches(wav_path, samplerate):
+    """(glitches, checked_until) from the daemon's return check in a
+    recording's sidecar: [(start, end, max_diff, rms_diff, type)] and the
+    frame the check got to, in recording frames; None without one."""
+    data = read_sidecar(wav_path)
+    try:
+        if data is not None and data['sample_rate'] == samplerate and 'loopback' in data:
+            loopback = data['loopback']
+            checked = max(int(loopback['compared_until']) - int(data['start_frame']), 0)
+            glitches = [(int(g['offset']), int(g['offset']) + int(g['end_frame']) - int(g['start_frame']),
+                         float(g['max_diff']), float(g.get('rms_diff', 0.0)), g['type'])
+                        for g in loopback['glitches']]
+            return glitches, checked
+    except (KeyError, TypeError, ValueError):
+        pass
+    return None
+
+def take_frame_of(anchors, frame):
+    """Take frame holding recording frame frame, see align_on_ticks."""
+    offset = anchors[0][1]
+    for t, o in anchors:
+        if t - o > frame:
+            break
+        offset = o
+    return max(frame + offset, 0)
+
 def find_wav_data_offset(path):
     import struct
     with open(path, 'rb') as f:
@@ -40,22 +198,415 @@ def find_wav_data_offset(path):
             f.seek(chunk_size, 1)
     raise RuntimeError('data chunk not found')
 
+def _load_native():
+    """libpwghost from the pw-ghost-rec build, or None to use numpy."""
+    path = os.environ.get('PW_GHOST_LIB') or ctypes.util.find_library('pwghost')
+    if not path:
+        return None
+    try:
+        lib = ctypes.CDLL(path)
+    except OSError:
+        return None
+    lib.sample_convert_to_pcm24.argtypes = [ctypes.c_void_p, ctypes.c_void_p, ctypes.c_size_t]
+    lib.sample_convert_to_pcm24.restype = None
+    lib.sync_detect.argtypes = [ctypes.c_void_p, ctypes.c_size_t, ctypes.c_size_t, ctypes.POINTER(_SyncMatch), ctypes.c_size_t]
+    lib.sync_detect.restype = ctypes.c_int64
+    return lib
+
+_native = _load_native()
+
 def float32_to_pcm24(samples):
-    import struct
-    samples = np.clip(samples, -1.0, 1.0)
-    ints = (samples * 8388607.0).astype(np.int32)
-    pcm_bytes = bytearray()
-    for i in ints:
-        pcm_bytes += struct.pack('<i', i)[0:3]
-    return pcm_bytes
+    """Saturate to [-1, 1] and pack as little endian 24 bit, rounding like libsndfile."""
+    samples = np.ascontiguousarray(samples, dtype=np.float32)
+    if _native is not None:
+        out = np.empty(len(samples) * 3, dtype=np.uint8)
+        _native.sample_convert_to_pcm24(samples.ctypes.data, out.ctypes.data, len(samples))
+        return out.tobytes()
+    ints = np.rint(np.clip(samples, -1.0, 1.0) * np.float32(8388607.0)).astype('<i4')
+    return ints.view(np.uint8).reshape(-1, 4)[:, :3].tobytes()
+
+def find_glitches(take, rec, start):
+    """Where the aligned mono take and recording differ from frame start on,
+    like src/glitch-map.c: damaged GLITCH_WINDOW frame windows closer than
+    GLITCH_MERGE form one glitch. Returns [(start, end, max_diff, rms_diff,
+    type)], type 'zeroed' (dropout, zeroed packet) or 'different'."""
+    start = int(start)
+    diff = np.abs(take[start:] - rec[start:])
+    n = len(diff)
+    if n == 0:
+        return []
+    windows = -(-n // GLITCH_WINDOW)
+    padded = np.zeros(windows * GLITCH_WINDOW, dtype=np.float32)
+    padded[:n] = diff
+    bad = np.flatnonzero(padded.reshape(windows, GLITCH_WINDOW).max(axis=1) > GLITCH_THRESHOLD)
+    if len(bad) == 0:
+        return []
+    breaks = np.flatnonzero((np.diff(bad) - 1) * GLITCH_WINDOW > GLITCH_MERGE)
+    firsts = np.concatenate(([bad[0]], bad[breaks + 1]))
+    lasts = np.concatenate((bad[breaks], [bad[-1]]))
+    glitches = []
+    for first, last in zip(firsts, lasts):
+        a, b = int(first) * GLITCH_WINDOW, min((int(last) + 1) * GLITCH_WINDOW, n)
+        d = diff[a:b]
+        over = d > GLITCH_THRESHOLD
+        zeroed = np.count_nonzero(over & (np.abs(take[start + a:start + b]) <= GLITCH_THRESHOLD))
+        glitches.append((start + a, start + b, float(d.max()), float(np.sqrt(np.mean(np.square(d, dtype=np.float64)))),
+                         'zeroed' if 2 * zeroed >= np.count_nonzero(over) else 'different'))
+    return glitches
+
+def glitch_patch_ranges(glitches, start, end):
+    """(first, last, fade_in, fade_out) frames to write per glitch: the glitch
+    plus up to CROSSFADE frames either side, within [start, end) and not
+    running into the neighbouring glitches."""
+    ranges = []
+    floor = start
+    for i, (g_start, g_end, *_) in enumerate(glitches):
+        half = (glitches[i + 1][0] - g_end) // 2 if i + 1 < len(glitches) else CROSSFADE
+        fade_in = min(CROSSFADE, g_start - floor)
+        fade_out = max(min(CROSSFADE, half, end - g_end), 0)
+        ranges.append((g_start - fade_in, g_end + fade_out, fade_in, fade_out))
+        floor = g_end + fade_out
+    return ranges
+
+def patch_wav_with_reference(ref_path, rec_path, rec_sync=None, undo=None, glitches_only=False, ticks=True):
+    """Patch the take at ref_path with the recording at rec_path after the
+    sync marker. rec_sync is the recording's marker offset if already known
+    (sidecar or index); then only the part of the recording that lines up
+    with the take is read. With an UndoRecord, what gets overwritten is saved
+    there first. glitches_only rewrites just the places where the take
+    differs, crossfaded; what the daemon's return check covered is taken
+    from the glitches in the recording's sidecar instead of compared again. With ticks, the tick markers listed in the
+    recording's sidecar align each interval between them on its own. Returns (diff_mean, diff_max, rec_sync, glitches),
+    glitches as from find_glitches, None unless glitches_only."""
+    # --- Load audio, find sync points ---
+    ref_audio, ref_sr = sf.read(str(ref_path), dtype='float32')
+    if ref_audio.ndim > 1:
+        ref_audio = ref_audio[:, 0]
+    ref_sync = find_sync_offset(ref_audio)
+    if ref_sync == -1:
+        raise RuntimeError("Sync pattern not found in the take!")
+    rec_ticks = sidecar_ticks(rec_path, ref_sr) if ticks else []
+    if rec_sync is None:
+        rec_audio, rec_sr = sf.read(str(rec_path), dtype='float32')
+        rec_start = 0
+    else:
+        # Each tick moves the alignment by at most TICK_SEARCH
+        margin = TICK_SEARCH * len(rec_ticks)
+        rec_start = max(0, rec_sync - ref_sync - margin)
+        rec_audio, rec_sr = sf.read(str(rec_path), dtype='float32', start=rec_start, frames=len(ref_audio) + 2 * margin)
+    if ref_sr != rec_sr:
+        raise RuntimeError(f"Sample rates differ: {ref_sr} vs {rec_sr}")
+    if rec_audio.ndim > 1:
+        rec_audio = rec_audio[:, 0]
+    if rec_sync is None:
+        rec_sync = find_sync_offset(rec_audio)
+    if rec_sync == -1:
+        raise NoSyncInRecording("Sync pattern not found in the recording!")
+
+    # --- Align local recording to reference, interval by interval ---
+    anchors, drift_ppm = align_on_ticks(ref_audio, ref_sync, rec_sync, rec_ticks)
+    window = rec_audio
+    rec_audio = np.zeros(len(ref_audio), dtype=np.float32)
+    for i, (first, offset) in enumerate(anchors):
+        last = anchors[i + 1][0] if i + 1 < len(anchors) else len(ref_audio)
+        # Window index of take frame t is t - offset - rec_start
+        a = max(0 if i == 0 else first, offset + rec_start)
+        b = min(last, offset + rec_start + len(window))
+        if a < b:
+            rec_audio[a:b] = window[a - offset - rec_start:b - offset - rec_start]
+
+    # --- Compute similarity metrics ---
+    sync_len = len(SYNC_PATTERN)
+    sync_start = ref_sync
+    compare_start = sync_start + sync_len
+    diff_mean = diff_max = None
+    if compare_start < len(ref_audio):
+        diff = np.abs(ref_audio[compare_start:] - rec_audio[compare_start:])
+        diff_mean = float(np.mean(diff))
+        diff_max = float(np.max(diff))
+    glitches = None
+    if glitches_only:
+        checked = sidecar_glitches(rec_path, ref_sr)
+        if checked is None:
+            glitches = find_glitches(ref_audio, rec_audio, compare_start)
+        else:
+            # The daemon already compared the take up to checked_end
+            reported, checked_until = checked
+            checked_end = min(max(take_frame_of(anchors, checked_until), compare_start), len(ref_audio))
+            glitches = []
+            for g_start, g_end, max_diff, rms_diff, kind in reported:
+                if g_start >= checked_until:
+                    break
+                a = take_frame_of(anchors, g_start)
+                a, b = max(a, compare_start), min(a + g_end - g_start, checked_end)
+                if a < b:
+                    glitches.append((a, b, max_diff, rms_diff, kind))
+            glitches += find_glitches(ref_audio, rec_audio, checked_end)
+
+    # --- Burn in sync marker (optional) ---
+    if sync_start + sync_len <= len(rec_audio):
+        rec_audio[sync_start:sync_start+sync_len] = rec_audio[sync_start:sync_start+sync_len] * 10000.0
+
+    # --- Patch the file: only the bytes after the sync point are written ---
+    data_offset, data_size = find_wav_data_offset(ref_path)
+    bytes_per_sample = 3
+    end = min(len(rec_audio), data_size // bytes_per_sample)
+    writes = []
+    if glitches_only:
+        # The marker, then each glitch with its crossfades
+        if sync_start < end:
+            writes.append((sync_start, rec_audio[sync_start:min(compare_start, end)]))
+        for first, last, fade_in, fade_out in glitch_patch_ranges(glitches, compare_start, end):
+            seg = rec_audio[first:last].copy()
+            if fade_in:
+                g = ((np.arange(fade_in) + 0.5) / fade_in).astype(np.float32)
+                seg[:fade_in] = ref_audio[first:first + fade_in] * (1 - g) + seg[:fade_in] * g
+            if fade_out:
+                g = (1 - (np.arange(fade_out) + 0.5) / fade_out).astype(np.float32)
+                seg[-fade_out:] = ref_audio[last - fade_out:last] * (1 - g) + seg[-fade_out:] * g
+            writes.append((first, seg))
+    elif sync_start < end:
+        writes.append((sync_start, rec_audio[sync_start:end]))
+    writes = [(data_offset + first * bytes_per_sample, float32_to_pcm24(samples)) for first, samples in writes]
+    if undo is not None:
+        undo.save(ref_path, [(offset, len(data)) for offset, data in writes])
+    with open(ref_path, 'r+b') as f:
+        for offset, data in writes:
+            f.seek(offset)
+            f.write(data)
+    what = f"{len(glitches)} glitch(es)" if glitches_only else "post-sync"
+    if len(anchors) > 1:
+        what += f", {len(anchors) - 1} tick(s), drift {drift_ppm:.1f} ppm"
+    print(f"Patched REAPER: {ref_path.name}  with  LOCAL: {rec_path.name} (only data chunk, PCM_24, {what})")
+    return diff_mean, diff_max, rec_sync, glitches
+
+
+class RecordingIndex:
+    """Duration, rate, mtime and sync offset of every recording, kept in
+    INDEX_NAME next to them. Only files whose size or mtime changed are read
+    again, so a rescan of thousands of recordings costs one stat each. Sync
+    offsets come from the daemon's sidecars where there are any.
+    Entries are sorted by mtime for window lookups."""
+
+    def __init__(self, recordings_dir):
+        self.dir = Path(recordings_dir)
+        self.path = self.dir / INDEX_NAME
+        self.entries = {}
+        self.dirty = False
+        try:
+            with open(self.path) as f:
+                data = json.load(f)
+            if data.get('version') == INDEX_VERSION:
+                self.entries = data['recordings']
+        except (OSError, ValueError, KeyError):
+            pass
+        self._sorted = None
+
+    def update(self):
+        """Pick up new and changed recordings, forget deleted ones."""
+        seen = set()
+        added = 0
+        for rec in self.dir.rglob('*.wav'):
+            name = str(rec.relative_to(self.dir))
+            seen.add(name)
+            st = rec.stat()
+            entry = self.entries.get(name)
+            if entry and entry['size'] == st.st_size and entry['mtime_ns'] == st.st_mtime_ns:
+                # The sidecar is saved right after its WAV, a scan in between misses it
+                if entry['sync'] is None:
+                    sync = sidecar_sync(rec, entry['samplerate'])
+                    if sync is not None:
+                        entry['sync'] = sync
+                        self.dirty = True
+                continue
+            try:
+                info = sf.info(str(rec))
+            except RuntimeError:
+                continue
+            self.entries[name] = {
+                'size': st.st_size,
+                'mtime_ns': st.st_mtime_ns,
+                'mtime': st.st_mtime,
+                'frames': info.frames,
+                'samplerate': info.samplerate,
+                'duration': info.frames / info.samplerate,
+                # From the sidecar, else found on first use; -1 once a search found none
+                'sync': sidecar_sync(rec, info.samplerate),
+            }
+            added += 1
+        removed = [name for name in self.entries if name not in seen]
+        for name in removed:
+            del self.entries[name]
+        if added or removed:
+            self.dirty = True
+            self._sorted = None
+        return added, len(removed)
+
+    def _by_mtime(self):
+        if self._sorted is None:
+            items = sorted(self.entries.items(), key=lambda item: item[1]['mtime'])
+            self._sorted = ([e['mtime'] for _, e in items], items)
+        return self._sorted
+
+    def match(self, mtime, duration):
+        """Newest recording within time_margin of mtime and DURATION_TOL of
+        duration, as (path, entry), or None."""
+        mtimes, items = self._by_mtime()
+        lo = bisect.bisect_left(mtimes, mtime - time_margin)
+        hi = bisect.bisect_right(mtimes, mtime + time_margin)
+        best = None
+        for name, entry in items[lo:hi]:
+            if abs(entry['mtime'] - mtime) < time_margin and abs(entry['duration'] - duration) < DURATION_TOL:
+                best = (self.dir / name, entry)
+        return best
+
+    def set_sync(self, path, sync):
+        entry = self.entries.get(str(Path(path).relative_to(self.dir)))
+        if entry is not None and entry['sync'] != sync:
+            entry['sync'] = sync
+            self.dirty = True
+
+    def save(self):
+        if not self.dirty:
+            return
+        tmp = self.path.with_suffix('.tmp')
+        with open(tmp, 'w') as f:
+            json.dump({'version': INDEX_VERSION, 'recordings': self.entries}, f)
+        os.replace(tmp, self.path)
+        self.dirty = False
+
+
+def _reflink(src, dst):
+    """Clone src to dst sharing its extents. False where the filesystem
+    cannot (ext4, tmpfs, across filesystems), dst is then left absent."""
+    with open(src, 'rb') as fsrc, open(dst, 'wb') as fdst:
+        try:
+            fcntl.ioctl(fdst.fileno(), FICLONE, fsrc.fileno())
+            return True
+        except OSError as e:
+            if e.errno not in (errno.EOPNOTSUPP, errno.ENOTTY, errno.EXDEV, errno.EINVAL, errno.ENOSYS):
+                raise
+    os.unlink(dst)
+    return False
+
+
+class UndoRecord:
+    """How to put back one take patched in place: a reflink clone of it where
+    the filesystem supports them (costs only the extents the patch then
+    rewrites), else the byte ranges about to be overwritten. Stored as
+    NAME.json (plus NAME.bin or NAME.orig) in the run's undo directory and
+    synced to disk before the take is touched. Picklable, so worker
+    processes write their own."""
+
+    def __init__(self, undo_dir, name):
+        self.dir = Path(undo_dir)
+        self.name = name
+
+    def save(self, path, ranges):
+        path = Path(path)
+        st = path.stat()
+        record = {'path': str(path), 'size': st.st_size, 'mode': st.st_mode & 0o7777,
+                  'atime_ns': st.st_atime_ns, 'mtime_ns': st.st_mtime_ns}
+        clone = self.dir / f'{self.name}.orig'
+        if _reflink(path, clone):
+            record['clone'] = clone.name
+        else:
+            record['ranges'] = [[offset, length] for offset, length in ranges]
+            with open(path, 'rb') as f, open(self.dir / f'{self.name}.bin', 'wb') as out:
+                for offset, length in ranges:
+                    f.seek(offset)
+                    out.write(f.read(length))
+                out.flush()
+                os.fsync(out.fileno())
+        tmp = self.dir / f'{self.name}.tmp'
+        with open(tmp, 'w') as f:
+            json.dump(record, f)
+            f.flush()
+            os.fsync(f.fileno())
+        os.replace(tmp, self.dir / f'{self.name}.json')
+
+    def restore(self):
+        """Put the take back as it was. False if there was nothing to restore
+        (the run stopped before this take was written)."""
+        try:
+            with open(self.dir / f'{self.name}.json') as f:
+                record = json.load(f)
+        except FileNotFoundError:
+            return False
+        path = Path(record['path'])
+        if 'clone' in record:
+            os.replace(self.dir / record['clone'], path)
+            os.chmod(path, record['mode'])
+        else:
+            with open(self.dir / f'{self.name}.bin', 'rb') as data, open(path, 'r+b') as f:
+                for offset, length in record['ranges']:
+                    f.seek(offset)
+                    f.write(data.read(length))
+                f.truncate(record['size'])
+        os.utime(path, ns=(record['atime_ns'], record['mtime_ns']))
+        return True
+
+
+def revert_in_place(project, run=None):
+    """Undo an in-place run (the latest if run is None) and drop its journal.
+    Returns the number of takes put back."""
+    undo_root = Path(project).expanduser().resolve() / UNDO_DIR
+    runs = sorted(p.name for p in undo_root.iterdir() if p.is_dir()) if undo_root.is_dir() else []
+    if run is None:
+        if not runs:
+            raise RuntimeError(f'No in-place run to revert in {undo_root}')
+        run = runs[-1]
+    run_dir = undo_root / run
+    if not run_dir.is_dir():
+        raise RuntimeError(f'No in-place run {run} in {undo_root}')
+    restored = 0
+    # Newest first, in case a take was patched twice
+    for record in sorted(run_dir.glob('*.json'), reverse=True):
+        restored += UndoRecord(run_dir, record.stem).restore()
+    for f in run_dir.iterdir():
+        f.unlink()
+    run_dir.rmdir()
+    return restored
+
+
+def glitch_stats(glitches, samplerate):
+    """Per-take summary of a glitch map: counts and milliseconds by type."""
+    stats = {'zeroed': [0, 0.0], 'different': [0, 0.0]}
+    for start, end, _, _, kind in glitches:
+        stats[kind][0] += 1
+        stats[kind][1] += (end - start) * 1000.0 / samplerate
+    return stats
+
+def _patch_job(job):
+    """Runs in a worker process: patch one take, report how it went."""
+    wav, rec, rec_sync, undo, glitches_only, ticks = job
+    try:
+        diff_mean, diff_max, rec_sync, glitches = patch_wav_with_reference(wav, rec, rec_sync, undo, glitches_only, ticks)
+        stats = glitch_stats(glitches, sf.info(str(wav)).samplerate) if glitches is not None else None
+        return wav, rec, rec_sync, (diff_mean, diff_max, stats), None
+    except NoSyncInRecording as e:
+        # Remembered, so later runs skip the recording without reading it
+        return wav, rec, -1, None, f"Failed: {e}"
+    except Exception as e:
+        return wav, rec, rec_sync, None, f"Failed: {e}"
+
 
 class ReaperPatcher:
-    def __init__(self, proj_path):
+    def __init__(self, proj_path, jobs=None, in_place=False, glitches_only=False, ticks=True):
         self.src_project = Path(proj_path).expanduser().resolve()
         self.proj_name = self.src_project.name
         # _out is relative to current working directory
         self.dest_project = Path.cwd() / "_out" / self.proj_name
         self.recordings_dir = Path.home() / ".pw-ghost-rec" / "recordings"
+        self.jobs = jobs or os.cpu_count() or 1
+        self.glitches_only = glitches_only
+        self.ticks = ticks
+        # In place: the takes of src_project are patched, with an undo journal
+        self.in_place = in_place
+        self.undo_dir = None
+        if in_place:
+            self.dest_project = self.src_project
+            self.undo_dir = self.src_project / UNDO_DIR / time.strftime('%Y%m%d-%H%M%S')
 
     def rsync_project(self):
         print(f"Rsyncing {self.src_project} to {self.dest_project}")
@@ -74,8 +625,9 @@ class ReaperPatcher:
         print("PATCH SUMMARY")
         print("="*40)
         print("\nPatched files:")
+        totals = {'zeroed': [0, 0.0], 'different': [0, 0.0]}
         if patch_results['patched']:
-            for wav, rec, diff_mean, diff_max in patch_results['patched']:
+            for wav, rec, diff_mean, diff_max, glitches in patch_results['patched']:
                 warn = ""
                 color = GREEN
                 if diff_mean is not None and (diff_mean > 0.01 or diff_max > 0.1):
@@ -84,8 +636,15 @@ class ReaperPatcher:
                 elif diff_mean is not None:
                     warn = f" (mean={diff_mean:.6f}, max={diff_max:.6f})"
                 print(f"  {color}✓ {wav.name}  <--  {rec.name}{warn}{RESET}")
+                if glitches is not None:
+                    print("      glitches: " + ", ".join(f"{n} {kind} ({ms:.1f} ms)" for kind, (n, ms) in glitches.items()))
+                    for kind, (n, ms) in glitches.items():
+                        totals[kind][0] += n
+                        totals[kind][1] += ms
         else:
             print("  (none)")
+        if self.glitches_only:
+            print("\nGlitches over all takes: " + ", ".join(f"{n} {kind} ({ms:.1f} ms)" for kind, (n, ms) in totals.items()))
         print("\nCould NOT patch:")
         if patch_results['not_patched']:
             for wav, reason in patch_results['not_patched']:
@@ -95,94 +654,44 @@ class ReaperPatcher:
         print("\n" + "="*40 + "\n")
 
     def patch_wav_files(self):
+        start = time.monotonic()
         print("Scanning for wav files in project...")
-        wav_files = list(self.dest_project.rglob('*.wav'))
+        wav_files = [wav for wav in self.dest_project.rglob('*.wav') if UNDO_DIR not in wav.parts]
         print(f"Found {len(wav_files)} wav files.")
-        rec_files = list(self.recordings_dir.rglob('*.wav'))
-        print(f"Found {len(rec_files)} candidate recordings.")
+        index = RecordingIndex(self.recordings_dir)
+        added, removed = index.update()
+        print(f"Indexed {len(index.entries)} candidate recordings ({added} new or changed, {removed} gone).")
         patch_results = {'patched': [], 'not_patched': []}
+        jobs = []
         for wav in wav_files:
-            wav_mtime = wav.stat().st_mtime
-            wav_dur = get_wav_duration(wav)
-            candidates = []
-            for rec in rec_files:
-                rec_mtime = rec.stat().st_mtime
-                rec_dur = get_wav_duration(rec)
-                if abs(wav_mtime - rec_mtime) < time_margin and abs(wav_dur - rec_dur) < DURATION_TOL:
-                    candidates.append(rec)
-            if not candidates:
+            found = index.match(wav.stat().st_mtime, get_wav_duration(wav))
+            if found is None:
                 patch_results['not_patched'].append((wav, 'No match found'))
                 continue
-            best = max(candidates, key=lambda r: r.stat().st_mtime)
-            print(f"Patching {wav.name} with {best.name}")
-            try:
-                diff_mean, diff_max = self.patch_wav_with_reference(wav, best)
-                patch_results['patched'].append((wav, best, diff_mean, diff_max))
-            except Exception as e:
-                patch_results['not_patched'].append((wav, f"Failed: {e}"))
+            rec, entry = found
+            if entry['sync'] == -1:
+                patch_results['not_patched'].append((wav, f'No sync marker in {rec.name}'))
+                continue
+            print(f"Patching {wav.name} with {rec.name}")
+            undo = None
+            if self.undo_dir is not None:
+                self.undo_dir.mkdir(parents=True, exist_ok=True)
+                undo = UndoRecord(self.undo_dir, f'{len(jobs):05d}')
+            jobs.append((wav, rec, entry['sync'], undo, self.glitches_only, self.ticks))
+        # Every job touches a different take, so they can all run at once
+        with ProcessPoolExecutor(max_workers=min(self.jobs, max(len(jobs), 1))) as pool:
+            for wav, rec, rec_sync, diffs, error in pool.map(_patch_job, jobs):
+                if rec_sync is not None:
+                    index.set_sync(rec, rec_sync)
+                if error:
+                    patch_results['not_patched'].append((wav, error))
+                else:
+                    patch_results['patched'].append((wav, rec) + diffs)
+        index.save()
         self.print_patch_summary(patch_results)
-
-    def patch_wav_with_reference(self, ref_path, rec_path):
-        # --- Load audio ---
-        ref_audio, ref_sr = sf.read(str(ref_path), dtype='float32')
-        rec_audio, rec_sr = sf.read(str(rec_path), dtype='float32')
-        if ref_sr != rec_sr:
-            raise RuntimeError(f"Sample rates differ: {ref_sr} vs {rec_sr}")
-        if ref_audio.ndim > 1:
-            ref_audio = ref_audio[:, 0]
-        if rec_audio.ndim > 1:
-            rec_audio = rec_audio[:, 0]
-
-        # --- Find sync points ---
-        ref_sync = find_sync_offset(ref_audio)
-        rec_sync = find_sync_offset(rec_audio)
-        if ref_sync == -1 or rec_sync == -1:
-            raise RuntimeError("Sync pattern not found in one or both files!")
-
-        # --- Align local recording to reference ---
-        offset_diff = ref_sync - rec_sync
-        if offset_diff > 0:
-            rec_audio = np.pad(rec_audio, (offset_diff, 0))
-        elif offset_diff < 0:
-            rec_audio = rec_audio[-offset_diff:]
-        if len(rec_audio) < len(ref_audio):
-            rec_audio = np.pad(rec_audio, (0, len(ref_audio) - len(rec_audio)))
-        rec_audio = rec_audio[:len(ref_audio)]
-
-        # --- Compute similarity metrics ---
-        sync_len = len(SYNC_PATTERN)
-        sync_start = ref_sync
-        compare_start = sync_start + sync_len
-        diff_mean = diff_max = None
-        if compare_start < len(ref_audio):
-            diff = np.abs(ref_audio[compare_start:] - rec_audio[compare_start:])
-            diff_mean = float(np.mean(diff))
-            diff_max = float(np.max(diff))
-
-        # --- Burn in sync marker (optional) ---
-        if sync_start + sync_len <= len(rec_audio):
-            rec_audio[sync_start:sync_start+sync_len] = rec_audio[sync_start:sync_start+sync_len] * 10000.0
-
-        # --- Patch the file ---
-        data_offset, data_size = find_wav_data_offset(ref_path)
-        patch_start = sync_start
-        patch_len = len(rec_audio) - patch_start
-        with open(ref_path, 'rb') as f:
-            f.seek(data_offset)
-            orig_data = f.read(data_size)
-        bytes_per_sample = 3
-        preamble_bytes = patch_start * bytes_per_sample
-        new_patch_bytes = float32_to_pcm24(rec_audio[patch_start:])
-        new_data = orig_data[:preamble_bytes] + new_patch_bytes
-        if len(new_data) < len(orig_data):
-            new_data += orig_data[len(new_data):]
-        elif len(new_data) > len(orig_data):
-            new_data = new_data[:len(orig_data)]
-        with open(ref_path, 'r+b') as f:
-            f.seek(data_offset)
-            f.write(new_data)
-        print(f"Patched REAPER: {ref_path.name}  with  LOCAL: {rec_path.name} (only data chunk, PCM_24, post-sync)")
-        return diff_mean, diff_max
+        if self.undo_dir is not None and jobs:
+            print(f"Undo journal: {self.undo_dir} (revert with --revert {self.undo_dir.name})")
+        print(f"Matched and patched in {time.monotonic() - start:.1f} s with {self.jobs} worker(s)")
 
     def rsync_back_to_src_patched(self):
         # After patching, rsync dest_project to src_patched next to the original src_project
@@ -194,17 +703,33 @@ class ReaperPatcher:
         os.system(rsync_cmd)
 
     def run(self):
+        if self.in_place:
+            self.patch_wav_files()
+            return
         self.rsync_project()
         self.patch_wav_files()
         print("Patching complete. Now syncing back to source project...")
         self.rsync_back_to_src_patched()
 
 def main():
-    if len(sys.argv) < 2:
-        print("Usage: run.py <REAPER_PROJECT_PATH>")
-        sys.exit(1)
-    proj_path = sys.argv[1]
-    patcher = ReaperPatcher(proj_path)
+    parser = argparse.ArgumentParser(description="Patch a REAPER project's takes with pw-ghost-rec recordings")
+    parser.add_argument('project', metavar='REAPER_PROJECT_PATH')
+    parser.add_argument('-j', '--jobs', type=int, default=None,
+                        help='takes patched in parallel (default: one per core)')
+    parser.add_argument('-i', '--in-place', action='store_true',
+                        help=f'patch the project itself instead of copies, journaling what is overwritten in {UNDO_DIR}')
+    parser.add_argument('-g', '--glitches', action='store_true',
+                        help='only patch where a take differs from its recording, crossfaded, and report the glitches')
+    parser.add_argument('--no-ticks', action='store_true',
+                        help="align on the sync marker only, ignore the recordings' tick markers")
+    parser.add_argument('--revert', nargs='?', const='', metavar='RUN',
+                        help='undo the last in-place run (or RUN) and exit')
+    args = parser.parse_args()
+    if args.revert is not None:
+        restored = revert_in_place(args.project, args.revert or None)
+        print(f"Reverted {restored} take(s)")
+        return
+    patcher = ReaperPatcher(args.project, args.jobs, args.in_place, args.glitches, not args.no_ticks)
     patcher.run()
 
 if __name__ == "__main__":
@@ -0,0 +1,62 @@
+#!/usr/bin/env python3
+# Run from this directory: python3 -m unittest test_run
+import tempfile
+import unittest
+from pathlib import Path
+
+import numpy as np
+import soundfile as sf
+
+import run
+
+RATE = 48000
+
+
+def noise(frames, seed, level=1e-3):
+    return (np.random.default_rng(seed).standard_normal(frames) * level).astype(np.float32)
+
+
+class RecordingIndexSyncTest(unittest.TestCase):
+    def setUp(self):
+        self.tmp = tempfile.TemporaryDirectory()
+        self.dir = Path(self.tmp.name)
+        self.recordings = self.dir / 'recordings'
+        self.recordings.mkdir()
+        # A recording without any marker and a take that has one
+        self.rec = self.recordings / 'rec.wav'
+        sf.write(str(self.rec), noise(3 * RATE, 1), RATE, subtype='PCM_24')
+        take = noise(3 * RATE, 2, 1e-7)
+        take[4800:4800 + len(run.SYNC_PATTERN)] = run.SYNC_PATTERN
+        self.take = self.dir / 'take.wav'
+        sf.write(str(self.take), take, RATE, subtype='FLOAT')
+
+    def tearDown(self):
+        self.tmp.cleanup()
+
+    def test_recording_without_marker_is_indexed_as_minus_one(self):
+        index = run.RecordingIndex(self.recordings)
+        self.assertEqual(index.update(), (1, 0))
+        # No sidecar, so not known yet
+        self.assertIsNone(index.entries['rec.wav']['sync'])
+
+        wav, rec, rec_sync, diffs, error = run._patch_job((self.take, self.rec, None, None, False, True))
+        self.assertEqual(rec_sync, -1)
+        self.assertIsNone(diffs)
+        self.assertIn('recording', error)
+        index.set_sync(rec, rec_sync)
+        index.save()
+
+        # Kept across runs for as long as the file is unchanged
+        index = run.RecordingIndex(self.recordings)
+        self.assertEqual(index.update(), (0, 0))
+        self.assertEqual(index.entries['rec.wav']['sync'], -1)
+
+    def test_take_without_marker_says_nothing_about_the_recording(self):
+        sf.write(str(self.take), noise(3 * RATE, 3), RATE, subtype='FLOAT')
+        wav, rec, rec_sync, diffs, error = run._patch_job((self.take, self.rec, None, None, False, True))
+        self.assertIsNone(rec_sync)
+        self.assertIn('take', error)
+
+
+if __name__ == '__main__':
+    unittest.main()
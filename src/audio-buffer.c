@@ -1,17 +1,54 @@
 #include "audio-buffer.h"
+#include "sample-convert.h"
+#include "sync-marker.h"
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
 #include <sndfile.h>
 
-void audio_buffer_init(audio_buffer_t *ab, unsigned int num_channels, unsigned int sample_rate, unsigned int buffer_seconds) {
+int audio_buffer_init_rt(audio_buffer_t *ab, unsigned int num_channels, unsigned int sample_rate, unsigned int buffer_seconds,
+                         unsigned int memory_flags, rt_memory_t *info) {
     ab->num_channels = num_channels;
     ab->sample_rate = sample_rate;
     ab->buffer_seconds = buffer_seconds;
-    ab->channels = (channel_buffer_t*)malloc(sizeof(channel_buffer_t) * num_channels);
-    ab->samples_since_sync = -1;
-    ab->sync_active = 0;
-    for (unsigned int i = 0; i < num_channels; ++i) {
-        channel_buffer_init(&ab->channels[i], sample_rate, buffer_seconds);
+    ab->channels = (channel_buffer_t*)calloc(num_channels, sizeof(channel_buffer_t));
+    atomic_init(&ab->sync_frame, AUDIO_BUFFER_NO_SYNC);
+    atomic_init(&ab->clock_offset, 0);
+    atomic_init(&ab->time_origin_ns, INT64_MIN);
+    atomic_init(&ab->spool, NULL);
+    int ret = marker_index_init(&ab->markers, MARKER_INDEX_DEFAULT_CAPACITY, MARKER_INDEX_TICK_CAPACITY);
+    ab->take_id = 0;
+    ab->rate_segment = 0;
+    if (!ab->channels) {
+        ab->num_channels = 0;
+        ret = -1;
+    }
+    // Reported flags are the ones every allocation got
+    rt_memory_t total = {0, 0, memory_flags};
+    for (unsigned int i = 0; ret == 0 && i < num_channels; ++i) {
+        ret = channel_buffer_init_rt(&ab->channels[i], sample_rate, buffer_seconds, memory_flags);
+        const rt_memory_t *m = &ab->channels[i].buffer.memory;
+        total.bytes += m->bytes;
+        total.locked += m->locked;
+        total.got &= m->got;
+    }
+    if (ret == 0 && memory_flags) {
+        // The RT thread appends markers and ticks too
+        rt_memory_t m;
+        rt_memory_prepare(ab->markers.markers, sizeof(marker_t) * ab->markers.capacity, memory_flags, &m);
+        total.bytes += m.bytes;
+        total.locked += m.locked;
+        rt_memory_prepare(ab->markers.ticks, sizeof(marker_t) * ab->markers.tick_capacity, memory_flags, &m);
+        total.bytes += m.bytes;
+        total.locked += m.locked;
     }
+    if (ret < 0) audio_buffer_free(ab);
+    if (info) *info = total;
+    return ret;
+}
+
+void audio_buffer_init(audio_buffer_t *ab, unsigned int num_channels, unsigned int sample_rate, unsigned int buffer_seconds) {
+    audio_buffer_init_rt(ab, num_channels, sample_rate, buffer_seconds, 0, NULL);
 }
 
 void audio_buffer_free(audio_buffer_t *ab) {
@@ -22,70 +59,384 @@ void audio_buffer_free(audio_buffer_t *ab) {
         free(ab->channels);
         ab->channels = NULL;
     }
+    marker_index_free(&ab->markers);
 }
 
-static void inject_sync(float *samples, int num_samples) {
-    // Use a very low amplitude, non-musical, pseudo-random pattern
-    static const float sync_pattern[16] = {
-        1.23e-5f, -2.34e-5f, 3.45e-5f, -4.56e-5f,
-        5.67e-5f, -6.78e-5f, 7.89e-5f, -8.90e-5f,
-        9.01e-5f, -1.23e-5f, 1.35e-5f, -2.46e-5f,
-        3.57e-5f, -4.68e-5f, 5.79e-5f, -6.80e-5f
-    };
-    int n = (num_samples < 16) ? num_samples : 16;
+static void inject_marker(float *samples, int num_samples, const float *pattern, int length) {
+    int n = (num_samples < length) ? num_samples : length;
     for (int i = 0; i < n; ++i) {
-        samples[i] = sync_pattern[i];
+        samples[i] = pattern[i];
     }
 }
 
+static void append_marker(audio_buffer_t *ab, marker_type_t type, uint64_t frame, uint64_t channel_mask, uint32_t sequence) {
+    if (type == MARKER_RECORD_START) {
+        ab->take_id++;
+        atomic_store(&ab->sync_frame, frame);
+    }
+    marker_t marker = {frame, channel_mask, ab->take_id, (uint32_t)type, ab->sample_rate, sequence};
+    marker_index_append(&ab->markers, &marker);
+}
+
 void audio_buffer_push(audio_buffer_t *ab, float *samples, int num_samples, int channel, int inject_sync_flag) {
     if (ab == NULL || ab->channels == NULL || channel < 0 || channel >= (int)ab->num_channels) return;
     if (inject_sync_flag) {
-        inject_sync(samples, num_samples);
-        ab->samples_since_sync = 0;
-        ab->sync_active = 1;
-    } else if (ab->sync_active) {
-        ab->samples_since_sync += num_samples;
+        inject_marker(samples, num_samples, sync_marker_pattern, SYNC_MARKER_LENGTH);
+        uint64_t mask = channel < 64 ? 1ull << channel : 0;
+        append_marker(ab, MARKER_RECORD_START, channel_buffer_write_position(&ab->channels[channel]), mask, 0);
     }
     channel_buffer_write(&ab->channels[channel], samples, num_samples);
 }
 
+void audio_buffer_push_frames(audio_buffer_t *ab, float **samples, int num_samples, int inject_sync_flag) {
+    if (inject_sync_flag) {
+        audio_buffer_push_frames_marked(ab, samples, num_samples, MARKER_RECORD_START, AUDIO_BUFFER_ALL_CHANNELS);
+        return;
+    }
+    if (ab == NULL || ab->channels == NULL || samples == NULL) return;
+    for (unsigned int ch = 0; ch < ab->num_channels; ++ch) {
+        if (samples[ch]) channel_buffer_write(&ab->channels[ch], samples[ch], num_samples);
+        else channel_buffer_write_silence(&ab->channels[ch], num_samples);
+    }
+}
+
+void audio_buffer_push_frames_marked(audio_buffer_t *ab, float **samples, int num_samples, marker_type_t type, uint64_t channel_mask) {
+    if (ab == NULL || ab->channels == NULL || samples == NULL) return;
+    const float *pattern = sync_marker_pattern_for((unsigned int)type);
+    // The marker lands on the first frame of this quantum on every channel
+    append_marker(ab, type, audio_buffer_write_position(ab), channel_mask, 0);
+    for (unsigned int ch = 0; ch < ab->num_channels; ++ch) {
+        if (!samples[ch]) {
+            channel_buffer_write_silence(&ab->channels[ch], num_samples);
+            continue;
+        }
+        if (pattern && ch < 64 && (channel_mask >> ch) & 1) inject_marker(samples[ch], num_samples, pattern, SYNC_MARKER_LENGTH);
+        channel_buffer_write(&ab->channels[ch], samples[ch], num_samples);
+    }
+}
+
+void audio_buffer_push_frames_tick(audio_buffer_t *ab, float **samples, int num_samples, uint32_t sequence) {
+    if (ab == NULL || ab->channels == NULL || samples == NULL) return;
+    float tick[SYNC_MARKER_TICK_LENGTH];
+    sync_marker_tick(sequence, tick);
+    append_marker(ab, MARKER_TICK, audio_buffer_write_position(ab), AUDIO_BUFFER_ALL_CHANNELS, sequence);
+    for (unsigned int ch = 0; ch < ab->num_channels; ++ch) {
+        if (!samples[ch]) {
+            channel_buffer_write_silence(&ab->channels[ch], num_samples);
+            continue;
+        }
+        inject_marker(samples[ch], num_samples, tick, SYNC_MARKER_TICK_LENGTH);
+        channel_buffer_write(&ab->channels[ch], samples[ch], num_samples);
+    }
+}
+
+// Channels are written one after another, the slowest one bounds what is readable
+static uint64_t channels_write_position(const audio_buffer_t *ab, unsigned int first_channel, unsigned int num_channels) {
+    uint64_t pos = channel_buffer_write_position(&ab->channels[first_channel]);
+    for (unsigned int ch = first_channel + 1; ch < first_channel + num_channels; ++ch) {
+        uint64_t p = channel_buffer_write_position(&ab->channels[ch]);
+        if (p < pos) pos = p;
+    }
+    return pos;
+}
+
+uint64_t audio_buffer_write_position(const audio_buffer_t *ab) {
+    if (!ab || !ab->channels || ab->num_channels == 0) return 0;
+    return channels_write_position(ab, 0, ab->num_channels);
+}
+
+void audio_buffer_set_clock(audio_buffer_t *ab, uint64_t clock_position) {
+    int64_t offset = (int64_t)(clock_position - audio_buffer_write_position(ab));
+    atomic_store_explicit(&ab->clock_offset, offset, memory_order_relaxed);
+}
+
+uint64_t audio_buffer_frame_at_clock(const audio_buffer_t *ab, uint64_t clock_position) {
+    audio_buffer_t *rw = (audio_buffer_t *)ab;
+    return clock_position - (uint64_t)atomic_load_explicit(&rw->clock_offset, memory_order_relaxed);
+}
+
+uint64_t audio_buffer_clock_at_frame(const audio_buffer_t *ab, uint64_t frame) {
+    audio_buffer_t *rw = (audio_buffer_t *)ab;
+    return frame + (uint64_t)atomic_load_explicit(&rw->clock_offset, memory_order_relaxed);
+}
+
+static int64_t frames_to_ns(const audio_buffer_t *ab, uint64_t frames) {
+    return (int64_t)((double)frames * 1e9 / (double)ab->sample_rate);
+}
+
+void audio_buffer_set_time(audio_buffer_t *ab, uint64_t nsec) {
+    int64_t origin = (int64_t)nsec - frames_to_ns(ab, audio_buffer_write_position(ab));
+    atomic_store_explicit(&ab->time_origin_ns, origin, memory_order_relaxed);
+}
+
+int audio_buffer_time_at_frame(const audio_buffer_t *ab, uint64_t frame, uint64_t *nsec) {
+    audio_buffer_t *rw = (audio_buffer_t *)ab;
+    int64_t origin = atomic_load_explicit(&rw->time_origin_ns, memory_order_relaxed);
+    if (origin == INT64_MIN || ab->sample_rate == 0) return -1;
+    *nsec = (uint64_t)(origin + frames_to_ns(ab, frame));
+    return 0;
+}
+
+uint64_t audio_buffer_sync_frame(const audio_buffer_t *ab) {
+    if (!ab) return AUDIO_BUFFER_NO_SYNC;
+    audio_buffer_t *rw = (audio_buffer_t *)ab;
+    return atomic_load(&rw->sync_frame);
+}
+
+uint64_t audio_buffer_oldest_frame(audio_buffer_t *ab) {
+    if (!ab || !ab->channels) return 0;
+    spool_t *spool = atomic_load_explicit(&ab->spool, memory_order_acquire);
+    uint64_t spool_oldest = UINT64_MAX;
+    if (spool) {
+        uint64_t flushed = atomic_load_explicit(&spool->flushed_pos, memory_order_acquire);
+        spool_oldest = flushed > spool->capacity ? flushed - spool->capacity : 0;
+    }
+    uint64_t newest_oldest = 0;
+    for (unsigned int ch = 0; ch < ab->num_channels; ++ch) {
+        const channel_buffer_t *cb = &ab->channels[ch];
+        uint64_t w = channel_buffer_write_position(cb);
+        uint64_t oldest = w > cb->buffer.capacity ? w - cb->buffer.capacity : 0;
+        if (cb->history) {
+            uint64_t start, end;
+            compressed_history_range(cb->history, &start, &end);
+            if (end >= oldest && start < oldest) oldest = start;
+        }
+        if (spool_oldest < oldest) oldest = spool_oldest;
+        if (oldest > newest_oldest) newest_oldest = oldest;
+    }
+    return newest_oldest;
+}
+
 int audio_buffer_write_channel_to_wav(audio_buffer_t *ab, int channel, float offset_seconds, float duration_seconds, const char *filename) {
     if (!ab || !ab->channels || channel < 0 || channel >= (int)ab->num_channels) return -1;
-    int sample_rate = ab->sample_rate;
-    int num_samples = (int)(duration_seconds * sample_rate);
-    float *buffer = (float *)malloc(sizeof(float) * num_samples);
-    if (!buffer) return -2;
-    int read = channel_buffer_read(&ab->channels[channel], buffer, offset_seconds, duration_seconds, num_samples);
-    if (read <= 0) { free(buffer); return -3; }
-
-    // Soft clamp all float audio to [-1.0, +1.0] before writing to WAV
-    for (int i = 0; i < read; ++i) {
-        if (buffer[i] > 1.0f) buffer[i] = 0.99f;
-        else if (buffer[i] < -1.0f) buffer[i] = -0.99f;
-    }
-
-    SF_INFO sfinfo = {0};
-    sfinfo.samplerate = sample_rate;
-    sfinfo.frames = read;
-    sfinfo.channels = 1;
-    sfinfo.format = SF_FORMAT_WAV | SF_FORMAT_PCM_24;
-
-    SNDFILE *outfile = sf_open(filename, SFM_WRITE, &sfinfo);
-    if (!outfile) { free(buffer); return -4; }
-    sf_write_float(outfile, buffer, read);
-    sf_close(outfile);
-    free(buffer);
+    return audio_buffer_write_channels_to_wav(ab, (unsigned int)channel, 1, offset_seconds, duration_seconds, filename, NULL);
+}
+
+void audio_buffer_attach_spool(audio_buffer_t *ab, spool_t *spool) {
+    atomic_store_explicit(&ab->spool, spool, memory_order_release);
+}
+
+int audio_buffer_enable_history(audio_buffer_t *ab, size_t arena_bytes) {
+    for (unsigned int ch = 0; ch < ab->num_channels; ch++) {
+        if (channel_buffer_enable_history(&ab->channels[ch], arena_bytes) < 0) return -1;
+    }
     return 0;
 }
 
+uint64_t audio_buffer_compress(audio_buffer_t *ab) {
+    uint64_t frames = 0;
+    for (unsigned int ch = 0; ch < ab->num_channels; ch++) {
+        frames += channel_buffer_compress(&ab->channels[ch]);
+    }
+    return frames;
+}
+
+// Read from the RAM ring, falling back to the spool for older frames
+static int read_channel_frames(audio_buffer_t *ab, unsigned int channel, float *samples, uint64_t start_frame, uint32_t count) {
+    if (channel_buffer_read_frames(&ab->channels[channel], samples, start_frame, count) == 0) return 0;
+    spool_t *spool = atomic_load_explicit(&ab->spool, memory_order_acquire);
+    if (!spool) return -1;
+    if (spool_read(spool, channel, samples, start_frame, count) == 0) return 0;
+    // Straddles the flushed edge: older part from disk, newer part from RAM
+    uint64_t flushed = atomic_load_explicit(&spool->flushed_pos, memory_order_acquire);
+    if (flushed <= start_frame || flushed >= start_frame + count) return -1;
+    uint32_t head = (uint32_t)(flushed - start_frame);
+    if (spool_read(spool, channel, samples, start_frame, head) < 0) return -1;
+    return channel_buffer_read_frames(&ab->channels[channel], samples + head, flushed, count - head);
+}
+
+static double monotonic_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+int audio_buffer_read_range(audio_buffer_t *ab, unsigned int channel, float *samples, uint64_t start_frame, uint64_t end_frame) {
+    if (!ab || !ab->channels || channel >= ab->num_channels || end_frame < start_frame) return -1;
+    if (end_frame - start_frame > UINT32_MAX) return -1;
+    if (end_frame == start_frame) return 0;
+    return read_channel_frames(ab, channel, samples, start_frame, (uint32_t)(end_frame - start_frame));
+}
+
+int audio_buffer_write_channels_to_wav(audio_buffer_t *ab, unsigned int first_channel, unsigned int num_channels, float offset_seconds, float duration_seconds, const char *filename, audio_export_stats_t *stats) {
+    if (!ab || !ab->channels || num_channels == 0 || first_channel + num_channels > ab->num_channels) return -1;
+    int64_t num_samples = (int64_t)((double)duration_seconds * ab->sample_rate);
+    int64_t offset_samples = (int64_t)((double)offset_seconds * ab->sample_rate);
+    // Anchor every channel at the same absolute frame, reading forward from (now - offset)
+    uint64_t end = channels_write_position(ab, first_channel, num_channels);
+    if (num_samples <= 0 || offset_samples < 0 || (uint64_t)offset_samples >= end) return -3;
+    uint64_t start = end - 1 - (uint64_t)offset_samples;
+    return audio_buffer_write_range_to_wav(ab, first_channel, num_channels, start, start + (uint64_t)num_samples, filename, stats);
+}
+
+int audio_buffer_write_range_to_wav(audio_buffer_t *ab, unsigned int first_channel, unsigned int num_channels, uint64_t start_frame, uint64_t end_frame, const char *filename, audio_export_stats_t *stats) {
+    audio_export_segment_t segment = {start_frame, end_frame, first_channel, num_channels, filename, {0, 0, 0.0}, 0};
+    int ret = audio_buffer_write_segments_to_wav(ab, &segment, 1);
+    if (stats) *stats = segment.stats;
+    return ret;
+}
+
+static void finish_segment(audio_export_segment_t *segment, SNDFILE **file, int result, double t0) {
+    if (*file) sf_close(*file);
+    *file = NULL;
+    segment->result = result;
+    segment->stats.bytes = segment->stats.frames * segment->num_channels * 3;
+    segment->stats.seconds = monotonic_seconds() - t0;
+}
+
+int audio_buffer_write_segments_to_wav(audio_buffer_t *ab, audio_export_segment_t *segments, unsigned int num_segments) {
+    if (!ab || !ab->channels || (num_segments > 0 && !segments)) return -1;
+    double t0 = monotonic_seconds();
+    SNDFILE **files = (SNDFILE **)calloc(num_segments ? num_segments : 1, sizeof(SNDFILE *));
+    uint8_t *done = (uint8_t *)calloc(num_segments ? num_segments : 1, 1);
+    uint8_t *used = (uint8_t *)calloc(ab->num_channels, 1);
+    if (!files || !done || !used) { free(files); free(done); free(used); return -2; }
+
+    // Clip every segment to what its channels hold and find the channel span
+    unsigned int lo = ab->num_channels, hi = 0, widest = 1, pending = 0;
+    for (unsigned int i = 0; i < num_segments; ++i) {
+        audio_export_segment_t *seg = &segments[i];
+        memset(&seg->stats, 0, sizeof(seg->stats));
+        seg->result = 0;
+        if (seg->num_channels == 0 || seg->first_channel + seg->num_channels > ab->num_channels) {
+            seg->result = -1;
+        } else {
+            uint64_t end = channels_write_position(ab, seg->first_channel, seg->num_channels);
+            if (seg->end_frame > end) seg->end_frame = end;
+            if (seg->start_frame >= seg->end_frame) seg->result = -3;
+        }
+        if (seg->result < 0) {
+            done[i] = 1;
+            continue;
+        }
+        pending++;
+        if (seg->first_channel < lo) lo = seg->first_channel;
+        if (seg->first_channel + seg->num_channels > hi) hi = seg->first_channel + seg->num_channels;
+        if (seg->num_channels > widest) widest = seg->num_channels;
+    }
+
+    uint32_t span = hi > lo ? hi - lo : 1;
+    uint32_t chunk_frames = AUDIO_BUFFER_EXPORT_CHUNK_SAMPLES / span;
+    if (chunk_frames > AUDIO_BUFFER_EXPORT_CHUNK_FRAMES) chunk_frames = AUDIO_BUFFER_EXPORT_CHUNK_FRAMES;
+    if (chunk_frames == 0) chunk_frames = 1;
+    float *planar = (float *)malloc(sizeof(float) * chunk_frames * span);
+    float *interleaved = (float *)malloc(sizeof(float) * chunk_frames * widest);
+    uint8_t *pcm = (uint8_t *)malloc((size_t)chunk_frames * widest * 3);
+    if (!planar || !interleaved || !pcm) {
+        for (unsigned int i = 0; i < num_segments; ++i) if (!done[i]) segments[i].result = -2;
+        pending = 0;
+    }
+
+    // Sweep forward once, jumping over frames no segment wants
+    uint64_t pos = UINT64_MAX;
+    for (unsigned int i = 0; i < num_segments; ++i) {
+        if (!done[i] && segments[i].start_frame < pos) pos = segments[i].start_frame;
+    }
+    while (pending > 0) {
+        uint64_t next = UINT64_MAX;
+        int active = 0;
+        for (unsigned int i = 0; i < num_segments; ++i) {
+            if (done[i]) continue;
+            if (segments[i].start_frame <= pos) active = 1;
+            else if (segments[i].start_frame < next) next = segments[i].start_frame;
+        }
+        if (!active) pos = next;
+        uint64_t chunk_end = pos + chunk_frames;
+
+        // Read every channel some segment needs in this chunk, once
+        memset(used, 0, ab->num_channels);
+        for (unsigned int i = 0; i < num_segments; ++i) {
+            if (done[i] || segments[i].start_frame >= chunk_end || segments[i].end_frame <= pos) continue;
+            for (unsigned int ch = 0; ch < segments[i].num_channels; ++ch) used[segments[i].first_channel + ch] = 1;
+        }
+        for (unsigned int ch = lo; ch < hi; ++ch) {
+            if (!used[ch]) continue;
+            // Only the part up to the newest frame any segment wants exists yet
+            uint64_t read_end = pos;
+            for (unsigned int i = 0; i < num_segments; ++i) {
+                audio_export_segment_t *seg = &segments[i];
+                if (done[i] || ch < seg->first_channel || ch >= seg->first_channel + seg->num_channels) continue;
+                uint64_t e = seg->end_frame < chunk_end ? seg->end_frame : chunk_end;
+                if (e > read_end) read_end = e;
+            }
+            if (read_end <= pos) continue;
+            if (read_channel_frames(ab, ch, &planar[(size_t)(ch - lo) * chunk_frames], pos, (uint32_t)(read_end - pos)) == 0) continue;
+            for (unsigned int i = 0; i < num_segments; ++i) {
+                audio_export_segment_t *seg = &segments[i];
+                if (done[i] || ch < seg->first_channel || ch >= seg->first_channel + seg->num_channels) continue;
+                if (seg->start_frame >= chunk_end) continue;
+                finish_segment(seg, &files[i], -3, t0);
+                done[i] = 1;
+                pending--;
+            }
+        }
+
+        // Stream ring -> soft clamp -> packed PCM24 -> every file covering the chunk
+        for (unsigned int i = 0; i < num_segments; ++i) {
+            audio_export_segment_t *seg = &segments[i];
+            if (done[i] || seg->start_frame >= chunk_end) continue;
+            if (!files[i]) {
+                SF_INFO sfinfo = {0};
+                sfinfo.samplerate = ab->sample_rate;
+                sfinfo.frames = (sf_count_t)(seg->end_frame - seg->start_frame);
+                sfinfo.channels = seg->num_channels;
+                sfinfo.format = SF_FORMAT_WAV | SF_FORMAT_PCM_24;
+                files[i] = sf_open(seg->filename, SFM_WRITE, &sfinfo);
+                if (!files[i]) {
+                    finish_segment(seg, &files[i], -4, t0);
+                    done[i] = 1;
+                    pending--;
+                    continue;
+                }
+            }
+            uint64_t from = seg->start_frame > pos ? seg->start_frame : pos;
+            uint64_t to = seg->end_frame < chunk_end ? seg->end_frame : chunk_end;
+            uint32_t n = (uint32_t)(to - from), skip = (uint32_t)(from - pos);
+            unsigned int nc = seg->num_channels;
+            for (unsigned int ch = 0; ch < nc; ++ch) {
+                const float *src = &planar[(size_t)(seg->first_channel + ch - lo) * chunk_frames + skip];
+                for (uint32_t f = 0; f < n; ++f) interleaved[(size_t)f * nc + ch] = src[f];
+            }
+            size_t total = (size_t)n * nc;
+            sample_convert_clamp(interleaved, total);
+            sample_convert_to_pcm24(interleaved, pcm, total);
+            if (sf_write_raw(files[i], pcm, (sf_count_t)(total * 3)) != (sf_count_t)(total * 3)) {
+                finish_segment(seg, &files[i], -4, t0);
+                done[i] = 1;
+                pending--;
+                continue;
+            }
+            seg->stats.frames += n;
+            if (to == seg->end_frame) {
+                finish_segment(seg, &files[i], 0, t0);
+                done[i] = 1;
+                pending--;
+            }
+        }
+        pos = chunk_end;
+    }
+
+    int ret = 0;
+    for (unsigned int i = 0; i < num_segments; ++i) {
+        if (files[i]) sf_close(files[i]);
+        if (ret == 0 && segments[i].result < 0) ret = segments[i].result;
+    }
+    free(files);
+    free(done);
+    free(used);
+    free(planar);
+    free(interleaved);
+    free(pcm);
+    return ret;
+}
+
 float audio_buffer_seconds_since_sync(const audio_buffer_t *ab) {
-    if (!ab || !ab->sync_active || ab->samples_since_sync < 0) return -1.0f;
-    return (float)ab->samples_since_sync / (float)ab->sample_rate;
+    uint64_t sync = audio_buffer_sync_frame(ab);
+    if (sync == AUDIO_BUFFER_NO_SYNC) return -1.0f;
+    return (float)((double)(audio_buffer_write_position(ab) - sync) / (double)ab->sample_rate);
 }
 
 void audio_buffer_stop_sync(audio_buffer_t *ab) {
     if (!ab) return;
-    ab->sync_active = 0;
-    ab->samples_since_sync = -1;
+    atomic_store(&ab->sync_frame, AUDIO_BUFFER_NO_SYNC);
 }
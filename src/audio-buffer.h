@@ -1,7 +1,37 @@
 #ifndef AUDIO_BUFFER
 #define AUDIO_BUFFER
 
+#include <stdatomic.h>
 #include "channel-buffer.h"
+#include "marker-index.h"
+#include "spool.h"
+
+// Exports stream through the ring in chunks of at most this many frames,
+// fewer when many channels share one interleaved chunk buffer
+#define AUDIO_BUFFER_EXPORT_CHUNK_FRAMES 65536
+#define AUDIO_BUFFER_EXPORT_CHUNK_SAMPLES (256 * 1024)
+
+// Frame positions are absolute: frame 0 is the first frame ever pushed and
+// the counter never wraps in practice (uint64 at 48 kHz)
+#define AUDIO_BUFFER_NO_SYNC UINT64_MAX
+#define AUDIO_BUFFER_ALL_CHANNELS UINT64_MAX
+
+typedef struct {
+    uint64_t frames;   // Frames written to the file
+    uint64_t bytes;    // Sample data bytes written to the file
+    double seconds;    // Wall clock time spent exporting
+} audio_export_stats_t;
+
+// One file of a multi-segment export
+typedef struct {
+    uint64_t start_frame;      // [start_frame, end_frame), end clipped to what was pushed
+    uint64_t end_frame;
+    unsigned int first_channel;
+    unsigned int num_channels;
+    const char *filename;
+    audio_export_stats_t stats; // Filled in by the export
+    int result;                 // 0, or the error code the single file export would return
+} audio_export_segment_t;
 
 // Forward declaration for now
 typedef struct {
@@ -9,18 +39,105 @@ typedef struct {
     unsigned int num_channels;
     unsigned int sample_rate;
     unsigned int buffer_seconds;
-    int samples_since_sync; // -1 if no sync injected
-    int sync_active;        // 1 if sync injected, 0 otherwise
+    _Atomic uint64_t sync_frame;   // Frame of the last record start marker, AUDIO_BUFFER_NO_SYNC if none
+    marker_index_t markers;        // Every marker injected, appended by the RT thread
+    uint32_t take_id;              // Record starts so far, RT thread only
+    _Atomic int64_t clock_offset;  // PipeWire clock position minus frame position, from the last cycle
+    _Atomic int64_t time_origin_ns; // CLOCK_MONOTONIC time of frame 0 from the last cycle, INT64_MIN if unknown
+    _Atomic(spool_t *) spool;      // Optional disk tier for frames older than the RAM rings
+    uint32_t rate_segment;         // Which rate segment of the run it holds, see buffer-set.h
 } audio_buffer_t;
 
 void audio_buffer_init(audio_buffer_t *ab, unsigned int num_channels, unsigned int sample_rate, unsigned int buffer_seconds);
+
+// Same, with everything the RT thread writes (rings and marker index) set up
+// with memory_flags (RT_MEMORY_*, see rt-memory.h). Slow for long buffers,
+// call it before handing the buffer to the RT thread. info (may be NULL)
+// gets the bytes mapped and locked and the flags every ring got. Returns -1,
+// with nothing left allocated, if memory ran out.
+int audio_buffer_init_rt(audio_buffer_t *ab, unsigned int num_channels, unsigned int sample_rate, unsigned int buffer_seconds,
+                         unsigned int memory_flags, rt_memory_t *info);
 void audio_buffer_free(audio_buffer_t *ab);
 void audio_buffer_push(audio_buffer_t *ab, float *samples, int num_samples, int channel, int inject_sync);
 
+// Push one quantum for every channel (samples[ch], planar like PipeWire DSP buffers).
+// A NULL channel pointer writes silence so all channels stay sample aligned.
+// With inject_sync the marker lands at the same sample index on every channel.
+void audio_buffer_push_frames(audio_buffer_t *ab, float **samples, int num_samples, int inject_sync);
+
+// Same, injecting the marker pattern of type into the channels in
+// channel_mask and appending it to ab->markers. A record start begins a new
+// take id.
+void audio_buffer_push_frames_marked(audio_buffer_t *ab, float **samples, int num_samples, marker_type_t type, uint64_t channel_mask);
+
+// Same with tick number sequence (sync-marker.h) on every channel. Quanta
+// shorter than SYNC_MARKER_TICK_LENGTH cut its bits short.
+void audio_buffer_push_frames_tick(audio_buffer_t *ab, float **samples, int num_samples, uint32_t sequence);
+
+// Absolute index of the next frame, i.e. the number of frames every channel holds
+uint64_t audio_buffer_write_position(const audio_buffer_t *ab);
+
+// Oldest frame every channel still holds in the ring, history or spool.
+// The writer keeps moving it forward, so reads may still fail right after.
+uint64_t audio_buffer_oldest_frame(audio_buffer_t *ab);
+
+// Tell the buffer which PipeWire clock position (spa_io_position
+// clock.position) the next pushed frame has. Call from the RT thread before
+// every push; the latest mapping wins, so clock jumps after an xrun are fine.
+void audio_buffer_set_clock(audio_buffer_t *ab, uint64_t clock_position);
+
+// Convert between PipeWire clock positions and buffer frames
+uint64_t audio_buffer_frame_at_clock(const audio_buffer_t *ab, uint64_t clock_position);
+uint64_t audio_buffer_clock_at_frame(const audio_buffer_t *ab, uint64_t frame);
+
+// Same for CLOCK_MONOTONIC: nsec is the time of the next pushed frame
+// (spa_io_position clock.nsec). Frames are converted at the nominal rate,
+// so times far from the last cycle drift with the device clock.
+void audio_buffer_set_time(audio_buffer_t *ab, uint64_t nsec);
+// 0 and the time in nsec, or -1 if no cycle set one yet
+int audio_buffer_time_at_frame(const audio_buffer_t *ab, uint64_t frame, uint64_t *nsec);
+
+// Absolute frame of the last sync marker, or AUDIO_BUFFER_NO_SYNC
+uint64_t audio_buffer_sync_frame(const audio_buffer_t *ab);
+
+// Read frames [start_frame, end_frame) of a channel, from the RAM ring or
+// the spool. O(1) to locate, 0 on success, -1 if no longer (or not yet) held.
+int audio_buffer_read_range(audio_buffer_t *ab, unsigned int channel, float *samples, uint64_t start_frame, uint64_t end_frame);
+
+// Write frames [start_frame, end_frame) of num_channels channels starting at
+// first_channel to one interleaved wav file, sample exact for any take
+// length. end_frame is clipped to what has been pushed. stats may be NULL.
+int audio_buffer_write_range_to_wav(audio_buffer_t *ab, unsigned int first_channel, unsigned int num_channels, uint64_t start_frame, uint64_t end_frame, const char *filename, audio_export_stats_t *stats);
+
+// Export several segments, possibly overlapping, in one pass over the
+// frames: every chunk is read from the ring (or spool) once and written to
+// each file that covers it. Returns 0 if every segment was written, else
+// the first failing segment's result.
+int audio_buffer_write_segments_to_wav(audio_buffer_t *ab, audio_export_segment_t *segments, unsigned int num_segments);
+
+// The float seconds variants below read forward from (now - offset) and
+// round to frames; they are kept for tests and tools.
+
 // Write a segment of a channel to a wav file
 int audio_buffer_write_channel_to_wav(audio_buffer_t *ab, int channel, float offset_seconds, float duration_seconds, const char *filename);
 
-// Returns seconds since last sync injection, or -1.0f if no sync
+// Write a segment of num_channels channels starting at first_channel to one interleaved wav file.
+// Memory use is bounded by the chunk size, not the segment length. stats may be NULL.
+int audio_buffer_write_channels_to_wav(audio_buffer_t *ab, unsigned int first_channel, unsigned int num_channels, float offset_seconds, float duration_seconds, const char *filename, audio_export_stats_t *stats);
+
+// Let exports fall back to the spool for frames the RAM rings no longer hold.
+// The spool must have been created with ab->channels as its source.
+void audio_buffer_attach_spool(audio_buffer_t *ab, spool_t *spool);
+
+// Give every channel a compressed history of arena_bytes behind its ring.
+// Call right after audio_buffer_init, before the buffer is shared.
+int audio_buffer_enable_history(audio_buffer_t *ab, size_t arena_bytes);
+
+// Compress whatever the rings hold that the histories do not yet, from a
+// non-RT thread. Returns the number of frames compressed over all channels.
+uint64_t audio_buffer_compress(audio_buffer_t *ab);
+
+// Returns seconds since the last sync marker, or -1.0f if no sync
 float audio_buffer_seconds_since_sync(const audio_buffer_t *ab);
 
 // Call this to stop sync tracking (e.g., on stop OSC)
@@ -0,0 +1,305 @@
+#include "block-codec.h"
+#include <string.h>
+
+enum {
+    MODE_RAW = 0,
+    MODE_CONSTANT = 1,
+    MODE_INT24 = 2,
+    MODE_FLOATBITS = 3,
+};
+
+#define RICE_PARTITION 256
+#define RICE_PARAM_BITS 5
+#define RICE_MAX_PARAM 30
+// A quotient this large is stored as an escape plus the raw 32 bit value
+#define RICE_ESCAPE 32
+#define INT24_SCALE 8388608.0f
+
+typedef struct {
+    uint8_t *out;
+    size_t cap;
+    size_t pos;
+    uint64_t acc;
+    unsigned int bits;
+    int overflow;
+} bit_writer_t;
+
+typedef struct {
+    const uint8_t *in;
+    size_t size;
+    size_t pos;
+    uint64_t acc;
+    unsigned int bits;
+} bit_reader_t;
+
+static void bw_put(bit_writer_t *bw, uint32_t value, unsigned int nbits) {
+    if (nbits == 0) return;
+    bw->acc = (bw->acc << nbits) | ((uint64_t)value & ((1ull << nbits) - 1));
+    bw->bits += nbits;
+    while (bw->bits >= 8) {
+        bw->bits -= 8;
+        if (bw->pos >= bw->cap) {
+            bw->overflow = 1;
+            return;
+        }
+        bw->out[bw->pos++] = (uint8_t)(bw->acc >> bw->bits);
+    }
+}
+
+static void bw_flush(bit_writer_t *bw) {
+    if (bw->bits > 0) bw_put(bw, 0, 8 - bw->bits);
+}
+
+static int br_get(bit_reader_t *br, unsigned int nbits, uint32_t *value) {
+    if (nbits == 0) {
+        *value = 0;
+        return 0;
+    }
+    while (br->bits < nbits) {
+        if (br->pos >= br->size) return -1;
+        br->acc = (br->acc << 8) | br->in[br->pos++];
+        br->bits += 8;
+    }
+    br->bits -= nbits;
+    *value = (uint32_t)((br->acc >> br->bits) & ((1ull << nbits) - 1));
+    return 0;
+}
+
+static uint32_t zigzag(int32_t v) {
+    return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31);
+}
+
+static int32_t unzigzag(uint32_t v) {
+    return (int32_t)(v >> 1) ^ -(int32_t)(v & 1);
+}
+
+static unsigned int rice_param(const uint32_t *values, uint32_t n) {
+    uint64_t sum = 0;
+    for (uint32_t i = 0; i < n; ++i) sum += values[i];
+    unsigned int k = 0;
+    while (k < RICE_MAX_PARAM && ((uint64_t)n << (k + 1)) < sum) k++;
+    return k;
+}
+
+static void rice_encode(bit_writer_t *bw, const uint32_t *values, uint32_t n) {
+    for (uint32_t start = 0; start < n && !bw->overflow; start += RICE_PARTITION) {
+        uint32_t len = n - start < RICE_PARTITION ? n - start : RICE_PARTITION;
+        unsigned int k = rice_param(&values[start], len);
+        bw_put(bw, k, RICE_PARAM_BITS);
+        for (uint32_t i = 0; i < len; ++i) {
+            uint32_t v = values[start + i];
+            uint32_t q = v >> k;
+            if (q >= RICE_ESCAPE) {
+                bw_put(bw, 0xFFFFFFFFu, RICE_ESCAPE);
+                bw_put(bw, v, 32);
+                continue;
+            }
+            // q ones and a terminating zero
+            bw_put(bw, ((1u << q) - 1) << 1, q + 1);
+            bw_put(bw, v, k);
+        }
+    }
+}
+
+static int rice_decode(bit_reader_t *br, uint32_t *values, uint32_t n) {
+    for (uint32_t start = 0; start < n; start += RICE_PARTITION) {
+        uint32_t len = n - start < RICE_PARTITION ? n - start : RICE_PARTITION;
+        uint32_t k;
+        if (br_get(br, RICE_PARAM_BITS, &k) < 0 || k > RICE_MAX_PARAM) return -1;
+        for (uint32_t i = 0; i < len; ++i) {
+            uint32_t q = 0, bit;
+            for (;;) {
+                if (br_get(br, 1, &bit) < 0) return -1;
+                if (!bit) break;
+                if (++q == RICE_ESCAPE) break;
+            }
+            if (q == RICE_ESCAPE) {
+                if (br_get(br, 32, &values[start + i]) < 0) return -1;
+                continue;
+            }
+            uint32_t low;
+            if (br_get(br, k, &low) < 0) return -1;
+            values[start + i] = (q << k) | low;
+        }
+    }
+    return 0;
+}
+
+static void put_u32(uint8_t *p, uint32_t v) {
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+    p[2] = (uint8_t)(v >> 16);
+    p[3] = (uint8_t)(v >> 24);
+}
+
+static uint32_t get_u32(const uint8_t *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint32_t float_bits(float f) {
+    uint32_t u;
+    memcpy(&u, &f, sizeof(u));
+    return u;
+}
+
+static float bits_float(uint32_t u) {
+    float f;
+    memcpy(&f, &u, sizeof(f));
+    return f;
+}
+
+// Float bit patterns mapped so that numerically close floats are close integers
+static uint32_t ordered_from_float(float f) {
+    uint32_t u = float_bits(f);
+    return (u & 0x80000000u) ? ~u : (u | 0x80000000u);
+}
+
+static float float_from_ordered(uint32_t u) {
+    return bits_float((u & 0x80000000u) ? (u & 0x7FFFFFFFu) : ~u);
+}
+
+// Fills ints with the samples as 24 bit integers, or returns -1 if any sample
+// is not exactly representable (including -0.0, NaN and out of range values)
+static int to_int24(const float *samples, uint32_t n, int32_t *ints) {
+    for (uint32_t i = 0; i < n; ++i) {
+        float v = samples[i] * INT24_SCALE;
+        if (!(v >= -INT24_SCALE && v < INT24_SCALE)) return -1;
+        int32_t iv = (int32_t)v;
+        if ((float)iv != v) return -1;
+        if (iv == 0 && (float_bits(samples[i]) & 0x80000000u)) return -1;
+        ints[i] = iv;
+    }
+    return 0;
+}
+
+// Residual of the fixed polynomial predictor of the given order at index i >= order
+static int32_t fixed_residual(const int32_t *x, uint32_t i, unsigned int order) {
+    switch (order) {
+    case 0: return x[i];
+    case 1: return x[i] - x[i - 1];
+    case 2: return x[i] - 2 * x[i - 1] + x[i - 2];
+    default: return x[i] - 3 * x[i - 1] + 3 * x[i - 2] - x[i - 3];
+    }
+}
+
+static int32_t fixed_predict(const int32_t *x, uint32_t i, unsigned int order) {
+    switch (order) {
+    case 0: return 0;
+    case 1: return x[i - 1];
+    case 2: return 2 * x[i - 1] - x[i - 2];
+    default: return 3 * x[i - 1] - 3 * x[i - 2] + x[i - 3];
+    }
+}
+
+static unsigned int best_fixed_order(const int32_t *x, uint32_t n) {
+    uint64_t cost[4] = {0, 0, 0, 0};
+    for (uint32_t i = 3; i < n; ++i) {
+        for (unsigned int order = 0; order < 4; ++order) {
+            int32_t r = fixed_residual(x, i, order);
+            cost[order] += (uint64_t)(r < 0 ? -(int64_t)r : r);
+        }
+    }
+    unsigned int best = 0;
+    for (unsigned int order = 1; order < 4; ++order) {
+        if (cost[order] < cost[best]) best = order;
+    }
+    return best;
+}
+
+size_t block_codec_max_encoded_size(uint32_t n) {
+    // Anything that would not beat raw samples is stored raw
+    return 1 + (size_t)n * sizeof(float);
+}
+
+static size_t encode_raw(const float *samples, uint32_t n, uint8_t *out) {
+    out[0] = MODE_RAW;
+    for (uint32_t i = 0; i < n; ++i) put_u32(&out[1 + 4 * (size_t)i], float_bits(samples[i]));
+    return 1 + (size_t)n * 4;
+}
+
+size_t block_codec_encode(const float *samples, uint32_t n, uint8_t *out) {
+    size_t raw_size = block_codec_max_encoded_size(n);
+    if (n == 0 || n > BLOCK_CODEC_MAX_FRAMES) return encode_raw(samples, n, out);
+
+    uint32_t first = float_bits(samples[0]);
+    uint32_t i = 1;
+    while (i < n && float_bits(samples[i]) == first) i++;
+    if (i == n) {
+        out[0] = MODE_CONSTANT;
+        put_u32(&out[1], first);
+        return 5;
+    }
+
+    // The bit writer gives up as soon as the block would not beat raw size
+    int32_t ints[BLOCK_CODEC_MAX_FRAMES];
+    uint32_t residuals[BLOCK_CODEC_MAX_FRAMES];
+    bit_writer_t bw = {out, raw_size, 1, 0, 0, 0};
+    if (to_int24(samples, n, ints) == 0) {
+        unsigned int order = n > 3 ? best_fixed_order(ints, n) : 0;
+        out[0] = MODE_INT24;
+        bw_put(&bw, order, 8);
+        for (unsigned int w = 0; w < order; ++w) bw_put(&bw, (uint32_t)ints[w], 32);
+        for (uint32_t j = order; j < n; ++j) residuals[j - order] = zigzag(fixed_residual(ints, j, order));
+        rice_encode(&bw, residuals, n - order);
+    } else {
+        out[0] = MODE_FLOATBITS;
+        uint32_t prev = ordered_from_float(samples[0]);
+        bw_put(&bw, prev, 32);
+        for (uint32_t j = 1; j < n; ++j) {
+            uint32_t cur = ordered_from_float(samples[j]);
+            residuals[j - 1] = zigzag((int32_t)(cur - prev));
+            prev = cur;
+        }
+        rice_encode(&bw, residuals, n - 1);
+    }
+    bw_flush(&bw);
+    if (bw.overflow || bw.pos >= raw_size) return encode_raw(samples, n, out);
+    return bw.pos;
+}
+
+int block_codec_decode(const uint8_t *in, size_t in_size, float *samples, uint32_t n) {
+    if (in_size < 1 || n > BLOCK_CODEC_MAX_FRAMES) return -1;
+    uint32_t residuals[BLOCK_CODEC_MAX_FRAMES];
+    bit_reader_t br = {in, in_size, 1, 0, 0};
+    switch (in[0]) {
+    case MODE_RAW:
+        if (in_size < 1 + (size_t)n * 4) return -1;
+        for (uint32_t i = 0; i < n; ++i) samples[i] = bits_float(get_u32(&in[1 + 4 * (size_t)i]));
+        return 0;
+    case MODE_CONSTANT: {
+        if (in_size < 5) return -1;
+        float v = bits_float(get_u32(&in[1]));
+        for (uint32_t i = 0; i < n; ++i) samples[i] = v;
+        return 0;
+    }
+    case MODE_INT24: {
+        int32_t ints[BLOCK_CODEC_MAX_FRAMES];
+        uint32_t order, v;
+        if (br_get(&br, 8, &order) < 0 || order > 3 || order > n) return -1;
+        for (uint32_t w = 0; w < order; ++w) {
+            if (br_get(&br, 32, &v) < 0) return -1;
+            ints[w] = (int32_t)v;
+        }
+        if (rice_decode(&br, residuals, n - order) < 0) return -1;
+        for (uint32_t i = order; i < n; ++i) {
+            ints[i] = fixed_predict(ints, i, order) + unzigzag(residuals[i - order]);
+        }
+        for (uint32_t i = 0; i < n; ++i) samples[i] = (float)ints[i] / INT24_SCALE;
+        return 0;
+    }
+    case MODE_FLOATBITS: {
+        uint32_t prev;
+        if (n == 0) return 0;
+        if (br_get(&br, 32, &prev) < 0) return -1;
+        if (rice_decode(&br, residuals, n - 1) < 0) return -1;
+        samples[0] = float_from_ordered(prev);
+        for (uint32_t i = 1; i < n; ++i) {
+            prev += (uint32_t)unzigzag(residuals[i - 1]);
+            samples[i] = float_from_ordered(prev);
+        }
+        return 0;
+    }
+    default:
+        return -1;
+    }
+}
@@ -0,0 +1,30 @@
+#ifndef BLOCK_CODEC
+#define BLOCK_CODEC
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Lossless codec for blocks of float samples, used for the compressed
+// history tier. Every block picks the smallest of:
+//   - constant:  all samples identical (digital silence)
+//   - int24:     samples are exact 24 bit values (what PipeWire produces for
+//                S16/S24 sources), coded FLAC style with a fixed polynomial
+//                predictor of order 0-3 and partitioned Rice residuals
+//   - floatbits: float bit patterns mapped to ordered integers, delta coded
+//                against the previous sample and Rice coded
+//   - raw:       the samples as they are
+// Decoding always reproduces the input bit for bit.
+
+#define BLOCK_CODEC_MAX_FRAMES 8192
+
+// Upper bound for the encoded size of a block of n samples
+size_t block_codec_max_encoded_size(uint32_t n);
+
+// Encode n samples into out (at least block_codec_max_encoded_size(n) bytes).
+// Returns the number of bytes used.
+size_t block_codec_encode(const float *samples, uint32_t n, uint8_t *out);
+
+// Decode a block of n samples. Returns 0 on success, -1 on corrupt input.
+int block_codec_decode(const uint8_t *in, size_t in_size, float *samples, uint32_t n);
+
+#endif /* BLOCK_CODEC */
@@ -0,0 +1,89 @@
+#include "buffer-set.h"
+#include <stdlib.h>
+#include <string.h>
+
+void buffer_set_init(buffer_set_t *bs) {
+    memset(bs->entries, 0, sizeof(bs->entries));
+    pthread_mutex_init(&bs->lock, NULL);
+    atomic_init(&bs->current, NULL);
+    bs->count = 0;
+    bs->next_segment = 0;
+}
+
+static void free_buffer(audio_buffer_t *ab) {
+    audio_buffer_free(ab);
+    free(ab);
+}
+
+void buffer_set_free(buffer_set_t *bs) {
+    for (unsigned int i = 0; i < bs->count; ++i) free_buffer(bs->entries[i].buffer);
+    bs->count = 0;
+    atomic_store(&bs->current, NULL);
+    pthread_mutex_destroy(&bs->lock);
+}
+
+// Drop unreferenced segments older than the newest BUFFER_SET_KEEP. Called
+// with the lock held; the current buffer is always among the kept ones.
+static void prune(buffer_set_t *bs) {
+    unsigned int i = 0;
+    while (i < bs->count) {
+        if (i + BUFFER_SET_KEEP < bs->count && bs->entries[i].refs == 0) {
+            free_buffer(bs->entries[i].buffer);
+            memmove(&bs->entries[i], &bs->entries[i + 1], sizeof(bs->entries[0]) * (bs->count - i - 1));
+            bs->count--;
+        } else {
+            i++;
+        }
+    }
+}
+
+int buffer_set_publish(buffer_set_t *bs, audio_buffer_t *ab) {
+    pthread_mutex_lock(&bs->lock);
+    prune(bs);
+    if (bs->count == BUFFER_SET_MAX) {
+        pthread_mutex_unlock(&bs->lock);
+        return -1;
+    }
+    int segment = (int)bs->next_segment++;
+    ab->rate_segment = (uint32_t)segment;
+    bs->entries[bs->count].buffer = ab;
+    bs->entries[bs->count].refs = 0;
+    bs->count++;
+    atomic_store_explicit(&bs->current, ab, memory_order_release);
+    prune(bs);
+    pthread_mutex_unlock(&bs->lock);
+    return segment;
+}
+
+audio_buffer_t *buffer_set_current(buffer_set_t *bs) {
+    return atomic_load_explicit(&bs->current, memory_order_acquire);
+}
+
+audio_buffer_t *buffer_set_acquire(buffer_set_t *bs, int64_t segment) {
+    audio_buffer_t *found = NULL;
+    pthread_mutex_lock(&bs->lock);
+    for (unsigned int i = 0; i < bs->count; ++i) {
+        buffer_set_entry_t *e = &bs->entries[i];
+        int match = segment < 0 ? i + 1 == bs->count : e->buffer->rate_segment == (uint64_t)segment;
+        if (match) {
+            e->refs++;
+            found = e->buffer;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&bs->lock);
+    return found;
+}
+
+void buffer_set_release(buffer_set_t *bs, audio_buffer_t *ab) {
+    if (!ab) return;
+    pthread_mutex_lock(&bs->lock);
+    for (unsigned int i = 0; i < bs->count; ++i) {
+        if (bs->entries[i].buffer == ab) {
+            bs->entries[i].refs--;
+            break;
+        }
+    }
+    prune(bs);
+    pthread_mutex_unlock(&bs->lock);
+}
@@ -0,0 +1,53 @@
+#ifndef BUFFER_SET
+#define BUFFER_SET
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include "audio-buffer.h"
+
+// The audio buffers of one run, one per rate segment. When the graph rate
+// changes the main loop builds a buffer for the new rate next to the one in
+// use and publishes it with a single pointer store, so the RT thread goes
+// from one ready buffer to the other between two callbacks. Older segments
+// stay readable: non-RT readers take a reference, and a retired buffer is
+// only freed once it is unreferenced and BUFFER_SET_KEEP newer ones exist.
+
+#define BUFFER_SET_MAX 8
+// Rate segments kept readable, the current one included
+#define BUFFER_SET_KEEP 2
+
+typedef struct {
+    audio_buffer_t *buffer;     // malloced, owned by the set
+    int refs;
+} buffer_set_entry_t;
+
+typedef struct {
+    pthread_mutex_t lock;
+    _Atomic(audio_buffer_t *) current; // Buffer the RT thread writes into. Only buffer_set_publish
+                                       // stores it (main loop, lock held); the RT thread only loads
+                                       // it. NULL until the first publish
+    buffer_set_entry_t entries[BUFFER_SET_MAX]; // Oldest first, the last one is current
+    unsigned int count;
+    uint32_t next_segment;
+} buffer_set_t;
+
+void buffer_set_init(buffer_set_t *bs);
+// Frees every buffer; nothing may hold a reference any more
+void buffer_set_free(buffer_set_t *bs);
+
+// Make ab (malloced, initialized) the buffer the RT thread writes and give
+// it the next rate segment number. Returns that number, or -1 if every slot
+// is still referenced (ab is then left to the caller).
+int buffer_set_publish(buffer_set_t *bs, audio_buffer_t *ab);
+
+// For the RT thread: the buffer to write, NULL if none yet. No lock, and
+// no reference: only non-current buffers are ever freed.
+audio_buffer_t *buffer_set_current(buffer_set_t *bs);
+
+// Reference rate segment number segment, or the current one if segment is
+// negative. NULL if there is none (not yet, or already freed).
+audio_buffer_t *buffer_set_acquire(buffer_set_t *bs, int64_t segment);
+void buffer_set_release(buffer_set_t *bs, audio_buffer_t *ab);
+
+#endif /* BUFFER_SET */
@@ -1,22 +1,36 @@
 #include "channel-buffer.h"
+#include <stdlib.h>
 #include <string.h>
 
-void channel_buffer_init(channel_buffer_t *cb, int sample_rate, int buffer_size_seconds) {
+int channel_buffer_init_rt(channel_buffer_t *cb, int sample_rate, int buffer_size_seconds, unsigned int memory_flags) {
     cb->sample_rate = sample_rate;
     cb->buffer_size_seconds = buffer_size_seconds;
+    cb->history = NULL;
     int buffer_size = sample_rate * buffer_size_seconds;
-    ringbuffer_float_init(&cb->buffer, buffer_size);
+    return ringbuffer_float_init_rt(&cb->buffer, buffer_size, memory_flags);
+}
+
+void channel_buffer_init(channel_buffer_t *cb, int sample_rate, int buffer_size_seconds) {
+    channel_buffer_init_rt(cb, sample_rate, buffer_size_seconds, 0);
 }
 
 void channel_buffer_free(channel_buffer_t *cb) {
     ringbuffer_float_free(&cb->buffer);
+    if (cb->history) {
+        compressed_history_free(cb->history);
+        free(cb->history);
+        cb->history = NULL;
+    }
 }
 
 void channel_buffer_write(channel_buffer_t *cb, const float *samples, int number_of_samples) {
-    for (int i = 0; i < number_of_samples; ++i) {
-        // Cast away const since ringbuffer_float_write does not modify the input value
-        ringbuffer_float_write(&cb->buffer, (float *)&samples[i]);
-    }
+    if (number_of_samples <= 0) return;
+    ringbuffer_float_write_block(&cb->buffer, samples, (uint32_t)number_of_samples);
+}
+
+void channel_buffer_write_silence(channel_buffer_t *cb, int number_of_samples) {
+    if (number_of_samples <= 0) return;
+    ringbuffer_float_write_silence(&cb->buffer, (uint32_t)number_of_samples);
 }
 
 int channel_buffer_duration_to_samples(const channel_buffer_t *cb, float duration_seconds) {
@@ -24,12 +38,63 @@ int channel_buffer_duration_to_samples(const channel_buffer_t *cb, float duratio
 }
 
 int channel_buffer_read(const channel_buffer_t *cb, float *samples, float offset_seconds, float duration_seconds, int samples_size) {
-    int offset_samples = (int)(offset_seconds * cb->sample_rate);
-    int num_samples = (int)(duration_seconds * cb->sample_rate);
+    int64_t offset_samples = (int64_t)((double)offset_seconds * cb->sample_rate);
+    int64_t num_samples = (int64_t)((double)duration_seconds * cb->sample_rate);
     if (num_samples > samples_size) num_samples = samples_size;
-    // Read forward in time from (now - offset) for duration seconds
-    for (int i = 0; i < num_samples; ++i) {
-        ringbuffer_float_get_value((ringbuffer_float_t *)&cb->buffer, &samples[i], offset_samples - i);
+    if (num_samples <= 0 || offset_samples < 0) return 0;
+    // Read forward in time from (now - offset) for duration seconds, but not past now
+    uint64_t end = channel_buffer_write_position(cb);
+    if ((uint64_t)offset_samples >= end) return -1;
+    uint64_t start = end - 1 - (uint64_t)offset_samples;
+    if ((uint64_t)num_samples > end - start) num_samples = (int64_t)(end - start);
+    if (channel_buffer_read_frames(cb, samples, start, (uint32_t)num_samples) < 0) return -1;
+    return (int)num_samples;
+}
+
+uint64_t channel_buffer_write_position(const channel_buffer_t *cb) {
+    return ringbuffer_float_write_position(&cb->buffer);
+}
+
+int channel_buffer_read_frames(const channel_buffer_t *cb, float *samples, uint64_t start_frame, uint32_t count) {
+    if (ringbuffer_float_read(&cb->buffer, samples, start_frame, count) == 0) return 0;
+    if (!cb->history) return -1;
+    // Older than the ring: decode what the history holds, the rest comes from the ring
+    uint64_t history_start, history_end;
+    compressed_history_range(cb->history, &history_start, &history_end);
+    if (start_frame < history_start || start_frame >= history_end) return -1;
+    uint32_t from_history = count;
+    if (start_frame + count > history_end) from_history = (uint32_t)(history_end - start_frame);
+    if (compressed_history_read(cb->history, samples, start_frame, from_history) < 0) return -1;
+    if (from_history == count) return 0;
+    return ringbuffer_float_read(&cb->buffer, samples + from_history, start_frame + from_history, count - from_history);
+}
+
+int channel_buffer_enable_history(channel_buffer_t *cb, size_t arena_bytes) {
+    compressed_history_t *history = (compressed_history_t *)malloc(sizeof(compressed_history_t));
+    if (!history) return -1;
+    if (compressed_history_init(history, arena_bytes, channel_buffer_write_position(cb)) < 0) {
+        free(history);
+        return -1;
+    }
+    cb->history = history;
+    return 0;
+}
+
+uint32_t channel_buffer_compress(channel_buffer_t *cb) {
+    float block[COMPRESSED_HISTORY_BLOCK_FRAMES];
+    uint32_t compressed = 0;
+    if (!cb->history) return 0;
+    for (;;) {
+        uint64_t next = compressed_history_next_frame(cb->history);
+        uint64_t head = channel_buffer_write_position(cb);
+        if (next + COMPRESSED_HISTORY_BLOCK_FRAMES > head) break;
+        if (ringbuffer_float_read(&cb->buffer, block, next, COMPRESSED_HISTORY_BLOCK_FRAMES) < 0) {
+            // Fell a whole ring behind; restart half a ring behind the writer
+            compressed_history_skip_to(cb->history, head - cb->buffer.capacity / 2);
+            continue;
+        }
+        compressed_history_append(cb->history, block);
+        compressed += COMPRESSED_HISTORY_BLOCK_FRAMES;
     }
-    return num_samples;
+    return compressed;
 }
@@ -2,20 +2,43 @@
 #define CHANNEL_BUFFER
 
 #include "ring-buffer.h"
+#include "compressed-history.h"
 
 typedef struct {
     ringbuffer_float_t buffer;
     int sample_rate;
     int buffer_size_seconds;
+    compressed_history_t *history; // Optional compressed tier behind the ring, NULL if off
 } channel_buffer_t;
 
 void channel_buffer_init(channel_buffer_t *cb, int sample_rate, int buffer_size_seconds);
+// With the ring in rt_memory set up with memory_flags (RT_MEMORY_*), -1 if it could not be allocated
+int channel_buffer_init_rt(channel_buffer_t *cb, int sample_rate, int buffer_size_seconds, unsigned int memory_flags);
 void channel_buffer_free(channel_buffer_t *cb);
 
 void channel_buffer_write(channel_buffer_t *cb, const float *samples, int number_of_samples);
 
+// Advance the channel by number_of_samples of silence (e.g. an unconnected port)
+void channel_buffer_write_silence(channel_buffer_t *cb, int number_of_samples);
+
 int channel_buffer_duration_to_samples(const channel_buffer_t *cb, float duration_seconds);
 
+// Read forward from (now - offset) for duration, rounded to samples. Exact
+// reads go through channel_buffer_read_frames.
 int channel_buffer_read(const channel_buffer_t *cb, float *samples, float offset_seconds, float duration_seconds, int samples_size);
 
+// Absolute index of the next sample to be written
+uint64_t channel_buffer_write_position(const channel_buffer_t *cb);
+
+// Read count samples starting at an absolute sample index, 0 on success, -1 if overwritten
+int channel_buffer_read_frames(const channel_buffer_t *cb, float *samples, uint64_t start_frame, uint32_t count);
+
+// Keep audio that falls out of the ring in a compressed arena of arena_bytes.
+// Call before the channel is shared with other threads.
+int channel_buffer_enable_history(channel_buffer_t *cb, size_t arena_bytes);
+
+// Move complete blocks from the ring into the compressed history, from a
+// non-RT thread. Returns the number of frames compressed.
+uint32_t channel_buffer_compress(channel_buffer_t *cb);
+
 #endif /* CHANNEL_BUFFER */
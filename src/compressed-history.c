@@ -0,0 +1,122 @@
+#include "compressed-history.h"
+#include "block-codec.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Upper bound on blocks held, so near-empty (silent) blocks cannot make the
+// descriptor ring grow without bound
+#define MIN_AVERAGE_BLOCK_BYTES 1024
+
+int compressed_history_init(compressed_history_t *ch, size_t arena_bytes, uint64_t start_frame) {
+    memset(ch, 0, sizeof(*ch));
+    size_t max_block = block_codec_max_encoded_size(COMPRESSED_HISTORY_BLOCK_FRAMES);
+    if (arena_bytes < 2 * max_block) arena_bytes = 2 * max_block;
+    ch->arena_size = arena_bytes;
+    ch->max_blocks = (uint32_t)(arena_bytes / MIN_AVERAGE_BLOCK_BYTES) + 1;
+    ch->arena = (uint8_t *)malloc(arena_bytes);
+    ch->blocks = (compressed_block_t *)calloc(ch->max_blocks, sizeof(compressed_block_t));
+    ch->encode_buffer = (uint8_t *)malloc(max_block);
+    if (!ch->arena || !ch->blocks || !ch->encode_buffer) {
+        compressed_history_free(ch);
+        return -1;
+    }
+    ch->first_block = ch->next_block = (start_frame + COMPRESSED_HISTORY_BLOCK_FRAMES - 1) / COMPRESSED_HISTORY_BLOCK_FRAMES;
+    pthread_mutex_init(&ch->lock, NULL);
+    return 0;
+}
+
+void compressed_history_free(compressed_history_t *ch) {
+    if (ch->arena) pthread_mutex_destroy(&ch->lock);
+    free(ch->arena);
+    free(ch->blocks);
+    free(ch->encode_buffer);
+    ch->arena = NULL;
+    ch->blocks = NULL;
+    ch->encode_buffer = NULL;
+}
+
+uint64_t compressed_history_next_frame(compressed_history_t *ch) {
+    pthread_mutex_lock(&ch->lock);
+    uint64_t frame = ch->next_block * COMPRESSED_HISTORY_BLOCK_FRAMES;
+    pthread_mutex_unlock(&ch->lock);
+    return frame;
+}
+
+static void evict_oldest(compressed_history_t *ch) {
+    ch->stored_bytes -= ch->blocks[ch->first_block % ch->max_blocks].size;
+    ch->first_block++;
+}
+
+void compressed_history_append(compressed_history_t *ch, const float *samples) {
+    // Encode outside the lock, readers only wait for the copy
+    size_t size = block_codec_encode(samples, COMPRESSED_HISTORY_BLOCK_FRAMES, ch->encode_buffer);
+
+    pthread_mutex_lock(&ch->lock);
+    // Blocks are stored contiguously; skip the arena tail if it is too short
+    uint64_t offset = ch->arena_head;
+    size_t physical = (size_t)(offset % ch->arena_size);
+    if (physical + size > ch->arena_size) offset += ch->arena_size - physical;
+    ch->arena_head = offset + size;
+    // Drop every block the new one overlaps, and make room in the descriptor ring
+    while (ch->first_block < ch->next_block &&
+           (ch->blocks[ch->first_block % ch->max_blocks].offset + ch->arena_size < ch->arena_head ||
+            ch->next_block - ch->first_block >= ch->max_blocks)) {
+        evict_oldest(ch);
+    }
+    memcpy(&ch->arena[offset % ch->arena_size], ch->encode_buffer, size);
+    compressed_block_t *block = &ch->blocks[ch->next_block % ch->max_blocks];
+    block->offset = offset;
+    block->size = (uint32_t)size;
+    ch->stored_bytes += size;
+    ch->next_block++;
+    pthread_mutex_unlock(&ch->lock);
+}
+
+void compressed_history_skip_to(compressed_history_t *ch, uint64_t frame) {
+    uint64_t block = (frame + COMPRESSED_HISTORY_BLOCK_FRAMES - 1) / COMPRESSED_HISTORY_BLOCK_FRAMES;
+    pthread_mutex_lock(&ch->lock);
+    if (block > ch->next_block) {
+        // History must stay contiguous, so everything before the gap goes
+        ch->dropped_frames += (block - ch->next_block) * COMPRESSED_HISTORY_BLOCK_FRAMES;
+        ch->first_block = ch->next_block = block;
+        ch->stored_bytes = 0;
+    }
+    pthread_mutex_unlock(&ch->lock);
+}
+
+int compressed_history_read(compressed_history_t *ch, float *samples, uint64_t start_frame, uint32_t count) {
+    float decoded[COMPRESSED_HISTORY_BLOCK_FRAMES];
+    int ret = 0;
+    pthread_mutex_lock(&ch->lock);
+    if (start_frame < ch->first_block * COMPRESSED_HISTORY_BLOCK_FRAMES ||
+        start_frame + count > ch->next_block * COMPRESSED_HISTORY_BLOCK_FRAMES) {
+        ret = -1;
+        goto out;
+    }
+    while (count > 0) {
+        uint64_t b = start_frame / COMPRESSED_HISTORY_BLOCK_FRAMES;
+        uint32_t skip = (uint32_t)(start_frame % COMPRESSED_HISTORY_BLOCK_FRAMES);
+        uint32_t span = COMPRESSED_HISTORY_BLOCK_FRAMES - skip;
+        if (span > count) span = count;
+        const compressed_block_t *block = &ch->blocks[b % ch->max_blocks];
+        if (block_codec_decode(&ch->arena[block->offset % ch->arena_size], block->size,
+                               decoded, COMPRESSED_HISTORY_BLOCK_FRAMES) < 0) {
+            ret = -1;
+            goto out;
+        }
+        memcpy(samples, &decoded[skip], sizeof(float) * span);
+        samples += span;
+        start_frame += span;
+        count -= span;
+    }
+out:
+    pthread_mutex_unlock(&ch->lock);
+    return ret;
+}
+
+void compressed_history_range(compressed_history_t *ch, uint64_t *start, uint64_t *end) {
+    pthread_mutex_lock(&ch->lock);
+    *start = ch->first_block * COMPRESSED_HISTORY_BLOCK_FRAMES;
+    *end = ch->next_block * COMPRESSED_HISTORY_BLOCK_FRAMES;
+    pthread_mutex_unlock(&ch->lock);
+}
@@ -0,0 +1,55 @@
+#ifndef COMPRESSED_HISTORY
+#define COMPRESSED_HISTORY
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stddef.h>
+
+// Older audio of one channel, losslessly compressed in fixed size blocks
+// (see block-codec.h) and kept in a byte arena that evicts the oldest
+// blocks when it fills up. Block b holds the absolute frames
+// [b * COMPRESSED_HISTORY_BLOCK_FRAMES, (b + 1) * COMPRESSED_HISTORY_BLOCK_FRAMES).
+// Only non-RT threads touch it: a background compressor appends blocks,
+// exports decode them, and a mutex keeps the two apart.
+
+#define COMPRESSED_HISTORY_BLOCK_FRAMES 4096
+
+typedef struct {
+    uint64_t offset; // Monotonic byte offset of the block in the arena
+    uint32_t size;   // Encoded size in bytes
+} compressed_block_t;
+
+typedef struct {
+    uint8_t *arena;
+    size_t arena_size;
+    uint64_t arena_head;          // Monotonic bytes handed out so far
+    compressed_block_t *blocks;   // Indexed by block number % max_blocks
+    uint32_t max_blocks;
+    uint64_t first_block;         // Oldest block still held
+    uint64_t next_block;          // Next block to append
+    uint64_t stored_bytes;        // Encoded bytes of the blocks held
+    uint64_t dropped_frames;      // Frames the compressor never saw (it fell behind)
+    uint8_t *encode_buffer;
+    pthread_mutex_t lock;
+} compressed_history_t;
+
+// start_frame is rounded up to the next block boundary
+int compressed_history_init(compressed_history_t *ch, size_t arena_bytes, uint64_t start_frame);
+void compressed_history_free(compressed_history_t *ch);
+
+// First frame of the next block to append
+uint64_t compressed_history_next_frame(compressed_history_t *ch);
+
+// Append the block starting at compressed_history_next_frame(). Blocks must
+// be appended in order; skip_to() starts over after a gap.
+void compressed_history_append(compressed_history_t *ch, const float *samples);
+void compressed_history_skip_to(compressed_history_t *ch, uint64_t frame);
+
+// Decode count frames starting at start_frame. 0 on success, -1 if any
+// frame is not held (not compressed yet or already evicted).
+int compressed_history_read(compressed_history_t *ch, float *samples, uint64_t start_frame, uint32_t count);
+
+// Frames [*start, *end) currently held
+void compressed_history_range(compressed_history_t *ch, uint64_t *start, uint64_t *end);
+
+#endif /* COMPRESSED_HISTORY */
@@ -0,0 +1,86 @@
+#include "export-queue.h"
+#include <time.h>
+
+double export_queue_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+void export_queue_init(export_queue_t *q) {
+    pthread_mutex_init(&q->lock, NULL);
+    pthread_cond_init(&q->wake, NULL);
+    q->head = 0;
+    q->depth = 0;
+    q->max_depth = 0;
+    q->queued = 0;
+    q->dropped = 0;
+    q->closed = 0;
+}
+
+void export_queue_free(export_queue_t *q) {
+    pthread_cond_destroy(&q->wake);
+    pthread_mutex_destroy(&q->lock);
+}
+
+int export_queue_stop(export_queue_t *q, const audio_buffer_t *ab) {
+    pthread_mutex_lock(&q->lock);
+    if (q->closed || q->depth == EXPORT_QUEUE_CAPACITY) {
+        q->dropped++;
+        pthread_mutex_unlock(&q->lock);
+        return -1;
+    }
+    export_job_t *job = &q->jobs[(q->head + q->depth) % EXPORT_QUEUE_CAPACITY];
+    job->stop_frame = audio_buffer_write_position(ab);
+    job->queued_at = export_queue_now();
+    job->rate_segment = ab->rate_segment;
+    int depth = (int)++q->depth;
+    if (q->depth > q->max_depth) q->max_depth = q->depth;
+    q->queued++;
+    pthread_cond_signal(&q->wake);
+    pthread_mutex_unlock(&q->lock);
+    return depth;
+}
+
+int export_queue_next(export_queue_t *q, const audio_buffer_t *ab, unsigned int timeout_ms, export_job_t *job, uint64_t *until) {
+    pthread_mutex_lock(&q->lock);
+    if (q->depth == 0 && !q->closed && timeout_ms > 0) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += timeout_ms / 1000;
+        deadline.tv_nsec += (long)(timeout_ms % 1000) * 1000000L;
+        deadline.tv_sec += deadline.tv_nsec / 1000000000L;
+        deadline.tv_nsec %= 1000000000L;
+        while (q->depth == 0 && !q->closed) {
+            if (pthread_cond_timedwait(&q->wake, &q->lock, &deadline) != 0) break;
+        }
+    }
+    int ret;
+    if (q->depth > 0) {
+        *job = q->jobs[q->head];
+        q->head = (q->head + 1) % EXPORT_QUEUE_CAPACITY;
+        q->depth--;
+        ret = 1;
+    } else if (q->closed) {
+        ret = -1;
+    } else {
+        *until = ab ? audio_buffer_write_position(ab) : 0;
+        ret = 0;
+    }
+    pthread_mutex_unlock(&q->lock);
+    return ret;
+}
+
+unsigned int export_queue_depth(export_queue_t *q) {
+    pthread_mutex_lock(&q->lock);
+    unsigned int depth = q->depth;
+    pthread_mutex_unlock(&q->lock);
+    return depth;
+}
+
+void export_queue_close(export_queue_t *q) {
+    pthread_mutex_lock(&q->lock);
+    q->closed = 1;
+    pthread_cond_broadcast(&q->wake);
+    pthread_mutex_unlock(&q->lock);
+}
@@ -0,0 +1,54 @@
+#ifndef EXPORT_QUEUE
+#define EXPORT_QUEUE
+
+#include <pthread.h>
+#include <stdint.h>
+#include "audio-buffer.h"
+
+// Bounded queue of record stops for the long lived export worker. A stop
+// takes its frame from the write position under the queue lock, and so
+// does the worker when it asks how far it may encode, so the worker never
+// writes past a stop it has not dequeued yet. Capture never waits on it.
+
+#define EXPORT_QUEUE_CAPACITY 8
+
+typedef struct {
+    uint64_t stop_frame;
+    double queued_at;           // CLOCK_MONOTONIC seconds
+    uint32_t rate_segment;      // Of the buffer stop_frame counts in
+} export_job_t;
+
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    export_job_t jobs[EXPORT_QUEUE_CAPACITY];
+    unsigned int head;
+    unsigned int depth;
+    unsigned int max_depth;     // Deepest the queue has been
+    uint64_t queued;            // Stops accepted
+    uint64_t dropped;           // Stops refused because the queue was full
+    int closed;
+} export_queue_t;
+
+void export_queue_init(export_queue_t *q);
+void export_queue_free(export_queue_t *q);
+
+// Queue a stop at ab's write position. Returns the depth including it, or
+// -1 if the queue is full or closed.
+int export_queue_stop(export_queue_t *q, const audio_buffer_t *ab);
+
+// Wait up to timeout_ms for a stop. Returns 1 with *job filled in, 0 with
+// *until set to the frame the worker may encode up to (0 if ab is NULL),
+// -1 once the queue is closed and drained.
+int export_queue_next(export_queue_t *q, const audio_buffer_t *ab, unsigned int timeout_ms, export_job_t *job, uint64_t *until);
+
+// Depth right now, for reporting
+unsigned int export_queue_depth(export_queue_t *q);
+
+// Wake the worker and make it return -1 after the remaining jobs
+void export_queue_close(export_queue_t *q);
+
+// CLOCK_MONOTONIC in seconds, the clock of queued_at
+double export_queue_now(void);
+
+#endif /* EXPORT_QUEUE */
@@ -0,0 +1,188 @@
+// ghost-patch: replace the audio of a REAPER take from its sync marker on
+// with the pw-ghost-rec recording of the same performance, in place.
+#include <getopt.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "take-patch.h"
+#include "wav-file.h"
+
+static void print_usage(const char *name) {
+    printf("Usage: %s [-n] [-m] [-s] [-g] [-t] TAKE.wav RECORDING.wav\n"
+           "  -n, --dry-run       only report how far the take differs from the recording\n"
+           "  -m, --burn-marker   boost the sync marker in the patched take so it is visible\n"
+           "  -s, --search        search the recording for its markers and ticks and compare all of it, even if its sidecar\n"
+           "                      gives them or its glitches\n"
+           "  -g, --glitches      only patch where the take differs from the recording, and list those places\n"
+           "  -t, --no-ticks      align on the sync marker only, ignore the recording's tick markers\n",
+           name);
+}
+
+static const char *open_error(int ret) {
+    switch (ret) {
+    case -2: return "not a WAV file";
+    case -3: return "unsupported sample format";
+    default: return "cannot open";
+    }
+}
+
+// One line per glitch, then totals per type
+static void print_glitches(const glitch_map_t *gm, unsigned int sample_rate) {
+    uint64_t frames[2] = {0, 0};
+    uint32_t count[2] = {0, 0};
+    for (uint32_t i = 0; i < gm->count; ++i) {
+        const glitch_t *g = &gm->glitches[i];
+        uint64_t n = g->end_frame - g->start_frame;
+        printf("Glitch %u: frames %llu-%llu (%.3f s, %.2f ms) %s, max %.1f dBFS, rms %.1f dBFS\n", i + 1,
+               (unsigned long long)g->start_frame, (unsigned long long)g->end_frame, (double)g->start_frame / sample_rate,
+               (double)n * 1000.0 / sample_rate, glitch_type_name(g->type),
+               20.0 * log10(g->max_diff > 1e-12f ? g->max_diff : 1e-12f), 20.0 * log10(g->rms_diff > 1e-12f ? g->rms_diff : 1e-12f));
+        frames[g->type & 1] += n;
+        count[g->type & 1]++;
+    }
+    printf("Glitches: %u zeroed (%.2f ms), %u different (%.2f ms) in %.1f s compared\n",
+           count[GLITCH_ZEROED], (double)frames[GLITCH_ZEROED] * 1000.0 / sample_rate,
+           count[GLITCH_DIFFERENT], (double)frames[GLITCH_DIFFERENT] * 1000.0 / sample_rate,
+           (double)gm->compared_frames / sample_rate);
+}
+
+static double monotonic_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+int main(int argc, char *argv[]) {
+    static const struct option long_options[] = {
+        {"dry-run", no_argument, NULL, 'n'},
+        {"burn-marker", no_argument, NULL, 'm'},
+        {"search", no_argument, NULL, 's'},
+        {"glitches", no_argument, NULL, 'g'},
+        {"no-ticks", no_argument, NULL, 't'},
+        {"help", no_argument, NULL, 'h'},
+        {NULL, 0, NULL, 0},
+    };
+    take_patch_options_t options = {0};
+    int search = 0;
+    int c;
+    while ((c = getopt_long(argc, argv, "nmsgth", long_options, NULL)) != -1) {
+        switch (c) {
+        case 'n':
+            options.dry_run = 1;
+            break;
+        case 'm':
+            options.burn_marker = 1;
+            break;
+        case 's':
+            search = 1;
+            break;
+        case 'g':
+            options.glitches_only = 1;
+            break;
+        case 't':
+            options.no_ticks = 1;
+            break;
+        case 'h':
+            print_usage(argv[0]);
+            return 0;
+        default:
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+    if (argc - optind != 2) {
+        print_usage(argv[0]);
+        return 1;
+    }
+    const char *take_path = argv[optind];
+    const char *rec_path = argv[optind + 1];
+
+    wav_file_t take, recording;
+    int ret = wav_file_open(&take, take_path, !options.dry_run);
+    if (ret < 0) {
+        fprintf(stderr, "%s: %s\n", take_path, open_error(ret));
+        return 1;
+    }
+    ret = wav_file_open(&recording, rec_path, 0);
+    if (ret < 0) {
+        fprintf(stderr, "%s: %s\n", rec_path, open_error(ret));
+        wav_file_close(&take);
+        return 1;
+    }
+    printf("Take:      %s (%s, %u ch, %u Hz, %llu frames%s)\n", take_path, wav_file_format_name(take.format),
+           take.channels, take.sample_rate, (unsigned long long)take.frames, take.rf64 ? ", RF64" : "");
+    printf("Recording: %s (%s, %u ch, %u Hz, %llu frames%s)\n", rec_path, wav_file_format_name(recording.format),
+           recording.channels, recording.sample_rate, (unsigned long long)recording.frames, recording.rf64 ? ", RF64" : "");
+
+    glitch_map_t glitches;
+    if (options.glitches_only) {
+        if (glitch_map_init(&glitches, 0.0f, 0) < 0) {
+            fprintf(stderr, "Out of memory\n");
+            return 1;
+        }
+        options.glitch_map = &glitches;
+    }
+    double t0 = monotonic_seconds();
+    // The daemon's sidecar says where the marker is, no need to search
+    int64_t rec_sync = search ? -1 : take_patch_sidecar_sync(rec_path, recording.sample_rate);
+    if (rec_sync >= 0) {
+        options.have_rec_sync = 1;
+        options.rec_sync = rec_sync;
+    }
+    take_patch_tick_t *ticks = NULL;
+    uint32_t num_ticks = search || options.no_ticks ? 0 : take_patch_sidecar_ticks(rec_path, recording.sample_rate, NULL, 0);
+    if (num_ticks > 0 && (ticks = (take_patch_tick_t *)malloc(sizeof(*ticks) * num_ticks)) != NULL) {
+        options.rec_ticks = ticks;
+        uint32_t n = take_patch_sidecar_ticks(rec_path, recording.sample_rate, ticks, num_ticks);
+        options.num_rec_ticks = n < num_ticks ? n : num_ticks;
+    }
+    // The daemon's return check already found the glitches it got to
+    glitch_t *rec_glitches = NULL;
+    int num_glitches = search || !options.glitches_only ? -1 :
+        take_patch_sidecar_glitches(rec_path, recording.sample_rate, NULL, 0, &options.rec_checked_until);
+    if (num_glitches == 0) {
+        options.have_rec_glitches = 1;
+    } else if (num_glitches > 0 && (rec_glitches = (glitch_t *)malloc(sizeof(*rec_glitches) * num_glitches)) != NULL) {
+        int n = take_patch_sidecar_glitches(rec_path, recording.sample_rate, rec_glitches, (uint32_t)num_glitches,
+                                            &options.rec_checked_until);
+        options.have_rec_glitches = 1;
+        options.rec_glitches = rec_glitches;
+        options.num_rec_glitches = (uint32_t)(n < num_glitches ? n : num_glitches);
+    }
+    take_patch_result_t result;
+    ret = take_patch(&take, &recording, &options, &result);
+    wav_file_close(&recording);
+    free(ticks);
+    free(rec_glitches);
+    if (wav_file_close(&take) < 0) {
+        perror("Flushing the take failed");
+        return 1;
+    }
+    if (ret < 0) {
+        fprintf(stderr, "Could not patch: %s\n", take_patch_strerror(ret));
+        return 1;
+    }
+    printf("%s %llu frames x %u channel(s) from sync at %lld (recording sync at %lld)%s in %.3f s\n",
+           options.dry_run ? "Would patch" : "Patched", (unsigned long long)result.frames, result.channels,
+           (long long)result.take_sync, (long long)result.rec_sync,
+           result.copied_raw ? ", samples copied verbatim" : ", samples converted",
+           monotonic_seconds() - t0);
+    if (options.have_rec_sync) printf("Sync confidence: take=%.4f, recording from its sidecar\n", result.take_confidence);
+    else printf("Sync confidence: take=%.4f, recording=%.4f\n", result.take_confidence, result.rec_confidence);
+    if (result.ticks) {
+        printf("Aligned on %u tick(s): drift %.1f ppm, largest shift %lld frames\n", result.ticks, result.drift_ppm,
+               (long long)result.max_shift);
+    }
+    printf("Difference after sync: mean=%.6f, max=%.6f\n", result.diff_mean, result.diff_max);
+    if (options.have_rec_glitches) {
+        printf("Glitches from the recording's sidecar for the first %.1f s, the daemon checked those\n",
+               (double)result.checked_frames / take.sample_rate);
+    }
+    if (options.glitches_only) {
+        print_glitches(&glitches, take.sample_rate);
+        glitch_map_free(&glitches);
+    }
+    return 0;
+}
@@ -0,0 +1,136 @@
+#include "glitch-map.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+int glitch_map_init(glitch_map_t *gm, float threshold, uint64_t merge_frames) {
+    memset(gm, 0, sizeof(*gm));
+    gm->threshold = threshold > 0.0f ? threshold : GLITCH_MAP_DEFAULT_THRESHOLD;
+    gm->merge_frames = merge_frames ? merge_frames : GLITCH_MAP_DEFAULT_MERGE_FRAMES;
+    gm->capacity = 64;
+    gm->glitches = (glitch_t *)malloc(sizeof(glitch_t) * gm->capacity);
+    if (!gm->glitches) {
+        gm->capacity = 0;
+        return -1;
+    }
+    return 0;
+}
+
+void glitch_map_free(glitch_map_t *gm) {
+    free(gm->glitches);
+    gm->glitches = NULL;
+    gm->count = gm->capacity = 0;
+}
+
+static glitch_t *append(glitch_map_t *gm) {
+    if (gm->count == gm->capacity) {
+        glitch_t *glitches = (glitch_t *)realloc(gm->glitches, sizeof(glitch_t) * gm->capacity * 2);
+        if (!glitches) return NULL;
+        gm->glitches = glitches;
+        gm->capacity *= 2;
+    }
+    return &gm->glitches[gm->count++];
+}
+
+static int close_glitch(glitch_map_t *gm) {
+    gm->open = 0;
+    glitch_t *g = append(gm);
+    if (!g) return -1;
+    *g = gm->current;
+    g->rms_diff = gm->current_samples ? (float)sqrt(gm->current_sum_sq / (double)gm->current_samples) : 0.0f;
+    g->type = gm->current_zeroed * 2 >= gm->current_differing ? GLITCH_ZEROED : GLITCH_DIFFERENT;
+    return 0;
+}
+
+static int close_window(glitch_map_t *gm) {
+    if (gm->window_frames == 0) return 0;
+    uint64_t end = gm->window_start + gm->window_frames;
+    int ret = 0;
+    if (gm->window_max > gm->threshold) {
+        // Too far from the open glitch to be part of it
+        if (gm->open && gm->window_start - gm->current.end_frame > gm->merge_frames) ret = close_glitch(gm);
+        if (!gm->open) {
+            gm->open = 1;
+            memset(&gm->current, 0, sizeof(gm->current));
+            gm->current.start_frame = gm->window_start;
+            gm->current_sum_sq = 0.0;
+            gm->current_samples = 0;
+            gm->current_differing = gm->current_zeroed = 0;
+        }
+        gm->current.end_frame = end;
+        if (gm->window_max > gm->current.max_diff) gm->current.max_diff = gm->window_max;
+        gm->current_sum_sq += gm->window_sum_sq;
+        gm->current_samples += gm->window_samples;
+        gm->current_differing += gm->window_differing;
+        gm->current_zeroed += gm->window_zeroed;
+    } else if (gm->open && end - gm->current.end_frame > gm->merge_frames) {
+        ret = close_glitch(gm);
+    }
+    gm->window_start = end;
+    gm->window_frames = 0;
+    gm->window_max = 0.0f;
+    gm->window_sum_sq = 0.0;
+    gm->window_samples = gm->window_differing = gm->window_zeroed = 0;
+    return ret;
+}
+
+int glitch_map_feed(glitch_map_t *gm, uint64_t frame, const float *take, unsigned int take_stride,
+                    const float *recording, unsigned int rec_stride, unsigned int channels, uint32_t n) {
+    int ret = 0;
+    while (n > 0) {
+        if (gm->window_frames == 0) gm->window_start = frame;
+        uint32_t span = GLITCH_MAP_WINDOW - gm->window_frames;
+        if (span > n) span = n;
+        float max_diff = gm->window_max, sum_sq = 0.0f, threshold = gm->threshold;
+        uint32_t differing = 0, zeroed = 0;
+        for (uint32_t f = 0; f < span; ++f) {
+            const float *t = take + (size_t)f * take_stride;
+            const float *r = recording + (size_t)f * rec_stride;
+            for (unsigned int ch = 0; ch < channels; ++ch) {
+                float d = t[ch] - r[ch];
+                float ad = fabsf(d);
+                int over = ad > threshold;
+                max_diff = ad > max_diff ? ad : max_diff;
+                sum_sq += d * d;
+                differing += (uint32_t)over;
+                zeroed += (uint32_t)(over & (fabsf(t[ch]) <= threshold));
+            }
+        }
+        gm->window_max = max_diff;
+        gm->window_sum_sq += sum_sq;
+        gm->window_differing += differing;
+        gm->window_zeroed += zeroed;
+        gm->window_samples += (uint64_t)span * channels;
+        gm->window_frames += span;
+        gm->compared_frames += span;
+        take += (size_t)span * take_stride;
+        recording += (size_t)span * rec_stride;
+        frame += span;
+        n -= span;
+        if (gm->window_frames == GLITCH_MAP_WINDOW && close_window(gm) < 0) ret = -1;
+    }
+    return ret;
+}
+
+int glitch_map_finish(glitch_map_t *gm) {
+    int ret = close_window(gm);
+    if (gm->open && close_glitch(gm) < 0) ret = -1;
+    return ret;
+}
+
+int glitch_map_add(glitch_map_t *gm, const glitch_t *g) {
+    glitch_t *slot = append(gm);
+    if (!slot) return -1;
+    *slot = *g;
+    return 0;
+}
+
+uint64_t glitch_map_frames(const glitch_map_t *gm) {
+    uint64_t frames = 0;
+    for (uint32_t i = 0; i < gm->count; ++i) frames += gm->glitches[i].end_frame - gm->glitches[i].start_frame;
+    return frames;
+}
+
+const char *glitch_type_name(uint32_t type) {
+    return type == GLITCH_ZEROED ? "zeroed" : "different";
+}
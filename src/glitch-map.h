@@ -0,0 +1,78 @@
+#ifndef GLITCH_MAP
+#define GLITCH_MAP
+
+#include <stdint.h>
+
+// Finds where a take differs from the recording of the same performance:
+// dropouts and zeroed packets from network jitter, repeated or skipped
+// buffers. Both are compared in windows of GLITCH_MAP_WINDOW frames; a
+// window whose largest difference on any channel is above the threshold is
+// damaged, and damaged windows closer than the merge gap form one glitch.
+
+#define GLITCH_MAP_WINDOW 64
+// About -80 dBFS: far above 24 bit requantization, far below any dropout
+#define GLITCH_MAP_DEFAULT_THRESHOLD 1e-4f
+#define GLITCH_MAP_DEFAULT_MERGE_FRAMES 256
+
+typedef enum {
+    GLITCH_DIFFERENT = 0,   // Other audio in the take: repeated, skipped or garbled buffers
+    GLITCH_ZEROED = 1,      // Mostly silent in the take where the recording is not: dropout, zeroed packet
+} glitch_type_t;
+
+typedef struct {
+    uint64_t start_frame;   // Take frames [start_frame, end_frame), whole windows
+    uint64_t end_frame;
+    float max_diff;         // Largest |take - recording|
+    float rms_diff;         // RMS of take - recording over its damaged windows, all compared channels
+    uint32_t type;          // glitch_type_t
+} glitch_t;
+
+typedef struct {
+    glitch_t *glitches;     // In frame order
+    uint32_t count;
+    uint32_t capacity;
+    float threshold;
+    uint64_t merge_frames;
+    uint64_t compared_frames;
+    // The window being filled and the glitch that may still grow
+    uint64_t window_start;
+    uint32_t window_frames;
+    float window_max;
+    double window_sum_sq;
+    uint64_t window_samples;
+    uint64_t window_differing;  // Samples over the threshold
+    uint64_t window_zeroed;     // Of those, the ones where the take is silent
+    int open;
+    glitch_t current;
+    double current_sum_sq;
+    uint64_t current_samples;
+    uint64_t current_differing;
+    uint64_t current_zeroed;
+} glitch_map_t;
+
+// threshold and merge_frames of 0 pick the defaults. 0, or -1 out of memory.
+int glitch_map_init(glitch_map_t *gm, float threshold, uint64_t merge_frames);
+void glitch_map_free(glitch_map_t *gm);
+
+// Compare n frames starting at take frame frame; frames must follow on from
+// the previous call. take and recording are interleaved with take_stride and
+// rec_stride samples per frame, the first channels of each are compared.
+// -1 if a glitch could not be stored.
+int glitch_map_feed(glitch_map_t *gm, uint64_t frame, const float *take, unsigned int take_stride,
+                    const float *recording, unsigned int rec_stride, unsigned int channels, uint32_t n);
+
+// Close the last window and glitch. -1 if a glitch could not be stored.
+int glitch_map_finish(glitch_map_t *gm);
+
+// Add a glitch found elsewhere (the daemon's return check, see
+// loopback-monitor.h). It goes after every glitch in the map and must end
+// before the frames fed next. -1 if it could not be stored.
+int glitch_map_add(glitch_map_t *gm, const glitch_t *g);
+
+// Frames covered by all glitches
+uint64_t glitch_map_frames(const glitch_map_t *gm);
+
+// "different" or "zeroed"
+const char *glitch_type_name(uint32_t type);
+
+#endif /* GLITCH_MAP */
@@ -0,0 +1,83 @@
+#include "http-request.h"
+#include <ctype.h>
+#include <string.h>
+
+// Digits at *p, advancing past them. -1 if there are none or it overflows.
+static int parse_digits(const char **p, uint64_t *out) {
+    const char *s = *p;
+    uint64_t v = 0;
+    if (!isdigit((unsigned char)*s)) return -1;
+    while (isdigit((unsigned char)*s)) {
+        uint64_t d = (uint64_t)(*s - '0');
+        if (v > (UINT64_MAX - d) / 10) return -1;
+        v = v * 10 + d;
+        s++;
+    }
+    *p = s;
+    *out = v;
+    return 0;
+}
+
+static const char *skip_spaces(const char *s) {
+    while (*s == ' ' || *s == '\t') s++;
+    return s;
+}
+
+int http_parse_range(const char *header, uint64_t total, uint64_t *first, uint64_t *last) {
+    if (!header) return 1;
+    const char *p = skip_spaces(header);
+    if (strncmp(p, "bytes=", 6) != 0) return 1;
+    p = skip_spaces(p + 6);
+    if (strchr(p, ',')) return 1;
+    uint64_t a, b;
+    if (*p == '-') {
+        // Suffix range: the last b bytes
+        p++;
+        if (parse_digits(&p, &b) < 0 || *skip_spaces(p) != '\0') return 1;
+        if (b == 0 || total == 0) return -1;
+        *first = b >= total ? 0 : total - b;
+        *last = total - 1;
+        return 0;
+    }
+    if (parse_digits(&p, &a) < 0 || *p != '-') return 1;
+    p++;
+    if (*skip_spaces(p) == '\0') {
+        b = UINT64_MAX;
+    } else if (parse_digits(&p, &b) < 0 || *skip_spaces(p) != '\0' || b < a) {
+        return 1;
+    }
+    if (a >= total) return -1;
+    *first = a;
+    *last = b >= total ? total - 1 : b;
+    return 0;
+}
+
+int http_parse_u64(const char *value, uint64_t *out) {
+    if (!value) return -1;
+    const char *p = value;
+    if (parse_digits(&p, out) < 0 || *p != '\0') return -1;
+    return 0;
+}
+
+int http_parse_channels(const char *value, unsigned int num_channels, unsigned int *channels, unsigned int max) {
+    if (!value) return -1;
+    const char *p = value;
+    unsigned int n = 0;
+    for (;;) {
+        uint64_t a, b;
+        if (parse_digits(&p, &a) < 0) return -1;
+        b = a;
+        if (*p == '-') {
+            p++;
+            if (parse_digits(&p, &b) < 0 || b < a) return -1;
+        }
+        if (a < 1 || b > num_channels) return -1;
+        for (uint64_t ch = a; ch <= b; ++ch) {
+            if (n == max) return -1;
+            channels[n++] = (unsigned int)(ch - 1);
+        }
+        if (*p == '\0') return (int)n;
+        if (*p != ',') return -1;
+        p++;
+    }
+}
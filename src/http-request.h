@@ -0,0 +1,23 @@
+#ifndef HTTP_REQUEST
+#define HTTP_REQUEST
+
+#include <stdint.h>
+
+// Parsing for the HTTP server's request headers and query arguments, kept
+// apart from libmicrohttpd so it can be tested without a server
+
+// A single "bytes=" range of a resource of total bytes, as [first, last].
+// Returns 0 with the range set, 1 if the header is absent or not one we
+// serve (multiple ranges, other units: answer with the whole resource), -1
+// if it cannot be satisfied (answer 416).
+int http_parse_range(const char *header, uint64_t total, uint64_t *first, uint64_t *last);
+
+// A decimal uint64 argument, 0 on success, -1 if absent or malformed
+int http_parse_u64(const char *value, uint64_t *out);
+
+// A comma separated list of 1-based channel numbers ("1,3,4" or "2-5"),
+// stored 0-based. Returns the number of channels, or -1 if malformed, out of
+// [1, num_channels] or more than max.
+int http_parse_channels(const char *value, unsigned int num_channels, unsigned int *channels, unsigned int max);
+
+#endif /* HTTP_REQUEST */
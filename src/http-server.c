@@ -0,0 +1,238 @@
+#include "http-server.h"
+#include "http-request.h"
+#include "wav-stream.h"
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <microhttpd.h>
+
+// The handler return type changed in libmicrohttpd 0.9.71
+#if MHD_VERSION >= 0x00097002
+#define MHD_RESULT enum MHD_Result
+#else
+#define MHD_RESULT int
+#endif
+
+#ifndef MHD_USE_INTERNAL_POLLING_THREAD
+#define MHD_USE_INTERNAL_POLLING_THREAD MHD_USE_SELECT_INTERNALLY
+#endif
+
+// Bytes handed to libmicrohttpd per content reader call
+#define STREAM_BLOCK_BYTES (64 * 1024)
+
+typedef struct {
+    wav_stream_t stream;
+    uint64_t offset; // First byte of the requested range
+    http_server_t *hs;
+    audio_buffer_t *ab; // Referenced until the response is done
+} stream_request_t;
+
+static ssize_t stream_reader(void *cls, uint64_t pos, char *buf, size_t max) {
+    stream_request_t *req = (stream_request_t *)cls;
+    ssize_t n = wav_stream_read(&req->stream, req->offset + pos, (uint8_t *)buf, max);
+    if (n < 0) return MHD_CONTENT_READER_END_WITH_ERROR;
+    if (n == 0) return MHD_CONTENT_READER_END_OF_STREAM;
+    return n;
+}
+
+static void stream_free(void *cls) {
+    stream_request_t *req = (stream_request_t *)cls;
+    wav_stream_free(&req->stream);
+    if (req->hs->release_buffer) req->hs->release_buffer(req->hs->userdata, req->ab);
+    free(req);
+}
+
+static MHD_RESULT reply_text(struct MHD_Connection *connection, unsigned int status, const char *text) {
+    struct MHD_Response *response = MHD_create_response_from_buffer(strlen(text), (void *)text, MHD_RESPMEM_PERSISTENT);
+    MHD_add_response_header(response, MHD_HTTP_HEADER_CONTENT_TYPE, "text/plain");
+    MHD_RESULT ret = MHD_queue_response(connection, status, response);
+    MHD_destroy_response(response);
+    return ret;
+}
+
+static MHD_RESULT serve_wav(struct MHD_Connection *connection, http_server_t *hs, audio_buffer_t *ab) {
+    const char *start_arg = MHD_lookup_connection_value(connection, MHD_GET_ARGUMENT_KIND, "start");
+    const char *end_arg = MHD_lookup_connection_value(connection, MHD_GET_ARGUMENT_KIND, "end");
+    const char *seconds_arg = MHD_lookup_connection_value(connection, MHD_GET_ARGUMENT_KIND, "seconds");
+    const char *channels_arg = MHD_lookup_connection_value(connection, MHD_GET_ARGUMENT_KIND, "channels");
+
+    uint64_t oldest = audio_buffer_oldest_frame(ab);
+    uint64_t end = audio_buffer_write_position(ab);
+    uint64_t start;
+    if (end_arg && http_parse_u64(end_arg, &end) < 0) return reply_text(connection, MHD_HTTP_BAD_REQUEST, "bad end\n");
+    if (start_arg) {
+        if (http_parse_u64(start_arg, &start) < 0) return reply_text(connection, MHD_HTTP_BAD_REQUEST, "bad start\n");
+    } else if (seconds_arg) {
+        double seconds = atof(seconds_arg);
+        uint64_t frames = seconds > 0.0 ? (uint64_t)(seconds * ab->sample_rate) : 0;
+        start = frames < end ? end - frames : 0;
+    } else {
+        uint64_t sync = audio_buffer_sync_frame(ab);
+        uint64_t pre = (uint64_t)(HTTP_SERVER_PRE_ROLL_SECONDS * ab->sample_rate);
+        start = sync != AUDIO_BUFFER_NO_SYNC && sync < end ? (sync > pre ? sync - pre : 0) : oldest;
+    }
+    if (start < oldest) start = oldest;
+
+    unsigned int channels[WAV_STREAM_MAX_CHANNELS];
+    int num_channels;
+    if (channels_arg) {
+        num_channels = http_parse_channels(channels_arg, ab->num_channels, channels, WAV_STREAM_MAX_CHANNELS);
+        if (num_channels < 0) return reply_text(connection, MHD_HTTP_BAD_REQUEST, "bad channels\n");
+    } else {
+        num_channels = ab->num_channels < WAV_STREAM_MAX_CHANNELS ? (int)ab->num_channels : WAV_STREAM_MAX_CHANNELS;
+        for (int ch = 0; ch < num_channels; ++ch) channels[ch] = (unsigned int)ch;
+    }
+
+    stream_request_t *req = (stream_request_t *)calloc(1, sizeof(*req));
+    if (!req) return reply_text(connection, MHD_HTTP_INTERNAL_SERVER_ERROR, "out of memory\n");
+    int ret = wav_stream_init(&req->stream, ab, start, end, channels, (unsigned int)num_channels);
+    if (ret < 0) {
+        free(req);
+        if (ret == -3) return reply_text(connection, MHD_HTTP_GONE, "frames not held\n");
+        if (ret == -1) return reply_text(connection, MHD_HTTP_BAD_REQUEST, "bad request\n");
+        return reply_text(connection, MHD_HTTP_INTERNAL_SERVER_ERROR, "out of memory\n");
+    }
+
+    // The response outlives this call, so it takes a reference of its own
+    req->hs = hs;
+    req->ab = hs->get_buffer(hs->userdata, ab->rate_segment);
+    uint64_t total = req->stream.total_bytes;
+    uint64_t first = 0, last = total - 1;
+    const char *range = MHD_lookup_connection_value(connection, MHD_HEADER_KIND, MHD_HTTP_HEADER_RANGE);
+    int ranged = http_parse_range(range, total, &first, &last);
+    char value[96];
+    if (ranged < 0) {
+        stream_free(req);
+        struct MHD_Response *response = MHD_create_response_from_buffer(0, NULL, MHD_RESPMEM_PERSISTENT);
+        snprintf(value, sizeof(value), "bytes */%" PRIu64, total);
+        MHD_add_response_header(response, MHD_HTTP_HEADER_CONTENT_RANGE, value);
+        MHD_RESULT r = MHD_queue_response(connection, MHD_HTTP_RANGE_NOT_SATISFIABLE, response);
+        MHD_destroy_response(response);
+        return r;
+    }
+    if (ranged > 0) {
+        first = 0;
+        last = total - 1;
+    }
+    req->offset = first;
+
+    struct MHD_Response *response = MHD_create_response_from_callback(last - first + 1, STREAM_BLOCK_BYTES, stream_reader, req, stream_free);
+    if (!response) {
+        stream_free(req);
+        return reply_text(connection, MHD_HTTP_INTERNAL_SERVER_ERROR, "out of memory\n");
+    }
+    MHD_add_response_header(response, MHD_HTTP_HEADER_CONTENT_TYPE, "audio/wav");
+    MHD_add_response_header(response, MHD_HTTP_HEADER_ACCEPT_RANGES, "bytes");
+    snprintf(value, sizeof(value), "%" PRIu64, start);
+    MHD_add_response_header(response, "X-Start-Frame", value);
+    snprintf(value, sizeof(value), "%" PRIu64, end);
+    MHD_add_response_header(response, "X-End-Frame", value);
+    snprintf(value, sizeof(value), "%u", ab->sample_rate);
+    MHD_add_response_header(response, "X-Sample-Rate", value);
+    snprintf(value, sizeof(value), "%u", ab->rate_segment);
+    MHD_add_response_header(response, "X-Rate-Segment", value);
+    if (ranged == 0) {
+        snprintf(value, sizeof(value), "bytes %" PRIu64 "-%" PRIu64 "/%" PRIu64, first, last, total);
+        MHD_add_response_header(response, MHD_HTTP_HEADER_CONTENT_RANGE, value);
+    }
+    MHD_RESULT r = MHD_queue_response(connection, ranged == 0 ? MHD_HTTP_PARTIAL_CONTENT : MHD_HTTP_OK, response);
+    MHD_destroy_response(response);
+    return r;
+}
+
+static MHD_RESULT serve_markers(struct MHD_Connection *connection, audio_buffer_t *ab) {
+    const marker_index_t *mi = &ab->markers;
+    // Markers and ticks held when we start; any added meanwhile are left out
+    uint32_t count = marker_index_count(mi);
+    uint32_t ticks = marker_index_tick_count(mi);
+    marker_cursor_t cursor = marker_index_cursor(mi, 0), end = {count, ticks};
+    size_t cap = 256 + ((size_t)(count - cursor.marker) + (ticks - cursor.tick)) * 160, len = 0;
+    char *json = (char *)malloc(cap);
+    if (!json) return reply_text(connection, MHD_HTTP_INTERNAL_SERVER_ERROR, "out of memory\n");
+    len += (size_t)snprintf(json + len, cap - len,
+        "{\"rate_segment\":%u,\"sample_rate\":%u,\"write_position\":%" PRIu64 ",\"oldest_frame\":%" PRIu64 ",\"markers\":[",
+        ab->rate_segment, ab->sample_rate, audio_buffer_write_position(ab), audio_buffer_oldest_frame(ab));
+    marker_t marker;
+    for (uint32_t i = 0; marker_index_next(mi, &cursor, &marker) == 0; ++i) {
+        if (cursor.marker > end.marker || (int32_t)(cursor.tick - end.tick) > 0) break;
+        const marker_t *m = &marker;
+        len += (size_t)snprintf(json + len, cap - len,
+            "%s{\"frame\":%" PRIu64 ",\"type\":\"%s\",\"take\":%u,\"channel_mask\":%" PRIu64 ",\"sample_rate\":%u",
+            i ? "," : "", m->frame, marker_type_name(m->type), m->take_id, m->channel_mask, m->sample_rate);
+        if (m->type == MARKER_TICK) len += (size_t)snprintf(json + len, cap - len, ",\"sequence\":%u", m->sequence);
+        len += (size_t)snprintf(json + len, cap - len, "}");
+    }
+    len += (size_t)snprintf(json + len, cap - len, "]}\n");
+    struct MHD_Response *response = MHD_create_response_from_buffer(len, json, MHD_RESPMEM_MUST_FREE);
+    MHD_add_response_header(response, MHD_HTTP_HEADER_CONTENT_TYPE, "application/json");
+    MHD_RESULT ret = MHD_queue_response(connection, MHD_HTTP_OK, response);
+    MHD_destroy_response(response);
+    return ret;
+}
+
+static MHD_RESULT serve_metrics(struct MHD_Connection *connection, http_server_t *hs) {
+    size_t cap = 64 * 1024;
+    char *text = (char *)malloc(cap);
+    size_t len = text ? hs->get_metrics(hs->userdata, text, cap) : 0;
+    if (text && len >= cap) {
+        // Grew past the first guess, try once more with room to spare
+        cap = len + 4096;
+        free(text);
+        text = (char *)malloc(cap);
+        len = text ? hs->get_metrics(hs->userdata, text, cap) : 0;
+        if (len >= cap) len = cap - 1;
+    }
+    if (!text) return reply_text(connection, MHD_HTTP_INTERNAL_SERVER_ERROR, "out of memory\n");
+    struct MHD_Response *response = MHD_create_response_from_buffer(len, text, MHD_RESPMEM_MUST_FREE);
+    MHD_add_response_header(response, MHD_HTTP_HEADER_CONTENT_TYPE, "text/plain; version=0.0.4");
+    MHD_RESULT ret = MHD_queue_response(connection, MHD_HTTP_OK, response);
+    MHD_destroy_response(response);
+    return ret;
+}
+
+static MHD_RESULT handle_request(void *cls, struct MHD_Connection *connection, const char *url,
+                                 const char *method, const char *version, const char *upload_data,
+                                 size_t *upload_data_size, void **con_cls) {
+    http_server_t *hs = (http_server_t *)cls;
+    (void)version; (void)upload_data; (void)upload_data_size; (void)con_cls;
+    if (strcmp(method, MHD_HTTP_METHOD_GET) != 0 && strcmp(method, MHD_HTTP_METHOD_HEAD) != 0) {
+        return reply_text(connection, MHD_HTTP_METHOD_NOT_ALLOWED, "only GET\n");
+    }
+    // Available before the first audio arrives
+    if (strcmp(url, "/metrics") == 0 && hs->get_metrics) return serve_metrics(connection, hs);
+    int64_t segment = -1;
+    const char *segment_arg = MHD_lookup_connection_value(connection, MHD_GET_ARGUMENT_KIND, "segment");
+    if (segment_arg) {
+        uint64_t value;
+        if (http_parse_u64(segment_arg, &value) < 0 || value > UINT32_MAX) {
+            return reply_text(connection, MHD_HTTP_BAD_REQUEST, "bad segment\n");
+        }
+        segment = (int64_t)value;
+    }
+    audio_buffer_t *ab = hs->get_buffer(hs->userdata, segment);
+    if (!ab && segment >= 0) return reply_text(connection, MHD_HTTP_GONE, "rate segment not held\n");
+    if (!ab) return reply_text(connection, MHD_HTTP_SERVICE_UNAVAILABLE, "no audio yet\n");
+    MHD_RESULT ret;
+    if (strcmp(url, "/buffer.wav") == 0) ret = serve_wav(connection, hs, ab);
+    else if (strcmp(url, "/markers") == 0) ret = serve_markers(connection, ab);
+    else ret = reply_text(connection, MHD_HTTP_NOT_FOUND, "not found\n");
+    if (hs->release_buffer) hs->release_buffer(hs->userdata, ab);
+    return ret;
+}
+
+int http_server_start(http_server_t *hs, unsigned int port, http_server_buffer_fn get_buffer, http_server_release_fn release_buffer,
+                      http_server_metrics_fn get_metrics, void *userdata) {
+    hs->get_buffer = get_buffer;
+    hs->release_buffer = release_buffer;
+    hs->get_metrics = get_metrics;
+    hs->userdata = userdata;
+    hs->daemon = MHD_start_daemon(MHD_USE_INTERNAL_POLLING_THREAD, (uint16_t)port, NULL, NULL,
+                                  &handle_request, hs, MHD_OPTION_END);
+    return hs->daemon ? 0 : -1;
+}
+
+void http_server_stop(http_server_t *hs) {
+    if (hs->daemon) MHD_stop_daemon(hs->daemon);
+    hs->daemon = NULL;
+}
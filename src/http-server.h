@@ -0,0 +1,54 @@
+#ifndef HTTP_SERVER
+#define HTTP_SERVER
+
+#include "audio-buffer.h"
+
+// Embedded HTTP server (libmicrohttpd) that serves audio straight from the
+// buffer. Every response is generated while it is sent (wav-stream.h), so
+// a request for any window costs one chunk of memory, no temp file.
+//
+//   GET /buffer.wav[?start=F&end=F|seconds=S][&channels=1,3-4]
+//       Frames [start, end) as 24 bit WAV. Defaults: end is now, start is
+//       100 ms before the last record start marker (or the oldest frame
+//       held), all channels. Range requests are answered with 206, and
+//       X-Start-Frame / X-End-Frame tell the client which exact frames to
+//       ask for when it resumes.
+//   GET /markers
+//       The marker index as JSON.
+//   Both take &segment=N to read an earlier rate segment (buffer-set.h)
+//   instead of the current one, 410 once it is no longer held. Frame
+//   numbers start from 0 in every segment; X-Rate-Segment and the
+//   rate_segment field say which one was served.
+//   GET /metrics
+//       Counters and histograms in the Prometheus text format, when the
+//       daemon provides them.
+
+#define HTTP_SERVER_DEFAULT_PORT 9123
+#define HTTP_SERVER_PRE_ROLL_SECONDS 0.100
+
+struct MHD_Daemon;
+
+// The server asks for the buffer of rate segment segment (the current one
+// if negative) on every request and answers 503 while there is none. What
+// it gets stays referenced until it hands it back to release (may be NULL).
+typedef audio_buffer_t *(*http_server_buffer_fn)(void *userdata, int64_t segment);
+typedef void (*http_server_release_fn)(void *userdata, audio_buffer_t *ab);
+
+// Writes the /metrics text like snprintf: returns the length it needs
+typedef size_t (*http_server_metrics_fn)(void *userdata, char *buf, size_t len);
+
+typedef struct {
+    struct MHD_Daemon *daemon;
+    http_server_buffer_fn get_buffer;
+    http_server_release_fn release_buffer;
+    http_server_metrics_fn get_metrics;
+    void *userdata;
+} http_server_t;
+
+// 0 on success, -1 if the server could not be started (e.g. port in use).
+// release_buffer and get_metrics may be NULL.
+int http_server_start(http_server_t *hs, unsigned int port, http_server_buffer_fn get_buffer, http_server_release_fn release_buffer,
+                      http_server_metrics_fn get_metrics, void *userdata);
+void http_server_stop(http_server_t *hs);
+
+#endif /* HTTP_SERVER */
@@ -0,0 +1,206 @@
+#include "loopback-monitor.h"
+#include <stdlib.h>
+#include <string.h>
+#include "sync-marker.h"
+
+int loopback_monitor_init(loopback_monitor_t *lm, audio_buffer_t *capture, unsigned int memory_flags) {
+    memset(lm, 0, sizeof(*lm));
+    lm->capture = capture;
+    lm->latency = LOOPBACK_MONITOR_UNALIGNED;
+    atomic_init(&lm->origin, -1);
+    size_t chunk = (size_t)LOOPBACK_MONITOR_CHUNK_FRAMES * capture->num_channels;
+    lm->planar = (float *)malloc(sizeof(float) * LOOPBACK_MONITOR_CHUNK_FRAMES);
+    lm->capture_chunk = (float *)malloc(sizeof(float) * chunk);
+    lm->return_chunk = (float *)malloc(sizeof(float) * chunk);
+    if (!lm->planar || !lm->capture_chunk || !lm->return_chunk) goto fail;
+    if (sync_detector_init(&lm->detector, sync_marker_pattern, SYNC_MARKER_LENGTH, 0.0f) < 0) goto fail;
+    if (glitch_map_init(&lm->map, 0.0f, 0) < 0) {
+        sync_detector_free(&lm->detector);
+        goto fail;
+    }
+    if (audio_buffer_init_rt(&lm->ret, capture->num_channels, capture->sample_rate, LOOPBACK_MONITOR_SECONDS,
+                             memory_flags, NULL) < 0) {
+        glitch_map_free(&lm->map);
+        sync_detector_free(&lm->detector);
+        goto fail;
+    }
+    pthread_mutex_init(&lm->lock, NULL);
+    return 0;
+fail:
+    free(lm->planar);
+    free(lm->capture_chunk);
+    free(lm->return_chunk);
+    return -1;
+}
+
+void loopback_monitor_free(loopback_monitor_t *lm) {
+    audio_buffer_free(&lm->ret);
+    glitch_map_free(&lm->map);
+    sync_detector_free(&lm->detector);
+    pthread_mutex_destroy(&lm->lock);
+    free(lm->planar);
+    free(lm->capture_chunk);
+    free(lm->return_chunk);
+}
+
+void loopback_monitor_push(loopback_monitor_t *lm, float **samples, int num_samples) {
+    // Published by the release store of the first push's write position
+    if (atomic_load_explicit(&lm->origin, memory_order_relaxed) < 0) {
+        int64_t origin = (int64_t)audio_buffer_write_position(lm->capture) - num_samples;
+        atomic_store_explicit(&lm->origin, origin, memory_order_relaxed);
+    }
+    audio_buffer_push_frames(&lm->ret, samples, num_samples, 0);
+}
+
+// The marker search fell behind the return ring: start over at frame
+static void restart_search(loopback_monitor_t *lm, uint64_t frame) {
+    sync_detector_free(&lm->detector);
+    sync_detector_init(&lm->detector, sync_marker_pattern, SYNC_MARKER_LENGTH, 0.0f);
+    lm->detector_origin = lm->scanned_frame = frame;
+    lm->matches_used = 0;
+}
+
+// Latest record start in the capture that a return marker at frame can be
+static int64_t capture_marker_before(loopback_monitor_t *lm, uint64_t frame) {
+    const marker_index_t *mi = &lm->capture->markers;
+    uint64_t max_latency = (uint64_t)LOOPBACK_MONITOR_MAX_LATENCY_SECONDS * lm->capture->sample_rate;
+    for (uint32_t i = marker_index_lower_bound(mi, frame + 1); i > 0; --i) {
+        const marker_t *m = &mi->markers[i - 1];
+        if (m->frame + max_latency < frame) break;
+        if (m->type == MARKER_RECORD_START) return (int64_t)m->frame;
+    }
+    return -1;
+}
+
+// Interleave n frames of every channel of ab from frame into out
+static int read_chunk(loopback_monitor_t *lm, audio_buffer_t *ab, float *out, uint64_t frame, uint32_t n) {
+    unsigned int channels = ab->num_channels;
+    for (unsigned int ch = 0; ch < channels; ++ch) {
+        if (audio_buffer_read_range(ab, ch, lm->planar, frame, frame + n) < 0) return -1;
+        for (uint32_t i = 0; i < n; ++i) out[(size_t)i * channels + ch] = lm->planar[i];
+    }
+    return 0;
+}
+
+// Compare return frames up to end at the current latency
+static void compare(loopback_monitor_t *lm, uint64_t end) {
+    unsigned int channels = lm->ret.num_channels;
+    while (lm->compared_frame < end) {
+        uint64_t frame = lm->compared_frame;
+        uint32_t n = end - frame > LOOPBACK_MONITOR_CHUNK_FRAMES ? LOOPBACK_MONITOR_CHUNK_FRAMES : (uint32_t)(end - frame);
+        uint64_t capture_frame = frame + (uint64_t)atomic_load_explicit(&lm->origin, memory_order_relaxed) - (uint64_t)lm->latency;
+        if (read_chunk(lm, &lm->ret, lm->return_chunk, frame, n) < 0 ||
+            read_chunk(lm, lm->capture, lm->capture_chunk, capture_frame, n) < 0) {
+            // Overwritten before we got to it: what was lost is not a glitch of the stream
+            pthread_mutex_lock(&lm->lock);
+            glitch_map_finish(&lm->map);
+            pthread_mutex_unlock(&lm->lock);
+            uint64_t oldest = audio_buffer_oldest_frame(&lm->ret);
+            lm->compared_frame = oldest > frame ? oldest : frame + n;
+            continue;
+        }
+        pthread_mutex_lock(&lm->lock);
+        glitch_map_feed(&lm->map, capture_frame, lm->return_chunk, channels, lm->capture_chunk, channels, channels, n);
+        lm->compared_until = capture_frame + n;
+        pthread_mutex_unlock(&lm->lock);
+        lm->compared_frame = frame + n;
+    }
+}
+
+// Align on the markers the detector confirmed since the last call
+static void align(loopback_monitor_t *lm) {
+    for (; lm->matches_used < lm->detector.num_matches; ++lm->matches_used) {
+        uint64_t frame = lm->detector_origin + (uint64_t)lm->detector.matches[lm->matches_used].frame;
+        // The capture frame that went out while this return frame came back
+        uint64_t capture_frame = frame + (uint64_t)atomic_load_explicit(&lm->origin, memory_order_relaxed);
+        int64_t marker = capture_marker_before(lm, capture_frame);
+        if (marker < 0) continue;
+        int64_t latency = (int64_t)capture_frame - marker;
+        if (latency == lm->latency) continue;
+        // Frames before the marker keep the old latency, the rest is compared anew
+        if (lm->latency != LOOPBACK_MONITOR_UNALIGNED) compare(lm, frame);
+        pthread_mutex_lock(&lm->lock);
+        glitch_map_finish(&lm->map);
+        lm->latency = latency;
+        lm->alignments++;
+        pthread_mutex_unlock(&lm->lock);
+        if (lm->compared_frame < frame) lm->compared_frame = frame;
+    }
+    // Every match has been used, they need not pile up for the daemon's lifetime
+    lm->detector.num_matches = 0;
+    lm->matches_used = 0;
+}
+
+// First glitch of the map ending after frame; the glitches are in frame
+// order and do not overlap. Caller holds lock.
+static uint32_t glitch_lower_bound(const glitch_map_t *map, uint64_t frame) {
+    uint32_t lo = 0, hi = map->count;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (map->glitches[mid].end_frame <= frame) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+uint32_t loopback_monitor_poll(loopback_monitor_t *lm) {
+    uint64_t end = audio_buffer_write_position(&lm->ret);
+    if (lm->scanned_frame < audio_buffer_oldest_frame(&lm->ret)) restart_search(lm, audio_buffer_oldest_frame(&lm->ret));
+    while (lm->scanned_frame < end) {
+        uint64_t frame = lm->scanned_frame;
+        uint32_t n = end - frame > LOOPBACK_MONITOR_CHUNK_FRAMES ? LOOPBACK_MONITOR_CHUNK_FRAMES : (uint32_t)(end - frame);
+        if (audio_buffer_read_range(&lm->ret, 0, lm->planar, frame, frame + n) < 0) {
+            restart_search(lm, audio_buffer_oldest_frame(&lm->ret));
+            continue;
+        }
+        sync_detector_feed(&lm->detector, lm->planar, n, 1);
+        lm->scanned_frame = frame + n;
+        align(lm);
+    }
+    if (lm->latency != LOOPBACK_MONITOR_UNALIGNED && end > LOOPBACK_MONITOR_HORIZON_FRAMES) {
+        compare(lm, end - LOOPBACK_MONITOR_HORIZON_FRAMES);
+    }
+    // No take can be exported from frames the capture no longer holds
+    uint64_t oldest = audio_buffer_oldest_frame(lm->capture);
+    pthread_mutex_lock(&lm->lock);
+    uint32_t gone = glitch_lower_bound(&lm->map, oldest);
+    if (gone > 0) {
+        lm->map.count -= gone;
+        memmove(lm->map.glitches, lm->map.glitches + gone, sizeof(glitch_t) * lm->map.count);
+        lm->glitches_dropped += gone;
+    }
+    uint32_t count = lm->glitches_dropped + lm->map.count;
+    pthread_mutex_unlock(&lm->lock);
+    return count;
+}
+
+uint32_t loopback_monitor_new_glitches(loopback_monitor_t *lm, uint32_t *next, glitch_t *out, uint32_t max) {
+    uint32_t n = 0;
+    pthread_mutex_lock(&lm->lock);
+    if (*next < lm->glitches_dropped) *next = lm->glitches_dropped;
+    for (; *next - lm->glitches_dropped < lm->map.count && n < max; ++*next) {
+        out[n++] = lm->map.glitches[*next - lm->glitches_dropped];
+    }
+    pthread_mutex_unlock(&lm->lock);
+    return n;
+}
+
+uint32_t loopback_monitor_glitches_in(loopback_monitor_t *lm, uint64_t start, uint64_t end, glitch_t *out, uint32_t max) {
+    uint32_t n = 0;
+    pthread_mutex_lock(&lm->lock);
+    for (uint32_t i = glitch_lower_bound(&lm->map, start); i < lm->map.count; ++i) {
+        const glitch_t *g = &lm->map.glitches[i];
+        if (g->start_frame >= end) break;
+        if (n < max) out[n] = *g;
+        n++;
+    }
+    pthread_mutex_unlock(&lm->lock);
+    return n;
+}
+
+void loopback_monitor_status(loopback_monitor_t *lm, int64_t *latency, uint64_t *compared_until) {
+    pthread_mutex_lock(&lm->lock);
+    *latency = lm->latency;
+    *compared_until = lm->compared_until;
+    pthread_mutex_unlock(&lm->lock);
+}
@@ -0,0 +1,76 @@
+#ifndef LOOPBACK_MONITOR
+#define LOOPBACK_MONITOR
+
+#include <pthread.h>
+#include <stdint.h>
+#include "audio-buffer.h"
+#include "glitch-map.h"
+#include "sync-detect.h"
+
+// Checks the return stream while recording runs. The return (what comes
+// back after the network hop, patched into the return ports) is pushed by
+// the RT thread into a short ring of its own, frame for frame with the
+// capture buffer from the first quantum the monitor sees on. An analysis thread finds the record start markers in it,
+// which gives the round trip latency, and compares the aligned return with
+// the capture ring in a glitch map. Glitches are in capture frames, so they
+// line up with takes, sidecars and the HTTP buffer.
+
+#define LOOPBACK_MONITOR_SECONDS 10
+// A return marker further than this behind its capture marker is not one
+#define LOOPBACK_MONITOR_MAX_LATENCY_SECONDS 2
+#define LOOPBACK_MONITOR_CHUNK_FRAMES 4096
+// Frames the marker search may lag behind the return write head. Nothing
+// closer than this is compared, so a new latency is always known in time.
+#define LOOPBACK_MONITOR_HORIZON_FRAMES (2 * SYNC_DETECT_FFT_SIZE)
+#define LOOPBACK_MONITOR_UNALIGNED INT64_MIN
+
+typedef struct {
+    audio_buffer_t *capture;    // Buffer the return belongs to, not owned
+    audio_buffer_t ret;         // Return frames, from 0 at the first push
+    _Atomic int64_t origin;     // Capture frame pushed with return frame 0, -1 before the first push; RT thread
+    // Analysis thread only
+    sync_detector_t detector;   // Record start markers on the first return channel
+    uint64_t detector_origin;   // Return frame the detector's frame 0 is
+    uint64_t scanned_frame;     // Return frames searched up to here
+    size_t matches_used;
+    uint64_t compared_frame;    // Return frames compared up to here
+    float *planar, *capture_chunk, *return_chunk;
+    // Guarded by lock, read from other threads
+    pthread_mutex_t lock;
+    int64_t latency;            // Capture frames a return lags its capture, LOOPBACK_MONITOR_UNALIGNED until known
+    uint32_t alignments;        // Latency changes, the first alignment included
+    uint64_t compared_until;    // Capture frame after the last one compared
+    glitch_map_t map;           // Only glitches the capture still holds frames of
+    uint32_t glitches_dropped;  // Glitches found before map.glitches[0]
+} loopback_monitor_t;
+
+// Allocate the return ring for capture (same channels and rate, rings set
+// up with memory_flags, see rt-memory.h). Slow, call it off the RT thread.
+// 0, or -1 out of memory.
+int loopback_monitor_init(loopback_monitor_t *lm, audio_buffer_t *capture, unsigned int memory_flags);
+void loopback_monitor_free(loopback_monitor_t *lm);
+
+// RT thread: the return frames of the quantum just pushed into the capture
+// buffer, planar, NULL channels are silence. The capture may have been
+// running for a while before the first call.
+void loopback_monitor_push(loopback_monitor_t *lm, float **samples, int num_samples);
+
+// Analysis thread: search and compare everything pushed so far, then forget
+// the glitches the capture no longer holds frames of. Returns the number of
+// glitches found so far.
+uint32_t loopback_monitor_poll(loopback_monitor_t *lm);
+
+// Copy up to max glitches found since *next and advance *next past them
+// (*next counts every glitch found, forgotten ones included). Returns how
+// many were copied.
+uint32_t loopback_monitor_new_glitches(loopback_monitor_t *lm, uint32_t *next, glitch_t *out, uint32_t max);
+
+// Copy up to max glitches overlapping capture frames [start, end), in the
+// order they were found. Returns how many there are in total.
+uint32_t loopback_monitor_glitches_in(loopback_monitor_t *lm, uint64_t start, uint64_t end, glitch_t *out, uint32_t max);
+
+// Latency (LOOPBACK_MONITOR_UNALIGNED if no marker came back yet) and the
+// capture frame everything before which has been compared
+void loopback_monitor_status(loopback_monitor_t *lm, int64_t *latency, uint64_t *compared_until);
+
+#endif /* LOOPBACK_MONITOR */
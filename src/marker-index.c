@@ -0,0 +1,171 @@
+#include "marker-index.h"
+#include <stdlib.h>
+
+int marker_index_init(marker_index_t *mi, uint32_t capacity, uint32_t tick_capacity) {
+    mi->markers = (marker_t *)calloc(capacity, sizeof(marker_t));
+    mi->capacity = mi->markers ? capacity : 0;
+    mi->ticks = (marker_t *)calloc(tick_capacity, sizeof(marker_t));
+    mi->tick_capacity = mi->ticks ? tick_capacity : 0;
+    atomic_init(&mi->count, 0);
+    atomic_init(&mi->dropped, 0);
+    atomic_init(&mi->record_starts_dropped, 0);
+    atomic_init(&mi->ticks_claimed, 0);
+    atomic_init(&mi->ticks_written, 0);
+    return mi->markers && mi->ticks ? 0 : -1;
+}
+
+void marker_index_free(marker_index_t *mi) {
+    free(mi->markers);
+    free(mi->ticks);
+    mi->markers = mi->ticks = NULL;
+    mi->capacity = mi->tick_capacity = 0;
+    atomic_store(&mi->count, 0);
+    atomic_store(&mi->ticks_claimed, 0);
+    atomic_store(&mi->ticks_written, 0);
+}
+
+static int append_tick(marker_index_t *mi, const marker_t *tick) {
+    if (mi->tick_capacity == 0) {
+        atomic_fetch_add_explicit(&mi->dropped, 1, memory_order_relaxed);
+        return -1;
+    }
+    uint32_t n = atomic_load_explicit(&mi->ticks_claimed, memory_order_relaxed);
+    atomic_store_explicit(&mi->ticks_claimed, n + 1, memory_order_relaxed);
+    // Order the claim before the slot is overwritten, as in a seqlock
+    atomic_thread_fence(memory_order_release);
+    mi->ticks[n % mi->tick_capacity] = *tick;
+    atomic_store_explicit(&mi->ticks_written, n + 1, memory_order_release);
+    return 0;
+}
+
+int marker_index_append(marker_index_t *mi, const marker_t *marker) {
+    if (marker->type == MARKER_TICK) return append_tick(mi, marker);
+    uint32_t count = atomic_load_explicit(&mi->count, memory_order_relaxed);
+    if (count >= mi->capacity) {
+        atomic_fetch_add_explicit(&mi->dropped, 1, memory_order_relaxed);
+        if (marker->type == MARKER_RECORD_START) atomic_fetch_add_explicit(&mi->record_starts_dropped, 1, memory_order_relaxed);
+        return -1;
+    }
+    mi->markers[count] = *marker;
+    atomic_store_explicit(&mi->count, count + 1, memory_order_release);
+    return 0;
+}
+
+uint32_t marker_index_count(const marker_index_t *mi) {
+    return atomic_load_explicit(&((marker_index_t *)mi)->count, memory_order_acquire);
+}
+
+int marker_index_full(const marker_index_t *mi) {
+    return marker_index_count(mi) >= mi->capacity;
+}
+
+uint32_t marker_index_lower_bound(const marker_index_t *mi, uint64_t frame) {
+    uint32_t lo = 0, hi = marker_index_count(mi);
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (mi->markers[mid].frame < frame) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+uint32_t marker_index_tick_count(const marker_index_t *mi) {
+    return atomic_load_explicit(&((marker_index_t *)mi)->ticks_written, memory_order_acquire);
+}
+
+int marker_index_tick(const marker_index_t *mi, uint32_t n, marker_t *out) {
+    uint32_t written = marker_index_tick_count(mi);
+    if (mi->tick_capacity == 0 || (int32_t)(written - n) <= 0) return -1;
+    *out = mi->ticks[n % mi->tick_capacity];
+    // The writer claims a slot before overwriting it, so re-reading the
+    // claim tells us whether the copy is intact
+    atomic_thread_fence(memory_order_acquire);
+    uint32_t claimed = atomic_load_explicit(&((marker_index_t *)mi)->ticks_claimed, memory_order_relaxed);
+    return claimed - n > mi->tick_capacity ? -1 : 0;
+}
+
+uint32_t marker_index_tick_lower_bound(const marker_index_t *mi, uint64_t frame) {
+    uint32_t written = marker_index_tick_count(mi);
+    uint32_t lo = written > mi->tick_capacity ? written - mi->tick_capacity : 0, hi = written;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        marker_t tick;
+        // A tick overwritten meanwhile is older than any still held
+        if (marker_index_tick(mi, mid, &tick) < 0 || tick.frame < frame) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+marker_cursor_t marker_index_cursor(const marker_index_t *mi, uint64_t frame) {
+    marker_cursor_t cursor = {marker_index_lower_bound(mi, frame), marker_index_tick_lower_bound(mi, frame)};
+    return cursor;
+}
+
+// Tick *n, or the oldest one after it still held if the ring lapped it
+static int held_tick(const marker_index_t *mi, uint32_t *n, marker_t *out) {
+    while ((int32_t)(marker_index_tick_count(mi) - *n) > 0) {
+        if (marker_index_tick(mi, *n, out) == 0) return 0;
+        uint32_t oldest = atomic_load_explicit(&((marker_index_t *)mi)->ticks_claimed, memory_order_relaxed) - mi->tick_capacity;
+        *n = (int32_t)(oldest - *n) > 0 ? oldest : *n + 1;
+    }
+    return -1;
+}
+
+int marker_index_next(const marker_index_t *mi, marker_cursor_t *cursor, marker_t *out) {
+    marker_t tick;
+    int have_tick = held_tick(mi, &cursor->tick, &tick) == 0;
+    if (cursor->marker < marker_index_count(mi) && (!have_tick || mi->markers[cursor->marker].frame <= tick.frame)) {
+        *out = mi->markers[cursor->marker++];
+        return 0;
+    }
+    if (!have_tick) return -1;
+    *out = tick;
+    cursor->tick++;
+    return 0;
+}
+
+uint32_t marker_index_segments(const marker_index_t *mi, uint64_t stop_frame, marker_segment_t *segments, uint32_t max) {
+    // Markers up to the stop, and of those the last record start
+    uint32_t end = marker_index_lower_bound(mi, stop_frame);
+    uint32_t first = end;
+    while (first > 0 && mi->markers[first - 1].type != MARKER_RECORD_START) first--;
+    if (first == 0) return 0;
+    first--;
+
+    uint32_t n = 0;
+    int open = 0;
+    marker_segment_t current = {0};
+    for (uint32_t i = first; i < end; ++i) {
+        const marker_t *m = &mi->markers[i];
+        if (open && m->frame > current.start_frame) {
+            current.end_frame = m->frame;
+            if (n < max) segments[n] = current;
+            n++;
+        }
+        open = m->type != MARKER_PUNCH_OUT;
+        if (open) {
+            current.start_frame = m->frame;
+            current.channel_mask = m->channel_mask;
+            current.take_id = m->take_id;
+            current.type = m->type;
+        }
+    }
+    if (open && stop_frame > current.start_frame) {
+        current.end_frame = stop_frame;
+        if (n < max) segments[n] = current;
+        n++;
+    }
+    return n;
+}
+
+const char *marker_type_name(uint32_t type) {
+    switch (type) {
+    case MARKER_RECORD_START: return "record_start";
+    case MARKER_PUNCH_IN: return "punch_in";
+    case MARKER_LOOP: return "loop";
+    case MARKER_PUNCH_OUT: return "punch_out";
+    case MARKER_TICK: return "tick";
+    default: return "unknown";
+    }
+}
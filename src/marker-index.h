@@ -0,0 +1,108 @@
+#ifndef MARKER_INDEX
+#define MARKER_INDEX
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+// Append-only index of every marker injected into a session: record starts,
+// punch-ins/outs and loop boundaries, by absolute frame. The RT thread is
+// the only writer; the array is preallocated and a new entry is published
+// with one release store of the count, so readers never lock and never see
+// a half written entry.
+//
+// Ticks come every few seconds for as long as takes record, so they go to
+// a ring of their own instead: the newest tick overwrites the oldest, and
+// the boundary markers keep all of their entries.
+
+#define MARKER_INDEX_DEFAULT_CAPACITY 16384
+// Over 50 minutes of ticks at the shortest interval (0.1 s)
+#define MARKER_INDEX_TICK_CAPACITY 32768
+
+// Values are the sync-marker.h pattern types injected for each
+typedef enum {
+    MARKER_RECORD_START = 0,
+    MARKER_PUNCH_IN = 1,
+    MARKER_LOOP = 2,
+    MARKER_PUNCH_OUT = 3,
+    MARKER_TICK = 4,        // Numbered, every few seconds of a take; never starts a segment
+} marker_type_t;
+
+typedef struct {
+    uint64_t frame;         // Absolute frame the marker starts on
+    uint64_t channel_mask;  // Channels that carry it, bit n is channel n
+    uint32_t take_id;       // Counts record starts, from 1
+    uint32_t type;          // marker_type_t
+    uint32_t sample_rate;   // Rate of the buffer it was injected into, 0 if unknown
+    uint32_t sequence;      // Tick number within the take, from 1; 0 for other markers
+} marker_t;
+
+typedef struct {
+    marker_t *markers;
+    uint32_t capacity;
+    _Atomic uint32_t count;
+    _Atomic uint32_t dropped;                // Appends that found the index full
+    _Atomic uint32_t record_starts_dropped;  // Of those, record starts
+    // Tick n (from 0) is in ticks[n % tick_capacity] until tick n + tick_capacity
+    // is claimed
+    marker_t *ticks;
+    uint32_t tick_capacity;
+    _Atomic uint32_t ticks_claimed;  // Stored before the slot is written
+    _Atomic uint32_t ticks_written;  // Stored after, publishes the tick
+} marker_index_t;
+
+// Walks markers and ticks together, in frame order
+typedef struct {
+    uint32_t marker;
+    uint32_t tick;
+} marker_cursor_t;
+
+// A stretch of audio one stop exports: from a record start, punch-in or
+// loop boundary to the next boundary, punch-out or the stop
+typedef struct {
+    uint64_t start_frame;
+    uint64_t end_frame;
+    uint64_t channel_mask;
+    uint32_t take_id;
+    uint32_t type;          // Type of the marker the segment starts with
+} marker_segment_t;
+
+int marker_index_init(marker_index_t *mi, uint32_t capacity, uint32_t tick_capacity);
+void marker_index_free(marker_index_t *mi);
+
+// RT safe, single writer. Frames must not decrease. 0 on success, -1 if full;
+// a tick always goes in, over the oldest one if need be.
+int marker_index_append(marker_index_t *mi, const marker_t *marker);
+
+// Number of published markers, ticks not included; entries below it never change
+uint32_t marker_index_count(const marker_index_t *mi);
+
+// 1 when the next marker other than a tick would be dropped
+int marker_index_full(const marker_index_t *mi);
+
+// First index whose frame is >= frame (count if none), binary search
+uint32_t marker_index_lower_bound(const marker_index_t *mi, uint64_t frame);
+
+// Number of ticks ever appended; tick n is held from then until n + tick_capacity
+uint32_t marker_index_tick_count(const marker_index_t *mi);
+
+// Copy tick n (from 0) to out: 0 if it is still held, -1 if it was
+// overwritten or is not written yet
+int marker_index_tick(const marker_index_t *mi, uint32_t n, marker_t *out);
+
+// Number of the first tick still held whose frame is >= frame
+uint32_t marker_index_tick_lower_bound(const marker_index_t *mi, uint64_t frame);
+
+// Cursor on the first marker or tick at or after frame
+marker_cursor_t marker_index_cursor(const marker_index_t *mi, uint64_t frame);
+
+// Copy the next marker or tick to out and step past it; -1 when there is none
+int marker_index_next(const marker_index_t *mi, marker_cursor_t *cursor, marker_t *out);
+
+// Split the take that was recording at stop_frame into segments, in frame
+// order, ticks aside. Returns how many there are; up to max are stored.
+uint32_t marker_index_segments(const marker_index_t *mi, uint64_t stop_frame, marker_segment_t *segments, uint32_t max);
+
+// "record_start", "punch_in", "loop", "punch_out", "tick" or "unknown", as used in JSON
+const char *marker_type_name(uint32_t type);
+
+#endif /* MARKER_INDEX */
@@ -11,107 +11,279 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <math.h>
 #include <pipewire/pipewire.h>
 #include <pipewire/filter.h>
 #include <lo/lo.h>
 #include <pthread.h>
 #include <stdatomic.h>
 #include "audio-buffer.h"
-#include <microhttpd.h>
+#include "buffer-set.h"
+#include "take-encoder.h"
+#include "take-sidecar.h"
+#include "loopback-monitor.h"
+#include "export-queue.h"
+#include "rt-stats.h"
+#include "rt-memory.h"
+#include "rt-events.h"
+#ifdef HAVE_MICROHTTPD
+#include "http-server.h"
+#endif
 #include <sys/stat.h>
 #include <time.h>
 #include <unistd.h>
 #include <sys/types.h>
 #include <pwd.h>
+#include <getopt.h>
+#include <dirent.h>
 
 #define AUDIO_BUFFER_SECONDS (30 * 60)
+// A /record without a time marks this long after it arrives
 #define SYNC_PRE_DELAY_SECONDS 0.100
+// Exports start this long before the marker
+#define EXPORT_PRE_ROLL_SECONDS 0.100
 #define RECORDINGS_DIR ".pw-ghost-rec/recordings"
+#define SPOOL_DIR ".pw-ghost-rec/spool"
+// With a disk spool the RAM rings only need to cover the flusher's latency
+#define SPOOL_RAM_SECONDS 60
+// Rate segments that get a disk spool of their own, each referenced until
+// exit; later ones keep the full AUDIO_BUFFER_SECONDS in RAM instead
+#define SPOOL_SEGMENTS 4
+// With compression a short raw ring feeds the compressor, and the rest of
+// the AUDIO_BUFFER_SECONDS RAM budget becomes compressed history
+#define COMPRESS_RAM_SECONDS 60
+#define COMPRESS_INTERVAL_MS 250
+// How far the take encoder trails the write head while a take records
+#define ENCODE_INTERVAL_MS 250
+#define MAX_CHANNELS 64
+// How often the loopback thread checks the return stream
+#define LOOPBACK_INTERVAL_MS 20
+// A stop waits this long at most for the return check to reach it
+#define LOOPBACK_SETTLE_MS 250
+#define LOOPBACK_SIDECAR_GLITCHES 256
 
 // Function prototypes for helpers used before definition
-static void make_reaper_filename(char *buf, size_t buflen);
+static void make_reaper_filename(char *buf, size_t buflen, const struct tm *tm, int channel, int segment);
 static void ensure_recordings_dir(void);
+static void get_recordings_dir(char *buf, size_t buflen);
 
 struct data {
     struct pw_main_loop *loop;
     struct pw_filter *filter;
-    struct pw_filter_port *in_port;
-    struct pw_filter_portort *out_port;
-    audio_buffer_t *audio_buffer;
-    int audio_buffer_initialized;
-    pthread_mutex_t buffer_mutex;
-    int pending_sync_inject;
-    int buffer_write_in_progress;
+    unsigned int num_channels;
+    int split_channels; // Export one file per channel instead of one interleaved file
+    unsigned int buffer_seconds; // Length of the RAM rings
+    unsigned int spool_minutes;  // 0 disables the disk spool
+    spool_t spools[SPOOL_SEGMENTS];               // Spool of rate segment n, spool thread only
+    audio_buffer_t *spool_buffers[SPOOL_SEGMENTS]; // Rate segment each spool flushes, referenced
+    unsigned int num_spools;
+    pthread_t spool_thread;
+    int compress;                // Keep older audio losslessly compressed in RAM
+    pthread_t compress_thread;
+    unsigned int http_port;      // 0 disables the HTTP server
+    unsigned int memory_flags;   // RT_MEMORY_* for everything the RT thread writes
+    struct pw_filter_port *in_ports[MAX_CHANNELS];
+    struct pw_filter_port *out_ports[MAX_CHANNELS];
+    int loopback;                       // Return ports: check the stream that comes back after the network hop
+    struct pw_filter_port *return_ports[MAX_CHANNELS];
+    _Atomic(loopback_monitor_t *) monitor; // Checks the current rate segment, NULL if none
+    loopback_monitor_t *monitors[BUFFER_SET_MAX]; // Every monitor made, freed at exit
+    unsigned int num_monitors;
+    pthread_t loopback_thread;
+    atomic_int recording;               // Between /record 1 and /record 0
+    pthread_mutex_t notify_lock;        // Guards the address below
+    char notify_host[256];              // Sender of the last /record 1, gets /glitch
+    char notify_port[16];
+    uint32_t record_starts_dropped;     // Of the current buffer's marker index at /record 1, OSC thread only
+    struct spa_io_position *position; // Graph clock, from io_changed
+    // One audio buffer per graph rate. Each is set up on the main loop (once
+    // the ports have a format, again whenever the rate changes) and then
+    // published, so the RT thread only ever sees a ready, prefaulted buffer.
+    // Nothing on the capture path may block: the ring buffer publishes its
+    // write position atomically and readers detect overwritten samples
+    // themselves.
+    buffer_set_t buffers;
+    _Atomic uint32_t pending_rate;      // Graph rate the RT thread found no buffer for, 0 if none
+    struct spa_source *rate_event;      // Wakes the main loop to build it
+    double tick_seconds;                // Numbered tick markers this far apart while a take records, 0 for none
+    rt_events_t events;                 // Markers from the OSC thread, placed on their frame by the RT thread
+    export_queue_t exports;             // Record stops waiting for the export worker
+    pthread_t export_thread;
+    rt_stats_t stats;                   // Each part written by one thread, see rt-stats.h
 };
 
 // Add a global atomic flag to signal shutdown
 static atomic_int osc_should_exit = 0;
 
+// Graph rate from the clock, 0 until a driver has set one. clock.rate is
+// the duration of one sample in seconds (1/48000), so the rate is
+// denom / num.
+static uint32_t clock_sample_rate(const struct spa_io_position *position) {
+    if (position && position->clock.rate.num > 0 && position->clock.rate.denom > 0) {
+        return position->clock.rate.denom / position->clock.rate.num;
+    }
+    return 0;
+}
+
 static void on_process(void *userdata, struct spa_io_position *position) {
     struct data *data = (struct data *)userdata;
-    float *in = pw_filter_get_dsp_buffer(data->in_port, position->clock.duration);
-    float *out = pw_filter_get_dsp_buffer(data->out_port, position->clock.duration);
+    uint64_t callback_start = rt_stats_now_ns();
     uint32_t n_samples = position->clock.duration;
-    static float sync_delay_accum = 0.0f;
-    static int waiting_for_sync = 0;
-
-    // Lazy audio_buffer_t initialization
-    if (!data->audio_buffer_initialized && in) {
-        uint32_t sample_rate = 48000; // default
-        if (position && position->clock.rate.denom > 0) {
-            if (position->clock.rate.num == 1) {
-                sample_rate = position->clock.rate.denom;
-            } else if (position->clock.rate.num > 0) {
-                sample_rate = position->clock.rate.num / position->clock.rate.denom;
-            }
+    int pushed = 0;
+    float *in[MAX_CHANNELS];
+    float *out[MAX_CHANNELS];
+    int have_input = 0;
+
+    for (unsigned int ch = 0; ch < data->num_channels; ++ch) {
+        in[ch] = pw_filter_get_dsp_buffer(data->in_ports[ch], n_samples);
+        out[ch] = pw_filter_get_dsp_buffer(data->out_ports[ch], n_samples);
+        if (in[ch]) have_input = 1;
+    }
+
+    audio_buffer_t *ab = buffer_set_current(&data->buffers);
+    uint32_t rate = clock_sample_rate(position);
+    if (rate && (!ab || ab->sample_rate != rate)) {
+        // No buffer yet, or samples at another rate that must not land in
+        // this ring. Ask the main loop once for one at this rate and drop
+        // input until it is published.
+        if (atomic_exchange_explicit(&data->pending_rate, rate, memory_order_relaxed) != rate) {
+            pw_loop_signal_event(pw_main_loop_get_loop(data->loop), data->rate_event);
         }
-        data->audio_buffer = malloc(sizeof(audio_buffer_t));
-        audio_buffer_init(data->audio_buffer, 1, sample_rate, AUDIO_BUFFER_SECONDS);
-        printf("Initialized audio buffer with sample rate %u, length %d seconds\n", sample_rate, AUDIO_BUFFER_SECONDS);
-        pthread_mutex_init(&data->buffer_mutex, NULL);
-        data->audio_buffer_initialized = 1;
-        data->pending_sync_inject = 0;
-        data->buffer_write_in_progress = 0;
-    }
-
-    if (in) {
-        // Write to audio buffer if initialized
-        if (data->audio_buffer_initialized && !data->buffer_write_in_progress) {
-            int inject_sync = 0;
-            if (waiting_for_sync) {
-                sync_delay_accum += (float)n_samples / (float)data->audio_buffer->sample_rate;
-                if (sync_delay_accum >= SYNC_PRE_DELAY_SECONDS) {
-                    inject_sync = 1;
-                    waiting_for_sync = 0;
-                    sync_delay_accum = 0.0f;
+        ab = NULL;
+    }
+
+    if (have_input) {
+        // Write to audio buffer once the main loop has published it
+        if (ab) {
+            audio_buffer_set_clock(ab, position->clock.position);
+            audio_buffer_set_time(ab, position->clock.nsec);
+            // Every marker due in this quantum lands on its own frame, on
+            // all its channels at once
+            rt_events_process(&data->events, ab, in, n_samples, position->clock.nsec,
+                              atomic_load_explicit(&data->recording, memory_order_relaxed));
+            pushed = 1;
+            // The return of the same quantum goes to the monitor of this segment only
+            loopback_monitor_t *lm = atomic_load_explicit(&data->monitor, memory_order_acquire);
+            if (lm && lm->capture == ab) {
+                float *ret[MAX_CHANNELS];
+                for (unsigned int ch = 0; ch < data->num_channels; ++ch) {
+                    ret[ch] = pw_filter_get_dsp_buffer(data->return_ports[ch], n_samples);
                 }
-            } else if (data->pending_sync_inject) {
-                waiting_for_sync = 1;
-                sync_delay_accum = 0.0f;
-                data->pending_sync_inject = 0;
+                loopback_monitor_push(lm, ret, n_samples);
             }
-            pthread_mutex_lock(&data->buffer_mutex);
-            audio_buffer_push(data->audio_buffer, in, n_samples, 0, inject_sync);
-            pthread_mutex_unlock(&data->buffer_mutex);
+        } else {
+            rt_counter_add(&data->stats.skipped_pushes, 1);
         }
     }
 
-    if (in && out) {
-        // Passthrough: copy input to output
-        for (uint32_t i = 0; i < n_samples; ++i) {
-            out[i] = in[i];
+    for (unsigned int ch = 0; ch < data->num_channels; ++ch) {
+        if (in[ch] && out[ch]) {
+            // Passthrough: copy input to output
+            memcpy(out[ch], in[ch], sizeof(float) * n_samples);
+        } else if (out[ch]) {
+            // Output is available but input is not: zero the output
+            memset(out[ch], 0, sizeof(float) * n_samples);
         }
-    } else if (out) {
-        // Output is available but input is not: zero the output
-        for (uint32_t i = 0; i < n_samples; ++i) {
-            out[i] = 0.0f;
+        // If neither in nor out, do nothing
+    }
+
+    uint64_t quantum_ns = 0;
+    if (position->clock.rate.denom > 0) {
+        quantum_ns = (uint64_t)n_samples * position->clock.rate.num * 1000000000ull / position->clock.rate.denom;
+    }
+    rt_stats_record_callback(&data->stats, rt_stats_now_ns() - callback_start, quantum_ns, n_samples, pushed);
+}
+
+// Runs on the main loop. Mapping, faulting in and locking a 30 minute ring
+// takes a while, which is fine here and would be an xrun in on_process.
+static audio_buffer_t *create_audio_buffer(struct data *data, uint32_t sample_rate) {
+    audio_buffer_t *ab = malloc(sizeof(audio_buffer_t));
+    rt_memory_t memory;
+    uint64_t t0 = rt_stats_now_ns();
+    unsigned int seconds = data->buffer_seconds;
+    // Publishing is the main loop's job too, so this is the segment the buffer becomes
+    if (data->spool_minutes > 0 && data->buffers.next_segment >= SPOOL_SEGMENTS) {
+        seconds = AUDIO_BUFFER_SECONDS;
+        fprintf(stderr, "Rate segment %u gets no disk spool (%d in use), keeping %u s of it in RAM instead\n",
+            data->buffers.next_segment, SPOOL_SEGMENTS, seconds);
+    }
+    if (!ab || audio_buffer_init_rt(ab, data->num_channels, sample_rate, seconds, data->memory_flags, &memory) < 0) {
+        fprintf(stderr, "Could not allocate the audio buffer (%u channel(s), %u seconds)\n",
+            data->num_channels, seconds);
+        free(ab);
+        return NULL;
+    }
+    printf("Initialized audio buffer with %u channel(s), sample rate %u, length %u seconds in %.0f ms\n",
+        data->num_channels, sample_rate, seconds, (double)(rt_stats_now_ns() - t0) * 1e-6);
+    printf("Audio buffer memory: %zu MB, %zu MB locked, %s pages\n", memory.bytes >> 20, memory.locked >> 20,
+        (memory.got & RT_MEMORY_HUGETLB) ? "explicit huge" : (memory.got & RT_MEMORY_THP) ? "transparent huge" : "normal");
+    if ((data->memory_flags & RT_MEMORY_LOCK) && memory.locked < memory.bytes) {
+        fprintf(stderr, "Could not lock all of the audio buffer in RAM (raise RLIMIT_MEMLOCK, e.g. ulimit -l)\n");
+    }
+    if (data->compress) {
+        size_t budget = (size_t)AUDIO_BUFFER_SECONDS * sample_rate * sizeof(float);
+        size_t ring = (size_t)ab->channels[0].buffer.capacity * sizeof(float);
+        size_t arena = budget > ring ? budget - ring : ring;
+        if (audio_buffer_enable_history(ab, arena) < 0) {
+            fprintf(stderr, "Could not allocate compressed history\n");
+        } else {
+            printf("Compressed history: %zu MB per channel\n", arena >> 20);
         }
     }
-    // If neither in nor out, do nothing
+    return ab;
+}
+
+// Builds the buffer for sample_rate next to the current one and swaps it
+// in. The previous rate segment stays readable (buffer-set.h).
+static void publish_audio_buffer(struct data *data, uint32_t sample_rate) {
+    audio_buffer_t *current = buffer_set_current(&data->buffers);
+    if (current && current->sample_rate == sample_rate) return;
+    audio_buffer_t *ab = create_audio_buffer(data, sample_rate);
+    if (!ab) return;
+    int segment = buffer_set_publish(&data->buffers, ab);
+    if (segment < 0) {
+        fprintf(stderr, "Too many rate segments still in use, keeping the %u Hz buffer\n", current->sample_rate);
+        audio_buffer_free(ab);
+        free(ab);
+        return;
+    }
+    if (current) {
+        printf("Graph rate changed from %u to %u Hz: rate segment %d starts, segment %u (%llu frames) stays readable\n",
+            current->sample_rate, sample_rate, segment, current->rate_segment,
+            (unsigned long long)audio_buffer_write_position(current));
+    }
+}
+
+// The RT thread saw a graph rate without a buffer for it
+static void on_rate_event(void *userdata, uint64_t count) {
+    struct data *data = (struct data *)userdata;
+    (void)count;
+    uint32_t rate = atomic_load_explicit(&data->pending_rate, memory_order_relaxed);
+    if (rate > 0) publish_audio_buffer(data, rate);
+    atomic_store_explicit(&data->pending_rate, 0, memory_order_relaxed);
+}
+
+static void on_io_changed(void *userdata, void *port_data, uint32_t id, void *area, uint32_t size) {
+    struct data *data = (struct data *)userdata;
+    (void)size;
+    if (port_data == NULL && id == SPA_IO_Position) data->position = (struct spa_io_position *)area;
+}
+
+// A port got its format: the graph is about to run, so the buffer has to be
+// ready now. Only if the graph clock already has a rate though; a guessed
+// one would be a full ring thrown away by the first quantum. Without one
+// the first quantum asks on_rate_event for it.
+static void on_param_changed(void *userdata, void *port_data, uint32_t id, const struct spa_pod *param) {
+    struct data *data = (struct data *)userdata;
+    if (port_data == NULL || id != SPA_PARAM_Format || param == NULL) return;
+    uint32_t rate = clock_sample_rate(data->position);
+    if (rate && !buffer_set_current(&data->buffers)) publish_audio_buffer(data, rate);
 }
 
 static const struct pw_filter_events filter_events = {
     PW_VERSION_FILTER_EVENTS,
+    .io_changed = on_io_changed,
+    .param_changed = on_param_changed,
     .process = on_process,
 };
 
@@ -121,53 +293,318 @@ static void do_quit(void *userdata, int signal_number) {
     pw_main_loop_quit(data->loop);
 }
 
-// Worker thread to write buffer to wav file
-void *write_buffer_thread(void *arg) {
+static void print_export_stats(const char *filename, const audio_export_stats_t *stats, unsigned int sample_rate) {
+    double audio_seconds = (double)stats->frames / (double)sample_rate;
+    double mb = (double)stats->bytes / (1024.0 * 1024.0);
+    double rate = stats->seconds > 0.0 ? mb / stats->seconds : 0.0;
+    printf("Saved recording: %s (%.1f s audio, %.1f MB in %.3f s, %.1f MB/s)\n",
+        filename, audio_seconds, mb, stats->seconds, rate);
+}
+
+// The monitor checking ab's return stream, once it has checked past
+// stop_frame (or LOOPBACK_SETTLE_MS passed), so glitches right before a
+// stop make it into the sidecars. NULL if ab's return is not checked.
+static loopback_monitor_t *settled_monitor(struct data *data, audio_buffer_t *ab, uint64_t stop_frame) {
+    loopback_monitor_t *lm = atomic_load_explicit(&data->monitor, memory_order_acquire);
+    if (!lm || lm->capture != ab) return NULL;
+    // An open glitch closes once a merge gap of clean windows follows it
+    uint64_t settled = stop_frame + GLITCH_MAP_DEFAULT_MERGE_FRAMES + GLITCH_MAP_WINDOW;
+    for (int waited = 0; waited < LOOPBACK_SETTLE_MS; waited += 5) {
+        int64_t latency;
+        uint64_t until;
+        loopback_monitor_status(lm, &latency, &until);
+        if (latency == LOOPBACK_MONITOR_UNALIGNED) return NULL;
+        if (until >= settled) break;
+        usleep(5 * 1000);
+    }
+    return lm;
+}
+
+// Close the take's files and give them their final names. Every segment of
+// the take (record start, punch-ins, loop passes) has its own file.
+static void finish_take(struct data *data, take_encoder_t *te, const export_job_t *job) {
+    unsigned int num_files = take_encoder_finish(te, job->stop_frame);
+    loopback_monitor_t *lm = num_files > 0 ? settled_monitor(data, te->ab, job->stop_frame) : NULL;
+    glitch_t glitches[LOOPBACK_SIDECAR_GLITCHES];
+    // All files of one export share the same timestamp
+    time_t now = time(NULL);
+    struct tm tm;
+    localtime_r(&now, &tm);
+    if (num_files == 0) fprintf(stderr, "No sync marker before the stop, nothing to export\n");
+    for (unsigned int i = 0; i < num_files; ++i) {
+        take_encoder_file_t *f = &te->files[i];
+        char filename[1024];
+        make_reaper_filename(filename, sizeof(filename), &tm, f->channel, te->num_segments > 1 ? (int)f->segment : -1);
+        if (f->result == 0 && rename(f->path, filename) < 0) f->result = -4;
+        if (f->result < 0) {
+            fprintf(stderr, "Could not save %s (error %d)\n", filename, f->result);
+            unlink(f->path);
+            rt_counter_add(&data->stats.export_errors, 1);
+        } else {
+            const marker_segment_t *seg = &te->segments[f->segment];
+            take_sidecar_t sc = {.start_frame = f->start_frame, .end_frame = f->end_frame, .sync_frame = seg->start_frame,
+                                 .sync_type = seg->type, .take_id = seg->take_id, .segment = f->segment,
+                                 .first_channel = f->first_channel, .num_channels = f->num_channels};
+            if (lm) {
+                sc.loopback = 1;
+                loopback_monitor_status(lm, &sc.loopback_latency, &sc.compared_until);
+                uint32_t n = loopback_monitor_glitches_in(lm, f->start_frame, f->end_frame, glitches, LOOPBACK_SIDECAR_GLITCHES);
+                sc.glitches = glitches;
+                sc.num_glitches = n < LOOPBACK_SIDECAR_GLITCHES ? n : LOOPBACK_SIDECAR_GLITCHES;
+            }
+            if (take_sidecar_write(filename, te->ab, &sc) < 0) fprintf(stderr, "Could not write the sidecar of %s\n", filename);
+            print_export_stats(filename, &f->stats, te->ab->sample_rate);
+            rt_counter_add(&data->stats.export_files, 1);
+            rt_counter_add(&data->stats.bytes_written, f->stats.bytes);
+        }
+    }
+    if (num_files > 0) {
+        rt_histogram_record(&data->stats.export_ns, (uint64_t)((export_queue_now() - job->queued_at) * 1e9));
+        rt_counter_add(&data->stats.exports, 1);
+        printf("Take ready %.1f ms after the stop (%llu frames left to encode, %u more stop(s) queued)\n",
+            (export_queue_now() - job->queued_at) * 1000.0, (unsigned long long)te->tail_frames,
+            export_queue_depth(&data->exports));
+    }
+    if (lm) {
+        uint64_t start = te->segments[0].start_frame, frames = 0;
+        uint32_t n = loopback_monitor_glitches_in(lm, start, job->stop_frame, glitches, LOOPBACK_SIDECAR_GLITCHES);
+        for (uint32_t i = 0; i < n && i < LOOPBACK_SIDECAR_GLITCHES; ++i) frames += glitches[i].end_frame - glitches[i].start_frame;
+        printf("Return stream: %u glitch(es) in the take, %.1f ms damaged\n", n, (double)frames * 1000.0 / te->ab->sample_rate);
+    }
+    take_encoder_reset(te);
+}
+
+// Move the encoder from rate segment ab (may be NULL) to segment (the
+// current one if negative). No more audio goes into ab once a newer
+// segment exists, so a take still recording in it ends at its last frame.
+// Returns the referenced buffer the encoder follows now, NULL if none.
+static audio_buffer_t *follow_rate_segment(struct data *data, take_encoder_t *te, audio_buffer_t *ab, int64_t segment, const char *dir) {
+    audio_buffer_t *next = buffer_set_acquire(&data->buffers, segment);
+    if (next == ab) {
+        buffer_set_release(&data->buffers, next);
+        return ab;
+    }
+    if (ab) {
+        export_job_t end = {audio_buffer_write_position(ab), export_queue_now(), ab->rate_segment};
+        if (te->take_id) printf("Rate change ends the take in rate segment %u\n", ab->rate_segment);
+        finish_take(data, te, &end);
+        take_encoder_free(te);
+        buffer_set_release(&data->buffers, ab);
+    }
+    if (!next) return NULL;
+    // Each file starts just before its marker, so the patchers can align it
+    uint64_t pre = (uint64_t)(EXPORT_PRE_ROLL_SECONDS * next->sample_rate);
+    if (take_encoder_init(te, next, dir, data->split_channels, pre) < 0) {
+        buffer_set_release(&data->buffers, next);
+        return NULL;
+    }
+    return next;
+}
+
+// The one export worker. It follows the write head and encodes the take as
+// it records, so a stop only has to encode the last ENCODE_INTERVAL_MS and
+// rename the files. Stops queue up while it works; capture never waits.
+static void *export_thread(void *arg) {
     struct data *data = (struct data *)arg;
-    pthread_mutex_lock(&data->buffer_mutex);
-    data->buffer_write_in_progress = 1;
-    // Ensure recordings dir exists (recursively)
+    take_encoder_t te;
+    audio_buffer_t *ab = NULL; // Rate segment the encoder follows
+    char dir[512];
     ensure_recordings_dir();
-    // Make filename
-    char filename[1024];
-    make_reaper_filename(filename, sizeof(filename));
-    float time_since_sync = audio_buffer_seconds_since_sync(data->audio_buffer);
-    float pre_time = 0.1f;
-    float offset = time_since_sync + pre_time;
-    float duration = time_since_sync - pre_time;
-    if (duration < 0.01f) duration = 0.01f; // Clamp to minimum duration
-    audio_buffer_write_channel_to_wav(data->audio_buffer, 0, offset, duration, filename);
-    printf("Saved recording: %s\n", filename);
-    data->buffer_write_in_progress = 0;
-    pthread_mutex_unlock(&data->buffer_mutex);
+    get_recordings_dir(dir, sizeof(dir));
+    for (;;) {
+        export_job_t job;
+        uint64_t until = 0;
+        int ret = export_queue_next(&data->exports, ab, ENCODE_INTERVAL_MS, &job, &until);
+        if (ret < 0) break;
+        // Stops come in segment order; between stops follow the current segment
+        if (ret > 0 && (!ab || job.rate_segment > ab->rate_segment)) {
+            ab = follow_rate_segment(data, &te, ab, job.rate_segment, dir);
+        } else if (ret == 0 && ab != buffer_set_current(&data->buffers)) {
+            ab = follow_rate_segment(data, &te, ab, -1, dir);
+            continue;
+        }
+        if (!ab) continue;
+        if (ret == 0) {
+            take_encoder_poll(&te, until);
+        } else if (job.rate_segment == ab->rate_segment) {
+            finish_take(data, &te, &job);
+        } else {
+            printf("Stop in rate segment %u came after its take was saved at the rate change\n", job.rate_segment);
+        }
+    }
+    if (ab) {
+        take_encoder_free(&te);
+        buffer_set_release(&data->buffers, ab);
+    }
     return NULL;
 }
 
-// OSC handler for /record
+// Glitches found while recording go back to whoever started it
+static void remember_operator(struct data *data, lo_message msg) {
+    lo_address source = lo_message_get_source(msg);
+    const char *host = source ? lo_address_get_hostname(source) : NULL;
+    const char *port = source ? lo_address_get_port(source) : NULL;
+    if (!host || !port) return;
+    pthread_mutex_lock(&data->notify_lock);
+    snprintf(data->notify_host, sizeof(data->notify_host), "%s", host);
+    snprintf(data->notify_port, sizeof(data->notify_port), "%s", port);
+    pthread_mutex_unlock(&data->notify_lock);
+}
+
+// Record starts the current buffer's marker index had no room for; those
+// takes have nothing to export. Also the index's other dropped markers.
+static uint32_t record_starts_dropped(struct data *data, uint32_t *markers_dropped, int *full) {
+    uint32_t n = 0;
+    if (markers_dropped) *markers_dropped = 0;
+    if (full) *full = 0;
+    audio_buffer_t *ab = buffer_set_acquire(&data->buffers, -1);
+    if (!ab) return 0;
+    n = atomic_load(&ab->markers.record_starts_dropped);
+    if (markers_dropped) *markers_dropped = atomic_load(&ab->markers.dropped);
+    if (full) *full = marker_index_full(&ab->markers);
+    buffer_set_release(&data->buffers, ab);
+    return n;
+}
+
+static void record_error(lo_message msg, const char *text) {
+    fprintf(stderr, "%s\n", text);
+    lo_address source = lo_message_get_source(msg);
+    if (source) lo_send(source, "/record/error", "s", text);
+}
+
+// CLOCK_MONOTONIC time of the bundle msg came in, or 0 if it came in no
+// timed bundle. Timetags are wall clock, the graph runs on the monotonic clock.
+static int bundle_time(lo_message msg, int64_t *nsec) {
+    lo_timetag tt = lo_message_get_timestamp(msg);
+    if (tt.sec == LO_TT_IMMEDIATE.sec && tt.frac == LO_TT_IMMEDIATE.frac) return 0;
+    lo_timetag now;
+    lo_timetag_now(&now);
+    *nsec = (int64_t)rt_stats_now_ns() + (int64_t)(lo_timetag_diff(tt, now) * 1e9);
+    return 1;
+}
+
+static void queue_event(struct data *data, rt_event_t e) {
+    if (rt_events_push(&data->events, &e) < 0) fprintf(stderr, "Marker queue full, marker dropped\n");
+}
+
+// Marker at the time of the bundle msg came in, right away without one
+static void queue_marker(struct data *data, lo_message msg, marker_type_t type, uint64_t mask) {
+    rt_event_t e = {type, RT_EVENT_NOW, 0, mask};
+    if (bundle_time(msg, &e.at)) e.clock = RT_EVENT_AT_NSEC;
+    queue_event(data, e);
+}
+
+// OSC handler for /record. A record start goes on the time of its bundle,
+// on the buffer frame of an optional int64 argument, or else
+// SYNC_PRE_DELAY_SECONDS from now. A take whose record start the marker
+// index has no room for is reported with /record/error to the sender.
 int osc_record(const char *path, const char *types, lo_arg **argv,
               int argc, struct lo_message_ *msg, void *user_data) {
     struct data *data = (struct data *)user_data;
-    (void)path; (void)types; (void)msg;
-    if (argc == 1 && types && types[0] == 'f') {
+    (void)path;
+    if (argc >= 1 && types && types[0] == 'f') {
         float val = argv[0]->f;
         printf("OSC: Received /record (float): %f\n", val);
         if (val == 1.0f) {
-            data->pending_sync_inject = 1;
+            rt_event_t e = {MARKER_RECORD_START, RT_EVENT_AT_NSEC, 0, AUDIO_BUFFER_ALL_CHANNELS};
+            if (argc >= 2 && types[1] == 'h') {
+                e.clock = RT_EVENT_AT_FRAME;
+                e.at = argv[1]->h;
+            } else if (!bundle_time(msg, &e.at)) {
+                e.at = (int64_t)rt_stats_now_ns() + (int64_t)(SYNC_PRE_DELAY_SECONDS * 1e9);
+            }
+            int full;
+            data->record_starts_dropped = record_starts_dropped(data, NULL, &full);
+            if (full) record_error(msg, "Marker index full, this take's record start will be dropped and the take not exported");
+            // Recording first, so ticks follow the marker however soon it is due
+            atomic_store(&data->recording, 1);
+            queue_event(data, e);
+            remember_operator(data, msg);
         } else if (val == 0.0f) {
-            if (!data->buffer_write_in_progress) {
-                pthread_t writer;
-                pthread_create(&writer, NULL, write_buffer_thread, data);
-                pthread_detach(writer);
+            atomic_store(&data->recording, 0);
+            if (record_starts_dropped(data, NULL, NULL) != data->record_starts_dropped) {
+                record_error(msg, "Marker index was full, this take's record start was dropped and there is nothing to export");
+            }
+            audio_buffer_t *ab = buffer_set_acquire(&data->buffers, -1);
+            if (ab) {
+                uint64_t t0 = rt_stats_now_ns();
+                int depth = export_queue_stop(&data->exports, ab);
+                rt_histogram_record(&data->stats.stop_wait_ns, rt_stats_now_ns() - t0);
+                buffer_set_release(&data->buffers, ab);
+                if (depth < 0) {
+                    fprintf(stderr, "Export queue full, stop dropped\n");
+                } else if (depth > 1) {
+                    printf("Export queued behind %d other(s)\n", depth - 1);
+                }
             }
         }
     }
     return 0;
 }
 
+// OSC handler for /punch: 1 punches in, 0 punches out. An optional int
+// argument is the mask of armed channels (bit n is channel n + 1).
+int osc_punch(const char *path, const char *types, lo_arg **argv,
+              int argc, struct lo_message_ *msg, void *user_data) {
+    struct data *data = (struct data *)user_data;
+    (void)path;
+    if (argc < 1 || !types || types[0] != 'f') return 0;
+    uint64_t mask = AUDIO_BUFFER_ALL_CHANNELS;
+    if (argc >= 2 && types[1] == 'i') mask = (uint64_t)(uint32_t)argv[1]->i;
+    else if (argc >= 2 && types[1] == 'h') mask = (uint64_t)argv[1]->h;
+    printf("OSC: Received /punch %s\n", argv[0]->f != 0.0f ? "in" : "out");
+    queue_marker(data, msg, argv[0]->f != 0.0f ? MARKER_PUNCH_IN : MARKER_PUNCH_OUT, mask);
+    return 0;
+}
+
+// OSC handler for /loop: a new loop recording pass starts
+int osc_loop(const char *path, const char *types, lo_arg **argv,
+             int argc, struct lo_message_ *msg, void *user_data) {
+    struct data *data = (struct data *)user_data;
+    (void)path; (void)types; (void)argv; (void)argc;
+    printf("OSC: Received /loop\n");
+    queue_marker(data, msg, MARKER_LOOP, AUDIO_BUFFER_ALL_CHANNELS);
+    return 0;
+}
+
+// OSC handler for /stats: replies to the sender with /stats/reply and
+// callbacks, overruns, callback p99 and max (ns), frames captured, skipped
+// pushes, exports, export p99 (ns), bytes written, the export queue depth,
+// markers the marker index dropped and how many of them were record starts
+int osc_stats(const char *path, const char *types, lo_arg **argv,
+              int argc, struct lo_message_ *msg, void *user_data) {
+    struct data *data = (struct data *)user_data;
+    (void)path; (void)types; (void)argv; (void)argc;
+    rt_stats_t *s = &data->stats;
+    lo_address source = lo_message_get_source(msg);
+    if (!source) return 0;
+    uint32_t markers_dropped;
+    uint32_t starts_dropped = record_starts_dropped(data, &markers_dropped, NULL);
+    lo_send(source, "/stats/reply", "hhhhhhhhhiii",
+        (int64_t)rt_counter_get(&s->callbacks),
+        (int64_t)rt_counter_get(&s->overruns),
+        (int64_t)rt_histogram_quantile(&s->callback_ns, 0.99),
+        (int64_t)atomic_load_explicit(&s->callback_ns.max, memory_order_relaxed),
+        (int64_t)rt_counter_get(&s->frames_captured),
+        (int64_t)rt_counter_get(&s->skipped_pushes),
+        (int64_t)rt_counter_get(&s->exports),
+        (int64_t)rt_histogram_quantile(&s->export_ns, 0.99),
+        (int64_t)rt_counter_get(&s->bytes_written),
+        (int32_t)export_queue_depth(&data->exports),
+        (int32_t)markers_dropped,
+        (int32_t)starts_dropped);
+    return 0;
+}
+
 void *osc_server_thread(void *arg) {
     struct data *data = (struct data *)arg;
     lo_server_thread st = lo_server_thread_new("9000", NULL);
+    // Bundles are handed over at once, the RT thread waits for their time
+    lo_server_enable_queue(lo_server_thread_get_server(st), 0, 1);
     lo_server_thread_add_method(st, "/record", NULL, osc_record, data);
+    lo_server_thread_add_method(st, "/punch", NULL, osc_punch, data);
+    lo_server_thread_add_method(st, "/loop", NULL, osc_loop, data);
+    lo_server_thread_add_method(st, "/stats", NULL, osc_stats, data);
     lo_server_thread_start(st);
     while (!atomic_load(&osc_should_exit)) {
         sleep(1);
@@ -177,25 +614,206 @@ void *osc_server_thread(void *arg) {
     return NULL;
 }
 
-// Helper to get recordings dir path (in home)
-static void get_recordings_dir(char *buf, size_t buflen) {
+// Report new glitches in the return stream. While a take records they are
+// printed and sent as /glitch to the sender of its /record: seconds into
+// the take, length in ms, type ("zeroed" or "different") and the largest
+// difference in dBFS.
+static void report_glitches(struct data *data, loopback_monitor_t *lm, uint32_t *next) {
+    glitch_t glitches[16];
+    uint32_t n;
+    while ((n = loopback_monitor_new_glitches(lm, next, glitches, 16)) > 0) {
+        for (uint32_t i = 0; i < n; ++i) {
+            const glitch_t *g = &glitches[i];
+            rt_counter_add(&data->stats.loopback_glitches, 1);
+            rt_counter_add(&data->stats.loopback_glitch_frames, g->end_frame - g->start_frame);
+            uint64_t sync = audio_buffer_sync_frame(lm->capture);
+            if (!atomic_load(&data->recording) || sync == AUDIO_BUFFER_NO_SYNC || g->start_frame < sync) continue;
+            float at = (float)(g->start_frame - sync) / (float)lm->capture->sample_rate;
+            float ms = (float)(g->end_frame - g->start_frame) * 1000.0f / (float)lm->capture->sample_rate;
+            float db = g->max_diff > 0.0f ? 20.0f * log10f(g->max_diff) : -INFINITY;
+            printf("Return stream glitch %.3f s into the take: %.1f ms %s, %.1f dBFS off\n", at, ms, glitch_type_name(g->type), db);
+            pthread_mutex_lock(&data->notify_lock);
+            lo_address target = data->notify_host[0] ? lo_address_new(data->notify_host, data->notify_port) : NULL;
+            pthread_mutex_unlock(&data->notify_lock);
+            if (target) {
+                lo_send(target, "/glitch", "ffsf", at, ms, glitch_type_name(g->type), db);
+                lo_address_free(target);
+            }
+        }
+    }
+}
+
+// Checks the return stream of the current rate segment. Each segment gets
+// its own monitor; old ones are kept until exit because the RT thread may
+// still be pushing into one when the next is published.
+static void *loopback_thread(void *arg) {
+    struct data *data = (struct data *)arg;
+    audio_buffer_t *ab = NULL; // Rate segment checked, referenced
+    loopback_monitor_t *lm = NULL;
+    uint32_t next = 0;
+    while (!atomic_load(&osc_should_exit)) {
+        audio_buffer_t *current = buffer_set_acquire(&data->buffers, -1);
+        if (current == ab) {
+            buffer_set_release(&data->buffers, current);
+        } else {
+            buffer_set_release(&data->buffers, ab);
+            ab = current;
+            lm = NULL;
+            next = 0;
+            if (data->num_monitors < BUFFER_SET_MAX) {
+                lm = malloc(sizeof(loopback_monitor_t));
+                if (!lm || loopback_monitor_init(lm, ab, data->memory_flags) < 0) {
+                    fprintf(stderr, "Could not set up the return stream check for rate segment %u\n", ab->rate_segment);
+                    free(lm);
+                    lm = NULL;
+                } else {
+                    data->monitors[data->num_monitors++] = lm;
+                }
+            }
+            atomic_store_explicit(&data->monitor, lm, memory_order_release);
+        }
+        if (lm) {
+            int64_t latency = lm->latency;
+            uint32_t alignments = lm->alignments;
+            loopback_monitor_poll(lm);
+            if (lm->alignments != alignments) {
+                printf("Return stream aligned: %.2f ms round trip (%lld frames)%s\n",
+                    (double)lm->latency * 1000.0 / lm->capture->sample_rate, (long long)lm->latency,
+                    latency == LOOPBACK_MONITOR_UNALIGNED ? "" : ", latency changed");
+            }
+            report_glitches(data, lm, &next);
+        }
+        usleep(LOOPBACK_INTERVAL_MS * 1000);
+    }
+    buffer_set_release(&data->buffers, ab);
+    return NULL;
+}
+
+// Helper to get a dir path below home
+static void get_home_dir(char *buf, size_t buflen, const char *subdir) {
     const char *home = getenv("HOME");
     if (!home) {
         struct passwd *pw = getpwuid(getuid());
         home = pw ? pw->pw_dir : ".";
     }
-    snprintf(buf, buflen, "%s/%s", home, RECORDINGS_DIR);
+    snprintf(buf, buflen, "%s/%s", home, subdir);
 }
 
-// Helper to generate REAPER-style filename
-static void make_reaper_filename(char *buf, size_t buflen) {
+// Helper to get recordings dir path (in home)
+static void get_recordings_dir(char *buf, size_t buflen) {
+    get_home_dir(buf, buflen, RECORDINGS_DIR);
+}
+
+// A spool dir only ever holds flat channel files
+static void remove_spool_dir(const char *dir) {
+    DIR *d = opendir(dir);
+    if (!d) return;
+    struct dirent *ent;
+    char path[1024];
+    while ((ent = readdir(d)) != NULL) {
+        if (ent->d_name[0] == '.') continue;
+        snprintf(path, sizeof(path), "%s/%s", dir, ent->d_name);
+        unlink(path);
+    }
+    closedir(d);
+    rmdir(dir);
+}
+
+// Give rate segment ab (referenced) a spool in spool/ for segment 0, spool.N
+// for segment N. A spool left there by a previous run is moved to .prev
+// first so a crashed session can still be recovered from it.
+static int start_spool(struct data *data, audio_buffer_t *ab) {
+    char dir[512], prev[530];
+    get_home_dir(dir, sizeof(dir), SPOOL_DIR);
+    if (ab->rate_segment > 0) snprintf(dir + strlen(dir), sizeof(dir) - strlen(dir), ".%u", ab->rate_segment);
+    snprintf(prev, sizeof(prev), "%s.prev", dir);
+    ensure_recordings_dir(); // Creates ~/.pw-ghost-rec as well
+    if (access(dir, F_OK) == 0) {
+        remove_spool_dir(prev);
+        if (rename(dir, prev) != 0) {
+            fprintf(stderr, "Could not move old spool %s out of the way\n", dir);
+        }
+    }
+    spool_t *spool = &data->spools[data->num_spools];
+    if (spool_init(spool, ab->channels, ab->num_channels, ab->sample_rate, dir, data->spool_minutes * 60) < 0) {
+        perror("Could not create disk spool");
+        fprintf(stderr, "Rate segment %u keeps only its last %u s\n", ab->rate_segment, ab->buffer_seconds);
+        return -1;
+    }
+    audio_buffer_attach_spool(ab, spool);
+    spool_start(spool);
+    data->spool_buffers[data->num_spools++] = ab;
+    printf("Spooling %u minute(s) of rate segment %u to %s\n", data->spool_minutes, ab->rate_segment, dir);
+    return 0;
+}
+
+// Gives each of the first SPOOL_SEGMENTS rate segments its spool once it is
+// published (the main loop sizes their RAM rings for that) and keeps them
+// flushing. A spooled segment stays referenced (and readable) until exit.
+// A new segment is picked up well within its SPOOL_RAM_SECONDS ring.
+static void *spool_setup_thread(void *arg) {
+    struct data *data = (struct data *)arg;
+    uint32_t next = 0;
+    while (!atomic_load(&osc_should_exit) && next < SPOOL_SEGMENTS) {
+        audio_buffer_t *current = buffer_set_acquire(&data->buffers, -1);
+        uint32_t newest = current ? current->rate_segment + 1 : 0;
+        if (current) buffer_set_release(&data->buffers, current);
+        for (; next < newest && next < SPOOL_SEGMENTS; ++next) {
+            audio_buffer_t *ab = buffer_set_acquire(&data->buffers, next);
+            if (!ab) {
+                fprintf(stderr, "Rate segment %u was replaced before it got its disk spool\n", next);
+            } else if (start_spool(data, ab) < 0) {
+                buffer_set_release(&data->buffers, ab);
+            }
+        }
+        usleep(100 * 1000);
+    }
+    return NULL;
+}
+
+// Moves audio from the raw rings into the compressed history. Runs well
+// inside COMPRESS_RAM_SECONDS, so the ring is never lapped in practice.
+static void *compress_thread(void *arg) {
+    struct data *data = (struct data *)arg;
+    while (!atomic_load(&osc_should_exit)) {
+        audio_buffer_t *ab = buffer_set_acquire(&data->buffers, -1);
+        if (ab) {
+            audio_buffer_compress(ab);
+            buffer_set_release(&data->buffers, ab);
+        }
+        usleep(COMPRESS_INTERVAL_MS * 1000);
+    }
+    return NULL;
+}
+
+#ifdef HAVE_MICROHTTPD
+static audio_buffer_t *http_get_buffer(void *userdata, int64_t segment) {
+    struct data *data = (struct data *)userdata;
+    return buffer_set_acquire(&data->buffers, segment);
+}
+
+static void http_release_buffer(void *userdata, audio_buffer_t *ab) {
+    struct data *data = (struct data *)userdata;
+    buffer_set_release(&data->buffers, ab);
+}
+
+static size_t http_get_metrics(void *userdata, char *buf, size_t len) {
+    struct data *data = (struct data *)userdata;
+    return rt_stats_format_prometheus(&data->stats, export_queue_depth(&data->exports), buf, len);
+}
+#endif
+
+// Helper to generate REAPER-style filename, segment >= 0 adds a _segNN and
+// channel >= 0 a _chNN suffix
+static void make_reaper_filename(char *buf, size_t buflen, const struct tm *tm, int channel, int segment) {
     char dir[512];
     get_recordings_dir(dir, sizeof(dir));
-    time_t now = time(NULL);
-    struct tm tm;
-    localtime_r(&now, &tm);
-    snprintf(buf, buflen, "%s/rec%04d%02d%02d-%02d%02d%02d.wav", dir,
-        tm.tm_year+1900, tm.tm_mon+1, tm.tm_mday, tm.tm_hour, tm.tm_min, tm.tm_sec);
+    char suffix[32] = "";
+    size_t len = 0;
+    if (segment >= 0) len += (size_t)snprintf(suffix, sizeof(suffix), "_seg%02d", segment + 1);
+    if (channel >= 0) snprintf(suffix + len, sizeof(suffix) - len, "_ch%02d", channel + 1);
+    snprintf(buf, buflen, "%s/rec%04d%02d%02d-%02d%02d%02d%s.wav", dir,
+        tm->tm_year+1900, tm->tm_mon+1, tm->tm_mday, tm->tm_hour, tm->tm_min, tm->tm_sec, suffix);
 }
 
 // Helper to ensure ~/.pw-ghost-rec/recordings exists (recursively)
@@ -212,13 +830,119 @@ static void ensure_recordings_dir(void) {
     mkdir(dir, 0700); // ~/.pw-ghost-rec/recordings
 }
 
+static void print_usage(const char *name) {
+    printf("Usage: %s [-c CHANNELS] [-s] [-z] [--spool MINUTES] [--http PORT] [--ticks SECONDS] [--return] [--hugepages] [--no-mlock]\n"
+           "  -c, --channels N   number of input/output port pairs (1-%d, default 1)\n"
+           "  -s, --split        export one wav file per channel instead of one interleaved file\n"
+           "  -z, --compress     keep history losslessly compressed, roughly doubling what fits in RAM\n"
+           "      --spool MIN    keep MIN minutes of history in preallocated files under ~/%s\n"
+           "      --http PORT    serve the buffer over HTTP on PORT (default 9123, 0 disables)\n"
+           "      --ticks SEC    inject a numbered tick marker every SEC seconds while a take records\n"
+           "      --return       add return input ports and check what comes back after the network hop for glitches\n"
+           "      --hugepages    put the RAM rings on explicit huge pages (vm.nr_hugepages), transparent ones if none are free\n"
+           "      --no-mlock     do not lock the RAM rings in memory\n",
+           name, MAX_CHANNELS, SPOOL_DIR);
+}
+
+static int parse_args(struct data *data, int argc, char *argv[]) {
+    static const struct option long_options[] = {
+        {"channels", required_argument, NULL, 'c'},
+        {"split", no_argument, NULL, 's'},
+        {"compress", no_argument, NULL, 'z'},
+        {"spool", required_argument, NULL, 'S'},
+        {"http", required_argument, NULL, 'H'},
+        {"ticks", required_argument, NULL, 'T'},
+        {"return", no_argument, NULL, 'R'},
+        {"hugepages", no_argument, NULL, 'P'},
+        {"no-mlock", no_argument, NULL, 'L'},
+        {"help", no_argument, NULL, 'h'},
+        {NULL, 0, NULL, 0},
+    };
+    int c;
+    while ((c = getopt_long(argc, argv, "c:szh", long_options, NULL)) != -1) {
+        switch (c) {
+        case 'c': {
+            int n = atoi(optarg);
+            if (n < 1 || n > MAX_CHANNELS) {
+                fprintf(stderr, "Invalid channel count: %s\n", optarg);
+                return -1;
+            }
+            data->num_channels = (unsigned int)n;
+            break;
+        }
+        case 's':
+            data->split_channels = 1;
+            break;
+        case 'z':
+            data->compress = 1;
+            data->buffer_seconds = COMPRESS_RAM_SECONDS;
+            break;
+        case 'S': {
+            int n = atoi(optarg);
+            if (n < 1) {
+                fprintf(stderr, "Invalid spool length: %s\n", optarg);
+                return -1;
+            }
+            data->spool_minutes = (unsigned int)n;
+            data->buffer_seconds = SPOOL_RAM_SECONDS;
+            break;
+        }
+        case 'H': {
+            int n = atoi(optarg);
+            if (n < 0 || n > 65535) {
+                fprintf(stderr, "Invalid HTTP port: %s\n", optarg);
+                return -1;
+            }
+            data->http_port = (unsigned int)n;
+            break;
+        }
+        case 'T': {
+            double seconds = atof(optarg);
+            if (seconds < 0.1) {
+                fprintf(stderr, "Invalid tick interval: %s\n", optarg);
+                return -1;
+            }
+            data->tick_seconds = seconds;
+            break;
+        }
+        case 'R':
+            data->loopback = 1;
+            break;
+        case 'P':
+            data->memory_flags |= RT_MEMORY_HUGETLB;
+            break;
+        case 'L':
+            data->memory_flags &= ~RT_MEMORY_LOCK;
+            break;
+        case 'h':
+            print_usage(argv[0]);
+            exit(0);
+        default:
+            print_usage(argv[0]);
+            return -1;
+        }
+    }
+    return 0;
+}
+
 int main(int argc, char *argv[]) {
     struct data data;
     memset(&data, 0, sizeof(data));
+    data.num_channels = 1;
+    data.buffer_seconds = AUDIO_BUFFER_SECONDS;
+    data.http_port = 9123;
+    data.memory_flags = RT_MEMORY_PREFAULT | RT_MEMORY_LOCK | RT_MEMORY_THP;
     pw_init(&argc, &argv);
+    if (parse_args(&data, argc, argv) < 0) {
+        return -1;
+    }
+    rt_events_init(&data.events, data.tick_seconds);
     data.loop = pw_main_loop_new(NULL);
     pw_loop_add_signal(pw_main_loop_get_loop(data.loop), SIGINT, do_quit, &data);
     pw_loop_add_signal(pw_main_loop_get_loop(data.loop), SIGTERM, do_quit, &data);
+    buffer_set_init(&data.buffers);
+    pthread_mutex_init(&data.notify_lock, NULL);
+    data.rate_event = pw_loop_add_event(pw_main_loop_get_loop(data.loop), on_rate_event, &data);
     data.filter = pw_filter_new_simple(
         pw_main_loop_get_loop(data.loop),
         "pw-ghost-rec",
@@ -229,37 +953,111 @@ int main(int argc, char *argv[]) {
             NULL),
         &filter_events,
         &data);
-    data.in_port = pw_filter_add_port(data.filter,
-        PW_DIRECTION_INPUT,
-        PW_FILTER_PORT_FLAG_MAP_BUFFERS,
-        0,
-        pw_properties_new(
-            PW_KEY_FORMAT_DSP, "32 bit float mono audio",
-            PW_KEY_PORT_NAME, "input",
-            NULL),
-        NULL, 0);
-    data.out_port = pw_filter_add_port(data.filter,
-        PW_DIRECTION_OUTPUT,
-        PW_FILTER_PORT_FLAG_MAP_BUFFERS,
-        0,
-        pw_properties_new(
-            PW_KEY_FORMAT_DSP, "32 bit float mono audio",
-            PW_KEY_PORT_NAME, "output-right",
-            NULL),
-        NULL, 0);
+    for (unsigned int ch = 0; ch < data.num_channels; ++ch) {
+        // A single channel keeps the original port names so existing links still work
+        char in_name[32], out_name[32];
+        if (data.num_channels == 1) {
+            snprintf(in_name, sizeof(in_name), "input");
+            snprintf(out_name, sizeof(out_name), "output-right");
+        } else {
+            snprintf(in_name, sizeof(in_name), "input_%u", ch + 1);
+            snprintf(out_name, sizeof(out_name), "output_%u", ch + 1);
+        }
+        data.in_ports[ch] = pw_filter_add_port(data.filter,
+            PW_DIRECTION_INPUT,
+            PW_FILTER_PORT_FLAG_MAP_BUFFERS,
+            0,
+            pw_properties_new(
+                PW_KEY_FORMAT_DSP, "32 bit float mono audio",
+                PW_KEY_PORT_NAME, in_name,
+                NULL),
+            NULL, 0);
+        data.out_ports[ch] = pw_filter_add_port(data.filter,
+            PW_DIRECTION_OUTPUT,
+            PW_FILTER_PORT_FLAG_MAP_BUFFERS,
+            0,
+            pw_properties_new(
+                PW_KEY_FORMAT_DSP, "32 bit float mono audio",
+                PW_KEY_PORT_NAME, out_name,
+                NULL),
+            NULL, 0);
+        if (data.loopback) {
+            char return_name[32];
+            if (data.num_channels == 1) snprintf(return_name, sizeof(return_name), "return");
+            else snprintf(return_name, sizeof(return_name), "return_%u", ch + 1);
+            data.return_ports[ch] = pw_filter_add_port(data.filter,
+                PW_DIRECTION_INPUT,
+                PW_FILTER_PORT_FLAG_MAP_BUFFERS,
+                0,
+                pw_properties_new(
+                    PW_KEY_FORMAT_DSP, "32 bit float mono audio",
+                    PW_KEY_PORT_NAME, return_name,
+                    NULL),
+                NULL, 0);
+        }
+    }
     if (pw_filter_connect(data.filter,
             PW_FILTER_FLAG_RT_PROCESS,
             NULL, 0) < 0) {
         fprintf(stderr, "can't connect\n");
         return -1;
     }
+    export_queue_init(&data.exports);
+    pthread_create(&data.export_thread, NULL, export_thread, &data);
     pthread_t osc_thread;
     pthread_create(&osc_thread, NULL, osc_server_thread, &data);
+    if (data.spool_minutes > 0) {
+        pthread_create(&data.spool_thread, NULL, spool_setup_thread, &data);
+    }
+    if (data.compress) {
+        pthread_create(&data.compress_thread, NULL, compress_thread, &data);
+    }
+    if (data.loopback) {
+        pthread_create(&data.loopback_thread, NULL, loopback_thread, &data);
+    }
+#ifdef HAVE_MICROHTTPD
+    http_server_t http = {0};
+    if (data.http_port > 0) {
+        if (http_server_start(&http, data.http_port, http_get_buffer, http_release_buffer, http_get_metrics, &data) < 0) {
+            fprintf(stderr, "Could not start HTTP server on port %u\n", data.http_port);
+        } else {
+            printf("Serving the buffer on http://localhost:%u/buffer.wav\n", data.http_port);
+        }
+    }
+#endif
     pw_main_loop_run(data.loop);
+#ifdef HAVE_MICROHTTPD
+    http_server_stop(&http);
+#endif
     // Signal OSC thread to exit
     atomic_store(&osc_should_exit, 1);
     pthread_join(osc_thread, NULL);
+    // Stops already queued are still exported
+    export_queue_close(&data.exports);
+    pthread_join(data.export_thread, NULL);
+    export_queue_free(&data.exports);
+    if (data.compress) {
+        pthread_join(data.compress_thread, NULL);
+    }
+    if (data.loopback) {
+        pthread_join(data.loopback_thread, NULL);
+    }
+    if (data.spool_minutes > 0) {
+        pthread_join(data.spool_thread, NULL);
+        // Final flush, so the spools hold everything recorded
+        for (unsigned int i = 0; i < data.num_spools; ++i) {
+            spool_free(&data.spools[i]);
+            buffer_set_release(&data.buffers, data.spool_buffers[i]);
+        }
+    }
     pw_filter_destroy(data.filter);
+    // The RT thread is gone, nothing pushes into the monitors any more
+    for (unsigned int i = 0; i < data.num_monitors; ++i) {
+        loopback_monitor_free(data.monitors[i]);
+        free(data.monitors[i]);
+    }
+    pthread_mutex_destroy(&data.notify_lock);
+    buffer_set_free(&data.buffers);
     pw_main_loop_destroy(data.loop);
     pw_deinit();
     return 0;
@@ -1,34 +1,125 @@
 #include "ring-buffer.h"
 #include <stdlib.h>
+#include <string.h>
 
-void ringbuffer_float_init(ringbuffer_float_t *state, uint32_t size) {
+int ringbuffer_float_init_rt(ringbuffer_float_t *state, uint32_t size, unsigned int memory_flags) {
     state->size = size;
-    state->start = 0;
-    state->end = size - 1;
-    state->buffer = (float*)malloc(sizeof(float) * size);
+    state->capacity = size ? size : 1;
+    state->write_index = 0;
+    atomic_init(&state->write_pos, 0);
+    atomic_init(&state->write_claim, 0);
+    memset(&state->memory, 0, sizeof(state->memory));
+    if (memory_flags) {
+        state->buffer = (float *)rt_memory_alloc(sizeof(float) * state->capacity, memory_flags, &state->memory);
+    } else {
+        state->buffer = (float*)malloc(sizeof(float) * state->capacity);
+    }
+    return state->buffer ? 0 : -1;
+}
+
+void ringbuffer_float_init(ringbuffer_float_t *state, uint32_t size) {
+    ringbuffer_float_init_rt(state, size, 0);
 }
 
 void ringbuffer_float_free(ringbuffer_float_t *state) {
     if (state->buffer) {
-        free(state->buffer);
+        if (state->memory.bytes) {
+            rt_memory_free(state->buffer, &state->memory);
+        } else {
+            free(state->buffer);
+        }
         state->buffer = NULL;
     }
 }
 
-void ringbuffer_float_increment_pointers(ringbuffer_float_t *state) {
-    state->start = (state->start+1) % state->size;
-    state->end = (state->end+1) % state->size;
+void ringbuffer_float_write(ringbuffer_float_t *state, float *value) {
+    ringbuffer_float_write_block(state, value, 1);
 }
 
-void ringbuffer_float_write(ringbuffer_float_t *state, float *value) {
-    state->buffer[state->start] = *value;
-    ringbuffer_float_increment_pointers(state);
+static void copy_in(ringbuffer_float_t *state, uint32_t index, const float *values, uint32_t count) {
+    uint32_t first = state->capacity - index;
+    if (first > count) first = count;
+    if (!values) {
+        memset(&state->buffer[index], 0, sizeof(float) * first);
+        if (count > first) memset(state->buffer, 0, sizeof(float) * (count - first));
+        return;
+    }
+    memcpy(&state->buffer[index], values, sizeof(float) * first);
+    if (count > first) {
+        memcpy(state->buffer, values + first, sizeof(float) * (count - first));
+    }
 }
 
-void ringbuffer_float_get_value(ringbuffer_float_t *state, float *value, int32_t offset) {
-    int32_t index = state->end - offset;
-    if(index < 0){
-        index += state->size;
+// values == NULL writes silence
+static void write_block(ringbuffer_float_t *state, const float *values, uint32_t count) {
+    // Only the writer modifies the positions, so relaxed loads are enough here
+    uint64_t pos = atomic_load_explicit(&state->write_pos, memory_order_relaxed);
+    uint64_t next = pos + count;
+    uint32_t index = state->write_index;
+    if (count > state->capacity) {
+        // Only the newest capacity samples survive anyway
+        if (values) values += count - state->capacity;
+        pos = next - state->capacity;
+        count = state->capacity;
+        index = (uint32_t)(pos % state->capacity);
     }
+    atomic_store_explicit(&state->write_claim, next, memory_order_relaxed);
+    // Order the claim before the sample stores, as in a seqlock
+    atomic_thread_fence(memory_order_release);
+    copy_in(state, index, values, count);
+    // count <= capacity, so one subtraction wraps it
+    index += count;
+    if (index >= state->capacity) index -= state->capacity;
+    state->write_index = index;
+    atomic_store_explicit(&state->write_pos, next, memory_order_release);
+}
+
+void ringbuffer_float_write_block(ringbuffer_float_t *state, const float *values, uint32_t count) {
+    write_block(state, values, count);
+}
+
+void ringbuffer_float_write_silence(ringbuffer_float_t *state, uint32_t count) {
+    write_block(state, NULL, count);
+}
+
+uint64_t ringbuffer_float_write_position(const ringbuffer_float_t *state) {
+    return atomic_load_explicit(&((ringbuffer_float_t *)state)->write_pos, memory_order_acquire);
+}
+
+static void copy_out(const ringbuffer_float_t *state, float *values, uint32_t index, uint32_t count) {
+    while (count > 0) {
+        uint32_t span = state->capacity - index;
+        if (span > count) span = count;
+        memcpy(values, &state->buffer[index], sizeof(float) * span);
+        values += span;
+        count -= span;
+        index += span;
+        if (index >= state->capacity) index -= state->capacity;
+    }
+}
+
+int ringbuffer_float_read(const ringbuffer_float_t *state, float *values, uint64_t position, uint32_t count) {
+    ringbuffer_float_t *rb = (ringbuffer_float_t *)state;
+    if (count > state->capacity) return -1;
+    uint64_t pos = atomic_load_explicit(&rb->write_pos, memory_order_acquire);
+    if (position + count > pos) return -1;
+    if (pos - position > state->capacity) return -1;
+    copy_out(state, values, (uint32_t)(position % state->capacity), count);
+    // Any sample store we may have observed happened after the writer's
+    // claim, so re-reading the claim tells us whether the copy is intact
+    atomic_thread_fence(memory_order_acquire);
+    uint64_t claim = atomic_load_explicit(&rb->write_claim, memory_order_relaxed);
+    if (claim - position > state->capacity) return -1;
+    return 0;
+}
+
+void ringbuffer_float_get_value(ringbuffer_float_t *state, float *value, int32_t offset) {
+    uint64_t last = ringbuffer_float_write_position(state) - 1;
+    uint32_t index = (uint32_t)((last - (uint64_t)(int64_t)offset) % state->capacity);
     *value = state->buffer[index];
-}
\ No newline at end of file
+}
+
+void ringbuffer_float_read_block(const ringbuffer_float_t *state, float *values, uint32_t offset, uint32_t count) {
+    uint64_t last = ringbuffer_float_write_position(state) - 1;
+    copy_out(state, values, (uint32_t)((last - offset) % state->capacity), count);
+}
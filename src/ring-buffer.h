@@ -1,26 +1,56 @@
 #ifndef RING_BUFFER
 #define RING_BUFFER
 
+#include <stdatomic.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include "rt-memory.h"
 
+// Single-producer ring buffer. The writer (the RT thread) never blocks: it
+// claims the range it is about to overwrite, copies the samples and then
+// publishes the new write position. Readers copy by absolute sample index
+// and re-check the claim afterwards to detect samples overwritten mid-copy.
 typedef struct {
     float *buffer;
-    uint32_t start;
-    uint32_t end;
-    uint32_t size;
+    uint32_t size;     // Requested history length in samples
+    uint32_t capacity; // Allocated length: size, at least 1. Not rounded up, the ring is
+                       // prefaulted and locked, so every sample of slack is resident
+    uint32_t write_index; // write_pos % capacity, kept by the writer with a compare and subtract
+    _Atomic uint64_t write_pos;   // Total samples written and published
+    _Atomic uint64_t write_claim; // write_pos plus the block currently being copied in
+    rt_memory_t memory;           // How buffer was mapped, memory.bytes is 0 if it was malloced
 } ringbuffer_float_t;
 
 void ringbuffer_float_init(ringbuffer_float_t *state, uint32_t size);
 
-void ringbuffer_float_free(ringbuffer_float_t *state);
+// Same, but the samples live in an rt_memory mapping set up with
+// memory_flags (RT_MEMORY_*), so the writer never faults on them. 0 is the
+// same as ringbuffer_float_init. Returns -1 if the allocation failed.
+int ringbuffer_float_init_rt(ringbuffer_float_t *state, uint32_t size, unsigned int memory_flags);
 
-void ringbuffer_float_increment_pointers(ringbuffer_float_t *state);
+void ringbuffer_float_free(ringbuffer_float_t *state);
 
 void ringbuffer_float_write(ringbuffer_float_t *state, float *value);
 
+// Write count samples with at most two memcpy spans (split at the wrap point)
+void ringbuffer_float_write_block(ringbuffer_float_t *state, const float *values, uint32_t count);
+
+// Same as write_block, but writes count zero samples
+void ringbuffer_float_write_silence(ringbuffer_float_t *state, uint32_t count);
+
+// Total number of samples written so far, i.e. the absolute index of the next sample
+uint64_t ringbuffer_float_write_position(const ringbuffer_float_t *state);
+
+// Copy count samples starting at absolute sample index position.
+// Returns 0 on success, -1 if the range was not written yet or has been
+// (possibly partially, while copying) overwritten by the writer.
+int ringbuffer_float_read(const ringbuffer_float_t *state, float *values, uint64_t position, uint32_t count);
+
 void ringbuffer_float_get_value(ringbuffer_float_t *state, float *value, int32_t offset);
 
+// Read count samples forward in time, starting offset samples before the most recent one
+void ringbuffer_float_read_block(const ringbuffer_float_t *state, float *values, uint32_t offset, uint32_t count);
+
 
 #endif /* RING_BUFFER */
@@ -0,0 +1,149 @@
+#include "rt-events.h"
+#include <string.h>
+
+void rt_events_init(rt_events_t *ev, double tick_seconds) {
+    memset(ev, 0, sizeof(*ev));
+    atomic_init(&ev->head, 0);
+    atomic_init(&ev->tail, 0);
+    atomic_init(&ev->late, 0);
+    ev->tick_seconds = tick_seconds;
+}
+
+int rt_events_push(rt_events_t *ev, const rt_event_t *event) {
+    uint32_t tail = atomic_load_explicit(&ev->tail, memory_order_relaxed);
+    uint32_t head = atomic_load_explicit(&ev->head, memory_order_acquire);
+    if (tail - head >= RT_EVENTS_CAPACITY) return -1;
+    ev->ring[tail % RT_EVENTS_CAPACITY] = *event;
+    atomic_store_explicit(&ev->tail, tail + 1, memory_order_release);
+    return 0;
+}
+
+// Frame of ab an event is due on, frame being the first of this quantum
+static uint64_t resolve(rt_events_t *ev, const rt_event_t *e, uint64_t frame, uint64_t nsec, uint32_t rate) {
+    int64_t target = (int64_t)frame;
+    if (e->clock == RT_EVENT_AT_FRAME) {
+        target = e->at;
+    } else if (e->clock == RT_EVENT_AT_NSEC) {
+        int64_t delta = e->at - (int64_t)nsec;
+        // Rounded to the nearest frame; delta * rate stays in range for days
+        int64_t frames = (delta * (int64_t)rate + (delta < 0 ? -500000000 : 500000000)) / 1000000000;
+        target = (int64_t)frame + frames;
+    }
+    if (target < (int64_t)frame) {
+        atomic_fetch_add_explicit(&ev->late, 1, memory_order_relaxed);
+        return frame;
+    }
+    return (uint64_t)target;
+}
+
+// Move queued events into the pending list, in frame order; ties keep
+// the order they were queued in
+static void collect(rt_events_t *ev, const audio_buffer_t *ab, uint64_t frame, uint64_t nsec) {
+    if (ev->resolved_for != ab) {
+        // Frames of another rate segment mean nothing here, place them now
+        for (uint32_t i = 0; i < ev->num_pending; ++i) ev->pending[i].at = (int64_t)frame;
+        ev->resolved_for = ab;
+    }
+    uint32_t head = atomic_load_explicit(&ev->head, memory_order_relaxed);
+    uint32_t tail = atomic_load_explicit(&ev->tail, memory_order_acquire);
+    for (; head != tail && ev->num_pending < RT_EVENTS_CAPACITY; ++head) {
+        rt_event_t e = ev->ring[head % RT_EVENTS_CAPACITY];
+        e.at = (int64_t)resolve(ev, &e, frame, nsec, ab->sample_rate);
+        uint32_t i = ev->num_pending++;
+        for (; i > 0 && ev->pending[i - 1].at > e.at; --i) ev->pending[i] = ev->pending[i - 1];
+        ev->pending[i] = e;
+    }
+    atomic_store_explicit(&ev->head, head, memory_order_release);
+}
+
+// Push frames [offset, offset + n) of the quantum, marked at their first frame
+static void push_piece(audio_buffer_t *ab, float **samples, uint32_t offset, uint32_t n, int marked, uint32_t type,
+                       uint64_t mask, uint32_t sequence) {
+    float *piece[RT_EVENTS_MAX_CHANNELS];
+    for (unsigned int ch = 0; ch < ab->num_channels && ch < RT_EVENTS_MAX_CHANNELS; ++ch) {
+        piece[ch] = samples[ch] ? samples[ch] + offset : NULL;
+    }
+    if (!marked) audio_buffer_push_frames(ab, piece, (int)n, 0);
+    else if (type == MARKER_TICK) audio_buffer_push_frames_tick(ab, piece, (int)n, sequence);
+    else audio_buffer_push_frames_marked(ab, piece, (int)n, (marker_type_t)type, mask);
+}
+
+void rt_events_process(rt_events_t *ev, audio_buffer_t *ab, float **samples, uint32_t n, uint64_t nsec, int recording) {
+    uint64_t frame = audio_buffer_write_position(ab);
+    uint64_t end = frame + n;
+    collect(ev, ab, frame, nsec);
+    uint64_t tick_frames = (uint64_t)(ev->tick_seconds * ab->sample_rate);
+    if (!recording || tick_frames == 0) ev->tick_sequence = 0;
+
+    // The next marker may start at cursor, after the one before it ended
+    uint64_t cursor = frame;
+    if (ev->carry_length) {
+        uint32_t k = ev->carry_length < n ? ev->carry_length : n;
+        for (unsigned int ch = 0; ch < ab->num_channels; ++ch) {
+            if (samples[ch] && ch < RT_EVENTS_MAX_CHANNELS && (ev->carry_mask >> ch) & 1) memcpy(samples[ch], ev->carry, sizeof(float) * k);
+        }
+        ev->carry_length -= k;
+        memmove(ev->carry, ev->carry + k, sizeof(float) * ev->carry_length);
+        cursor = frame + k;
+    }
+
+    uint32_t start = 0;
+    int marked = 0;
+    uint32_t type = 0, sequence = 0;
+    uint64_t mask = 0;
+    for (;;) {
+        // Whichever is due first: the next event or the next tick
+        uint64_t at = end;
+        int next = 0;
+        if (ev->num_pending) {
+            uint64_t f = (uint64_t)ev->pending[0].at > cursor ? (uint64_t)ev->pending[0].at : cursor;
+            if (f < at) {
+                at = f;
+                next = 1;
+            }
+        }
+        if (ev->tick_sequence) {
+            uint64_t f = ev->next_tick > cursor ? ev->next_tick : cursor;
+            if (f < at) {
+                at = f;
+                next = 2;
+            }
+        }
+        uint32_t stop = (uint32_t)(at - frame);
+        if (stop > start) push_piece(ab, samples, start, stop - start, marked, type, mask, sequence);
+        if (!next) break;
+
+        const float *pattern;
+        uint32_t length;
+        if (next == 1) {
+            rt_event_t e = ev->pending[0];
+            memmove(ev->pending, ev->pending + 1, sizeof(rt_event_t) * --ev->num_pending);
+            type = e.type;
+            mask = e.channel_mask;
+            pattern = sync_marker_pattern_for(type);
+            length = SYNC_MARKER_LENGTH;
+            // Ticks count from the record start marker
+            if (type == MARKER_RECORD_START && recording && tick_frames) {
+                ev->tick_sequence = 1;
+                ev->next_tick = at + tick_frames;
+            }
+        } else {
+            type = MARKER_TICK;
+            mask = AUDIO_BUFFER_ALL_CHANNELS;
+            sequence = ev->tick_sequence++;
+            sync_marker_tick(sequence, ev->tick);
+            pattern = ev->tick;
+            length = SYNC_MARKER_TICK_LENGTH;
+            ev->next_tick += tick_frames;
+        }
+        start = stop;
+        marked = 1;
+        cursor = at + length;
+        if (cursor > end && pattern) {
+            // The next quantum starts with the rest of it
+            ev->carry_length = (uint32_t)(cursor - end);
+            memcpy(ev->carry, pattern + (end - at), sizeof(float) * ev->carry_length);
+            ev->carry_mask = mask;
+        }
+    }
+}
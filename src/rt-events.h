@@ -0,0 +1,68 @@
+#ifndef RT_EVENTS
+#define RT_EVENTS
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include "audio-buffer.h"
+#include "sync-marker.h"
+
+// Markers scheduled by the control thread and placed by the RT thread on
+// the exact frame they are due, anywhere inside a quantum. Events travel
+// through a lock-free single producer, single consumer ring (the OSC server
+// thread is the only producer). The RT thread moves them into a pending
+// list sorted by frame, and pushes each quantum in pieces that start on the
+// events due in it, so one quantum can carry several markers. Tick markers
+// (sync-marker.h) are scheduled here too, counted from each record start.
+
+#define RT_EVENTS_CAPACITY 64
+#define RT_EVENTS_MAX_CHANNELS 64
+
+// What rt_event_t.at counts in
+enum {
+    RT_EVENT_NOW = 0,      // First frame of the next quantum, at is ignored
+    RT_EVENT_AT_FRAME = 1, // Absolute frame of the current audio buffer
+    RT_EVENT_AT_NSEC = 2,  // CLOCK_MONOTONIC ns, mapped through the graph clock
+};
+
+typedef struct {
+    uint32_t type;         // marker_type_t, not MARKER_TICK
+    uint32_t clock;        // RT_EVENT_*
+    int64_t at;
+    uint64_t channel_mask; // Channels the marker goes on
+} rt_event_t;
+
+typedef struct {
+    // Control thread to RT thread
+    rt_event_t ring[RT_EVENTS_CAPACITY];
+    _Atomic uint32_t head;      // Next slot the RT thread reads
+    _Atomic uint32_t tail;      // Next slot the control thread writes
+    _Atomic uint64_t late;      // Events whose frame had already passed when they arrived
+    // RT thread only
+    rt_event_t pending[RT_EVENTS_CAPACITY]; // at is a frame of resolved_for, sorted
+    uint32_t num_pending;
+    const audio_buffer_t *resolved_for;
+    double tick_seconds;        // 0 for no ticks
+    uint32_t tick_sequence;     // Next tick number, 0 while not ticking
+    uint64_t next_tick;
+    float tick[SYNC_MARKER_TICK_LENGTH];
+    // Rest of a marker that ran past the end of the last quantum
+    float carry[SYNC_MARKER_TICK_LENGTH];
+    uint32_t carry_length;
+    uint64_t carry_mask;
+} rt_events_t;
+
+// tick_seconds apart ticks follow every record start while recording, 0 disables them
+void rt_events_init(rt_events_t *ev, double tick_seconds);
+
+// Control thread: queue event. 0, or -1 if the ring is full.
+int rt_events_push(rt_events_t *ev, const rt_event_t *event);
+
+// RT thread: push the quantum of n frames in samples (planar, NULL channels
+// are silence) into ab with every marker due in it injected in place on its
+// frame. nsec is the graph clock time of the quantum's first frame
+// (spa_io_position clock.nsec). Markers are never closer together than
+// their length; one due too early waits for the previous to end. Ticks stop
+// while recording is 0.
+void rt_events_process(rt_events_t *ev, audio_buffer_t *ab, float **samples, uint32_t n, uint64_t nsec, int recording);
+
+#endif /* RT_EVENTS */
@@ -0,0 +1,94 @@
+#include "rt-memory.h"
+#include <sys/mman.h>
+#include <unistd.h>
+
+static size_t page_size(void) {
+    long size = sysconf(_SC_PAGESIZE);
+    return size > 0 ? (size_t)size : 4096;
+}
+
+static size_t round_up(size_t bytes, size_t to) {
+    return (bytes + to - 1) / to * to;
+}
+
+// Write to every page so the kernel hands out (and zeroes) them now
+static void touch_pages(void *ptr, size_t bytes, size_t step) {
+    volatile uint8_t *p = (volatile uint8_t *)ptr;
+    for (size_t i = 0; i < bytes; i += step) p[i] = p[i];
+    if (bytes > 0) p[bytes - 1] = p[bytes - 1];
+}
+
+static void lock_pages(void *ptr, size_t bytes, rt_memory_t *info) {
+    if (mlock(ptr, bytes) == 0) {
+        info->locked = bytes;
+        info->got |= RT_MEMORY_LOCK;
+    }
+}
+
+void *rt_memory_alloc(size_t bytes, unsigned int flags, rt_memory_t *info) {
+    info->bytes = 0;
+    info->locked = 0;
+    info->got = 0;
+    if (bytes == 0) bytes = 1;
+    void *ptr = MAP_FAILED;
+#ifdef MAP_HUGETLB
+    if (flags & RT_MEMORY_HUGETLB) {
+        size_t huge = round_up(bytes, RT_MEMORY_HUGE_PAGE_BYTES);
+        // MAP_POPULATE takes the huge pages from the pool now; fails if it is too small
+        ptr = mmap(NULL, huge, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | MAP_POPULATE, -1, 0);
+        if (ptr != MAP_FAILED) {
+            info->bytes = huge;
+            info->got |= RT_MEMORY_HUGETLB | RT_MEMORY_PREFAULT;
+        }
+    }
+#endif
+    if (ptr == MAP_FAILED) {
+        if (flags & RT_MEMORY_HUGETLB) flags |= RT_MEMORY_THP;
+        size_t mapped = round_up(bytes, (flags & RT_MEMORY_THP) ? RT_MEMORY_HUGE_PAGE_BYTES : page_size());
+        ptr = mmap(NULL, mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (ptr == MAP_FAILED) return NULL;
+        info->bytes = mapped;
+#ifdef MADV_HUGEPAGE
+        // Before the first touch, so the faults below already get huge pages
+        if ((flags & RT_MEMORY_THP) && madvise(ptr, mapped, MADV_HUGEPAGE) == 0) info->got |= RT_MEMORY_THP;
+#endif
+        if (flags & RT_MEMORY_PREFAULT) {
+            touch_pages(ptr, mapped, page_size());
+            info->got |= RT_MEMORY_PREFAULT;
+        }
+    }
+    if (flags & RT_MEMORY_LOCK) lock_pages(ptr, info->bytes, info);
+    return ptr;
+}
+
+void rt_memory_free(void *ptr, const rt_memory_t *info) {
+    if (!ptr) return;
+    if (info->locked) munlock(ptr, info->locked);
+    munmap(ptr, info->bytes);
+}
+
+void rt_memory_prepare(void *ptr, size_t bytes, unsigned int flags, rt_memory_t *info) {
+    info->bytes = bytes;
+    info->locked = 0;
+    info->got = 0;
+    if (!ptr || bytes == 0) return;
+    if (flags & RT_MEMORY_PREFAULT) {
+        touch_pages(ptr, bytes, page_size());
+        info->got |= RT_MEMORY_PREFAULT;
+    }
+    if (flags & RT_MEMORY_LOCK) lock_pages(ptr, bytes, info);
+}
+
+size_t rt_memory_resident_pages(const void *ptr, size_t bytes) {
+    size_t page = page_size();
+    uintptr_t start = (uintptr_t)ptr / page * page;
+    size_t pages = ((uintptr_t)ptr + bytes - start + page - 1) / page;
+    size_t resident = 0;
+    unsigned char vec[256];
+    for (size_t done = 0; done < pages; done += sizeof(vec)) {
+        size_t n = pages - done < sizeof(vec) ? pages - done : sizeof(vec);
+        if (mincore((void *)(start + done * page), n * page, vec) < 0) break;
+        for (size_t i = 0; i < n; ++i) resident += vec[i] & 1;
+    }
+    return resident;
+}
@@ -0,0 +1,39 @@
+#ifndef RT_MEMORY
+#define RT_MEMORY
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Memory the RT thread writes into must not page fault: a 30 minute ring is
+// hundreds of MB per channel, and faulting it in lazily means a minor fault
+// (a zeroed page from the kernel) in the audio thread every 4 KiB for the
+// whole first pass. These helpers allocate and fault it in up front, from a
+// non-RT thread, and optionally pin it and back it with huge pages.
+
+#define RT_MEMORY_PREFAULT 1u // Touch every page before returning
+#define RT_MEMORY_LOCK 2u     // mlock, so the pages are never swapped out or reclaimed
+#define RT_MEMORY_THP 4u      // Ask for transparent huge pages (madvise)
+#define RT_MEMORY_HUGETLB 8u  // Explicit huge pages from the hugetlbfs pool, THP if none are free
+
+#define RT_MEMORY_HUGE_PAGE_BYTES (2u * 1024 * 1024)
+
+typedef struct {
+    size_t bytes;     // Mapped, rounded up to whole (huge) pages
+    size_t locked;    // Bytes that mlock succeeded on
+    unsigned int got; // The RT_MEMORY_* flags that took effect
+} rt_memory_t;
+
+// Anonymous zeroed mapping of at least bytes. Flags that cannot be honored
+// (no huge pages, RLIMIT_MEMLOCK too low) are dropped from info->got rather
+// than failing the allocation. Returns NULL only if the mapping fails.
+void *rt_memory_alloc(size_t bytes, unsigned int flags, rt_memory_t *info);
+void rt_memory_free(void *ptr, const rt_memory_t *info);
+
+// Fault in and optionally lock memory allocated elsewhere, keeping its
+// contents. Only RT_MEMORY_PREFAULT and RT_MEMORY_LOCK apply.
+void rt_memory_prepare(void *ptr, size_t bytes, unsigned int flags, rt_memory_t *info);
+
+// Pages of [ptr, ptr + bytes) currently resident, from mincore
+size_t rt_memory_resident_pages(const void *ptr, size_t bytes);
+
+#endif /* RT_MEMORY */
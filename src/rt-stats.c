@@ -0,0 +1,157 @@
+#include "rt-stats.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include <time.h>
+
+#define SUB_BUCKETS (1u << RT_HISTOGRAM_SUB_BITS)
+// Bucket bounds of the ns histograms in the Prometheus output: 2^10 ns (~1 us) to 2^38 ns (~4.6 min)
+#define PROMETHEUS_NS_FIRST_BIT 10
+#define PROMETHEUS_NS_LAST_BIT 38
+
+uint64_t rt_stats_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+uint32_t rt_histogram_bucket(uint64_t value) {
+    if (value < SUB_BUCKETS) return (uint32_t)value;
+    if (value >> RT_HISTOGRAM_MAX_BITS) return RT_HISTOGRAM_BUCKETS - 1;
+    uint32_t bit = 63 - (uint32_t)__builtin_clzll(value);
+    uint32_t shift = bit - RT_HISTOGRAM_SUB_BITS;
+    return ((bit - RT_HISTOGRAM_SUB_BITS + 1) << RT_HISTOGRAM_SUB_BITS) + (uint32_t)((value >> shift) - SUB_BUCKETS);
+}
+
+uint64_t rt_histogram_bucket_max(uint32_t index) {
+    if (index < SUB_BUCKETS) return index;
+    uint32_t shift = (index >> RT_HISTOGRAM_SUB_BITS) - 1;
+    uint64_t lower = (uint64_t)(SUB_BUCKETS + (index & (SUB_BUCKETS - 1))) << shift;
+    return lower + (1ull << shift) - 1;
+}
+
+static inline void store_add(_Atomic uint64_t *v, uint64_t n) {
+    atomic_store_explicit(v, atomic_load_explicit(v, memory_order_relaxed) + n, memory_order_relaxed);
+}
+
+void rt_histogram_record(rt_histogram_t *h, uint64_t value) {
+    store_add(&h->counts[rt_histogram_bucket(value)], 1);
+    store_add(&h->sum, value);
+    if (value > atomic_load_explicit(&h->max, memory_order_relaxed)) {
+        atomic_store_explicit(&h->max, value, memory_order_relaxed);
+    }
+    // Last, so a reader never sees more values than bucket counts
+    store_add(&h->total, 1);
+}
+
+uint64_t rt_histogram_quantile(const rt_histogram_t *h, double q) {
+    uint64_t total = atomic_load_explicit(&h->total, memory_order_relaxed);
+    if (total == 0) return 0;
+    uint64_t rank = (uint64_t)(q * (double)total + 0.5);
+    if (rank < 1) rank = 1;
+    if (rank > total) rank = total;
+    uint64_t max = atomic_load_explicit(&h->max, memory_order_relaxed);
+    uint64_t seen = 0;
+    for (uint32_t i = 0; i < RT_HISTOGRAM_BUCKETS; ++i) {
+        seen += atomic_load_explicit(&h->counts[i], memory_order_relaxed);
+        if (seen >= rank) {
+            uint64_t bound = rt_histogram_bucket_max(i);
+            return bound < max ? bound : max;
+        }
+    }
+    return max;
+}
+
+uint64_t rt_histogram_count_below(const rt_histogram_t *h, uint64_t limit) {
+    uint64_t count = 0;
+    for (uint32_t i = 0; i < RT_HISTOGRAM_BUCKETS && rt_histogram_bucket_max(i) < limit; ++i) {
+        count += atomic_load_explicit(&h->counts[i], memory_order_relaxed);
+    }
+    return count;
+}
+
+void rt_stats_record_callback(rt_stats_t *s, uint64_t callback_ns, uint64_t quantum_ns, uint32_t frames, int pushed) {
+    rt_histogram_record(&s->callback_ns, callback_ns);
+    if (quantum_ns > 0) {
+        rt_histogram_record(&s->load, (callback_ns << 10) / quantum_ns);
+        atomic_store_explicit(&s->quantum_ns, quantum_ns, memory_order_relaxed);
+        if (callback_ns > quantum_ns) rt_counter_add(&s->overruns, 1);
+    }
+    rt_counter_add(&s->callbacks, 1);
+    if (pushed) rt_counter_add(&s->frames_captured, frames);
+}
+
+typedef struct {
+    char *buf;
+    size_t len;
+    size_t pos;
+} text_t;
+
+static void appendf(text_t *t, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+static void appendf(text_t *t, const char *fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    size_t room = t->pos < t->len ? t->len - t->pos : 0;
+    int n = vsnprintf(room ? t->buf + t->pos : NULL, room, fmt, ap);
+    va_end(ap);
+    if (n > 0) t->pos += (size_t)n;
+}
+
+static void counter(text_t *t, const char *name, const char *help, uint64_t value) {
+    appendf(t, "# HELP %s %s\n# TYPE %s counter\n%s %llu\n", name, help, name, name, (unsigned long long)value);
+}
+
+static void gauge(text_t *t, const char *name, const char *help, double value) {
+    appendf(t, "# HELP %s %s\n# TYPE %s gauge\n%s %.9g\n", name, help, name, name, value);
+}
+
+// A histogram of ns values, exposed in seconds like Prometheus expects
+static void ns_histogram(text_t *t, const char *name, const char *help, const rt_histogram_t *h) {
+    uint64_t total = atomic_load_explicit(&h->total, memory_order_relaxed);
+    appendf(t, "# HELP %s %s\n# TYPE %s histogram\n", name, help, name);
+    for (int bit = PROMETHEUS_NS_FIRST_BIT; bit <= PROMETHEUS_NS_LAST_BIT; ++bit) {
+        uint64_t limit = 1ull << bit;
+        appendf(t, "%s_bucket{le=\"%.9g\"} %llu\n", name, (double)limit * 1e-9,
+            (unsigned long long)rt_histogram_count_below(h, limit));
+    }
+    appendf(t, "%s_bucket{le=\"+Inf\"} %llu\n", name, (unsigned long long)total);
+    appendf(t, "%s_sum %.9g\n", name, (double)atomic_load_explicit(&h->sum, memory_order_relaxed) * 1e-9);
+    appendf(t, "%s_count %llu\n", name, (unsigned long long)total);
+}
+
+size_t rt_stats_format_prometheus(const rt_stats_t *s, unsigned int queue_depth, char *buf, size_t len) {
+    text_t t = {buf, len, 0};
+    if (len > 0) buf[0] = '\0';
+    ns_histogram(&t, "pwghost_callback_seconds", "Time spent in the PipeWire process callback", &s->callback_ns);
+
+    // Load in 1/1024ths of the quantum, so the bounds fall on bucket edges
+    static const uint64_t load_bounds[] = {64, 128, 256, 512, 768, 896, 1024, 1536, 2048, 4096};
+    uint64_t total = atomic_load_explicit(&s->load.total, memory_order_relaxed);
+    appendf(&t, "# HELP pwghost_callback_load Callback time as a fraction of the quantum\n# TYPE pwghost_callback_load histogram\n");
+    for (size_t i = 0; i < sizeof(load_bounds) / sizeof(load_bounds[0]); ++i) {
+        appendf(&t, "pwghost_callback_load_bucket{le=\"%g\"} %llu\n", (double)load_bounds[i] / 1024.0,
+            (unsigned long long)rt_histogram_count_below(&s->load, load_bounds[i]));
+    }
+    appendf(&t, "pwghost_callback_load_bucket{le=\"+Inf\"} %llu\n", (unsigned long long)total);
+    appendf(&t, "pwghost_callback_load_sum %.9g\n", (double)atomic_load_explicit(&s->load.sum, memory_order_relaxed) / 1024.0);
+    appendf(&t, "pwghost_callback_load_count %llu\n", (unsigned long long)total);
+
+    gauge(&t, "pwghost_callback_max_seconds", "Longest callback so far",
+        (double)atomic_load_explicit(&s->callback_ns.max, memory_order_relaxed) * 1e-9);
+    gauge(&t, "pwghost_quantum_seconds", "Duration of the last quantum",
+        (double)atomic_load_explicit(&s->quantum_ns, memory_order_relaxed) * 1e-9);
+    counter(&t, "pwghost_callbacks_total", "Process callbacks", rt_counter_get(&s->callbacks));
+    counter(&t, "pwghost_overruns_total", "Callbacks that took longer than their quantum", rt_counter_get(&s->overruns));
+    counter(&t, "pwghost_frames_captured_total", "Frames pushed into the buffer", rt_counter_get(&s->frames_captured));
+    counter(&t, "pwghost_skipped_pushes_total", "Callbacks with input that could not be pushed", rt_counter_get(&s->skipped_pushes));
+    ns_histogram(&t, "pwghost_stop_wait_seconds", "Time to queue a record stop, lock wait included", &s->stop_wait_ns);
+    ns_histogram(&t, "pwghost_export_seconds", "From a record stop to its files being ready", &s->export_ns);
+    gauge(&t, "pwghost_export_queue_depth", "Record stops waiting for the export worker", (double)queue_depth);
+    counter(&t, "pwghost_exports_total", "Takes exported", rt_counter_get(&s->exports));
+    counter(&t, "pwghost_export_files_total", "Files saved", rt_counter_get(&s->export_files));
+    counter(&t, "pwghost_export_errors_total", "Files that could not be saved", rt_counter_get(&s->export_errors));
+    counter(&t, "pwghost_bytes_written_total", "Sample data bytes saved", rt_counter_get(&s->bytes_written));
+    counter(&t, "pwghost_loopback_glitches_total", "Glitches found in the return stream", rt_counter_get(&s->loopback_glitches));
+    counter(&t, "pwghost_loopback_glitch_frames_total", "Frames covered by return stream glitches",
+        rt_counter_get(&s->loopback_glitch_frames));
+    return t.pos;
+}
@@ -0,0 +1,79 @@
+#ifndef RT_STATS
+#define RT_STATS
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Counters and log-linear (HDR style) histograms for the RT callback and
+// the export path. Every counter and histogram has a single writer thread,
+// which updates it with relaxed loads and stores: no locks, no read-modify-
+// write, no syscalls (CLOCK_MONOTONIC is read through the vDSO). Readers on
+// other threads see consistent enough values for monitoring.
+
+// Values below 2^RT_HISTOGRAM_SUB_BITS are exact, above that every power
+// of two is split into 2^RT_HISTOGRAM_SUB_BITS buckets (about 6% wide)
+#define RT_HISTOGRAM_SUB_BITS 4
+#define RT_HISTOGRAM_MAX_BITS 48
+#define RT_HISTOGRAM_BUCKETS ((RT_HISTOGRAM_MAX_BITS - RT_HISTOGRAM_SUB_BITS + 1) << RT_HISTOGRAM_SUB_BITS)
+
+typedef struct {
+    _Atomic uint64_t counts[RT_HISTOGRAM_BUCKETS];
+    _Atomic uint64_t total;
+    _Atomic uint64_t sum;
+    _Atomic uint64_t max;
+} rt_histogram_t;
+
+typedef struct {
+    _Atomic uint64_t value;
+} rt_counter_t;
+
+typedef struct {
+    // Written by the RT thread
+    rt_histogram_t callback_ns;     // Time spent in on_process
+    rt_histogram_t load;            // Callback time per quantum time, in 1/1024ths
+    rt_counter_t callbacks;
+    rt_counter_t overruns;          // Callbacks that took longer than their quantum
+    rt_counter_t frames_captured;
+    rt_counter_t skipped_pushes;    // Callbacks with input that could not be pushed yet
+    _Atomic uint64_t quantum_ns;    // Duration of the last quantum
+    // Written by the OSC thread
+    rt_histogram_t stop_wait_ns;    // Queuing a stop, including the lock wait
+    // Written by the export worker
+    rt_histogram_t export_ns;       // From the stop to the files being ready
+    rt_counter_t exports;
+    rt_counter_t export_files;
+    rt_counter_t export_errors;
+    rt_counter_t bytes_written;
+    // Written by the loopback thread
+    rt_counter_t loopback_glitches;      // Glitches found in the return stream
+    rt_counter_t loopback_glitch_frames; // Capture frames they cover
+} rt_stats_t;
+
+uint64_t rt_stats_now_ns(void);
+
+void rt_histogram_record(rt_histogram_t *h, uint64_t value);
+// Upper bound of the bucket holding quantile q (0..1), at most the max
+uint64_t rt_histogram_quantile(const rt_histogram_t *h, double q);
+// Values recorded below limit; exact when limit is a power of two
+uint64_t rt_histogram_count_below(const rt_histogram_t *h, uint64_t limit);
+uint32_t rt_histogram_bucket(uint64_t value);
+// Largest value that lands in bucket index
+uint64_t rt_histogram_bucket_max(uint32_t index);
+
+static inline void rt_counter_add(rt_counter_t *c, uint64_t n) {
+    atomic_store_explicit(&c->value, atomic_load_explicit(&c->value, memory_order_relaxed) + n, memory_order_relaxed);
+}
+
+static inline uint64_t rt_counter_get(const rt_counter_t *c) {
+    return atomic_load_explicit(&c->value, memory_order_relaxed);
+}
+
+// Called by the RT thread at the end of each callback
+void rt_stats_record_callback(rt_stats_t *s, uint64_t callback_ns, uint64_t quantum_ns, uint32_t frames, int pushed);
+
+// Prometheus text exposition format. Like snprintf, returns the length the
+// whole text needs and truncates it to fit len.
+size_t rt_stats_format_prometheus(const rt_stats_t *s, unsigned int queue_depth, char *buf, size_t len);
+
+#endif /* RT_STATS */
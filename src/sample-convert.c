@@ -0,0 +1,445 @@
+#include "sample-convert.h"
+#include <math.h>
+#include <pthread.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define HAVE_X86 1
+#include <immintrin.h>
+#endif
+
+#if defined(__aarch64__) && defined(__ARM_NEON)
+#define HAVE_NEON 1
+#include <arm_neon.h>
+#endif
+
+#define PCM24_SCALE 8388607.0f
+#define PCM16_SCALE 32767.0f
+#define SOFT_CLAMP 0.99f
+
+typedef struct {
+    void (*clamp)(float *samples, size_t count);
+    void (*to_pcm24)(const float *in, uint8_t *out, size_t count);
+    void (*to_pcm16)(const float *in, int16_t *out, size_t count, sample_convert_dither_t *dither);
+    sample_convert_isa_t isa;
+} kernels_t;
+
+// Scalar kernels, also used for the tails of the vector loops. The saturation
+// and rounding steps mirror minps/maxps/cvtps2dq exactly, NaN included.
+
+static inline float saturate(float x) {
+    x = x < 1.0f ? x : 1.0f;
+    return x > -1.0f ? x : -1.0f;
+}
+
+static inline uint32_t xorshift(uint32_t r) {
+    r ^= r << 13;
+    r ^= r >> 17;
+    r ^= r << 5;
+    return r;
+}
+
+// Sum of two 16 bit uniforms, in LSB: triangular over (-1, 1)
+static inline float tpdf(uint32_t r) {
+    return (float)((int32_t)(r & 0xFFFF) + (int32_t)(r >> 16) - 65535) * (1.0f / 65536.0f);
+}
+
+static inline void put_pcm24(uint8_t *out, int32_t v) {
+    out[0] = (uint8_t)v;
+    out[1] = (uint8_t)(v >> 8);
+    out[2] = (uint8_t)(v >> 16);
+}
+
+static void clamp_range(float *samples, size_t start, size_t count) {
+    for (size_t i = start; i < count; ++i) {
+        if (samples[i] > 1.0f) samples[i] = SOFT_CLAMP;
+        else if (samples[i] < -1.0f) samples[i] = -SOFT_CLAMP;
+    }
+}
+
+static void pcm24_range(const float *in, uint8_t *out, size_t start, size_t count) {
+    for (size_t i = start; i < count; ++i) {
+        put_pcm24(&out[i * 3], (int32_t)lrintf(saturate(in[i]) * PCM24_SCALE));
+    }
+}
+
+static void pcm16_range(const float *in, int16_t *out, size_t start, size_t count, sample_convert_dither_t *dither) {
+    for (size_t i = start; i < count; ++i) {
+        float x = saturate(in[i]) * PCM16_SCALE;
+        if (dither) {
+            uint32_t *lane = &dither->lanes[i % SAMPLE_CONVERT_DITHER_LANES];
+            *lane = xorshift(*lane);
+            x += tpdf(*lane);
+        }
+        long v = lrintf(x);
+        if (v > 32767) v = 32767;
+        if (v < -32768) v = -32768;
+        out[i] = (int16_t)v;
+    }
+}
+
+static void clamp_scalar(float *samples, size_t count) {
+    clamp_range(samples, 0, count);
+}
+
+static void pcm24_scalar(const float *in, uint8_t *out, size_t count) {
+    pcm24_range(in, out, 0, count);
+}
+
+static void pcm16_scalar(const float *in, int16_t *out, size_t count, sample_convert_dither_t *dither) {
+    pcm16_range(in, out, 0, count, dither);
+}
+
+#ifdef HAVE_X86
+
+// The SSE2 attribute only matters on 32 bit x86, x86-64 always has it
+__attribute__((target("sse2")))
+static void clamp_sse2(float *samples, size_t count) {
+    const __m128 one = _mm_set1_ps(1.0f), minus_one = _mm_set1_ps(-1.0f);
+    const __m128 high = _mm_set1_ps(SOFT_CLAMP), low = _mm_set1_ps(-SOFT_CLAMP);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128 x = _mm_loadu_ps(&samples[i]);
+        __m128 over = _mm_cmpgt_ps(x, one);
+        __m128 under = _mm_cmplt_ps(x, minus_one);
+        x = _mm_andnot_ps(_mm_or_ps(over, under), x);
+        x = _mm_or_ps(x, _mm_or_ps(_mm_and_ps(over, high), _mm_and_ps(under, low)));
+        _mm_storeu_ps(&samples[i], x);
+    }
+    clamp_range(samples, i, count);
+}
+
+__attribute__((target("sse2")))
+static inline __m128i scale_sse2(const float *in, __m128 scale) {
+    __m128 x = _mm_loadu_ps(in);
+    x = _mm_max_ps(_mm_min_ps(x, _mm_set1_ps(1.0f)), _mm_set1_ps(-1.0f));
+    return _mm_cvtps_epi32(_mm_mul_ps(x, scale));
+}
+
+__attribute__((target("sse2")))
+static void pcm24_sse2(const float *in, uint8_t *out, size_t count) {
+    const __m128 scale = _mm_set1_ps(PCM24_SCALE);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        // No byte shuffle before SSSE3: pack two 24 bit values per 48 bits
+        int32_t v[4];
+        _mm_storeu_si128((__m128i *)v, scale_sse2(&in[i], scale));
+        uint64_t lo = ((uint64_t)(uint32_t)v[0] & 0xFFFFFF) | (((uint64_t)(uint32_t)v[1] & 0xFFFFFF) << 24) |
+                      ((uint64_t)(uint32_t)v[2] << 48);
+        uint32_t hi = (((uint32_t)v[2] >> 16) & 0xFF) | ((uint32_t)v[3] << 8);
+        memcpy(&out[i * 3], &lo, 8);
+        memcpy(&out[i * 3 + 8], &hi, 4);
+    }
+    pcm24_range(in, out, i, count);
+}
+
+__attribute__((target("sse2")))
+static inline __m128i xorshift_sse2(__m128i r) {
+    r = _mm_xor_si128(r, _mm_slli_epi32(r, 13));
+    r = _mm_xor_si128(r, _mm_srli_epi32(r, 17));
+    return _mm_xor_si128(r, _mm_slli_epi32(r, 5));
+}
+
+__attribute__((target("sse2")))
+static inline __m128 tpdf_sse2(__m128i r) {
+    const __m128i low16 = _mm_set1_epi32(0xFFFF);
+    __m128i sum = _mm_add_epi32(_mm_and_si128(r, low16), _mm_srli_epi32(r, 16));
+    sum = _mm_sub_epi32(sum, _mm_set1_epi32(65535));
+    return _mm_mul_ps(_mm_cvtepi32_ps(sum), _mm_set1_ps(1.0f / 65536.0f));
+}
+
+__attribute__((target("sse2")))
+static void pcm16_sse2(const float *in, int16_t *out, size_t count, sample_convert_dither_t *dither) {
+    const __m128 scale = _mm_set1_ps(PCM16_SCALE);
+    const __m128 one = _mm_set1_ps(1.0f), minus_one = _mm_set1_ps(-1.0f);
+    __m128i r0 = _mm_setzero_si128(), r1 = _mm_setzero_si128();
+    if (dither) {
+        r0 = _mm_loadu_si128((const __m128i *)&dither->lanes[0]);
+        r1 = _mm_loadu_si128((const __m128i *)&dither->lanes[4]);
+    }
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m128 a = _mm_max_ps(_mm_min_ps(_mm_loadu_ps(&in[i]), one), minus_one);
+        __m128 b = _mm_max_ps(_mm_min_ps(_mm_loadu_ps(&in[i + 4]), one), minus_one);
+        a = _mm_mul_ps(a, scale);
+        b = _mm_mul_ps(b, scale);
+        if (dither) {
+            r0 = xorshift_sse2(r0);
+            r1 = xorshift_sse2(r1);
+            a = _mm_add_ps(a, tpdf_sse2(r0));
+            b = _mm_add_ps(b, tpdf_sse2(r1));
+        }
+        __m128i packed = _mm_packs_epi32(_mm_cvtps_epi32(a), _mm_cvtps_epi32(b));
+        _mm_storeu_si128((__m128i *)&out[i], packed);
+    }
+    if (dither) {
+        _mm_storeu_si128((__m128i *)&dither->lanes[0], r0);
+        _mm_storeu_si128((__m128i *)&dither->lanes[4], r1);
+    }
+    pcm16_range(in, out, i, count, dither);
+}
+
+__attribute__((target("avx2")))
+static void clamp_avx2(float *samples, size_t count) {
+    const __m256 one = _mm256_set1_ps(1.0f), minus_one = _mm256_set1_ps(-1.0f);
+    const __m256 high = _mm256_set1_ps(SOFT_CLAMP), low = _mm256_set1_ps(-SOFT_CLAMP);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256 x = _mm256_loadu_ps(&samples[i]);
+        x = _mm256_blendv_ps(x, high, _mm256_cmp_ps(x, one, _CMP_GT_OQ));
+        x = _mm256_blendv_ps(x, low, _mm256_cmp_ps(x, minus_one, _CMP_LT_OQ));
+        _mm256_storeu_ps(&samples[i], x);
+    }
+    clamp_range(samples, i, count);
+}
+
+__attribute__((target("avx2")))
+static void pcm24_avx2(const float *in, uint8_t *out, size_t count) {
+    const __m256 scale = _mm256_set1_ps(PCM24_SCALE);
+    const __m256 one = _mm256_set1_ps(1.0f), minus_one = _mm256_set1_ps(-1.0f);
+    // Drop the top byte of every value in each 128 bit lane, then close the gap between the lanes
+    const __m256i bytes = _mm256_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1,
+                                           0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+    const __m256i words = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256 x = _mm256_max_ps(_mm256_min_ps(_mm256_loadu_ps(&in[i]), one), minus_one);
+        __m256i v = _mm256_cvtps_epi32(_mm256_mul_ps(x, scale));
+        v = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(v, bytes), words);
+        _mm_storeu_si128((__m128i *)&out[i * 3], _mm256_castsi256_si128(v));
+        _mm_storel_epi64((__m128i *)&out[i * 3 + 16], _mm256_extracti128_si256(v, 1));
+    }
+    pcm24_range(in, out, i, count);
+}
+
+__attribute__((target("avx2")))
+static void pcm16_avx2(const float *in, int16_t *out, size_t count, sample_convert_dither_t *dither) {
+    const __m256 scale = _mm256_set1_ps(PCM16_SCALE);
+    const __m256 one = _mm256_set1_ps(1.0f), minus_one = _mm256_set1_ps(-1.0f);
+    const __m256i low16 = _mm256_set1_epi32(0xFFFF), bias = _mm256_set1_epi32(65535);
+    const __m256 lsb = _mm256_set1_ps(1.0f / 65536.0f);
+    __m256i r = dither ? _mm256_loadu_si256((const __m256i *)dither->lanes) : _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256 x = _mm256_max_ps(_mm256_min_ps(_mm256_loadu_ps(&in[i]), one), minus_one);
+        x = _mm256_mul_ps(x, scale);
+        if (dither) {
+            r = _mm256_xor_si256(r, _mm256_slli_epi32(r, 13));
+            r = _mm256_xor_si256(r, _mm256_srli_epi32(r, 17));
+            r = _mm256_xor_si256(r, _mm256_slli_epi32(r, 5));
+            __m256i sum = _mm256_sub_epi32(_mm256_add_epi32(_mm256_and_si256(r, low16), _mm256_srli_epi32(r, 16)), bias);
+            x = _mm256_add_ps(x, _mm256_mul_ps(_mm256_cvtepi32_ps(sum), lsb));
+        }
+        __m256i v = _mm256_cvtps_epi32(x);
+        __m128i packed = _mm_packs_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+        _mm_storeu_si128((__m128i *)&out[i], packed);
+    }
+    if (dither) _mm256_storeu_si256((__m256i *)dither->lanes, r);
+    pcm16_range(in, out, i, count, dither);
+}
+
+#endif /* HAVE_X86 */
+
+#ifdef HAVE_NEON
+
+static void clamp_neon(float *samples, size_t count) {
+    const float32x4_t one = vdupq_n_f32(1.0f), minus_one = vdupq_n_f32(-1.0f);
+    const float32x4_t high = vdupq_n_f32(SOFT_CLAMP), low = vdupq_n_f32(-SOFT_CLAMP);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        float32x4_t x = vld1q_f32(&samples[i]);
+        x = vbslq_f32(vcgtq_f32(x, one), high, x);
+        x = vbslq_f32(vcltq_f32(x, minus_one), low, x);
+        vst1q_f32(&samples[i], x);
+    }
+    clamp_range(samples, i, count);
+}
+
+// vminq/vmaxq propagate NaN, select instead to match saturate()
+static inline float32x4_t saturate_neon(float32x4_t x) {
+    const float32x4_t one = vdupq_n_f32(1.0f), minus_one = vdupq_n_f32(-1.0f);
+    x = vbslq_f32(vcltq_f32(x, one), x, one);
+    return vbslq_f32(vcgtq_f32(x, minus_one), x, minus_one);
+}
+
+static void pcm24_neon(const float *in, uint8_t *out, size_t count) {
+    const float32x4_t scale = vdupq_n_f32(PCM24_SCALE);
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        // Interleaved store of the low three bytes of 16 values
+        uint8_t values[64];
+        uint8x16x3_t planes;
+        for (int q = 0; q < 4; ++q) {
+            int32x4_t v = vcvtnq_s32_f32(vmulq_f32(saturate_neon(vld1q_f32(&in[i + q * 4])), scale));
+            vst1q_u8(&values[q * 16], vreinterpretq_u8_s32(v));
+        }
+        uint8x16x4_t bytes = vld4q_u8(values);
+        planes.val[0] = bytes.val[0];
+        planes.val[1] = bytes.val[1];
+        planes.val[2] = bytes.val[2];
+        vst3q_u8(&out[i * 3], planes);
+    }
+    pcm24_range(in, out, i, count);
+}
+
+static void pcm16_neon(const float *in, int16_t *out, size_t count, sample_convert_dither_t *dither) {
+    const float32x4_t scale = vdupq_n_f32(PCM16_SCALE);
+    const uint32x4_t low16 = vdupq_n_u32(0xFFFF);
+    const int32x4_t bias = vdupq_n_s32(65535);
+    uint32x4_t r[2] = {vdupq_n_u32(0), vdupq_n_u32(0)};
+    if (dither) {
+        r[0] = vld1q_u32(&dither->lanes[0]);
+        r[1] = vld1q_u32(&dither->lanes[4]);
+    }
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        int16x4_t half[2];
+        for (int h = 0; h < 2; ++h) {
+            float32x4_t x = vmulq_f32(saturate_neon(vld1q_f32(&in[i + h * 4])), scale);
+            if (dither) {
+                r[h] = veorq_u32(r[h], vshlq_n_u32(r[h], 13));
+                r[h] = veorq_u32(r[h], vshrq_n_u32(r[h], 17));
+                r[h] = veorq_u32(r[h], vshlq_n_u32(r[h], 5));
+                int32x4_t sum = vsubq_s32(vreinterpretq_s32_u32(vaddq_u32(vandq_u32(r[h], low16), vshrq_n_u32(r[h], 16))), bias);
+                x = vaddq_f32(x, vmulq_f32(vcvtq_f32_s32(sum), vdupq_n_f32(1.0f / 65536.0f)));
+            }
+            half[h] = vqmovn_s32(vcvtnq_s32_f32(x));
+        }
+        vst1q_s16(&out[i], vcombine_s16(half[0], half[1]));
+    }
+    if (dither) {
+        vst1q_u32(&dither->lanes[0], r[0]);
+        vst1q_u32(&dither->lanes[4], r[1]);
+    }
+    pcm16_range(in, out, i, count, dither);
+}
+
+#endif /* HAVE_NEON */
+
+static kernels_t kernels;
+static pthread_once_t kernels_once = PTHREAD_ONCE_INIT;
+
+static int isa_supported(sample_convert_isa_t isa) {
+    switch (isa) {
+    case SAMPLE_CONVERT_SCALAR:
+        return 1;
+#ifdef HAVE_X86
+    case SAMPLE_CONVERT_SSE2:
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("sse2");
+    case SAMPLE_CONVERT_AVX2:
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2");
+#endif
+#ifdef HAVE_NEON
+    case SAMPLE_CONVERT_NEON:
+        return 1;
+#endif
+    default:
+        return 0;
+    }
+}
+
+static void use_isa(sample_convert_isa_t isa) {
+    kernels.isa = isa;
+    kernels.clamp = clamp_scalar;
+    kernels.to_pcm24 = pcm24_scalar;
+    kernels.to_pcm16 = pcm16_scalar;
+    switch (isa) {
+#ifdef HAVE_X86
+    case SAMPLE_CONVERT_SSE2:
+        kernels.clamp = clamp_sse2;
+        kernels.to_pcm24 = pcm24_sse2;
+        kernels.to_pcm16 = pcm16_sse2;
+        break;
+    case SAMPLE_CONVERT_AVX2:
+        kernels.clamp = clamp_avx2;
+        kernels.to_pcm24 = pcm24_avx2;
+        kernels.to_pcm16 = pcm16_avx2;
+        break;
+#endif
+#ifdef HAVE_NEON
+    case SAMPLE_CONVERT_NEON:
+        kernels.clamp = clamp_neon;
+        kernels.to_pcm24 = pcm24_neon;
+        kernels.to_pcm16 = pcm16_neon;
+        break;
+#endif
+    default:
+        break;
+    }
+}
+
+static void pick_kernels(void) {
+    static const sample_convert_isa_t preferred[] = {
+        SAMPLE_CONVERT_AVX2, SAMPLE_CONVERT_NEON, SAMPLE_CONVERT_SSE2,
+    };
+    for (size_t i = 0; i < sizeof(preferred) / sizeof(preferred[0]); ++i) {
+        if (isa_supported(preferred[i])) {
+            use_isa(preferred[i]);
+            return;
+        }
+    }
+    use_isa(SAMPLE_CONVERT_SCALAR);
+}
+
+static const kernels_t *get_kernels(void) {
+    pthread_once(&kernels_once, pick_kernels);
+    return &kernels;
+}
+
+sample_convert_isa_t sample_convert_isa(void) {
+    return get_kernels()->isa;
+}
+
+const char *sample_convert_isa_name(sample_convert_isa_t isa) {
+    switch (isa) {
+    case SAMPLE_CONVERT_SSE2: return "sse2";
+    case SAMPLE_CONVERT_AVX2: return "avx2";
+    case SAMPLE_CONVERT_NEON: return "neon";
+    default: return "scalar";
+    }
+}
+
+int sample_convert_set_isa(sample_convert_isa_t isa) {
+    get_kernels();
+    if (!isa_supported(isa)) return -1;
+    use_isa(isa);
+    return 0;
+}
+
+void sample_convert_clamp(float *samples, size_t count) {
+    get_kernels()->clamp(samples, count);
+}
+
+void sample_convert_to_pcm24(const float *in, uint8_t *out, size_t count) {
+    get_kernels()->to_pcm24(in, out, count);
+}
+
+void sample_convert_to_pcm16(const float *in, int16_t *out, size_t count, sample_convert_dither_t *dither) {
+    get_kernels()->to_pcm16(in, out, count, dither);
+}
+
+void sample_convert_to_f32le(const float *in, uint8_t *out, size_t count) {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    for (size_t i = 0; i < count; ++i) {
+        uint32_t v;
+        memcpy(&v, &in[i], 4);
+        v = __builtin_bswap32(v);
+        memcpy(&out[i * 4], &v, 4);
+    }
+#else
+    memcpy(out, in, count * sizeof(float));
+#endif
+}
+
+void sample_convert_dither_init(sample_convert_dither_t *dither, uint32_t seed) {
+    // splitmix32 style scramble, xorshift lanes must not start at zero
+    for (int i = 0; i < SAMPLE_CONVERT_DITHER_LANES; ++i) {
+        uint32_t z = seed + 0x9E3779B9u * (uint32_t)(i + 1);
+        z = (z ^ (z >> 16)) * 0x85EBCA6Bu;
+        z = (z ^ (z >> 13)) * 0xC2B2AE35u;
+        z ^= z >> 16;
+        dither->lanes[i] = z ? z : 0x6D2B79F5u;
+    }
+}
@@ -0,0 +1,52 @@
+#ifndef SAMPLE_CONVERT
+#define SAMPLE_CONVERT
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Float sample conversion kernels for export and the patchers. The fastest
+// implementation the CPU supports is picked on first use (AVX2 or SSE2 on
+// x86, NEON on aarch64, plain C elsewhere); every implementation produces
+// bit identical output.
+//
+// Integer conversions saturate to [-1.0, 1.0] and round to nearest like
+// libsndfile does (x * 8388607 for 24 bit, x * 32767 for 16 bit), so files
+// written through here match files written with sf_write_float.
+
+typedef enum {
+    SAMPLE_CONVERT_SCALAR = 0,
+    SAMPLE_CONVERT_SSE2,
+    SAMPLE_CONVERT_AVX2,
+    SAMPLE_CONVERT_NEON,
+} sample_convert_isa_t;
+
+// TPDF dither generator, 8 independent xorshift lanes so it vectorizes
+#define SAMPLE_CONVERT_DITHER_LANES 8
+
+typedef struct {
+    uint32_t lanes[SAMPLE_CONVERT_DITHER_LANES];
+} sample_convert_dither_t;
+
+// Implementation in use
+sample_convert_isa_t sample_convert_isa(void);
+const char *sample_convert_isa_name(sample_convert_isa_t isa);
+
+// Force an implementation (tests, benchmarks). -1 if the CPU lacks it.
+int sample_convert_set_isa(sample_convert_isa_t isa);
+
+// Soft clamp in place: above 1.0 becomes 0.99, below -1.0 becomes -0.99
+void sample_convert_clamp(float *samples, size_t count);
+
+// Packed little endian 24 bit, 3 bytes per sample
+void sample_convert_to_pcm24(const float *in, uint8_t *out, size_t count);
+
+// Native 16 bit. With dither non-NULL, triangular noise of +-1 LSB is added
+// before rounding.
+void sample_convert_to_pcm16(const float *in, int16_t *out, size_t count, sample_convert_dither_t *dither);
+
+// 32 bit float, little endian byte order regardless of the host
+void sample_convert_to_f32le(const float *in, uint8_t *out, size_t count);
+
+void sample_convert_dither_init(sample_convert_dither_t *dither, uint32_t seed);
+
+#endif /* SAMPLE_CONVERT */
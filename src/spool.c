@@ -0,0 +1,237 @@
+#include "spool.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+// Frames moved per pwrite by the flusher
+#define SPOOL_CHUNK_FRAMES 65536
+
+static uint64_t next_power_of_two_u64(uint64_t v) {
+    uint64_t p = 1;
+    while (p < v) p <<= 1;
+    return p;
+}
+
+static int write_all(int fd, const void *buf, size_t len, off_t offset) {
+    const char *p = (const char *)buf;
+    while (len > 0) {
+        ssize_t n = pwrite(fd, p, len, offset);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        p += n;
+        len -= (size_t)n;
+        offset += n;
+    }
+    return 0;
+}
+
+// Frames published on every source channel
+static uint64_t source_position(const spool_t *spool) {
+    uint64_t pos = channel_buffer_write_position(&spool->source[0]);
+    for (unsigned int ch = 1; ch < spool->num_channels; ++ch) {
+        uint64_t p = channel_buffer_write_position(&spool->source[ch]);
+        if (p < pos) pos = p;
+    }
+    return pos;
+}
+
+static int write_header(const spool_t *spool, unsigned int channel, uint64_t flushed_pos) {
+    spool_header_t header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SPOOL_MAGIC, sizeof(header.magic));
+    header.version = 1;
+    header.sample_rate = spool->sample_rate;
+    header.channel = channel;
+    header.num_channels = spool->num_channels;
+    header.capacity = spool->capacity;
+    header.flushed_pos = flushed_pos;
+    return write_all(spool->channels[channel].fd, &header, sizeof(header), 0);
+}
+
+int spool_init(spool_t *spool, const channel_buffer_t *source, unsigned int num_channels, unsigned int sample_rate, const char *dir, unsigned int seconds) {
+    memset(spool, 0, sizeof(*spool));
+    spool->source = source;
+    spool->num_channels = num_channels;
+    spool->sample_rate = sample_rate;
+    spool->capacity = next_power_of_two_u64((uint64_t)sample_rate * seconds);
+    spool->mask = spool->capacity - 1;
+    // Spooling starts at the current write head, earlier audio stays RAM only
+    uint64_t start = source_position(spool);
+    atomic_init(&spool->flushed_pos, start);
+    atomic_init(&spool->flush_claim, start);
+    atomic_init(&spool->overruns, 0);
+    atomic_init(&spool->running, 0);
+
+    spool->channels = (spool_channel_t *)calloc(num_channels, sizeof(spool_channel_t));
+    spool->scratch = (float *)malloc(sizeof(float) * SPOOL_CHUNK_FRAMES);
+    if (!spool->channels || !spool->scratch) {
+        spool_free(spool);
+        errno = ENOMEM;
+        return -1;
+    }
+    for (unsigned int ch = 0; ch < num_channels; ++ch) spool->channels[ch].fd = -1;
+
+    mkdir(dir, 0700);
+    size_t map_bytes = SPOOL_HEADER_BYTES + (size_t)spool->capacity * sizeof(float);
+    for (unsigned int ch = 0; ch < num_channels; ++ch) {
+        spool_channel_t *sc = &spool->channels[ch];
+        char path[1024];
+        snprintf(path, sizeof(path), "%s/ch%02u.f32", dir, ch + 1);
+        sc->fd = open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+        if (sc->fd < 0) goto fail;
+        // Reserve the blocks now: retention is bounded by the disk, and a
+        // full disk is reported here instead of in the middle of a take
+        int err = posix_fallocate(sc->fd, 0, (off_t)map_bytes);
+        if (err != 0) {
+            errno = err;
+            goto fail;
+        }
+        if (write_header(spool, ch, 0) < 0) goto fail;
+        void *map = mmap(NULL, map_bytes, PROT_READ, MAP_SHARED, sc->fd, 0);
+        if (map == MAP_FAILED) goto fail;
+        sc->map = (const float *)((const char *)map + SPOOL_HEADER_BYTES);
+        sc->map_bytes = map_bytes;
+    }
+    return 0;
+
+fail: {
+        int saved = errno;
+        spool_free(spool);
+        errno = saved;
+        return -1;
+    }
+}
+
+void spool_free(spool_t *spool) {
+    spool_stop(spool);
+    if (spool->channels) {
+        for (unsigned int ch = 0; ch < spool->num_channels; ++ch) {
+            spool_channel_t *sc = &spool->channels[ch];
+            if (sc->map) munmap((void *)((const char *)sc->map - SPOOL_HEADER_BYTES), sc->map_bytes);
+            if (sc->fd >= 0) close(sc->fd);
+        }
+        free(spool->channels);
+        spool->channels = NULL;
+    }
+    free(spool->scratch);
+    spool->scratch = NULL;
+}
+
+// Write frames [pos, pos + count) of one channel into the file ring, zeros if samples is NULL
+static int write_frames(spool_t *spool, unsigned int channel, const float *samples, uint64_t pos, uint32_t count) {
+    static const float zeros[1024];
+    while (count > 0) {
+        uint64_t index = pos & spool->mask;
+        uint64_t span = spool->capacity - index;
+        if (span > count) span = count;
+        if (!samples && span > 1024) span = 1024;
+        off_t offset = SPOOL_HEADER_BYTES + (off_t)(index * sizeof(float));
+        if (write_all(spool->channels[channel].fd, samples ? samples : zeros, (size_t)span * sizeof(float), offset) < 0) return -1;
+        if (samples) samples += span;
+        pos += span;
+        count -= (uint32_t)span;
+    }
+    return 0;
+}
+
+uint64_t spool_flush(spool_t *spool) {
+    if (!spool->channels) return 0;
+    uint64_t from = atomic_load_explicit(&spool->flushed_pos, memory_order_relaxed);
+    uint64_t to = source_position(spool);
+    if (to <= from) return 0;
+
+    // Readers must not trust the file range we are about to overwrite
+    atomic_store_explicit(&spool->flush_claim, to, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    for (unsigned int ch = 0; ch < spool->num_channels; ++ch) {
+        uint64_t pos = from;
+        while (pos < to) {
+            uint32_t count = SPOOL_CHUNK_FRAMES;
+            if ((uint64_t)count > to - pos) count = (uint32_t)(to - pos);
+            const float *samples = spool->scratch;
+            if (channel_buffer_read_frames(&spool->source[ch], spool->scratch, pos, count) < 0) {
+                // We fell behind the RAM ring; leave silence instead of stale
+                // audio up to a point the writer will not reach for a while
+                const ringbuffer_float_t *rb = &spool->source[ch].buffer;
+                uint64_t head = channel_buffer_write_position(&spool->source[ch]);
+                uint64_t resume = head > rb->capacity / 2 ? head - rb->capacity / 2 : 0;
+                if (resume <= pos) resume = pos + 1;
+                if ((uint64_t)count > resume - pos) count = (uint32_t)(resume - pos);
+                samples = NULL;
+                if (ch == 0) atomic_fetch_add_explicit(&spool->overruns, count, memory_order_relaxed);
+            }
+            if (write_frames(spool, ch, samples, pos, count) < 0) {
+                perror("spool: write");
+                return 0;
+            }
+            pos += count;
+        }
+#ifdef SYNC_FILE_RANGE_WRITE
+        // Start writeback now so it happens sequentially, without waiting for it
+        sync_file_range(spool->channels[ch].fd, 0, 0, SYNC_FILE_RANGE_WRITE);
+#endif
+        write_header(spool, ch, to);
+    }
+    atomic_store_explicit(&spool->flushed_pos, to, memory_order_release);
+    return to - from;
+}
+
+static void *flusher_thread(void *arg) {
+    spool_t *spool = (spool_t *)arg;
+    struct timespec interval = {0, SPOOL_FLUSH_INTERVAL_MS * 1000000L};
+    while (atomic_load(&spool->running)) {
+        spool_flush(spool);
+        nanosleep(&interval, NULL);
+    }
+    // Make everything recorded so far durable on shutdown
+    spool_flush(spool);
+    return NULL;
+}
+
+int spool_start(spool_t *spool) {
+    atomic_store(&spool->running, 1);
+    if (pthread_create(&spool->thread, NULL, flusher_thread, spool) != 0) {
+        atomic_store(&spool->running, 0);
+        return -1;
+    }
+    return 0;
+}
+
+void spool_stop(spool_t *spool) {
+    if (atomic_exchange(&spool->running, 0)) {
+        pthread_join(spool->thread, NULL);
+    }
+}
+
+int spool_read(const spool_t *spool, unsigned int channel, float *samples, uint64_t start_frame, uint32_t count) {
+    spool_t *sp = (spool_t *)spool;
+    if (!spool->channels || channel >= spool->num_channels) return -1;
+    uint64_t flushed = atomic_load_explicit(&sp->flushed_pos, memory_order_acquire);
+    if (start_frame + count > flushed || flushed - start_frame > spool->capacity) return -1;
+    const float *map = spool->channels[channel].map;
+    uint64_t pos = start_frame;
+    uint32_t left = count;
+    while (left > 0) {
+        uint64_t index = pos & spool->mask;
+        uint64_t span = spool->capacity - index;
+        if (span > left) span = left;
+        memcpy(samples, &map[index], (size_t)span * sizeof(float));
+        samples += span;
+        pos += span;
+        left -= (uint32_t)span;
+    }
+    // Same overwrite check as the RAM ring: was part of the copy rewritten meanwhile?
+    atomic_thread_fence(memory_order_acquire);
+    uint64_t claim = atomic_load_explicit(&sp->flush_claim, memory_order_relaxed);
+    if (claim - start_frame > spool->capacity) return -1;
+    return 0;
+}
@@ -0,0 +1,71 @@
+#ifndef SPOOL
+#define SPOOL
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include "channel-buffer.h"
+
+// Disk tier behind the in-RAM ring buffers. Every channel gets one
+// preallocated file holding a ring of float samples, indexed by the same
+// absolute frame numbers as the RAM ring. A non-RT flusher copies new
+// frames from the RAM rings into the files with plain sequential writes,
+// and readers get older frames through a read-only mapping of the files.
+// The RT thread never touches the files or the mapping.
+
+#define SPOOL_MAGIC "PWGHSPL1"
+#define SPOOL_HEADER_BYTES 4096
+#define SPOOL_FLUSH_INTERVAL_MS 100
+
+// Lives at the start of every channel file, so a spool left behind by a
+// crashed daemon can be read back without any other state
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t sample_rate;
+    uint32_t channel;
+    uint32_t num_channels;
+    uint64_t capacity;      // Frames in the file ring (power of two)
+    uint64_t flushed_pos;   // Absolute frame index up to which the file is valid
+} spool_header_t;
+
+typedef struct {
+    int fd;
+    const float *map;       // Read-only view of the sample area
+    size_t map_bytes;       // Header plus sample area
+} spool_channel_t;
+
+typedef struct {
+    spool_channel_t *channels;
+    unsigned int num_channels;
+    unsigned int sample_rate;
+    uint64_t capacity;
+    uint64_t mask;
+    const channel_buffer_t *source; // RAM rings the flusher copies from
+    float *scratch;                  // Flusher copy buffer
+    _Atomic uint64_t flushed_pos;    // Frames [flushed_pos - capacity, flushed_pos) are on disk
+    _Atomic uint64_t flush_claim;    // flushed_pos plus the range being written
+    _Atomic uint64_t overruns;       // Frames lost because the flusher fell behind the RAM ring
+    atomic_int running;
+    pthread_t thread;
+} spool_t;
+
+// Create (or truncate) one file per channel under dir, preallocating
+// seconds of history. Returns 0 on success, -1 (with errno set) on failure,
+// e.g. when the disk is too small.
+int spool_init(spool_t *spool, const channel_buffer_t *source, unsigned int num_channels, unsigned int sample_rate, const char *dir, unsigned int seconds);
+void spool_free(spool_t *spool);
+
+// Copy every frame published to the RAM rings since the last call to disk.
+// Returns the number of frames flushed.
+uint64_t spool_flush(spool_t *spool);
+
+// Run spool_flush every SPOOL_FLUSH_INTERVAL_MS on a background thread
+int spool_start(spool_t *spool);
+void spool_stop(spool_t *spool);
+
+// Read count frames of one channel from the file ring. 0 on success, -1 if
+// the range is not on disk (yet or anymore).
+int spool_read(const spool_t *spool, unsigned int channel, float *samples, uint64_t start_frame, uint32_t count);
+
+#endif /* SPOOL */
@@ -0,0 +1,246 @@
+#include "sync-detect.h"
+#include "sync-marker.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// Windows with less energy than this are digital silence, not a marker
+#define MIN_WINDOW_ENERGY 1e-30
+
+// In-place radix-2 FFT on split complex arrays. Twiddles are stored per
+// stage (stage with half size h at [h, 2h)), so the inner loop is contiguous.
+static void fft(const sync_detector_t *d, float *re, float *im) {
+    const uint32_t n = SYNC_DETECT_FFT_SIZE;
+    for (uint32_t p = 0; p < d->num_swaps; ++p) {
+        uint32_t i = d->swaps[p][0], j = d->swaps[p][1];
+        float t = re[i]; re[i] = re[j]; re[j] = t;
+        t = im[i]; im[i] = im[j]; im[j] = t;
+    }
+    // The first two stages only need the twiddles 1 and -i: one radix-4 pass
+    for (uint32_t i = 0; i < n; i += 4) {
+        float ar = re[i] + re[i + 1], ai = im[i] + im[i + 1];
+        float br = re[i] - re[i + 1], bi = im[i] - im[i + 1];
+        float cr = re[i + 2] + re[i + 3], ci = im[i + 2] + im[i + 3];
+        float dr = re[i + 2] - re[i + 3], di = im[i + 2] - im[i + 3];
+        re[i] = ar + cr; im[i] = ai + ci;
+        re[i + 2] = ar - cr; im[i + 2] = ai - ci;
+        // d times -i
+        re[i + 1] = br + di; im[i + 1] = bi - dr;
+        re[i + 3] = br - di; im[i + 3] = bi + dr;
+    }
+    for (uint32_t half = 4; half < n; half <<= 1) {
+        const float *wr = &d->twiddle_re[half], *wi = &d->twiddle_im[half];
+        for (uint32_t start = 0; start < n; start += 2 * half) {
+            float *ar = &re[start], *ai = &im[start];
+            float *br = &re[start + half], *bi = &im[start + half];
+#ifdef __SSE2__
+            // Part of every x86-64, half is a multiple of 4 from here on
+            for (uint32_t k = 0; k < half; k += 4) {
+                __m128 xr = _mm_loadu_ps(&br[k]), xi = _mm_loadu_ps(&bi[k]);
+                __m128 cr = _mm_loadu_ps(&wr[k]), ci = _mm_loadu_ps(&wi[k]);
+                __m128 tr = _mm_sub_ps(_mm_mul_ps(xr, cr), _mm_mul_ps(xi, ci));
+                __m128 ti = _mm_add_ps(_mm_mul_ps(xr, ci), _mm_mul_ps(xi, cr));
+                __m128 yr = _mm_loadu_ps(&ar[k]), yi = _mm_loadu_ps(&ai[k]);
+                _mm_storeu_ps(&br[k], _mm_sub_ps(yr, tr));
+                _mm_storeu_ps(&bi[k], _mm_sub_ps(yi, ti));
+                _mm_storeu_ps(&ar[k], _mm_add_ps(yr, tr));
+                _mm_storeu_ps(&ai[k], _mm_add_ps(yi, ti));
+            }
+#else
+            for (uint32_t k = 0; k < half; ++k) {
+                float tr = br[k] * wr[k] - bi[k] * wi[k];
+                float ti = br[k] * wi[k] + bi[k] * wr[k];
+                br[k] = ar[k] - tr;
+                bi[k] = ai[k] - ti;
+                ar[k] += tr;
+                ai[k] += ti;
+            }
+#endif
+        }
+    }
+}
+
+static void emit(sync_detector_t *d, const sync_detect_match_t *match) {
+    if (d->num_matches == d->max_matches) {
+        size_t max = d->max_matches ? d->max_matches * 2 : 16;
+        sync_detect_match_t *grown = (sync_detect_match_t *)realloc(d->matches, sizeof(*grown) * max);
+        if (!grown) return;
+        d->matches = grown;
+        d->max_matches = max;
+    }
+    d->matches[d->num_matches++] = *match;
+}
+
+// Neighbouring positions of one marker can all pass the threshold once the
+// audio is filtered; keep the best one per pattern length
+static void consider(sync_detector_t *d, int64_t frame, double correlation, double energy) {
+    double score = correlation / sqrt(energy * d->pattern_energy);
+    // Rounding in the FFT can push a perfect match a hair past 1
+    if (score > 1.0) score = 1.0;
+    sync_detect_match_t match = {frame, (float)score, (float)(correlation / d->pattern_energy)};
+    if (d->candidate.frame >= 0 && frame - d->candidate.frame < (int64_t)d->length) {
+        if (match.confidence > d->candidate.confidence) d->candidate = match;
+        return;
+    }
+    if (d->candidate.frame >= 0) emit(d, &d->candidate);
+    d->candidate = match;
+}
+
+// Correlate the first positions frames of the input: two overlap-save
+// blocks at once, one in the real and one in the imaginary part
+static void correlate(sync_detector_t *d, size_t positions) {
+    const uint32_t n = SYNC_DETECT_FFT_SIZE, hop = d->hop;
+    size_t fill_re = d->input_fill < n ? d->input_fill : n;
+    size_t fill_im = d->input_fill > hop ? d->input_fill - hop : 0;
+    if (fill_im > n) fill_im = n;
+    memcpy(d->re, d->input, sizeof(float) * fill_re);
+    memset(&d->re[fill_re], 0, sizeof(float) * (n - fill_re));
+    memcpy(d->im, &d->input[hop], sizeof(float) * fill_im);
+    memset(&d->im[fill_im], 0, sizeof(float) * (n - fill_im));
+    fft(d, d->re, d->im);
+    // Multiply by the conjugated pattern spectrum, then inverse FFT as
+    // conj(fft(conj(x)))
+    for (uint32_t i = 0; i < n; ++i) {
+        float r = d->re[i] * d->pattern_re[i] - d->im[i] * d->pattern_im[i];
+        float m = d->re[i] * d->pattern_im[i] + d->im[i] * d->pattern_re[i];
+        d->re[i] = r;
+        d->im[i] = -m;
+    }
+    fft(d, d->re, d->im);
+
+    // score >= threshold means c^2 >= limit * window energy. The first and
+    // last sample alone bound the energy from below, which rejects nearly
+    // every position before the exact energy is needed.
+    const float limit = (float)((double)d->threshold * d->threshold * d->pattern_energy);
+    const float *x = d->input;
+    const uint32_t last = d->length - 1;
+    for (size_t k = 0; k < positions; ++k) {
+        // Real part holds the first block, imaginary part the second
+        float c = k < hop ? d->re[k] : -d->im[k - hop];
+        // c * |c| rejects negative correlation without a branch on its sign
+        if (c * fabsf(c) <= limit * (x[k] * x[k] + x[k + last] * x[k + last])) continue;
+        double e = 0.0;
+        for (uint32_t j = 0; j < d->length; ++j) e += (double)x[k + j] * x[k + j];
+        if (e > MIN_WINDOW_ENERGY && (double)c * c >= (double)limit * e) {
+            consider(d, d->input_frame + (int64_t)k, c, e);
+        }
+    }
+
+    // Keep the frames the next positions still need
+    memmove(d->input, &d->input[positions], sizeof(float) * (d->input_fill - positions));
+    d->input_fill -= positions;
+    d->input_frame += (int64_t)positions;
+    if (d->candidate.frame >= 0 && d->input_frame - d->candidate.frame >= (int64_t)d->length) {
+        emit(d, &d->candidate);
+        d->candidate.frame = -1;
+    }
+}
+
+int sync_detector_init(sync_detector_t *d, const float *pattern, uint32_t length, float threshold) {
+    const uint32_t n = SYNC_DETECT_FFT_SIZE;
+    memset(d, 0, sizeof(*d));
+    if (length < 2 || length > n / 2) return -1;
+    d->length = length;
+    d->hop = n - (length - 1);
+    d->threshold = threshold > 0.0f ? threshold : SYNC_DETECT_THRESHOLD;
+    d->candidate.frame = -1;
+    size_t input_size = 2 * (size_t)d->hop + length - 1;
+    d->pattern_re = (float *)malloc(sizeof(float) * n);
+    d->pattern_im = (float *)malloc(sizeof(float) * n);
+    d->twiddle_re = (float *)malloc(sizeof(float) * n);
+    d->twiddle_im = (float *)malloc(sizeof(float) * n);
+    d->swaps = (uint32_t (*)[2])malloc(sizeof(uint32_t) * 2 * n);
+    d->re = (float *)malloc(sizeof(float) * n);
+    d->im = (float *)malloc(sizeof(float) * n);
+    d->input = (float *)malloc(sizeof(float) * input_size);
+    if (!d->pattern_re || !d->pattern_im || !d->twiddle_re || !d->twiddle_im || !d->swaps ||
+        !d->re || !d->im || !d->input) {
+        sync_detector_free(d);
+        return -1;
+    }
+
+    uint32_t bits = 0;
+    while ((1u << bits) < n) bits++;
+    for (uint32_t i = 0; i < n; ++i) {
+        uint32_t r = 0;
+        for (uint32_t b = 0; b < bits; ++b) r |= ((i >> b) & 1u) << (bits - 1 - b);
+        if (r > i) {
+            d->swaps[d->num_swaps][0] = i;
+            d->swaps[d->num_swaps][1] = r;
+            d->num_swaps++;
+        }
+    }
+    for (uint32_t half = 1; half < n; half <<= 1) {
+        for (uint32_t k = 0; k < half; ++k) {
+            double angle = -M_PI * (double)k / (double)half;
+            d->twiddle_re[half + k] = (float)cos(angle);
+            d->twiddle_im[half + k] = (float)sin(angle);
+        }
+    }
+
+    d->pattern_energy = 0.0;
+    for (uint32_t i = 0; i < n; ++i) {
+        d->pattern_re[i] = i < length ? pattern[i] : 0.0f;
+        d->pattern_im[i] = 0.0f;
+        if (i < length) d->pattern_energy += (double)pattern[i] * pattern[i];
+    }
+    if (d->pattern_energy <= 0.0) {
+        sync_detector_free(d);
+        return -1;
+    }
+    fft(d, d->pattern_re, d->pattern_im);
+    for (uint32_t i = 0; i < n; ++i) {
+        d->pattern_re[i] /= (float)n;
+        d->pattern_im[i] = -d->pattern_im[i] / (float)n;
+    }
+    return 0;
+}
+
+void sync_detector_free(sync_detector_t *d) {
+    free(d->pattern_re);
+    free(d->pattern_im);
+    free(d->twiddle_re);
+    free(d->twiddle_im);
+    free(d->swaps);
+    free(d->re);
+    free(d->im);
+    free(d->input);
+    free(d->matches);
+    memset(d, 0, sizeof(*d));
+}
+
+void sync_detector_feed(sync_detector_t *d, const float *samples, size_t count, size_t stride) {
+    size_t input_size = 2 * (size_t)d->hop + d->length - 1;
+    while (count > 0) {
+        size_t n = input_size - d->input_fill;
+        if (n > count) n = count;
+        float *dst = &d->input[d->input_fill];
+        for (size_t i = 0; i < n; ++i) dst[i] = samples[i * stride];
+        d->input_fill += n;
+        samples += n * stride;
+        count -= n;
+        if (d->input_fill == input_size) correlate(d, 2 * (size_t)d->hop);
+    }
+}
+
+void sync_detector_finish(sync_detector_t *d) {
+    if (d->input_fill >= d->length) correlate(d, d->input_fill - d->length + 1);
+    if (d->candidate.frame >= 0) {
+        emit(d, &d->candidate);
+        d->candidate.frame = -1;
+    }
+}
+
+int64_t sync_detect(const float *samples, size_t count, size_t stride, sync_detect_match_t *matches, size_t max_matches) {
+    sync_detector_t d;
+    if (sync_detector_init(&d, sync_marker_pattern, SYNC_MARKER_LENGTH, 0.0f) < 0) return -1;
+    sync_detector_feed(&d, samples, count, stride);
+    sync_detector_finish(&d);
+    int64_t found = (int64_t)d.num_matches;
+    for (size_t i = 0; i < d.num_matches && i < max_matches; ++i) matches[i] = d.matches[i];
+    sync_detector_free(&d);
+    return found;
+}
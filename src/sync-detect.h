@@ -0,0 +1,59 @@
+#ifndef SYNC_DETECT
+#define SYNC_DETECT
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Finds a marker pattern in audio by normalized cross-correlation, computed
+// block wise with FFTs (overlap-save). Normalizing makes detection
+// independent of gain, and the score tolerates dither and requantization
+// down to roughly 16 bit.
+
+#define SYNC_DETECT_FFT_SIZE 1024
+// Normalized correlation a match must reach, 1.0 is a bit exact marker
+#define SYNC_DETECT_THRESHOLD 0.99f
+
+typedef struct {
+    int64_t frame;      // First frame of the marker
+    float confidence;   // Normalized correlation at that frame, up to 1.0
+    float gain;         // Marker amplitude relative to the pattern
+} sync_detect_match_t;
+
+typedef struct {
+    uint32_t length;        // Pattern length
+    uint32_t hop;           // New frames per FFT block
+    float threshold;
+    double pattern_energy;
+    float *pattern_re, *pattern_im;  // Conjugated pattern spectrum, scaled for the inverse FFT
+    float *twiddle_re, *twiddle_im;
+    uint32_t (*swaps)[2];   // Bit reversal permutation as index pairs
+    uint32_t num_swaps;
+    float *re, *im;         // Work buffers
+    float *input;           // Frames not fully correlated yet
+    size_t input_fill;
+    int64_t input_frame;    // Absolute frame of input[0]
+    sync_detect_match_t candidate;  // Best match of the current cluster, frame -1 if none
+    sync_detect_match_t *matches;
+    size_t num_matches, max_matches;
+} sync_detector_t;
+
+// Patterns are 2 to SYNC_DETECT_FFT_SIZE / 2 frames long. threshold <= 0
+// uses SYNC_DETECT_THRESHOLD. 0 on success, -1 on bad arguments or out of
+// memory.
+int sync_detector_init(sync_detector_t *d, const float *pattern, uint32_t length, float threshold);
+void sync_detector_free(sync_detector_t *d);
+
+// Feed the next count frames (samples stride floats apart, e.g. one channel
+// of interleaved audio). Matches are appended to d->matches as they are
+// confirmed.
+void sync_detector_feed(sync_detector_t *d, const float *samples, size_t count, size_t stride);
+
+// Correlate what is left at the end of the stream
+void sync_detector_finish(sync_detector_t *d);
+
+// Find every sync marker the daemon injects (sync-marker.h) in a buffer.
+// Up to max_matches are stored; returns how many there are in total, or -1
+// when out of memory.
+int64_t sync_detect(const float *samples, size_t count, size_t stride, sync_detect_match_t *matches, size_t max_matches);
+
+#endif /* SYNC_DETECT */
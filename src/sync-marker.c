@@ -0,0 +1,55 @@
+#include "sync-marker.h"
+
+// Very low amplitude, non-musical, pseudo-random
+const float sync_marker_pattern[SYNC_MARKER_LENGTH] = {
+    1.23e-5f, -2.34e-5f, 3.45e-5f, -4.56e-5f,
+    5.67e-5f, -6.78e-5f, 7.89e-5f, -8.90e-5f,
+    9.01e-5f, -1.23e-5f, 1.35e-5f, -2.46e-5f,
+    3.57e-5f, -4.68e-5f, 5.79e-5f, -6.80e-5f
+};
+
+// Rows 0, 5, 10, 15 and 6 of the 16 point Walsh-Hadamard matrix
+static const unsigned int walsh_rows[SYNC_MARKER_TYPES] = {0, 5, 10, 15, 6};
+
+static float patterns[SYNC_MARKER_TYPES][SYNC_MARKER_LENGTH];
+static int patterns_ready;
+
+static void build_patterns(void) {
+    for (unsigned int t = 0; t < SYNC_MARKER_TYPES; ++t) {
+        for (unsigned int i = 0; i < SYNC_MARKER_LENGTH; ++i) {
+            int flip = __builtin_parity(walsh_rows[t] & i);
+            patterns[t][i] = flip ? -sync_marker_pattern[i] : sync_marker_pattern[i];
+        }
+    }
+}
+
+const float *sync_marker_pattern_for(unsigned int type) {
+    if (type >= SYNC_MARKER_TYPES) return NULL;
+    // Building the table is idempotent, so a race here only repeats work
+    if (!__atomic_load_n(&patterns_ready, __ATOMIC_ACQUIRE)) {
+        build_patterns();
+        __atomic_store_n(&patterns_ready, 1, __ATOMIC_RELEASE);
+    }
+    return patterns[type];
+}
+
+void sync_marker_tick(uint32_t sequence, float *out) {
+    const float *pattern = sync_marker_pattern_for(SYNC_MARKER_TICK);
+    for (unsigned int i = 0; i < SYNC_MARKER_LENGTH; ++i) out[i] = pattern[i];
+    for (unsigned int b = 0; b < SYNC_MARKER_TICK_BITS; ++b) {
+        int bit = (sequence >> (SYNC_MARKER_TICK_BITS - 1 - b)) & 1;
+        out[SYNC_MARKER_LENGTH + b] = bit ? SYNC_MARKER_TICK_AMPLITUDE : -SYNC_MARKER_TICK_AMPLITUDE;
+    }
+}
+
+int32_t sync_marker_tick_sequence(const float *samples, size_t stride, float gain) {
+    float expected = SYNC_MARKER_TICK_AMPLITUDE * gain;
+    int32_t sequence = 0;
+    for (unsigned int b = 0; b < SYNC_MARKER_TICK_BITS; ++b) {
+        float v = samples[(SYNC_MARKER_LENGTH + b) * stride];
+        float a = v < 0.0f ? -v : v;
+        if (!(a > 0.5f * expected && a < 1.5f * expected)) return -1;
+        sequence = (sequence << 1) | (v > 0.0f);
+    }
+    return sequence;
+}
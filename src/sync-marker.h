@@ -0,0 +1,40 @@
+#ifndef SYNC_MARKER
+#define SYNC_MARKER
+
+#include <stddef.h>
+#include <stdint.h>
+
+// The marker the daemon writes into the audio when recording starts, and
+// that the patchers look for in both the REAPER take and the recording
+// (sync-detect.h)
+#define SYNC_MARKER_LENGTH 16
+
+extern const float sync_marker_pattern[SYNC_MARKER_LENGTH];
+
+// Punch-ins and loop boundaries get their own markers: the same amplitudes
+// with the signs of a different Walsh code, far enough apart that one never
+// correlates as another. Type 0 is sync_marker_pattern.
+#define SYNC_MARKER_TYPES 5
+#define SYNC_MARKER_TICK 4
+
+// Pattern of a marker type, or NULL if type is out of range
+const float *sync_marker_pattern_for(unsigned int type);
+
+// Numbered tick markers, injected periodically while a take records: the
+// SYNC_MARKER_TICK pattern followed by SYNC_MARKER_TICK_BITS samples of
+// +-SYNC_MARKER_TICK_AMPLITUDE, most significant bit first. The flat bits
+// correlate with no marker pattern (about 0.88 at best), so they never
+// pass for one.
+#define SYNC_MARKER_TICK_BITS 16
+#define SYNC_MARKER_TICK_LENGTH (SYNC_MARKER_LENGTH + SYNC_MARKER_TICK_BITS)
+#define SYNC_MARKER_TICK_AMPLITUDE 5e-5f
+
+// The SYNC_MARKER_TICK_LENGTH samples of tick sequence (modulo 2^16)
+void sync_marker_tick(uint32_t sequence, float *out);
+
+// Sequence number of the tick starting at samples[0] (samples stride floats
+// apart), whose pattern matched with gain (sync_detect_match_t). -1 if a
+// bit is not clearly there, e.g. the tick was cut short or requantized away.
+int32_t sync_marker_tick_sequence(const float *samples, size_t stride, float gain);
+
+#endif /* SYNC_MARKER */
@@ -0,0 +1,203 @@
+#include "take-encoder.h"
+#include "sample-convert.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+static double monotonic_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+int take_encoder_init(take_encoder_t *te, audio_buffer_t *ab, const char *dir, int split, uint64_t pre_roll) {
+    memset(te, 0, sizeof(*te));
+    te->ab = ab;
+    snprintf(te->dir, sizeof(te->dir), "%s", dir);
+    te->split = split && ab->num_channels > 1;
+    te->pre_roll = pre_roll;
+    size_t samples = (size_t)TAKE_ENCODER_CHUNK_FRAMES * ab->num_channels;
+    te->planar = (float *)malloc(sizeof(float) * samples);
+    te->interleaved = (float *)malloc(sizeof(float) * samples);
+    te->pcm = (uint8_t *)malloc(samples * 3);
+    if (!te->planar || !te->interleaved || !te->pcm) {
+        take_encoder_free(te);
+        return -2;
+    }
+    return 0;
+}
+
+static void close_file(take_encoder_file_t *f) {
+    if (f->file) sf_close(f->file);
+    f->file = NULL;
+    f->stats.bytes = f->stats.frames * f->num_channels * 3;
+}
+
+// Throw away the files of a take that will never be finished
+static void drop_files(take_encoder_t *te) {
+    for (unsigned int i = 0; i < te->num_files; ++i) {
+        close_file(&te->files[i]);
+        unlink(te->files[i].path);
+    }
+    te->num_files = 0;
+    te->num_segments = 0;
+}
+
+void take_encoder_free(take_encoder_t *te) {
+    if (te->take_id) drop_files(te);
+    free(te->segments);
+    free(te->files);
+    free(te->planar);
+    free(te->interleaved);
+    free(te->pcm);
+    memset(te, 0, sizeof(*te));
+}
+
+static int add_file(take_encoder_t *te, uint32_t segment, const marker_segment_t *seg, int channel) {
+    if (te->num_files == te->files_capacity) {
+        unsigned int capacity = te->files_capacity ? te->files_capacity * 2 : 16;
+        take_encoder_file_t *files = (take_encoder_file_t *)realloc(te->files, capacity * sizeof(*files));
+        if (!files) return -2;
+        te->files = files;
+        te->files_capacity = capacity;
+    }
+    take_encoder_file_t *f = &te->files[te->num_files++];
+    memset(f, 0, sizeof(*f));
+    f->segment = segment;
+    f->channel = channel;
+    f->first_channel = channel < 0 ? 0 : (unsigned int)channel;
+    f->num_channels = channel < 0 ? te->ab->num_channels : 1;
+    f->start_frame = seg->start_frame > te->pre_roll ? seg->start_frame - te->pre_roll : 0;
+    f->end_frame = seg->end_frame;
+    f->encoded_frame = f->start_frame;
+    if (channel < 0) {
+        snprintf(f->path, sizeof(f->path), "%s/.take%u_seg%02u.part", te->dir, seg->take_id, segment);
+    } else {
+        snprintf(f->path, sizeof(f->path), "%s/.take%u_seg%02u_ch%02d.part", te->dir, seg->take_id, segment, channel + 1);
+    }
+    return 0;
+}
+
+// Pick up the take's segments up to until_frame and open files for new ones
+static void sync_segments(take_encoder_t *te, uint64_t until_frame) {
+    marker_index_t *mi = &te->ab->markers;
+    uint32_t n = marker_index_segments(mi, until_frame, NULL, 0);
+    if (n == 0) return;
+    if (n > te->segments_capacity) {
+        marker_segment_t *segments = (marker_segment_t *)realloc(te->segments, n * 2 * sizeof(*segments));
+        if (!segments) return;
+        te->segments = segments;
+        te->segments_capacity = n * 2;
+    }
+    // Markers at or after until_frame are ignored, so the count cannot grow here
+    n = marker_index_segments(mi, until_frame, te->segments, n);
+    uint32_t take = te->segments[0].take_id;
+    if (take == te->done_take_id) return;
+    if (take != te->take_id) {
+        if (te->take_id) drop_files(te);
+        te->take_id = take;
+        te->num_segments = 0;
+    }
+    for (uint32_t i = te->num_segments; i < n; ++i) {
+        const marker_segment_t *seg = &te->segments[i];
+        unsigned int first_file = te->num_files;
+        int ret = 0;
+        if (!te->split) {
+            ret = add_file(te, i, seg, -1);
+        } else {
+            // Split exports only cover the channels a punch-in was armed on
+            for (unsigned int ch = 0; ch < te->ab->num_channels && ret == 0; ++ch) {
+                if (ch < 64 && !((seg->channel_mask >> ch) & 1)) continue;
+                ret = add_file(te, i, seg, (int)ch);
+            }
+        }
+        if (ret < 0) {
+            // Retried on the next poll
+            te->num_files = first_file;
+            break;
+        }
+        te->num_segments = i + 1;
+    }
+    for (unsigned int i = 0; i < te->num_files; ++i) {
+        te->files[i].end_frame = te->segments[te->files[i].segment].end_frame;
+    }
+}
+
+// Append the file's frames up to its segment end
+static uint64_t encode_file(take_encoder_t *te, take_encoder_file_t *f) {
+    if (f->result < 0 || f->encoded_frame >= f->end_frame) return 0;
+    double t0 = monotonic_seconds();
+    if (!f->file) {
+        SF_INFO sfinfo = {0};
+        sfinfo.samplerate = te->ab->sample_rate;
+        sfinfo.channels = f->num_channels;
+        sfinfo.format = SF_FORMAT_WAV | SF_FORMAT_PCM_24;
+        f->file = sf_open(f->path, SFM_WRITE, &sfinfo);
+        if (!f->file) {
+            f->result = -4;
+            return 0;
+        }
+    }
+    uint64_t encoded = 0;
+    unsigned int nc = f->num_channels;
+    while (f->encoded_frame < f->end_frame) {
+        uint64_t from = f->encoded_frame;
+        uint32_t n = f->end_frame - from < TAKE_ENCODER_CHUNK_FRAMES ? (uint32_t)(f->end_frame - from) : TAKE_ENCODER_CHUNK_FRAMES;
+        for (unsigned int ch = 0; ch < nc; ++ch) {
+            float *plane = &te->planar[(size_t)ch * TAKE_ENCODER_CHUNK_FRAMES];
+            if (audio_buffer_read_range(te->ab, f->first_channel + ch, plane, from, from + n) < 0) {
+                f->result = -3;
+                break;
+            }
+            for (uint32_t i = 0; i < n; ++i) te->interleaved[(size_t)i * nc + ch] = plane[i];
+        }
+        if (f->result < 0) break;
+        size_t total = (size_t)n * nc;
+        sample_convert_clamp(te->interleaved, total);
+        sample_convert_to_pcm24(te->interleaved, te->pcm, total);
+        if (sf_write_raw(f->file, te->pcm, (sf_count_t)(total * 3)) != (sf_count_t)(total * 3)) {
+            f->result = -4;
+            break;
+        }
+        f->encoded_frame += n;
+        f->stats.frames += n;
+        encoded += n;
+    }
+    // Keep the header current so a crash mid take leaves a playable file
+    if (encoded > 0 && f->file) sf_command(f->file, SFC_UPDATE_HEADER_NOW, NULL, 0);
+    f->stats.seconds += monotonic_seconds() - t0;
+    return encoded;
+}
+
+uint64_t take_encoder_poll(take_encoder_t *te, uint64_t until_frame) {
+    if (!te->ab) return 0;
+    // Every marker before the write position is published before it
+    uint64_t w = audio_buffer_write_position(te->ab);
+    if (until_frame > w) until_frame = w;
+    sync_segments(te, until_frame);
+    if (!te->take_id) return 0;
+    uint64_t encoded = 0;
+    for (unsigned int i = 0; i < te->num_files; ++i) {
+        take_encoder_file_t *f = &te->files[i];
+        encoded += encode_file(te, f);
+        // Earlier segments never change, their files can be closed early
+        if (f->segment + 1 < te->num_segments && f->encoded_frame >= f->end_frame) close_file(f);
+    }
+    return encoded;
+}
+
+unsigned int take_encoder_finish(take_encoder_t *te, uint64_t stop_frame) {
+    te->tail_frames = take_encoder_poll(te, stop_frame);
+    if (!te->take_id) return 0;
+    for (unsigned int i = 0; i < te->num_files; ++i) close_file(&te->files[i]);
+    te->done_take_id = te->take_id;
+    te->take_id = 0;
+    return te->num_files;
+}
+
+void take_encoder_reset(take_encoder_t *te) {
+    te->num_files = 0;
+    te->num_segments = 0;
+}
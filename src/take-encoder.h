@@ -0,0 +1,70 @@
+#ifndef TAKE_ENCODER
+#define TAKE_ENCODER
+
+#include <stdint.h>
+#include <sndfile.h>
+#include "audio-buffer.h"
+
+// Encodes the take being recorded while it is still running. Polled from a
+// background thread, it follows the write head and appends packed 24 bit
+// PCM to one file per segment (or per segment and channel), so a stop only
+// has to encode the last few hundred milliseconds and let libsndfile patch
+// the header sizes. The output matches audio_buffer_write_segments_to_wav.
+
+// Frames read from the buffer per channel and write
+#define TAKE_ENCODER_CHUNK_FRAMES 16384
+
+typedef struct {
+    SNDFILE *file;
+    char path[1024];            // Where the file is written while the take runs
+    uint32_t segment;           // Index of its segment in the take
+    int channel;                // The channel of a split export, -1 otherwise
+    unsigned int first_channel;
+    unsigned int num_channels;
+    uint64_t start_frame;
+    uint64_t end_frame;         // Known once a later marker or the stop ends the segment
+    uint64_t encoded_frame;     // Frames before this one are in the file
+    int result;                 // 0, or an audio_buffer_write_segments_to_wav error code
+    audio_export_stats_t stats; // seconds is the time spent encoding it
+} take_encoder_file_t;
+
+typedef struct {
+    audio_buffer_t *ab;
+    char dir[512];
+    int split;                  // One file per channel
+    uint64_t pre_roll;          // Frames each file starts before its marker
+    uint32_t take_id;           // Take being encoded, 0 if none
+    uint32_t done_take_id;      // Last take finished, it is never picked up again
+    uint32_t num_segments;
+    marker_segment_t *segments;
+    uint32_t segments_capacity;
+    take_encoder_file_t *files;
+    unsigned int num_files;
+    unsigned int files_capacity;
+    float *planar;
+    float *interleaved;
+    uint8_t *pcm;
+    uint64_t tail_frames;       // Frames the last finish still had to encode
+} take_encoder_t;
+
+// Files go to dir. 0 on success, -2 out of memory.
+int take_encoder_init(take_encoder_t *te, audio_buffer_t *ab, const char *dir, int split, uint64_t pre_roll);
+
+// Deletes the files of a take that was not finished
+void take_encoder_free(take_encoder_t *te);
+
+// Encode the current take up to until_frame (at most the write position).
+// A new record start drops the files of an unfinished take. Returns the
+// number of frames encoded.
+uint64_t take_encoder_poll(take_encoder_t *te, uint64_t until_frame);
+
+// Encode the rest of the take recording at stop_frame and close its files.
+// Written frames cannot be taken back, so stop_frame must not be before an
+// until_frame polled earlier. te->files then lists them until
+// take_encoder_reset. Returns the number of files, 0 if there was no take.
+unsigned int take_encoder_finish(take_encoder_t *te, uint64_t stop_frame);
+
+// Forget the finished files (renamed or deleted by the caller)
+void take_encoder_reset(take_encoder_t *te);
+
+#endif /* TAKE_ENCODER */
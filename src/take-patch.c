@@ -0,0 +1,519 @@
+#include "take-patch.h"
+#include "sync-detect.h"
+#include "sync-marker.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// What --burn-marker multiplies the marker by, the Python patchers used the same
+#define BURN_GAIN 10000.0f
+
+int64_t take_patch_find_sync(const wav_file_t *wav, float *confidence) {
+    sync_detector_t detector;
+    if (sync_detector_init(&detector, sync_marker_pattern, SYNC_MARKER_LENGTH, 0.0f) < 0) return -1;
+    float chunk[TAKE_PATCH_CHUNK_FRAMES];
+    // Stops at the first confirmed match, the detector carries the overlap
+    for (uint64_t start = 0; start < wav->frames && detector.num_matches == 0; start += TAKE_PATCH_CHUNK_FRAMES) {
+        uint32_t n = TAKE_PATCH_CHUNK_FRAMES;
+        if ((uint64_t)n > wav->frames - start) n = (uint32_t)(wav->frames - start);
+        wav_file_read_channel(wav, 0, chunk, start, n);
+        sync_detector_feed(&detector, chunk, n, 1);
+    }
+    if (detector.num_matches == 0) sync_detector_finish(&detector);
+    int64_t frame = -1;
+    if (detector.num_matches > 0) {
+        frame = detector.matches[0].frame;
+        if (confidence) *confidence = detector.matches[0].confidence;
+    }
+    sync_detector_free(&detector);
+    return frame;
+}
+
+// The recording's sidecar as a string, NULL if there is none or its rate
+// is not sample_rate. The caller frees it.
+static char *read_sidecar(const char *recording_path, unsigned int sample_rate) {
+    // Same name with .json for .wav, like take_sidecar_path
+    char path[1024];
+    size_t n = strlen(recording_path);
+    if (n >= 4 && strcmp(recording_path + n - 4, ".wav") == 0) n -= 4;
+    snprintf(path, sizeof(path), "%.*s.json", (int)n, recording_path);
+    FILE *f = fopen(path, "r");
+    if (!f) return NULL;
+    char *json = NULL;
+    long size = fseek(f, 0, SEEK_END) == 0 ? ftell(f) : -1;
+    if (size >= 0 && fseek(f, 0, SEEK_SET) == 0 && (json = (char *)malloc((size_t)size + 1)) != NULL) {
+        json[fread(json, 1, (size_t)size, f)] = '\0';
+    }
+    fclose(f);
+    unsigned int rate;
+    const char *p = json ? strstr(json, "\"sample_rate\":") : NULL;
+    if (!p || sscanf(p, "\"sample_rate\":%u", &rate) != 1 || rate != sample_rate) {
+        free(json);
+        return NULL;
+    }
+    return json;
+}
+
+int64_t take_patch_sidecar_sync(const char *recording_path, unsigned int sample_rate) {
+    char *json = read_sidecar(recording_path, sample_rate);
+    if (!json) return -1;
+    long long offset = -1;
+    const char *p = strstr(json, "\"sync\":{");
+    if (!p || !(p = strstr(p, "\"offset\":")) || sscanf(p, "\"offset\":%lld", &offset) != 1 || offset < 0) offset = -1;
+    free(json);
+    return offset;
+}
+
+uint32_t take_patch_sidecar_ticks(const char *recording_path, unsigned int sample_rate, take_patch_tick_t *ticks, uint32_t max) {
+    char *json = read_sidecar(recording_path, sample_rate);
+    if (!json) return 0;
+    uint32_t n = 0;
+    const char *p = strstr(json, "\"markers\":[");
+    for (; p && (p = strstr(p, "{\"frame\":")) != NULL; ++p) {
+        unsigned long long frame;
+        long long offset;
+        unsigned int sequence;
+        if (sscanf(p, "{\"frame\":%llu,\"offset\":%lld,\"type\":\"tick\",\"sequence\":%u", &frame, &offset, &sequence) != 3) continue;
+        if (n < max) {
+            ticks[n].frame = offset;
+            ticks[n].sequence = sequence;
+        }
+        n++;
+    }
+    free(json);
+    return n;
+}
+
+int take_patch_sidecar_glitches(const char *recording_path, unsigned int sample_rate, glitch_t *glitches, uint32_t max,
+                                int64_t *checked_until) {
+    char *json = read_sidecar(recording_path, sample_rate);
+    if (!json) return -1;
+    unsigned long long file_start, compared_until;
+    const char *p = strstr(json, "\"start_frame\":");
+    const char *loopback = strstr(json, "\"loopback\":{");
+    if (!p || sscanf(p, "\"start_frame\":%llu", &file_start) != 1 || !loopback ||
+        !(p = strstr(loopback, "\"compared_until\":")) || sscanf(p, "\"compared_until\":%llu", &compared_until) != 1) {
+        free(json);
+        return -1;
+    }
+    *checked_until = compared_until > file_start ? (int64_t)(compared_until - file_start) : 0;
+    int n = 0;
+    p = strstr(loopback, "\"glitches\":[");
+    for (; p && (p = strstr(p, "{\"start_frame\":")) != NULL; ++p) {
+        unsigned long long start, end;
+        long long offset;
+        char type[16];
+        float max_diff, rms_diff = 0.0f;
+        if (sscanf(p, "{\"start_frame\":%llu,\"end_frame\":%llu,\"offset\":%lld,\"type\":\"%15[a-z]\",\"max_diff\":%f,\"rms_diff\":%f",
+                   &start, &end, &offset, type, &max_diff, &rms_diff) < 5 || end < start || offset < 0) continue;
+        if ((uint32_t)n < max) {
+            glitch_t *g = &glitches[n];
+            g->start_frame = (uint64_t)offset;
+            g->end_frame = (uint64_t)offset + (end - start);
+            g->max_diff = max_diff;
+            g->rms_diff = rms_diff;
+            g->type = strcmp(type, "zeroed") == 0 ? GLITCH_ZEROED : GLITCH_DIFFERENT;
+        }
+        n++;
+    }
+    free(json);
+    return n;
+}
+
+static void burn_marker(wav_file_t *take, int64_t sync, uint64_t end, unsigned int channels) {
+    float marker[SYNC_MARKER_LENGTH];
+    uint32_t n = SYNC_MARKER_LENGTH;
+    if ((uint64_t)sync + n > end) n = (uint32_t)(end - (uint64_t)sync);
+    for (unsigned int ch = 0; ch < channels; ++ch) {
+        wav_file_read_channel(take, ch, marker, (uint64_t)sync, n);
+        for (uint32_t i = 0; i < n; ++i) marker[i] *= BURN_GAIN;
+        wav_file_write_channel(take, ch, marker, (uint64_t)sync, n);
+    }
+}
+
+// Every tick in frames [start, end) of the first channel, in frame order.
+// The caller frees the array.
+static take_patch_tick_t *find_ticks(const wav_file_t *wav, uint64_t start, uint64_t end, uint32_t *count) {
+    *count = 0;
+    sync_detector_t detector;
+    if (sync_detector_init(&detector, sync_marker_pattern_for(SYNC_MARKER_TICK), SYNC_MARKER_LENGTH, 0.0f) < 0) return NULL;
+    float chunk[TAKE_PATCH_CHUNK_FRAMES];
+    for (uint64_t f = start; f < end; f += TAKE_PATCH_CHUNK_FRAMES) {
+        uint32_t n = TAKE_PATCH_CHUNK_FRAMES;
+        if ((uint64_t)n > end - f) n = (uint32_t)(end - f);
+        wav_file_read_channel(wav, 0, chunk, f, n);
+        sync_detector_feed(&detector, chunk, n, 1);
+    }
+    sync_detector_finish(&detector);
+    take_patch_tick_t *ticks = detector.num_matches ? (take_patch_tick_t *)malloc(sizeof(*ticks) * detector.num_matches) : NULL;
+    for (size_t i = 0; ticks && i < detector.num_matches; ++i) {
+        uint64_t frame = start + (uint64_t)detector.matches[i].frame;
+        if (frame + SYNC_MARKER_TICK_LENGTH > wav->frames) continue;
+        wav_file_read_channel(wav, 0, chunk, frame, SYNC_MARKER_TICK_LENGTH);
+        int32_t sequence = sync_marker_tick_sequence(chunk, 1, detector.matches[i].gain);
+        if (sequence < 0) continue;
+        ticks[*count].frame = (int64_t)frame;
+        ticks[*count].sequence = (uint32_t)sequence;
+        (*count)++;
+    }
+    sync_detector_free(&detector);
+    return ticks;
+}
+
+// Frame of tick sequence within TAKE_PATCH_TICK_SEARCH_FRAMES of predicted, or -1
+static int64_t find_tick_near(const wav_file_t *wav, int64_t predicted, uint32_t sequence) {
+    int64_t from = predicted - TAKE_PATCH_TICK_SEARCH_FRAMES;
+    int64_t to = predicted + TAKE_PATCH_TICK_SEARCH_FRAMES + SYNC_MARKER_TICK_LENGTH;
+    if (from < 0) from = 0;
+    if (to > (int64_t)wav->frames) to = (int64_t)wav->frames;
+    if (to <= from) return -1;
+    uint32_t count;
+    take_patch_tick_t *ticks = find_ticks(wav, (uint64_t)from, (uint64_t)to, &count);
+    // Only the bits of the sequence number are in the audio
+    uint32_t mask = (1u << SYNC_MARKER_TICK_BITS) - 1;
+    int64_t frame = -1;
+    for (uint32_t i = 0; i < count && frame < 0; ++i) {
+        if (ticks[i].sequence == (sequence & mask)) frame = ticks[i].frame;
+    }
+    free(ticks);
+    return frame;
+}
+
+// Take frame t holds recording frame t - offset, with the offset of the
+// last anchor at or before t (of the first anchor before that)
+typedef struct {
+    uint64_t take_frame;
+    int64_t offset;
+} anchor_t;
+
+typedef struct {
+    anchor_t *anchors;
+    uint32_t count;
+    uint32_t capacity;
+} alignment_t;
+
+static int add_anchor(alignment_t *al, uint64_t take_frame, int64_t offset) {
+    if (al->count == al->capacity) {
+        uint32_t capacity = al->capacity ? al->capacity * 2 : 16;
+        anchor_t *anchors = (anchor_t *)realloc(al->anchors, sizeof(anchor_t) * capacity);
+        if (!anchors) return -1;
+        al->anchors = anchors;
+        al->capacity = capacity;
+    }
+    al->anchors[al->count].take_frame = take_frame;
+    al->anchors[al->count].offset = offset;
+    al->count++;
+    return 0;
+}
+
+// Index of the anchor whose interval holds take frame t
+static uint32_t anchor_at(const alignment_t *al, uint64_t t) {
+    uint32_t lo = 0, hi = al->count;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (al->anchors[mid].take_frame <= t) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo > 0 ? lo - 1 : 0;
+}
+
+// Anchor on the sync marker, then on every tick of the recording that
+// turns up in the take near where the interval before it puts it
+static int align_on_ticks(const wav_file_t *take, const wav_file_t *recording, const take_patch_options_t *options,
+                          alignment_t *al, take_patch_result_t *result) {
+    int64_t offset = result->take_sync - result->rec_sync;
+    if (add_anchor(al, (uint64_t)result->take_sync, offset) < 0) return -1;
+    if (options->no_ticks) return 0;
+    const take_patch_tick_t *ticks = options->rec_ticks;
+    uint32_t count = options->num_rec_ticks;
+    take_patch_tick_t *found = NULL;
+    if (!ticks) ticks = found = find_ticks(recording, (uint64_t)result->rec_sync, recording->frames, &count);
+    double sxx = 0.0, sxy = 0.0;
+    int ret = 0;
+    for (uint32_t i = 0; i < count; ++i) {
+        const take_patch_tick_t *tick = &ticks[i];
+        if (tick->frame <= result->rec_sync) continue;
+        const anchor_t *last = &al->anchors[al->count - 1];
+        int64_t predicted = tick->frame + last->offset;
+        if (predicted >= (int64_t)take->frames) break;
+        int64_t t = find_tick_near(take, predicted, tick->sequence);
+        if (t < 0 || (uint64_t)t <= last->take_frame) continue;
+        if (add_anchor(al, (uint64_t)t, t - tick->frame) < 0) {
+            ret = -1;
+            break;
+        }
+        // How far this tick moved against the sync marker's alignment
+        int64_t shift = t - tick->frame - offset;
+        double x = (double)(tick->frame - result->rec_sync);
+        sxx += x * x;
+        sxy += x * (double)shift;
+        if (llabs(shift) > llabs(result->max_shift)) result->max_shift = shift;
+    }
+    result->ticks = al->count - 1;
+    result->drift_ppm = sxx > 0.0 ? sxy / sxx * 1e6 : 0.0;
+    free(found);
+    return ret;
+}
+
+// Take frame holding recording frame r
+static uint64_t take_frame_of(const alignment_t *al, int64_t r) {
+    uint32_t lo = 0, hi = al->count;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if ((int64_t)al->anchors[mid].take_frame - al->anchors[mid].offset <= r) lo = mid + 1;
+        else hi = mid;
+    }
+    int64_t t = r + al->anchors[lo > 0 ? lo - 1 : 0].offset;
+    return t > 0 ? (uint64_t)t : 0;
+}
+
+// The chunk from take frame *t on: within one interval, before end, and
+// with recording frames behind it. Frames the recording does not cover are
+// skipped. Returns its length, 0 once *t reaches end; *r gets the
+// recording frame of *t.
+static uint32_t next_chunk(const alignment_t *al, uint64_t recording_frames, uint64_t *t, uint64_t end, uint64_t *r) {
+    while (*t < end) {
+        uint32_t i = anchor_at(al, *t);
+        uint64_t stop = i + 1 < al->count && al->anchors[i + 1].take_frame < end ? al->anchors[i + 1].take_frame : end;
+        int64_t rf = (int64_t)*t - al->anchors[i].offset;
+        if (rf >= 0 && (uint64_t)rf < recording_frames) {
+            uint64_t n = stop - *t;
+            if (n > recording_frames - (uint64_t)rf) n = recording_frames - (uint64_t)rf;
+            if (n > TAKE_PATCH_CHUNK_FRAMES) n = TAKE_PATCH_CHUNK_FRAMES;
+            *r = (uint64_t)rf;
+            return (uint32_t)n;
+        }
+        *t = stop;
+    }
+    return 0;
+}
+
+typedef struct {
+    float *take;
+    float *rec;
+    float *channel;
+} patch_buffers_t;
+
+// Replace take frames [t, t + n) with recording frames from r on. take_buf
+// must hold the take's frames when the samples are converted.
+static void copy_from_recording(wav_file_t *take, const wav_file_t *recording, uint64_t t, uint64_t r, uint32_t n,
+                                unsigned int channels, int raw, patch_buffers_t *b) {
+    unsigned int tc = take->channels, rc = recording->channels;
+    if (raw && tc == rc) {
+        memcpy(wav_file_sample(take, t, 0), wav_file_sample(recording, r, 0), (size_t)n * take->block_align);
+    } else if (raw) {
+        for (uint32_t f = 0; f < n; ++f) {
+            memcpy(wav_file_sample(take, t + f, 0), wav_file_sample(recording, r + f, 0), (size_t)channels * take->bytes_per_sample);
+        }
+    } else if (channels == tc) {
+        // Every take channel is replaced, convert whole frames
+        for (uint32_t f = 0; f < n; ++f) {
+            memcpy(&b->take[(size_t)f * tc], &b->rec[(size_t)f * rc], sizeof(float) * tc);
+        }
+        wav_file_write_frames(take, b->take, t, n);
+    } else {
+        for (unsigned int ch = 0; ch < channels; ++ch) {
+            for (uint32_t f = 0; f < n; ++f) b->channel[f] = b->rec[(size_t)f * rc + ch];
+            wav_file_write_channel(take, ch, b->channel, t, n);
+        }
+    }
+}
+
+// Linear crossfade over take frames [t, t + n): from the take to the
+// recording if fade_in, the other way round otherwise
+static void crossfade(wav_file_t *take, const wav_file_t *recording, uint64_t t, uint64_t r, uint32_t n,
+                      unsigned int channels, int fade_in, patch_buffers_t *b) {
+    for (unsigned int ch = 0; ch < channels; ++ch) {
+        wav_file_read_channel(take, ch, b->take, t, n);
+        wav_file_read_channel(recording, ch, b->rec, r, n);
+        for (uint32_t f = 0; f < n; ++f) {
+            float g = ((float)f + 0.5f) / (float)n;
+            if (!fade_in) g = 1.0f - g;
+            b->channel[f] = b->take[f] * (1.0f - g) + b->rec[f] * g;
+        }
+        wav_file_write_channel(take, ch, b->channel, t, n);
+    }
+}
+
+// Take frames [t, end) from the recording, in chunks
+static void copy_range(wav_file_t *take, const wav_file_t *recording, uint64_t t, uint64_t end, const alignment_t *al,
+                       unsigned int channels, int raw, patch_buffers_t *b) {
+    uint64_t r;
+    uint32_t n;
+    while ((n = next_chunk(al, recording->frames, &t, end, &r)) > 0) {
+        if (!raw) {
+            wav_file_read_frames(take, b->take, t, n);
+            wav_file_read_frames(recording, b->rec, r, n);
+        }
+        copy_from_recording(take, recording, t, r, n, channels, raw, b);
+        t += n;
+    }
+}
+
+// Rewrite each glitch and fade in and out over up to
+// TAKE_PATCH_CROSSFADE_FRAMES around it, within [start, end) and without
+// running into the neighbouring glitches. Returns the frames written.
+static uint64_t patch_glitches(wav_file_t *take, const wav_file_t *recording, const glitch_map_t *gm, uint64_t start,
+                               uint64_t end, const alignment_t *al, unsigned int channels, int raw, patch_buffers_t *b) {
+    uint64_t written = 0, floor = start;
+    for (uint32_t i = 0; i < gm->count; ++i) {
+        const glitch_t *g = &gm->glitches[i];
+        uint64_t ceiling = i + 1 < gm->count ? gm->glitches[i + 1].start_frame : end;
+        uint64_t half = i + 1 < gm->count ? (ceiling - g->end_frame) / 2 : TAKE_PATCH_CROSSFADE_FRAMES;
+        uint64_t fade_in = g->start_frame - floor < TAKE_PATCH_CROSSFADE_FRAMES ? g->start_frame - floor : TAKE_PATCH_CROSSFADE_FRAMES;
+        uint64_t fade_out = half < TAKE_PATCH_CROSSFADE_FRAMES ? half : TAKE_PATCH_CROSSFADE_FRAMES;
+        if (g->end_frame + fade_out > end) fade_out = end - g->end_frame;
+        uint64_t a = g->start_frame - fade_in;
+        int64_t in = al->anchors[anchor_at(al, a)].offset, out = al->anchors[anchor_at(al, g->end_frame)].offset;
+        if (fade_in) crossfade(take, recording, a, a - in, (uint32_t)fade_in, channels, 1, b);
+        copy_range(take, recording, g->start_frame, g->end_frame, al, channels, raw, b);
+        if (fade_out) crossfade(take, recording, g->end_frame, g->end_frame - out, (uint32_t)fade_out, channels, 0, b);
+        floor = g->end_frame + fade_out;
+        written += floor - a;
+    }
+    return written;
+}
+
+int take_patch(wav_file_t *take, const wav_file_t *recording, const take_patch_options_t *options, take_patch_result_t *result) {
+    memset(result, 0, sizeof(*result));
+    if (take->sample_rate != recording->sample_rate) return TAKE_PATCH_RATE_MISMATCH;
+    result->take_sync = take_patch_find_sync(take, &result->take_confidence);
+    if (result->take_sync < 0) return TAKE_PATCH_NO_SYNC_IN_TAKE;
+    if (options->have_rec_sync) {
+        result->rec_sync = options->rec_sync < (int64_t)recording->frames ? options->rec_sync : -1;
+        result->rec_confidence = 1.0f;
+    } else {
+        result->rec_sync = take_patch_find_sync(recording, &result->rec_confidence);
+    }
+    if (result->rec_sync < 0) return TAKE_PATCH_NO_SYNC_IN_RECORDING;
+
+    // Each interval between anchors has an offset of its own. Where the
+    // recording ends first, the rest of the take is left as it is.
+    alignment_t al = {0};
+    if (align_on_ticks(take, recording, options, &al, result) < 0) {
+        free(al.anchors);
+        return TAKE_PATCH_NO_MEMORY;
+    }
+    uint64_t start = (uint64_t)result->take_sync;
+    uint64_t end = recording->frames + al.anchors[al.count - 1].offset;
+    if (end > take->frames) end = take->frames;
+    if (end <= start) {
+        free(al.anchors);
+        return TAKE_PATCH_NOTHING_TO_PATCH;
+    }
+
+    unsigned int tc = take->channels, rc = recording->channels;
+    unsigned int channels = tc < rc ? tc : rc;
+    result->channels = channels;
+    result->copied_raw = take->format == recording->format;
+    patch_buffers_t b;
+    b.take = (float *)malloc(sizeof(float) * TAKE_PATCH_CHUNK_FRAMES * tc);
+    b.rec = (float *)malloc(sizeof(float) * TAKE_PATCH_CHUNK_FRAMES * rc);
+    b.channel = (float *)malloc(sizeof(float) * TAKE_PATCH_CHUNK_FRAMES);
+    glitch_map_t own_map;
+    glitch_map_t *gm = options->glitch_map;
+    if (!gm && options->glitches_only && glitch_map_init(&own_map, 0.0f, 0) == 0) gm = &own_map;
+    if (!b.take || !b.rec || !b.channel || (options->glitches_only && !gm)) {
+        free(al.anchors);
+        free(b.take);
+        free(b.rec);
+        free(b.channel);
+        return TAKE_PATCH_NO_MEMORY;
+    }
+
+    // Metrics and the glitch map skip the marker itself, it is the same in
+    // both. With glitches_only the first pass only compares.
+    int write_all = !options->dry_run && !options->glitches_only;
+    uint64_t compare_from = start + SYNC_MARKER_LENGTH;
+    double diff_sum = 0.0, diff_max = 0.0;
+    uint64_t compared = 0, covered = 0, t = start, r;
+    uint32_t n;
+    int map_ok = 0;
+    // What the daemon already checked is taken from its glitches, the
+    // comparison picks up where its check stopped
+    int64_t checked_until = 0;
+    if (options->glitches_only && options->have_rec_glitches) {
+        checked_until = options->rec_checked_until;
+        uint64_t checked_end = take_frame_of(&al, checked_until);
+        if (checked_end > end) checked_end = end;
+        result->checked_frames = checked_end > compare_from ? checked_end - compare_from : 0;
+        for (uint32_t i = 0; i < options->num_rec_glitches; ++i) {
+            const glitch_t *rg = &options->rec_glitches[i];
+            if ((int64_t)rg->start_frame >= checked_until) break;
+            glitch_t g = *rg;
+            g.start_frame = take_frame_of(&al, (int64_t)rg->start_frame);
+            g.end_frame = g.start_frame + (rg->end_frame - rg->start_frame);
+            if (g.start_frame < compare_from) g.start_frame = compare_from;
+            if (g.end_frame > checked_end) g.end_frame = checked_end;
+            if (g.end_frame > g.start_frame) map_ok |= glitch_map_add(gm, &g);
+        }
+    }
+    while ((n = next_chunk(&al, recording->frames, &t, end, &r)) > 0) {
+        if ((int64_t)r < checked_until) {
+            uint64_t k = (uint64_t)(checked_until - (int64_t)r);
+            t += k < n ? k : n;
+            continue;
+        }
+        wav_file_read_frames(take, b.take, t, n);
+        wav_file_read_frames(recording, b.rec, r, n);
+        uint32_t from = (t < compare_from) ? (uint32_t)((compare_from - t) < n ? compare_from - t : n) : 0;
+        for (uint32_t f = from; f < n; ++f) {
+            for (unsigned int ch = 0; ch < channels; ++ch) {
+                double d = fabs((double)b.take[(size_t)f * tc + ch] - (double)b.rec[(size_t)f * rc + ch]);
+                diff_sum += d;
+                if (d > diff_max) diff_max = d;
+            }
+            compared += channels;
+        }
+        if (gm && from < n) {
+            map_ok |= glitch_map_feed(gm, t + from, &b.take[(size_t)from * tc], tc, &b.rec[(size_t)from * rc], rc, channels, n - from);
+        }
+        if (write_all) copy_from_recording(take, recording, t, r, n, channels, result->copied_raw, &b);
+        covered += n;
+        t += n;
+    }
+    if (gm) {
+        map_ok |= glitch_map_finish(gm);
+        result->glitches = gm->count;
+        result->glitch_frames = glitch_map_frames(gm);
+    }
+
+    if (options->glitches_only) {
+        // A map that ran out of memory is incomplete, patching it would leave glitches behind
+        if (map_ok < 0) {
+            if (gm == &own_map) glitch_map_free(&own_map);
+            free(al.anchors);
+            free(b.take);
+            free(b.rec);
+            free(b.channel);
+            return TAKE_PATCH_NO_MEMORY;
+        }
+        if (!options->dry_run) result->frames = patch_glitches(take, recording, gm, start, end, &al, channels, result->copied_raw, &b);
+        else result->frames = result->glitch_frames;
+    } else {
+        result->frames = covered;
+    }
+    if (!options->dry_run && options->burn_marker) burn_marker(take, result->take_sync, end, channels);
+
+    result->diff_mean = compared ? diff_sum / (double)compared : 0.0;
+    result->diff_max = diff_max;
+    if (gm == &own_map) glitch_map_free(&own_map);
+    free(al.anchors);
+    free(b.take);
+    free(b.rec);
+    free(b.channel);
+    return TAKE_PATCH_OK;
+}
+
+const char *take_patch_strerror(int error) {
+    switch (error) {
+    case TAKE_PATCH_OK: return "ok";
+    case TAKE_PATCH_NO_SYNC_IN_TAKE: return "sync marker not found in the take";
+    case TAKE_PATCH_NO_SYNC_IN_RECORDING: return "sync marker not found in the recording";
+    case TAKE_PATCH_RATE_MISMATCH: return "sample rates differ";
+    case TAKE_PATCH_NOTHING_TO_PATCH: return "the recording ends before the marker";
+    case TAKE_PATCH_NO_MEMORY: return "out of memory";
+    }
+    return "unknown error";
+}
@@ -0,0 +1,99 @@
+#ifndef TAKE_PATCH
+#define TAKE_PATCH
+
+#include <stdint.h>
+#include "glitch-map.h"
+#include "wav-file.h"
+
+// Replaces the audio of a REAPER take from its sync marker on with the
+// daemon's recording of the same performance, aligned on the marker in both
+// files. Only the patched region of the take is touched, in place.
+// When the recording has tick markers (pw-ghost-rec --ticks), each interval
+// between two ticks is aligned on its own tick, so drift or a dropped
+// buffer only shifts the interval it happens in.
+
+// Frames processed per pass over both files
+#define TAKE_PATCH_CHUNK_FRAMES 16384
+// Length of the fades into and out of each patched glitch
+#define TAKE_PATCH_CROSSFADE_FRAMES 64
+// A tick is looked for this far either side of where the previous interval
+// puts it in the take
+#define TAKE_PATCH_TICK_SEARCH_FRAMES 2048
+
+// A tick marker (sync-marker.h) in a file
+typedef struct {
+    int64_t frame;
+    uint32_t sequence;
+} take_patch_tick_t;
+
+typedef struct {
+    int burn_marker; // Boost the marker so it is visible in the patched take
+    int dry_run;     // Compute the metrics, do not write
+    int have_rec_sync; // rec_sync is known (from the recording's sidecar), do not search for it
+    int64_t rec_sync;
+    int glitches_only; // Only rewrite where the take differs from the recording, crossfading in and out
+    glitch_map_t *glitch_map; // Initialized by the caller, gets those regions; may be NULL
+    int no_ticks;    // Align on the sync marker only
+    const take_patch_tick_t *rec_ticks; // The recording's ticks in frame order (from its sidecar), NULL to search for them
+    uint32_t num_rec_ticks;
+    // Glitches the daemon's return check found, in recording frames (from
+    // the recording's sidecar). With glitches_only they are patched as they
+    // are, and only the frames from rec_checked_until on are compared.
+    int have_rec_glitches;
+    const glitch_t *rec_glitches;
+    uint32_t num_rec_glitches;
+    int64_t rec_checked_until;
+} take_patch_options_t;
+
+typedef struct {
+    int64_t take_sync;   // Marker frame in the take
+    int64_t rec_sync;    // Marker frame in the recording
+    float take_confidence; // Normalized correlation of both markers, see sync-detect.h
+    float rec_confidence;
+    uint64_t frames;     // Frames patched, from take_sync on or in and around glitches
+    uint32_t glitches;   // Regions that differ (glitches_only or with a glitch_map)
+    uint64_t glitch_frames;
+    uint64_t checked_frames; // Take frames the daemon had checked, not compared again
+    unsigned int channels;
+    int copied_raw;      // Same sample format: bytes were copied verbatim
+    double diff_mean;    // Mean and max of |take - recording| over the frames compared after the marker
+    double diff_max;
+    uint32_t ticks;      // Intervals aligned on a tick found in both files
+    int64_t max_shift;   // Largest move of a tick in the take against the sync marker's alignment, frames
+    double drift_ppm;    // Least squares slope of those moves over the recording's frames
+} take_patch_result_t;
+
+enum {
+    TAKE_PATCH_OK = 0,
+    TAKE_PATCH_NO_SYNC_IN_TAKE = -1,
+    TAKE_PATCH_NO_SYNC_IN_RECORDING = -2,
+    TAKE_PATCH_RATE_MISMATCH = -3,
+    TAKE_PATCH_NOTHING_TO_PATCH = -4,
+    TAKE_PATCH_NO_MEMORY = -5,
+};
+
+// Find the first sync marker in the first channel of a file, or -1. With
+// confidence non-NULL the match score is stored there.
+int64_t take_patch_find_sync(const wav_file_t *wav, float *confidence);
+
+// Sync marker offset in a recording read from its sidecar (see
+// take-sidecar.h), or -1 if there is none, it does not parse or its rate is
+// not sample_rate
+int64_t take_patch_sidecar_sync(const char *recording_path, unsigned int sample_rate);
+
+// Ticks of a recording from its sidecar, in frame order. Returns how many
+// there are (0 without a sidecar or at another rate); up to max are stored.
+uint32_t take_patch_sidecar_ticks(const char *recording_path, unsigned int sample_rate, take_patch_tick_t *ticks, uint32_t max);
+
+// Glitches the daemon's return check found in a recording, from its
+// sidecar, in recording frames and frame order. Returns how many there are
+// (up to max are stored) and sets checked_until to the recording frame the
+// check got to; -1 if the sidecar has no loopback object or another rate.
+int take_patch_sidecar_glitches(const char *recording_path, unsigned int sample_rate, glitch_t *glitches, uint32_t max,
+                                int64_t *checked_until);
+
+int take_patch(wav_file_t *take, const wav_file_t *recording, const take_patch_options_t *options, take_patch_result_t *result);
+
+const char *take_patch_strerror(int error);
+
+#endif /* TAKE_PATCH */
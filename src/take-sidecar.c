@@ -0,0 +1,76 @@
+#include "take-sidecar.h"
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+void take_sidecar_path(char *buf, size_t len, const char *wav_path) {
+    size_t n = strlen(wav_path);
+    if (n >= 4 && strcmp(wav_path + n - 4, ".wav") == 0) n -= 4;
+    snprintf(buf, len, "%.*s.json", (int)n, wav_path);
+}
+
+// Graph clock position and monotonic time of a frame, null if unknown
+static void write_times(FILE *f, const audio_buffer_t *ab, uint64_t frame) {
+    uint64_t nsec;
+    fprintf(f, "\"clock_position\":%" PRIu64 ",\"monotonic_ns\":", audio_buffer_clock_at_frame(ab, frame));
+    if (audio_buffer_time_at_frame(ab, frame, &nsec) == 0) fprintf(f, "%" PRIu64, nsec);
+    else fputs("null", f);
+}
+
+int take_sidecar_write(const char *wav_path, const audio_buffer_t *ab, const take_sidecar_t *sc) {
+    char path[1024], tmp[1040];
+    take_sidecar_path(path, sizeof(path), wav_path);
+    snprintf(tmp, sizeof(tmp), "%s.part", path);
+    FILE *f = fopen(tmp, "w");
+    if (!f) return -1;
+
+    const char *name = strrchr(wav_path, '/');
+    name = name ? name + 1 : wav_path;
+    fprintf(f, "{\"version\":%d,\"wav\":\"%s\",\"sample_rate\":%u,\"rate_segment\":%u,\"take\":%u,\"segment\":%u,",
+        TAKE_SIDECAR_VERSION, name, ab->sample_rate, ab->rate_segment, sc->take_id, sc->segment);
+    // 1-based buffer channels, in file order
+    fputs("\"channels\":[", f);
+    for (unsigned int i = 0; i < sc->num_channels; ++i) fprintf(f, "%s%u", i ? "," : "", sc->first_channel + i + 1);
+    fprintf(f, "],\"start_frame\":%" PRIu64 ",\"end_frame\":%" PRIu64 ",\"frames\":%" PRIu64 ",",
+        sc->start_frame, sc->end_frame, sc->end_frame - sc->start_frame);
+    fprintf(f, "\"sync\":{\"frame\":%" PRIu64 ",\"offset\":%" PRIu64 ",\"type\":\"%s\"},",
+        sc->sync_frame, sc->sync_frame - sc->start_frame, marker_type_name(sc->sync_type));
+    write_times(f, ab, sc->start_frame);
+
+    // Every marker inside the file, the sync marker included
+    fputs(",\"markers\":[", f);
+    marker_cursor_t cursor = marker_index_cursor(&ab->markers, sc->start_frame);
+    marker_t marker;
+    for (uint32_t n = 0; marker_index_next(&ab->markers, &cursor, &marker) == 0; ++n) {
+        const marker_t *m = &marker;
+        if (m->frame >= sc->end_frame) break;
+        fprintf(f, "%s{\"frame\":%" PRIu64 ",\"offset\":%" PRIu64 ",\"type\":\"%s\",", n ? "," : "", m->frame,
+            m->frame - sc->start_frame, marker_type_name(m->type));
+        // Ticks let the patchers align every interval on its own
+        if (m->type == MARKER_TICK) fprintf(f, "\"sequence\":%u,", m->sequence);
+        fprintf(f, "\"take\":%u,\"channel_mask\":%" PRIu64 ",", m->take_id, m->channel_mask);
+        write_times(f, ab, m->frame);
+        fputc('}', f);
+    }
+    fputc(']', f);
+
+    if (sc->loopback) {
+        fprintf(f, ",\"loopback\":{\"latency\":%" PRId64 ",\"compared_until\":%" PRIu64 ",\"glitches\":[",
+            sc->loopback_latency, sc->compared_until);
+        for (uint32_t i = 0; i < sc->num_glitches; ++i) {
+            const glitch_t *g = &sc->glitches[i];
+            fprintf(f, "%s{\"start_frame\":%" PRIu64 ",\"end_frame\":%" PRIu64 ",\"offset\":%" PRId64 ",\"type\":\"%s\",\"max_diff\":%.6g,\"rms_diff\":%.6g}",
+                i ? "," : "", g->start_frame, g->end_frame, (int64_t)(g->start_frame - sc->start_frame),
+                glitch_type_name(g->type), (double)g->max_diff, (double)g->rms_diff);
+        }
+        fputs("]}", f);
+    }
+    fputs("}\n", f);
+
+    int ret = ferror(f) ? -1 : 0;
+    if (fclose(f) != 0) ret = -1;
+    if (ret == 0 && rename(tmp, path) < 0) ret = -1;
+    if (ret < 0) unlink(tmp);
+    return ret;
+}
@@ -0,0 +1,43 @@
+#ifndef TAKE_SIDECAR
+#define TAKE_SIDECAR
+
+#include <stddef.h>
+#include <stdint.h>
+#include "audio-buffer.h"
+#include "glitch-map.h"
+
+// Small JSON file saved next to every exported WAV (same name, .json) that
+// places the file in the daemon's timeline: the absolute frames it covers,
+// the offset of its sync marker and of every other marker inside it, the
+// rate, which buffer channels it holds, and PipeWire graph clock and
+// CLOCK_MONOTONIC times. Patchers take the sync offset from it instead of
+// searching the recording for the marker.
+
+#define TAKE_SIDECAR_VERSION 1
+
+typedef struct {
+    uint64_t start_frame;       // Absolute frame of the file's first sample
+    uint64_t end_frame;
+    uint64_t sync_frame;        // Marker the file is aligned on
+    uint32_t sync_type;         // Its marker_type_t
+    uint32_t take_id;
+    uint32_t segment;           // Index of the segment in its take
+    unsigned int first_channel; // Buffer channels the file holds, in order
+    unsigned int num_channels;
+    // Set when a return stream was checked during the take (loopback-monitor.h)
+    int loopback;
+    int64_t loopback_latency;   // Return frame minus capture frame
+    uint64_t compared_until;    // Capture frames checked up to here
+    const glitch_t *glitches;   // Glitches the return showed inside the file, capture frames
+    uint32_t num_glitches;
+} take_sidecar_t;
+
+// "<name>.json" for "<name>.wav", wav_path + ".json" for other names
+void take_sidecar_path(char *buf, size_t len, const char *wav_path);
+
+// Write the sidecar of wav_path through a temporary file and a rename, so
+// readers never see half of it. Markers and times come from ab. 0 on
+// success, -1 if the file could not be written.
+int take_sidecar_write(const char *wav_path, const audio_buffer_t *ab, const take_sidecar_t *sc);
+
+#endif /* TAKE_SIDECAR */
@@ -0,0 +1,216 @@
+#include "wav-file.h"
+#include "sample-convert.h"
+#include <fcntl.h>
+#include <math.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define WAVE_FORMAT_PCM 0x0001
+#define WAVE_FORMAT_IEEE_FLOAT 0x0003
+#define WAVE_FORMAT_EXTENSIBLE 0xFFFE
+// RF64 puts this in the 32 bit size fields and the real size in ds64
+#define RF64_SIZE_IN_DS64 0xFFFFFFFFu
+// Samples converted at a time when one channel is written
+#define CHANNEL_CHUNK 1024
+
+static uint16_t le16(const uint8_t *p) {
+    return (uint16_t)(p[0] | p[1] << 8);
+}
+
+static uint32_t le32(const uint8_t *p) {
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static uint64_t le64(const uint8_t *p) {
+    return (uint64_t)le32(p) | (uint64_t)le32(p + 4) << 32;
+}
+
+static int parse_fmt(wav_file_t *wav, const uint8_t *fmt, uint32_t size) {
+    if (size < 16) return -2;
+    uint16_t tag = le16(fmt);
+    wav->channels = le16(fmt + 2);
+    wav->sample_rate = le32(fmt + 4);
+    wav->block_align = le16(fmt + 12);
+    unsigned int bits = le16(fmt + 14);
+    // The sub format GUID starts with the plain format tag
+    if (tag == WAVE_FORMAT_EXTENSIBLE && size >= 26) tag = le16(fmt + 24);
+    if (tag == WAVE_FORMAT_PCM && bits == 16) wav->format = WAV_SAMPLE_PCM16;
+    else if (tag == WAVE_FORMAT_PCM && bits == 24) wav->format = WAV_SAMPLE_PCM24;
+    else if (tag == WAVE_FORMAT_PCM && bits == 32) wav->format = WAV_SAMPLE_PCM32;
+    else if (tag == WAVE_FORMAT_IEEE_FLOAT && bits == 32) wav->format = WAV_SAMPLE_FLOAT32;
+    else return -3;
+    wav->bytes_per_sample = bits / 8;
+    if (wav->channels == 0 || wav->block_align != wav->channels * wav->bytes_per_sample) return -3;
+    return 0;
+}
+
+static int parse_chunks(wav_file_t *wav) {
+    const uint8_t *m = wav->map;
+    if (wav->map_size < 12 || memcmp(m + 8, "WAVE", 4) != 0) return -2;
+    if (memcmp(m, "RF64", 4) == 0) wav->rf64 = 1;
+    else if (memcmp(m, "RIFF", 4) != 0) return -2;
+
+    uint64_t ds64_data_size = 0;
+    int have_fmt = 0;
+    size_t pos = 12;
+    while (pos + 8 <= wav->map_size) {
+        const uint8_t *id = m + pos;
+        uint64_t size = le32(m + pos + 4);
+        const uint8_t *body = m + pos + 8;
+        if (memcmp(id, "ds64", 4) == 0 && size >= 24 && pos + 8 + 24 <= wav->map_size) {
+            ds64_data_size = le64(body + 8);
+        } else if (memcmp(id, "fmt ", 4) == 0 && pos + 8 + size <= wav->map_size) {
+            int ret = parse_fmt(wav, body, (uint32_t)size);
+            if (ret < 0) return ret;
+            have_fmt = 1;
+        } else if (memcmp(id, "data", 4) == 0) {
+            if (!have_fmt) return -2;
+            if (wav->rf64 && size == RF64_SIZE_IN_DS64) size = ds64_data_size;
+            // A take still being recorded may claim more than is on disk
+            uint64_t available = wav->map_size - (pos + 8);
+            if (size > available) size = available;
+            wav->data_offset = pos + 8;
+            wav->data = wav->map + wav->data_offset;
+            wav->frames = size / wav->block_align;
+            return 0;
+        }
+        pos += 8 + size + (size & 1);
+    }
+    return -2;
+}
+
+int wav_file_open(wav_file_t *wav, const char *path, int writable) {
+    memset(wav, 0, sizeof(*wav));
+    wav->fd = open(path, writable ? O_RDWR : O_RDONLY);
+    if (wav->fd < 0) return -1;
+    struct stat st;
+    if (fstat(wav->fd, &st) < 0) {
+        close(wav->fd);
+        return -1;
+    }
+    if (st.st_size < 12) {
+        close(wav->fd);
+        return -2;
+    }
+    wav->map_size = (size_t)st.st_size;
+    wav->writable = writable;
+    void *map = mmap(NULL, wav->map_size, writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, wav->fd, 0);
+    if (map == MAP_FAILED) {
+        close(wav->fd);
+        return -1;
+    }
+    wav->map = (uint8_t *)map;
+    madvise(wav->map, wav->map_size, MADV_SEQUENTIAL);
+    int ret = parse_chunks(wav);
+    if (ret < 0) {
+        munmap(wav->map, wav->map_size);
+        close(wav->fd);
+        wav->map = NULL;
+        return ret;
+    }
+    return 0;
+}
+
+int wav_file_close(wav_file_t *wav) {
+    int ret = 0;
+    if (!wav->map) return 0;
+    if (wav->writable && msync(wav->map, wav->map_size, MS_SYNC) < 0) ret = -1;
+    munmap(wav->map, wav->map_size);
+    close(wav->fd);
+    wav->map = NULL;
+    return ret;
+}
+
+const char *wav_file_format_name(wav_sample_format_t format) {
+    switch (format) {
+    case WAV_SAMPLE_PCM16: return "PCM16";
+    case WAV_SAMPLE_PCM24: return "PCM24";
+    case WAV_SAMPLE_PCM32: return "PCM32";
+    case WAV_SAMPLE_FLOAT32: return "FLOAT32";
+    }
+    return "?";
+}
+
+// Decode count samples stride bytes apart
+static void decode(wav_sample_format_t format, const uint8_t *in, size_t stride, float *out, size_t count) {
+    switch (format) {
+    case WAV_SAMPLE_PCM16:
+        for (size_t i = 0; i < count; ++i, in += stride) out[i] = (float)(int16_t)le16(in) * (1.0f / 32768.0f);
+        break;
+    case WAV_SAMPLE_PCM24:
+        for (size_t i = 0; i < count; ++i, in += stride) {
+            int32_t v = (int32_t)((uint32_t)in[0] << 8 | (uint32_t)in[1] << 16 | (uint32_t)in[2] << 24) >> 8;
+            out[i] = (float)v * (1.0f / 8388608.0f);
+        }
+        break;
+    case WAV_SAMPLE_PCM32:
+        for (size_t i = 0; i < count; ++i, in += stride) out[i] = (float)((double)(int32_t)le32(in) * (1.0 / 2147483648.0));
+        break;
+    case WAV_SAMPLE_FLOAT32:
+        for (size_t i = 0; i < count; ++i, in += stride) {
+            uint32_t bits = le32(in);
+            memcpy(&out[i], &bits, 4);
+        }
+        break;
+    }
+}
+
+// Encode count contiguous samples into a contiguous byte buffer
+static void encode(wav_sample_format_t format, const float *in, uint8_t *out, size_t count) {
+    switch (format) {
+    case WAV_SAMPLE_PCM16: {
+        int16_t pcm[CHANNEL_CHUNK];
+        for (size_t done = 0; done < count; done += CHANNEL_CHUNK) {
+            size_t n = count - done < CHANNEL_CHUNK ? count - done : CHANNEL_CHUNK;
+            sample_convert_to_pcm16(in + done, pcm, n, NULL);
+            for (size_t i = 0; i < n; ++i) {
+                out[(done + i) * 2] = (uint8_t)pcm[i];
+                out[(done + i) * 2 + 1] = (uint8_t)((uint16_t)pcm[i] >> 8);
+            }
+        }
+        break;
+    }
+    case WAV_SAMPLE_PCM24:
+        sample_convert_to_pcm24(in, out, count);
+        break;
+    case WAV_SAMPLE_PCM32:
+        for (size_t i = 0; i < count; ++i) {
+            double x = in[i] < 1.0f ? in[i] : 1.0f;
+            x = x > -1.0 ? x : -1.0;
+            uint32_t v = (uint32_t)(int32_t)lrint(x * 2147483647.0);
+            out[i * 4] = (uint8_t)v;
+            out[i * 4 + 1] = (uint8_t)(v >> 8);
+            out[i * 4 + 2] = (uint8_t)(v >> 16);
+            out[i * 4 + 3] = (uint8_t)(v >> 24);
+        }
+        break;
+    case WAV_SAMPLE_FLOAT32:
+        sample_convert_to_f32le(in, out, count);
+        break;
+    }
+}
+
+void wav_file_read_frames(const wav_file_t *wav, float *samples, uint64_t start_frame, uint32_t count) {
+    decode(wav->format, wav_file_sample(wav, start_frame, 0), wav->bytes_per_sample, samples, (size_t)count * wav->channels);
+}
+
+void wav_file_write_frames(wav_file_t *wav, const float *samples, uint64_t start_frame, uint32_t count) {
+    encode(wav->format, samples, wav_file_sample(wav, start_frame, 0), (size_t)count * wav->channels);
+}
+
+void wav_file_read_channel(const wav_file_t *wav, unsigned int channel, float *samples, uint64_t start_frame, uint32_t count) {
+    decode(wav->format, wav_file_sample(wav, start_frame, channel), wav->block_align, samples, count);
+}
+
+void wav_file_write_channel(wav_file_t *wav, unsigned int channel, const float *samples, uint64_t start_frame, uint32_t count) {
+    uint8_t bytes[CHANNEL_CHUNK * 4];
+    for (uint32_t done = 0; done < count; done += CHANNEL_CHUNK) {
+        uint32_t n = count - done < CHANNEL_CHUNK ? count - done : CHANNEL_CHUNK;
+        encode(wav->format, samples + done, bytes, n);
+        for (uint32_t i = 0; i < n; ++i) {
+            memcpy(wav_file_sample(wav, start_frame + done + i, channel), &bytes[i * wav->bytes_per_sample], wav->bytes_per_sample);
+        }
+    }
+}
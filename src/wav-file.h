@@ -0,0 +1,58 @@
+#ifndef WAV_FILE
+#define WAV_FILE
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Memory mapped RIFF/RF64 WAV files, for reading and patching sample data in
+// place. Supports PCM 16/24/32 bit and 32 bit float, plain or
+// WAVE_FORMAT_EXTENSIBLE. Integer samples decode like libsndfile does
+// (divided by 2^(bits-1)) and encode through sample-convert.
+
+typedef enum {
+    WAV_SAMPLE_PCM16,
+    WAV_SAMPLE_PCM24,
+    WAV_SAMPLE_PCM32,
+    WAV_SAMPLE_FLOAT32,
+} wav_sample_format_t;
+
+typedef struct {
+    int fd;
+    uint8_t *map;
+    size_t map_size;
+    int writable;
+    int rf64;
+    wav_sample_format_t format;
+    unsigned int channels;
+    unsigned int sample_rate;
+    unsigned int bytes_per_sample;
+    unsigned int block_align;   // Bytes per frame
+    uint8_t *data;              // First byte of the data chunk
+    uint64_t data_offset;       // Its offset in the file
+    uint64_t frames;
+} wav_file_t;
+
+// 0 on success, -1 if the file cannot be opened or mapped, -2 if it is not a
+// WAV file, -3 for sample formats not listed above
+int wav_file_open(wav_file_t *wav, const char *path, int writable);
+
+// Flush writes to disk and unmap. 0 on success, -1 if flushing failed.
+int wav_file_close(wav_file_t *wav);
+
+const char *wav_file_format_name(wav_sample_format_t format);
+
+// Interleaved frames of all channels. The caller keeps start + count within
+// wav->frames.
+void wav_file_read_frames(const wav_file_t *wav, float *samples, uint64_t start_frame, uint32_t count);
+void wav_file_write_frames(wav_file_t *wav, const float *samples, uint64_t start_frame, uint32_t count);
+
+// One channel only, the other channels are left alone
+void wav_file_read_channel(const wav_file_t *wav, unsigned int channel, float *samples, uint64_t start_frame, uint32_t count);
+void wav_file_write_channel(wav_file_t *wav, unsigned int channel, const float *samples, uint64_t start_frame, uint32_t count);
+
+// Address of a sample in the mapping
+static inline uint8_t *wav_file_sample(const wav_file_t *wav, uint64_t frame, unsigned int channel) {
+    return wav->data + frame * wav->block_align + (uint64_t)channel * wav->bytes_per_sample;
+}
+
+#endif /* WAV_FILE */
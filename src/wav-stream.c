@@ -0,0 +1,151 @@
+#include "wav-stream.h"
+#include "sample-convert.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define BYTES_PER_SAMPLE 3
+// Largest data chunk a plain RIFF header can describe
+#define RIFF_MAX_DATA (0xFFFFFFFFull - 36)
+
+static void put16(uint8_t *p, uint16_t v) {
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+}
+
+static void put32(uint8_t *p, uint32_t v) {
+    put16(p, (uint16_t)v);
+    put16(p + 2, (uint16_t)(v >> 16));
+}
+
+static void put64(uint8_t *p, uint64_t v) {
+    put32(p, (uint32_t)v);
+    put32(p + 4, (uint32_t)(v >> 32));
+}
+
+static void build_header(wav_stream_t *ws, unsigned int sample_rate) {
+    uint8_t *h = ws->header;
+    uint32_t block_align = ws->num_channels * BYTES_PER_SAMPLE;
+    int rf64 = ws->data_bytes > RIFF_MAX_DATA;
+    uint32_t pos = 12;
+    memcpy(h, rf64 ? "RF64" : "RIFF", 4);
+    memcpy(h + 8, "WAVE", 4);
+    if (rf64) {
+        memcpy(h + pos, "ds64", 4);
+        put32(h + pos + 4, 28);
+        put64(h + pos + 8, 0);                 // RIFF size, filled in below
+        put64(h + pos + 16, ws->data_bytes);
+        put64(h + pos + 24, ws->end_frame - ws->start_frame);
+        put32(h + pos + 32, 0);                // No table entries
+        pos += 36;
+    }
+    memcpy(h + pos, "fmt ", 4);
+    put32(h + pos + 4, 16);
+    put16(h + pos + 8, 1);                     // WAVE_FORMAT_PCM
+    put16(h + pos + 10, (uint16_t)ws->num_channels);
+    put32(h + pos + 12, sample_rate);
+    put32(h + pos + 16, sample_rate * block_align);
+    put16(h + pos + 20, (uint16_t)block_align);
+    put16(h + pos + 22, BYTES_PER_SAMPLE * 8);
+    pos += 24;
+    memcpy(h + pos, "data", 4);
+    put32(h + pos + 4, rf64 ? 0xFFFFFFFFu : (uint32_t)ws->data_bytes);
+    pos += 8;
+
+    ws->header_size = pos;
+    ws->total_bytes = pos + ws->data_bytes + (ws->data_bytes & 1);
+    uint64_t riff_size = ws->total_bytes - 8;
+    if (rf64) {
+        put32(h + 4, 0xFFFFFFFFu);
+        put64(h + 20, riff_size);
+    } else {
+        put32(h + 4, (uint32_t)riff_size);
+    }
+}
+
+int wav_stream_init(wav_stream_t *ws, audio_buffer_t *ab, uint64_t start_frame, uint64_t end_frame, const unsigned int *channels, unsigned int num_channels) {
+    memset(ws, 0, sizeof(*ws));
+    if (!ab || !ab->channels || num_channels == 0 || num_channels > WAV_STREAM_MAX_CHANNELS) return -1;
+    for (unsigned int i = 0; i < num_channels; ++i) {
+        if (channels[i] >= ab->num_channels) return -1;
+        ws->channels[i] = channels[i];
+    }
+    if (end_frame <= start_frame) return -3;
+    if (end_frame > audio_buffer_write_position(ab) || start_frame < audio_buffer_oldest_frame(ab)) return -3;
+    ws->ab = ab;
+    ws->num_channels = num_channels;
+    ws->start_frame = start_frame;
+    ws->end_frame = end_frame;
+    ws->data_bytes = (end_frame - start_frame) * num_channels * BYTES_PER_SAMPLE;
+    build_header(ws, ab->sample_rate);
+
+    size_t samples = (size_t)WAV_STREAM_CHUNK_FRAMES * num_channels;
+    ws->planar = (float *)malloc(sizeof(float) * samples);
+    ws->interleaved = (float *)malloc(sizeof(float) * samples);
+    ws->pcm = (uint8_t *)malloc(samples * BYTES_PER_SAMPLE);
+    if (!ws->planar || !ws->interleaved || !ws->pcm) {
+        wav_stream_free(ws);
+        return -2;
+    }
+    return 0;
+}
+
+void wav_stream_free(wav_stream_t *ws) {
+    free(ws->planar);
+    free(ws->interleaved);
+    free(ws->pcm);
+    ws->planar = NULL;
+    ws->interleaved = NULL;
+    ws->pcm = NULL;
+    ws->cached_frames = 0;
+}
+
+// Convert the chunk holding frame (relative to start_frame) into ws->pcm
+static int fill_chunk(wav_stream_t *ws, uint64_t frame) {
+    uint64_t first = frame - frame % WAV_STREAM_CHUNK_FRAMES;
+    uint64_t frames = ws->end_frame - ws->start_frame - first;
+    if (frames > WAV_STREAM_CHUNK_FRAMES) frames = WAV_STREAM_CHUNK_FRAMES;
+    uint64_t start = ws->start_frame + first;
+    unsigned int nc = ws->num_channels;
+    for (unsigned int ch = 0; ch < nc; ++ch) {
+        float *plane = &ws->planar[(size_t)ch * WAV_STREAM_CHUNK_FRAMES];
+        if (audio_buffer_read_range(ws->ab, ws->channels[ch], plane, start, start + frames) < 0) return -1;
+        for (uint64_t i = 0; i < frames; ++i) ws->interleaved[i * nc + ch] = plane[i];
+    }
+    // Same soft clamp and rounding as the file exports, so the bytes match
+    size_t total = (size_t)frames * nc;
+    sample_convert_clamp(ws->interleaved, total);
+    sample_convert_to_pcm24(ws->interleaved, ws->pcm, total);
+    ws->cached_frame = first;
+    ws->cached_frames = (uint32_t)frames;
+    return 0;
+}
+
+ssize_t wav_stream_read(wav_stream_t *ws, uint64_t offset, uint8_t *buf, size_t max) {
+    size_t copied = 0;
+    uint64_t block_align = (uint64_t)ws->num_channels * BYTES_PER_SAMPLE;
+    while (copied < max && offset < ws->total_bytes) {
+        size_t n;
+        if (offset < ws->header_size) {
+            n = ws->header_size - (size_t)offset;
+            if (n > max - copied) n = max - copied;
+            memcpy(buf + copied, ws->header + offset, n);
+        } else if (offset - ws->header_size >= ws->data_bytes) {
+            // Pad byte of an odd sized data chunk
+            buf[copied] = 0;
+            n = 1;
+        } else {
+            uint64_t data_offset = offset - ws->header_size;
+            uint64_t frame = data_offset / block_align;
+            if (ws->cached_frames == 0 || frame < ws->cached_frame || frame >= ws->cached_frame + ws->cached_frames) {
+                if (fill_chunk(ws, frame) < 0) return copied > 0 ? (ssize_t)copied : -1;
+            }
+            uint64_t chunk_offset = data_offset - ws->cached_frame * block_align;
+            uint64_t left = (uint64_t)ws->cached_frames * block_align - chunk_offset;
+            n = left < max - copied ? (size_t)left : max - copied;
+            memcpy(buf + copied, ws->pcm + chunk_offset, n);
+        }
+        copied += n;
+        offset += n;
+    }
+    return (ssize_t)copied;
+}
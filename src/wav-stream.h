@@ -0,0 +1,42 @@
+#ifndef WAV_STREAM
+#define WAV_STREAM
+
+#include <stdint.h>
+#include <sys/types.h>
+#include "audio-buffer.h"
+
+// A WAV file (packed 24 bit PCM, like the exports) that only exists as a
+// function: any byte range of it is generated on demand from the ring,
+// history or spool. Nothing is copied ahead, so serving an hour of audio
+// needs no more memory than one chunk. Ranges past 4 GiB use RF64.
+
+#define WAV_STREAM_CHUNK_FRAMES 8192
+#define WAV_STREAM_MAX_CHANNELS 64
+
+typedef struct {
+    audio_buffer_t *ab;
+    uint64_t start_frame;
+    uint64_t end_frame;
+    unsigned int channels[WAV_STREAM_MAX_CHANNELS];
+    unsigned int num_channels;
+    uint8_t header[80];
+    uint32_t header_size;
+    uint64_t data_bytes;
+    uint64_t total_bytes;       // Size of the whole file
+    float *planar;              // One chunk of every channel
+    float *interleaved;
+    uint8_t *pcm;               // The converted chunk starting at cached_frame
+    uint64_t cached_frame;
+    uint32_t cached_frames;     // 0 if nothing is cached
+} wav_stream_t;
+
+// Frames [start_frame, end_frame) of the given channels. 0 on success, -1 on
+// bad arguments, -2 out of memory, -3 if the range is not (or no longer) held.
+int wav_stream_init(wav_stream_t *ws, audio_buffer_t *ab, uint64_t start_frame, uint64_t end_frame, const unsigned int *channels, unsigned int num_channels);
+void wav_stream_free(wav_stream_t *ws);
+
+// Copy up to max bytes of the file from offset. Returns the number copied,
+// 0 at the end, -1 if the audio was overwritten before it could be read.
+ssize_t wav_stream_read(wav_stream_t *ws, uint64_t offset, uint8_t *buf, size_t max);
+
+#endif /* WAV_STREAM */
@@ -1,4 +1,7 @@
 import sys
+import os
+import ctypes
+import ctypes.util
 import tempfile
 import requests
 import soundfile as sf
@@ -11,27 +14,73 @@ SYNC_PATTERN = np.array([
     9.01e-5, -1.23e-5, 1.35e-5, -2.46e-5,
     3.57e-5, -4.68e-5, 5.79e-5, -6.80e-5
 ], dtype=np.float32)
-SYNC_TOL = 1e-6
+SYNC_THRESHOLD = 0.99  # Normalized correlation a marker must reach, see src/sync-detect.h
+
+
+class _SyncMatch(ctypes.Structure):
+    _fields_ = [('frame', ctypes.c_int64), ('confidence', ctypes.c_float), ('gain', ctypes.c_float)]
+
 
 
 def find_sync_offset(audio: np.ndarray) -> int:
-    """Find the offset of the sync pattern in a mono float32 numpy array."""
-    for i in range(len(audio) - len(SYNC_PATTERN) + 1):
-        if np.all(np.abs(audio[i:i+len(SYNC_PATTERN)] - SYNC_PATTERN) < SYNC_TOL):
-            return i
+    """Find the offset of the sync pattern in a mono float32 numpy array.
+
+    Matched by normalized cross-correlation, so gain changes and dither do
+    not hide the marker. Returns -1 when no position scores SYNC_THRESHOLD.
+    """
+    audio = np.ascontiguousarray(audio, dtype=np.float32)
+    n = len(SYNC_PATTERN)
+    if len(audio) < n:
+        return -1
+    if _native is not None:
+        match = _SyncMatch()
+        found = _native.sync_detect(audio.ctypes.data, len(audio), 1, ctypes.byref(match), 1)
+        return int(match.frame) if found > 0 else -1
+    pattern = SYNC_PATTERN.astype(np.float64)
+    pattern_energy = np.dot(pattern, pattern)
+    # Chunked so long recordings do not need several float64 copies at once
+    step = 1 << 20
+    for start in range(0, len(audio) - n + 1, step):
+        x = audio[start:start + step + 2 * n].astype(np.float64)
+        corr = np.correlate(x, pattern, mode='valid')
+        energy = np.convolve(x * x, np.ones(n), mode='valid')
+        score = np.where(energy > 0, corr / np.sqrt(np.maximum(energy, 1e-300) * pattern_energy), 0.0)
+        hits = np.flatnonzero(score[:step] >= SYNC_THRESHOLD)
+        if len(hits):
+            # Best position of the first cluster of hits
+            first = hits[0]
+            return start + first + int(np.argmax(score[first:first + n]))
     return -1
 
 
+def _load_native():
+    """libpwghost from the pw-ghost-rec build, or None to use numpy."""
+    path = os.environ.get('PW_GHOST_LIB') or ctypes.util.find_library('pwghost')
+    if not path:
+        return None
+    try:
+        lib = ctypes.CDLL(path)
+    except OSError:
+        return None
+    lib.sample_convert_to_pcm24.argtypes = [ctypes.c_void_p, ctypes.c_void_p, ctypes.c_size_t]
+    lib.sample_convert_to_pcm24.restype = None
+    lib.sync_detect.argtypes = [ctypes.c_void_p, ctypes.c_size_t, ctypes.c_size_t, ctypes.POINTER(_SyncMatch), ctypes.c_size_t]
+    lib.sync_detect.restype = ctypes.c_int64
+    return lib
+
+
+_native = _load_native()
+
+
 def float32_to_pcm24(samples):
-    # Clip to [-1, 1]
-    samples = np.clip(samples, -1.0, 1.0)
-    # Scale to int32 range for 24-bit
-    ints = (samples * 8388607.0).astype(np.int32)
-    # Pack as 3 bytes little-endian
-    pcm_bytes = bytearray()
-    for i in ints:
-        pcm_bytes += struct.pack('<i', i)[0:3]  # take only 3 LSBs
-    return pcm_bytes
+    """Saturate to [-1, 1] and pack as little endian 24 bit, rounding like libsndfile."""
+    samples = np.ascontiguousarray(samples, dtype=np.float32)
+    if _native is not None:
+        out = np.empty(len(samples) * 3, dtype=np.uint8)
+        _native.sample_convert_to_pcm24(samples.ctypes.data, out.ctypes.data, len(samples))
+        return out.tobytes()
+    ints = np.rint(np.clip(samples, -1.0, 1.0) * np.float32(8388607.0)).astype('<i4')
+    return ints.view(np.uint8).reshape(-1, 4)[:, :3].tobytes()
 
 
 def find_wav_data_offset(path):
@@ -49,16 +98,22 @@ def find_wav_data_offset(path):
     raise RuntimeError('data chunk not found')
 
 
+BUFFER_URL = os.environ.get('PW_GHOST_URL', 'http://localhost:9123/buffer.wav')
+
+
 def main():
     if len(sys.argv) != 2:
         print(f"Usage: {sys.argv[0]} <reference.wav>")
         sys.exit(1)
     ref_path = sys.argv[1]
 
-    # Download to temp file
+    # Download to temp file; the daemon streams the WAV straight out of its
+    # buffer, so copy it through in blocks instead of holding it in memory
     with tempfile.NamedTemporaryFile(suffix='.wav', delete=False) as tmp:
-        r = requests.get('http://localhost:9123/buffer.wav')
-        tmp.write(r.content)
+        with requests.get(BUFFER_URL, params={'channels': '1'}, stream=True) as r:
+            r.raise_for_status()
+            for block in r.iter_content(chunk_size=1 << 20):
+                tmp.write(block)
         dl_path = tmp.name
 
     # Read both wavs
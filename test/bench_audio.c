@@ -0,0 +1,258 @@
+// Microbenchmarks for the capture and export paths, run by `meson benchmark`.
+// Prints one JSON document on stdout (and to the file given as the first
+// argument) so results can be compared across releases.
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include "../src/audio-buffer.h"
+#include "../src/channel-buffer.h"
+#include "../src/sample-convert.h"
+#include "../src/sync-detect.h"
+#include "../src/sync-marker.h"
+
+#ifndef PW_GHOST_REC_VERSION
+#define PW_GHOST_REC_VERSION "unknown"
+#endif
+
+#define RATE 48000
+// Each push and read configuration runs for about this long
+#define BENCH_SECONDS 0.1
+#define RT_QUANTUM 256
+#define RT_CHANNELS 8
+#define RT_CALLBACKS 200000
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static FILE *outputs[2];
+static int num_outputs;
+static int first_result = 1;
+
+static void emit(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+static void emit(const char *fmt, ...) {
+    for (int i = 0; i < num_outputs; ++i) {
+        va_list ap;
+        va_start(ap, fmt);
+        vfprintf(outputs[i], fmt, ap);
+        va_end(ap);
+    }
+}
+
+static void begin_result(const char *name) {
+    emit("%s\n    {\"name\": \"%s\"", first_result ? "" : ",", name);
+    first_result = 0;
+}
+
+static void noise(float *samples, size_t count, uint32_t seed) {
+    for (size_t i = 0; i < count; ++i) {
+        seed = seed * 1664525u + 1013904223u;
+        samples[i] = ((float)(seed >> 8) / 16777216.0f - 0.5f) * 0.5f;
+    }
+}
+
+// audio_buffer_push_frames, the call the PipeWire callback makes every quantum
+static void bench_push(void) {
+    static const int quanta[] = {32, 64, 128, 256, 512, 1024, 2048};
+    static const unsigned int channel_counts[] = {1, 2, 8, 32};
+    float *block = malloc(sizeof(float) * 2048);
+    noise(block, 2048, 1);
+    for (size_t c = 0; c < sizeof(channel_counts) / sizeof(channel_counts[0]); ++c) {
+        unsigned int nc = channel_counts[c];
+        float *planes[32];
+        for (unsigned int ch = 0; ch < nc; ++ch) planes[ch] = block;
+        for (size_t q = 0; q < sizeof(quanta) / sizeof(quanta[0]); ++q) {
+            int quantum = quanta[q];
+            audio_buffer_t ab;
+            audio_buffer_init(&ab, nc, RATE, 10);
+            uint64_t pushes = 0;
+            double t0 = now_seconds(), elapsed;
+            do {
+                for (int i = 0; i < 64; ++i) audio_buffer_push_frames(&ab, planes, quantum, 0);
+                pushes += 64;
+                elapsed = now_seconds() - t0;
+            } while (elapsed < BENCH_SECONDS);
+            begin_result("push");
+            emit(", \"quantum\": %d, \"channels\": %u, \"frames_per_second\": %.0f, \"ns_per_quantum\": %.1f}",
+                quantum, nc, (double)pushes * quantum / elapsed, elapsed * 1e9 / (double)pushes);
+            audio_buffer_free(&ab);
+        }
+    }
+    free(block);
+}
+
+// channel_buffer_read of one second windows from a full ring
+static void bench_read(void) {
+    channel_buffer_t cb;
+    channel_buffer_init(&cb, RATE, 60);
+    float *block = malloc(sizeof(float) * RATE);
+    noise(block, RATE, 2);
+    for (int i = 0; i < 60; ++i) channel_buffer_write(&cb, block, RATE);
+    uint64_t samples = 0;
+    int reads = 0;
+    double t0 = now_seconds(), elapsed;
+    do {
+        float offset = (float)(1 + reads % 58);
+        samples += (uint64_t)channel_buffer_read(&cb, block, offset, 1.0f, RATE);
+        reads++;
+        elapsed = now_seconds() - t0;
+    } while (elapsed < BENCH_SECONDS);
+    begin_result("channel_read");
+    emit(", \"window_frames\": %d, \"samples_per_second\": %.0f}", RATE, (double)samples / elapsed);
+    free(block);
+    channel_buffer_free(&cb);
+}
+
+// A minute of stereo to a 24 bit WAV, the path every stop takes
+static void bench_export(const char *dir) {
+    audio_buffer_t ab;
+    audio_buffer_init(&ab, 2, RATE, 70);
+    float *a = malloc(sizeof(float) * RATE), *b = malloc(sizeof(float) * RATE);
+    noise(a, RATE, 3);
+    noise(b, RATE, 4);
+    float *planes[2] = {a, b};
+    for (int i = 0; i < 61; ++i) audio_buffer_push_frames(&ab, planes, RATE, 0);
+    char path[1024];
+    snprintf(path, sizeof(path), "%s/bench_export.wav", dir);
+    audio_export_stats_t stats;
+    double t0 = now_seconds();
+    int ret = audio_buffer_write_range_to_wav(&ab, 0, 2, RATE / 2, RATE / 2 + 60 * RATE, path, &stats);
+    double elapsed = now_seconds() - t0;
+    unlink(path);
+    begin_result("export");
+    emit(", \"frames\": %llu, \"channels\": 2, \"result\": %d, \"seconds\": %.4f, \"mb_per_second\": %.1f, \"realtime_factor\": %.0f}",
+        (unsigned long long)stats.frames, ret, elapsed, (double)stats.bytes / (1024.0 * 1024.0) / elapsed,
+        60.0 / elapsed);
+    free(a);
+    free(b);
+    audio_buffer_free(&ab);
+}
+
+// FFT cross-correlation over five minutes of mono with one marker at the end
+static void bench_sync_detect(void) {
+    size_t count = (size_t)5 * 60 * RATE;
+    float *samples = malloc(sizeof(float) * count);
+    noise(samples, count, 5);
+    for (size_t i = 0; i < count; ++i) samples[i] *= 1e-3f;
+    memcpy(&samples[count - RATE], sync_marker_pattern, sizeof(sync_marker_pattern));
+    sync_detect_match_t match;
+    double t0 = now_seconds();
+    int64_t found = sync_detect(samples, count, 1, &match, 1);
+    double elapsed = now_seconds() - t0;
+    begin_result("sync_detect");
+    emit(", \"samples\": %zu, \"found\": %lld, \"seconds\": %.4f, \"samples_per_second\": %.0f}",
+        count, (long long)found, elapsed, (double)count / elapsed);
+    free(samples);
+}
+
+// Soft clamp and 24 bit packing over five minutes of mono, what an export
+// does to every sample
+static void bench_pcm24(void) {
+    size_t count = (size_t)5 * 60 * RATE;
+    float *samples = malloc(sizeof(float) * count);
+    uint8_t *pcm = malloc(count * 3);
+    noise(samples, count, 6);
+    // Warm up caches and page tables outside the timed part
+    sample_convert_to_pcm24(samples, pcm, count);
+    double t0 = now_seconds();
+    sample_convert_clamp(samples, count);
+    sample_convert_to_pcm24(samples, pcm, count);
+    double elapsed = now_seconds() - t0;
+    begin_result("pcm24");
+    emit(", \"samples\": %zu, \"seconds\": %.4f, \"samples_per_second\": %.0f}",
+        count, elapsed, (double)count / elapsed);
+    free(samples);
+    free(pcm);
+}
+
+static atomic_int reader_stop;
+
+// Reads behind the writer like an export or the HTTP server would
+static void *reader_thread(void *arg) {
+    audio_buffer_t *ab = (audio_buffer_t *)arg;
+    float *window = malloc(sizeof(float) * RATE);
+    while (!atomic_load(&reader_stop)) {
+        uint64_t w = audio_buffer_write_position(ab);
+        if (w > RATE) {
+            for (unsigned int ch = 0; ch < ab->num_channels; ++ch) audio_buffer_read_range(ab, ch, window, w - RATE, w);
+        }
+    }
+    free(window);
+    return NULL;
+}
+
+static int compare_doubles(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+// The work of one on_process call (push plus passthrough copy), timed per
+// call while another thread keeps reading the buffer. The buffer is set up
+// like the daemon does it, prefaulted before the first callback.
+static void bench_rt_callback(void) {
+    audio_buffer_t ab;
+    audio_buffer_init_rt(&ab, RT_CHANNELS, RATE, 30, RT_MEMORY_PREFAULT | RT_MEMORY_THP, NULL);
+    float in[RT_CHANNELS][RT_QUANTUM], out[RT_CHANNELS][RT_QUANTUM];
+    float *planes[RT_CHANNELS];
+    for (int ch = 0; ch < RT_CHANNELS; ++ch) {
+        noise(in[ch], RT_QUANTUM, 10 + ch);
+        planes[ch] = in[ch];
+    }
+    double *times = malloc(sizeof(double) * RT_CALLBACKS);
+    atomic_store(&reader_stop, 0);
+    pthread_t reader;
+    pthread_create(&reader, NULL, reader_thread, &ab);
+    for (int i = 0; i < RT_CALLBACKS; ++i) {
+        double t0 = now_seconds();
+        audio_buffer_push_frames(&ab, planes, RT_QUANTUM, i % 1000 == 0);
+        for (int ch = 0; ch < RT_CHANNELS; ++ch) memcpy(out[ch], in[ch], sizeof(out[ch]));
+        times[i] = now_seconds() - t0;
+    }
+    atomic_store(&reader_stop, 1);
+    pthread_join(reader, NULL);
+    double sum = 0.0;
+    for (int i = 0; i < RT_CALLBACKS; ++i) sum += times[i];
+    qsort(times, RT_CALLBACKS, sizeof(double), compare_doubles);
+    begin_result("rt_callback");
+    emit(", \"quantum\": %d, \"channels\": %d, \"callbacks\": %d, \"mean_ns\": %.0f, \"p99_ns\": %.0f, \"p999_ns\": %.0f, \"max_ns\": %.0f, \"budget_ns\": %.0f}",
+        RT_QUANTUM, RT_CHANNELS, RT_CALLBACKS, sum / RT_CALLBACKS * 1e9,
+        times[RT_CALLBACKS * 99 / 100] * 1e9, times[RT_CALLBACKS * 999 / 1000] * 1e9,
+        times[RT_CALLBACKS - 1] * 1e9, (double)RT_QUANTUM / RATE * 1e9);
+    free(times);
+    audio_buffer_free(&ab);
+}
+
+int main(int argc, char *argv[]) {
+    outputs[num_outputs++] = stdout;
+    if (argc > 1) {
+        FILE *f = fopen(argv[1], "w");
+        if (!f) {
+            fprintf(stderr, "Cannot write %s\n", argv[1]);
+            return 1;
+        }
+        outputs[num_outputs++] = f;
+    }
+    const char *dir = getenv("TMPDIR") ? getenv("TMPDIR") : "/tmp";
+    time_t now = time(NULL);
+    char when[32];
+    strftime(when, sizeof(when), "%Y-%m-%dT%H:%M:%SZ", gmtime(&now));
+    emit("{\n  \"version\": \"%s\",\n  \"date\": \"%s\",\n  \"isa\": \"%s\",\n  \"results\": [",
+        PW_GHOST_REC_VERSION, when, sample_convert_isa_name(sample_convert_isa()));
+    bench_push();
+    bench_read();
+    bench_export(dir);
+    bench_sync_detect();
+    bench_pcm24();
+    bench_rt_callback();
+    emit("\n  ]\n}\n");
+    if (num_outputs > 1) fclose(outputs[1]);
+    return 0;
+}
@@ -1,8 +1,13 @@
 #include <check.h>
 #include <stdlib.h>
+#include <stdio.h>
 #include <sndfile.h>
 #include <math.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
 #include "../src/audio-buffer.h"
+#include "../src/sync-marker.h"
 
 START_TEST(test_audio_buffer_init_and_free)
 {
@@ -367,6 +372,353 @@ START_TEST(test_audio_buffer_offset_from_sync_feature)
 }
 END_TEST
 
+START_TEST(test_audio_buffer_push_frames_sync_on_all_channels)
+{
+    audio_buffer_t ab;
+    unsigned int num_channels = 4;
+    unsigned int sample_rate = 48000;
+    audio_buffer_init(&ab, num_channels, sample_rate, 1);
+
+    float block[4][32];
+    float *planes[4];
+    for (int q = 0; q < 10; ++q) {
+        for (unsigned int ch = 0; ch < num_channels; ++ch) {
+            for (int i = 0; i < 32; ++i) block[ch][i] = 0.01f * (float)(ch + 1);
+            planes[ch] = block[ch];
+        }
+        // Channel 2 is an unconnected port
+        planes[2] = NULL;
+        audio_buffer_push_frames(&ab, planes, 32, q == 5);
+    }
+
+    // Every channel advanced by the same number of frames, counted once
+    ck_assert_uint_eq(audio_buffer_write_position(&ab), 320);
+    for (unsigned int ch = 0; ch < num_channels; ++ch) {
+        ck_assert_uint_eq(channel_buffer_write_position(&ab.channels[ch]), 320);
+    }
+    // The marker sits on the first frame of the quantum it was injected in
+    ck_assert_uint_eq(audio_buffer_sync_frame(&ab), 160);
+    ck_assert_float_eq_tol(audio_buffer_seconds_since_sync(&ab), 160.0f / sample_rate, 1e-9);
+
+    static const float sync_pattern[16] = {
+        1.23e-5f, -2.34e-5f, 3.45e-5f, -4.56e-5f,
+        5.67e-5f, -6.78e-5f, 7.89e-5f, -8.90e-5f,
+        9.01e-5f, -1.23e-5f, 1.35e-5f, -2.46e-5f,
+        3.57e-5f, -4.68e-5f, 5.79e-5f, -6.80e-5f
+    };
+    float out[16];
+    for (unsigned int ch = 0; ch < num_channels; ++ch) {
+        ck_assert_int_eq(channel_buffer_read_frames(&ab.channels[ch], out, 160, 16), 0);
+        for (int i = 0; i < 16; ++i) {
+            float expected = (ch == 2) ? 0.0f : sync_pattern[i];
+            ck_assert_float_eq_tol(out[i], expected, 1e-9);
+        }
+    }
+    audio_buffer_free(&ab);
+}
+END_TEST
+
+START_TEST(test_audio_buffer_write_channels_to_wav_interleaved)
+{
+    audio_buffer_t ab;
+    unsigned int num_channels = 3;
+    unsigned int sample_rate = 48000;
+    audio_buffer_init(&ab, num_channels, sample_rate, 2);
+
+    // Each channel carries its own constant level
+    float block[3][128];
+    float *planes[3] = {block[0], block[1], block[2]};
+    for (int q = 0; q < 750; ++q) {
+        for (unsigned int ch = 0; ch < num_channels; ++ch) {
+            for (int i = 0; i < 128; ++i) block[ch][i] = 0.25f * (float)(ch + 1);
+        }
+        audio_buffer_push_frames(&ab, planes, 128, 0);
+    }
+
+    int ret = audio_buffer_write_channels_to_wav(&ab, 1, 2, 1.0f, 0.5f, "_out/test_interleaved.wav", NULL);
+    ck_assert_int_eq(ret, 0);
+
+    SF_INFO sfinfo = {0};
+    SNDFILE *infile = sf_open("_out/test_interleaved.wav", SFM_READ, &sfinfo);
+    ck_assert_ptr_nonnull(infile);
+    ck_assert_int_eq(sfinfo.channels, 2);
+    ck_assert_int_eq(sfinfo.frames, 24000);
+    float *data = (float *)malloc(sizeof(float) * sfinfo.frames * sfinfo.channels);
+    sf_read_float(infile, data, sfinfo.frames * sfinfo.channels);
+    sf_close(infile);
+    for (int i = 0; i < sfinfo.frames; ++i) {
+        ck_assert_float_eq_tol(data[i * 2], 0.5f, 1e-6);
+        ck_assert_float_eq_tol(data[i * 2 + 1], 0.75f, 1e-6);
+    }
+    free(data);
+
+    ck_assert_int_lt(audio_buffer_write_channels_to_wav(&ab, 2, 2, 1.0f, 0.5f, "_out/test_interleaved.wav", NULL), 0);
+    audio_buffer_free(&ab);
+}
+END_TEST
+
+START_TEST(test_audio_buffer_export_streams_in_chunks)
+{
+    audio_buffer_t ab;
+    unsigned int num_channels = 2;
+    unsigned int sample_rate = 48000;
+    audio_buffer_init(&ab, num_channels, sample_rate, 10);
+
+    // A ramp of exact 24 bit values, so every sample survives the PCM_24 round trip
+    int total_frames = sample_rate * 10;
+    float block[2][256];
+    float *planes[2] = {block[0], block[1]};
+    for (int f = 0; f < total_frames; f += 256) {
+        for (int i = 0; i < 256; ++i) {
+            block[0][i] = (float)((f + i) % 100000) / 8388608.0f;
+            block[1][i] = -block[0][i];
+        }
+        audio_buffer_push_frames(&ab, planes, 256, 0);
+    }
+
+    // Several chunks long, and not a multiple of the chunk size
+    audio_export_stats_t stats = {0};
+    int ret = audio_buffer_write_channels_to_wav(&ab, 0, 2, 9.0f, 7.5f, "_out/test_chunked.wav", &stats);
+    ck_assert_int_eq(ret, 0);
+    ck_assert_uint_eq(stats.frames, 360000);
+    ck_assert_uint_eq(stats.bytes, 360000 * 2 * 3);
+    ck_assert(stats.seconds >= 0.0);
+
+    SF_INFO sfinfo = {0};
+    SNDFILE *infile = sf_open("_out/test_chunked.wav", SFM_READ, &sfinfo);
+    ck_assert_ptr_nonnull(infile);
+    ck_assert_int_eq(sfinfo.frames, 360000);
+    float *data = (float *)malloc(sizeof(float) * sfinfo.frames * 2);
+    sf_read_float(infile, data, sfinfo.frames * 2);
+    sf_close(infile);
+
+    int first = total_frames - 1 - 9 * sample_rate;
+    for (int i = 0; i < sfinfo.frames; ++i) {
+        float expected = (float)((first + i) % 100000) / 8388608.0f;
+        ck_assert_float_eq_tol(data[i * 2], expected, 1e-9);
+        ck_assert_float_eq_tol(data[i * 2 + 1], -expected, 1e-9);
+    }
+    free(data);
+    audio_buffer_free(&ab);
+}
+END_TEST
+
+#define HELD_EXPORT_START (6 * 48000)
+#define HELD_EXPORT_END (10 * 48000)
+
+typedef struct {
+    audio_buffer_t *ab;
+    atomic_int started;   // Set once, before the first export
+    atomic_int released;  // Set by the test after its pushes
+    int exports;
+    int result;
+} held_export_t;
+
+// Exports the same range over and over until the test releases it, so the
+// export path is busy for as long as the test pushes
+static void *held_export(void *arg)
+{
+    held_export_t *he = (held_export_t *)arg;
+    atomic_store(&he->started, 1);
+    do {
+        he->result = audio_buffer_write_range_to_wav(he->ab, 0, 2, HELD_EXPORT_START, HELD_EXPORT_END,
+                                                     "_out/test_held_export.wav", NULL);
+        he->exports++;
+    } while (he->result == 0 && !atomic_load(&he->released));
+    return NULL;
+}
+
+START_TEST(test_audio_buffer_push_never_waits_for_export)
+{
+    // The RT write path must keep going while an export reads the same ring
+    audio_buffer_t ab;
+    audio_buffer_init(&ab, 2, 48000, 10);
+    float block[2][480];
+    float *planes[2] = {block[0], block[1]};
+    uint64_t frame = 0;
+    for (; frame < HELD_EXPORT_END; frame += 480) {
+        for (int i = 0; i < 480; ++i) {
+            block[0][i] = (float)((frame + i) % 100000) / 8388608.0f;
+            block[1][i] = -block[0][i];
+        }
+        audio_buffer_push_frames(&ab, planes, 480, 0);
+    }
+
+    held_export_t he = {&ab, 0, 0, 0, -1};
+    pthread_t thread;
+    ck_assert_int_eq(pthread_create(&thread, NULL, held_export, &he), 0);
+    while (!atomic_load(&he.started)) sched_yield();
+    // Every quantum completes while the exports run; 2 s of them, so the
+    // exported range stays in the ring
+    for (int q = 0; q < 200; ++q) audio_buffer_push_frames(&ab, planes, 480, 0);
+    ck_assert_uint_eq(audio_buffer_write_position(&ab), HELD_EXPORT_END + 200 * 480);
+    atomic_store(&he.released, 1);
+    pthread_join(thread, NULL);
+    ck_assert_int_eq(he.result, 0);
+    ck_assert_int_ge(he.exports, 1);
+
+    SF_INFO sfinfo = {0};
+    SNDFILE *infile = sf_open("_out/test_held_export.wav", SFM_READ, &sfinfo);
+    ck_assert_ptr_nonnull(infile);
+    ck_assert_int_eq(sfinfo.frames, HELD_EXPORT_END - HELD_EXPORT_START);
+    float *data = (float *)malloc(sizeof(float) * sfinfo.frames * 2);
+    sf_read_float(infile, data, sfinfo.frames * 2);
+    sf_close(infile);
+    for (int i = 0; i < sfinfo.frames; ++i) {
+        float expected = (float)((HELD_EXPORT_START + i) % 100000) / 8388608.0f;
+        ck_assert_float_eq_tol(data[i * 2], expected, 1e-9);
+    }
+    free(data);
+    audio_buffer_free(&ab);
+}
+END_TEST
+
+START_TEST(test_audio_buffer_range_export_is_frame_exact)
+{
+    audio_buffer_t ab;
+    unsigned int sample_rate = 48000;
+    audio_buffer_init(&ab, 1, sample_rate, 2);
+
+    // Three hours in, where float seconds can no longer address single frames
+    float *silence[1] = {NULL};
+    uint64_t clock = 1000000007;
+    for (int q = 0; q < 3 * 3600; ++q) {
+        audio_buffer_set_clock(&ab, clock + audio_buffer_write_position(&ab));
+        audio_buffer_push_frames(&ab, silence, sample_rate, 0);
+    }
+    uint64_t base = audio_buffer_write_position(&ab);
+    ck_assert_uint_eq(base, 3ull * 3600 * sample_rate);
+
+    // Odd quantum size, marker somewhere in the middle, exact 24 bit ramp
+    float block[117];
+    float *planes[1] = {block};
+    for (int q = 0; q < 400; ++q) {
+        uint64_t pos = audio_buffer_write_position(&ab);
+        for (int i = 0; i < 117; ++i) block[i] = (float)((pos - base + i) % 5000 + 100) / 8388608.0f;
+        audio_buffer_set_clock(&ab, clock + pos);
+        audio_buffer_push_frames(&ab, planes, 117, q == 201);
+    }
+    uint64_t sync = audio_buffer_sync_frame(&ab);
+    ck_assert_uint_eq(sync, base + 201 * 117);
+    ck_assert_uint_eq(audio_buffer_frame_at_clock(&ab, clock + sync), sync);
+    ck_assert_uint_eq(audio_buffer_clock_at_frame(&ab, sync), clock + sync);
+
+    audio_export_stats_t stats = {0};
+    uint64_t start = sync - 5, end = sync + 12345;
+    ck_assert_int_eq(audio_buffer_write_range_to_wav(&ab, 0, 1, start, end, "_out/test_range.wav", &stats), 0);
+    ck_assert_uint_eq(stats.frames, end - start);
+
+    SF_INFO sfinfo = {0};
+    SNDFILE *infile = sf_open("_out/test_range.wav", SFM_READ, &sfinfo);
+    ck_assert_ptr_nonnull(infile);
+    ck_assert_int_eq(sfinfo.frames, (sf_count_t)(end - start));
+    float *data = (float *)malloc(sizeof(float) * sfinfo.frames);
+    sf_read_float(infile, data, sfinfo.frames);
+    sf_close(infile);
+    for (int i = 0; i < sfinfo.frames; ++i) {
+        uint64_t frame = start + (uint64_t)i;
+        float expected = (float)((frame - base) % 5000 + 100) / 8388608.0f;
+        if (frame >= sync && frame < sync + 16) continue; // The marker
+        ck_assert_msg(data[i] == expected, "frame %d", i);
+    }
+    free(data);
+
+    // Range reads: exact frames, and -1 once the ring has moved on
+    float out[16];
+    ck_assert_int_eq(audio_buffer_read_range(&ab, 0, out, sync, sync + 16), 0);
+    ck_assert_float_eq_tol(out[0], 1.23e-5f, 1e-9);
+    ck_assert_int_eq(audio_buffer_read_range(&ab, 0, out, base - sample_rate * 3, base - sample_rate * 3 + 16), -1);
+    ck_assert_int_lt(audio_buffer_write_range_to_wav(&ab, 0, 1, end + 1000000, end + 2000000, "_out/test_range.wav", NULL), 0);
+    audio_buffer_free(&ab);
+}
+END_TEST
+
+START_TEST(test_audio_buffer_marked_segments_export_in_one_pass)
+{
+    audio_buffer_t ab;
+    unsigned int sample_rate = 48000;
+    audio_buffer_init(&ab, 3, sample_rate, 2);
+
+    // Record start on all channels, a punch-in on channel 1 only, a loop boundary
+    float block[3][100];
+    float *planes[3] = {block[0], block[1], block[2]};
+    for (int q = 0; q < 300; ++q) {
+        uint64_t pos = audio_buffer_write_position(&ab);
+        for (int ch = 0; ch < 3; ++ch) {
+            for (int i = 0; i < 100; ++i) block[ch][i] = (float)((pos + i) % 7000 + 1000 * ch + 1) / 8388608.0f;
+        }
+        if (q == 20) audio_buffer_push_frames(&ab, planes, 100, 1);
+        else if (q == 100) audio_buffer_push_frames_marked(&ab, planes, 100, MARKER_PUNCH_IN, 0x2);
+        else if (q == 200) audio_buffer_push_frames_marked(&ab, planes, 100, MARKER_LOOP, AUDIO_BUFFER_ALL_CHANNELS);
+        else audio_buffer_push_frames(&ab, planes, 100, 0);
+    }
+    ck_assert_uint_eq(audio_buffer_sync_frame(&ab), 2000);
+    ck_assert_uint_eq(marker_index_count(&ab.markers), 3);
+    ck_assert_uint_eq(ab.markers.markers[1].frame, 10000);
+    ck_assert_uint_eq(ab.markers.markers[1].take_id, 1);
+
+    // The punch-in pattern is on channel 1 only, and differs from the sync marker
+    float out[16];
+    const float *punch = sync_marker_pattern_for(MARKER_PUNCH_IN);
+    ck_assert_int_eq(audio_buffer_read_range(&ab, 1, out, 10000, 10016), 0);
+    for (int i = 0; i < 16; ++i) ck_assert(out[i] == punch[i]);
+    ck_assert(punch[1] != sync_marker_pattern[1] || punch[2] != sync_marker_pattern[2]);
+    ck_assert_int_eq(audio_buffer_read_range(&ab, 0, out, 10000, 10016), 0);
+    ck_assert(out[0] != punch[0]);
+
+    // Every segment with 10 ms pre-roll, interleaved plus a split copy of channel 2
+    marker_segment_t segs[4];
+    uint64_t stop = audio_buffer_write_position(&ab);
+    ck_assert_uint_eq(marker_index_segments(&ab.markers, stop, segs, 4), 3);
+    char names[6][64];
+    audio_export_segment_t exports[6];
+    for (int i = 0; i < 3; ++i) {
+        uint64_t start = segs[i].start_frame - 480;
+        snprintf(names[i], sizeof(names[i]), "_out/test_seg%d.wav", i);
+        snprintf(names[i + 3], sizeof(names[i + 3]), "_out/test_seg%d_ch03.wav", i);
+        exports[i] = (audio_export_segment_t){start, segs[i].end_frame, 0, 3, names[i], {0, 0, 0.0}, 0};
+        exports[i + 3] = (audio_export_segment_t){start, segs[i].end_frame, 2, 1, names[i + 3], {0, 0, 0.0}, 0};
+    }
+    ck_assert_int_eq(audio_buffer_write_segments_to_wav(&ab, exports, 6), 0);
+
+    const uint64_t bounds[3][2] = {{2000 - 480, 10000}, {10000 - 480, 20000}, {20000 - 480, 30000}};
+    for (int i = 0; i < 6; ++i) {
+        uint64_t first = bounds[i % 3][0], last = bounds[i % 3][1];
+        ck_assert_int_eq(exports[i].result, 0);
+        ck_assert_uint_eq(exports[i].stats.frames, last - first);
+        SF_INFO sfinfo = {0};
+        SNDFILE *infile = sf_open(names[i], SFM_READ, &sfinfo);
+        ck_assert_ptr_nonnull(infile);
+        ck_assert_int_eq(sfinfo.frames, (sf_count_t)(last - first));
+        float *data = (float *)malloc(sizeof(float) * sfinfo.frames * sfinfo.channels);
+        sf_read_float(infile, data, sfinfo.frames * sfinfo.channels);
+        sf_close(infile);
+        for (sf_count_t f = 0; f < sfinfo.frames; ++f) {
+            uint64_t frame = first + (uint64_t)f;
+            int marker = (frame >= 2000 && frame < 2016) || (frame >= 10000 && frame < 10016) || (frame >= 20000 && frame < 20016);
+            if (marker) continue;
+            for (int c = 0; c < sfinfo.channels; ++c) {
+                int ch = i < 3 ? c : 2;
+                float expected = (float)(frame % 7000 + 1000 * ch + 1) / 8388608.0f;
+                ck_assert_msg(data[f * sfinfo.channels + c] == expected, "file %d frame %d", i, (int)f);
+            }
+        }
+        free(data);
+    }
+
+    // A bad segment fails on its own, the others are still written
+    exports[0].first_channel = 2;
+    exports[4].start_frame = stop + 10;
+    exports[4].end_frame = stop + 20;
+    ck_assert_int_eq(audio_buffer_write_segments_to_wav(&ab, exports, 6), -1);
+    ck_assert_int_eq(exports[0].result, -1);
+    ck_assert_int_eq(exports[4].result, -3);
+    ck_assert_int_eq(exports[1].result, 0);
+    ck_assert_uint_eq(exports[5].stats.frames, 10480);
+    audio_buffer_free(&ab);
+}
+END_TEST
+
 int main(void)
 {
     Suite *s = suite_create("AudioBuffer");
@@ -381,6 +733,12 @@ int main(void)
     tcase_add_test(tc_core, test_audio_buffer_guitar_like_wrap_and_sync);
     tcase_add_test(tc_core, test_audio_buffer_sync_at_wrap_boundary);
     tcase_add_test(tc_core, test_audio_buffer_offset_from_sync_feature);
+    tcase_add_test(tc_core, test_audio_buffer_push_frames_sync_on_all_channels);
+    tcase_add_test(tc_core, test_audio_buffer_write_channels_to_wav_interleaved);
+    tcase_add_test(tc_core, test_audio_buffer_export_streams_in_chunks);
+    tcase_add_test(tc_core, test_audio_buffer_push_never_waits_for_export);
+    tcase_add_test(tc_core, test_audio_buffer_range_export_is_frame_exact);
+    tcase_add_test(tc_core, test_audio_buffer_marked_segments_export_in_one_pass);
     suite_add_tcase(s, tc_core);
 
     srunner_run_all(sr, CK_NORMAL);
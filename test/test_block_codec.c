@@ -0,0 +1,132 @@
+#include <check.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include "../src/block-codec.h"
+
+#define N 4096
+
+static uint8_t encoded[1 + N * 4];
+static float decoded[N];
+
+// Encode, decode and compare bit for bit; returns the encoded size
+static size_t round_trip(const float *samples, uint32_t n)
+{
+    size_t size = block_codec_encode(samples, n, encoded);
+    ck_assert_uint_le(size, block_codec_max_encoded_size(n));
+    memset(decoded, 0xAB, sizeof(decoded));
+    ck_assert_int_eq(block_codec_decode(encoded, size, decoded, n), 0);
+    ck_assert(memcmp(samples, decoded, sizeof(float) * n) == 0);
+    return size;
+}
+
+static uint32_t lcg_state = 12345;
+static uint32_t lcg(void)
+{
+    lcg_state = lcg_state * 1664525u + 1013904223u;
+    return lcg_state;
+}
+
+START_TEST(test_block_codec_silence)
+{
+    float samples[N] = {0};
+    ck_assert_uint_eq(round_trip(samples, N), 5);
+    for (int i = 0; i < N; ++i) samples[i] = -0.0f;
+    ck_assert_uint_eq(round_trip(samples, N), 5);
+}
+END_TEST
+
+START_TEST(test_block_codec_int24_sine)
+{
+    // A 24 bit source, as PipeWire delivers it from S24 hardware
+    float samples[N];
+    for (int i = 0; i < N; ++i) {
+        float v = 0.5f * sinf(2.0f * 3.14159265f * 440.0f * i / 48000.0f);
+        samples[i] = (float)lrintf(v * 8388608.0f) / 8388608.0f;
+    }
+    size_t size = round_trip(samples, N);
+    ck_assert_uint_lt(size, N * 4 / 2);
+}
+END_TEST
+
+START_TEST(test_block_codec_int24_noisy_signal_compresses)
+{
+    // Music-like level plus 16 bits of noise still beats raw floats by 2x
+    float samples[N];
+    for (int i = 0; i < N; ++i) {
+        float v = 0.3f * sinf(2.0f * 3.14159265f * 220.0f * i / 48000.0f);
+        int32_t noise = (int32_t)(lcg() >> 16) - 32768;
+        samples[i] = (float)(lrintf(v * 8388608.0f) + noise / 8) / 8388608.0f;
+    }
+    size_t size = round_trip(samples, N);
+    ck_assert_uint_lt(size, N * 4 / 2);
+}
+END_TEST
+
+START_TEST(test_block_codec_float_signal)
+{
+    // Not 24 bit representable: goes through the float bits path
+    float samples[N];
+    for (int i = 0; i < N; ++i) samples[i] = 0.25f * sinf((float)i * 0.01f) + 1e-9f * (float)i;
+    size_t size = round_trip(samples, N);
+    ck_assert_uint_lt(size, N * 4);
+}
+END_TEST
+
+START_TEST(test_block_codec_random_bits_fall_back_to_raw)
+{
+    float samples[N];
+    for (int i = 0; i < N; ++i) {
+        uint32_t u = lcg();
+        memcpy(&samples[i], &u, sizeof(u));
+    }
+    ck_assert_uint_eq(round_trip(samples, N), 1 + N * 4);
+}
+END_TEST
+
+START_TEST(test_block_codec_edge_values)
+{
+    float samples[16] = {
+        1.0f, -1.0f, -0.0f, 0.0f, 0.99999994f, -0.99999994f, 3.0f, -7.5f,
+        1e-38f, -1e-45f, INFINITY, -INFINITY, 0.5f, 0.25f, 8388607.0f / 8388608.0f, -1.0f
+    };
+    round_trip(samples, 16);
+    round_trip(samples, 1);
+    round_trip(samples, 3);
+    float full_scale[4] = {-1.0f, 8388607.0f / 8388608.0f, -1.0f, 8388607.0f / 8388608.0f};
+    round_trip(full_scale, 4);
+}
+END_TEST
+
+START_TEST(test_block_codec_rejects_truncated_input)
+{
+    float samples[N];
+    for (int i = 0; i < N; ++i) samples[i] = (float)((int32_t)(lcg() >> 20) - 2048) / 8388608.0f;
+    size_t size = block_codec_encode(samples, N, encoded);
+    ck_assert_int_eq(block_codec_decode(encoded, size / 2, decoded, N), -1);
+    encoded[0] = 0x7F;
+    ck_assert_int_eq(block_codec_decode(encoded, size, decoded, N), -1);
+}
+END_TEST
+
+int main(void)
+{
+    Suite *s = suite_create("BlockCodec");
+    TCase *tc_core = tcase_create("Core");
+    SRunner *sr = srunner_create(s);
+
+    tcase_add_test(tc_core, test_block_codec_silence);
+    tcase_add_test(tc_core, test_block_codec_int24_sine);
+    tcase_add_test(tc_core, test_block_codec_int24_noisy_signal_compresses);
+    tcase_add_test(tc_core, test_block_codec_float_signal);
+    tcase_add_test(tc_core, test_block_codec_random_bits_fall_back_to_raw);
+    tcase_add_test(tc_core, test_block_codec_edge_values);
+    tcase_add_test(tc_core, test_block_codec_rejects_truncated_input);
+    suite_add_tcase(s, tc_core);
+
+    srunner_run_all(sr, CK_NORMAL);
+    int number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+    return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,116 @@
+#include <check.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include "../src/buffer-set.h"
+
+static audio_buffer_t *new_buffer(unsigned int sample_rate) {
+    audio_buffer_t *ab = malloc(sizeof(audio_buffer_t));
+    audio_buffer_init(ab, 1, sample_rate, 1);
+    return ab;
+}
+
+static void push(audio_buffer_t *ab, int frames, int marked) {
+    float samples[1024] = {0};
+    float *planes[1] = {samples};
+    if (marked) audio_buffer_push_frames_marked(ab, planes, frames, MARKER_RECORD_START, AUDIO_BUFFER_ALL_CHANNELS);
+    else audio_buffer_push_frames(ab, planes, frames, 0);
+}
+
+START_TEST(test_buffer_set_keeps_previous_rate_segment)
+{
+    buffer_set_t bs;
+    buffer_set_init(&bs);
+    ck_assert_ptr_null(buffer_set_current(&bs));
+    ck_assert_ptr_null(buffer_set_acquire(&bs, -1));
+
+    audio_buffer_t *a = new_buffer(44100);
+    ck_assert_int_eq(buffer_set_publish(&bs, a), 0);
+    ck_assert_ptr_eq(buffer_set_current(&bs), a);
+    push(a, 512, 1);
+    // Markers carry the rate of the buffer they went into
+    ck_assert_uint_eq(a->markers.markers[0].sample_rate, 44100);
+
+    audio_buffer_t *b = new_buffer(48000);
+    ck_assert_int_eq(buffer_set_publish(&bs, b), 1);
+    ck_assert_ptr_eq(buffer_set_current(&bs), b);
+    ck_assert_uint_eq(b->rate_segment, 1);
+
+    // The previous segment stays readable, frames and rate intact
+    audio_buffer_t *old = buffer_set_acquire(&bs, 0);
+    ck_assert_ptr_eq(old, a);
+    ck_assert_uint_eq(audio_buffer_write_position(old), 512);
+    ck_assert_uint_eq(old->sample_rate, 44100);
+
+    // A third rate would drop segment 0, but it is still referenced
+    audio_buffer_t *c = new_buffer(96000);
+    ck_assert_int_eq(buffer_set_publish(&bs, c), 2);
+    ck_assert_uint_eq(bs.count, 3);
+    ck_assert_ptr_eq(buffer_set_acquire(&bs, 0), a);
+    buffer_set_release(&bs, a);
+    buffer_set_release(&bs, a);
+    ck_assert_uint_eq(bs.count, 2);
+    ck_assert_ptr_null(buffer_set_acquire(&bs, 0));
+
+    audio_buffer_t *current = buffer_set_acquire(&bs, -1);
+    ck_assert_ptr_eq(current, c);
+    buffer_set_release(&bs, current);
+    buffer_set_free(&bs);
+}
+END_TEST
+
+typedef struct {
+    buffer_set_t *bs;
+    atomic_int stop;
+    int bad;
+} reader_t;
+
+// Holds buffers like an HTTP download while rates keep changing
+static void *reader(void *arg) {
+    reader_t *r = (reader_t *)arg;
+    while (!atomic_load(&r->stop)) {
+        audio_buffer_t *ab = buffer_set_acquire(r->bs, -1);
+        if (!ab) continue;
+        float out[256];
+        uint64_t end = audio_buffer_write_position(ab);
+        if (end >= 256 && audio_buffer_read_range(ab, 0, out, end - 256, end) < 0) r->bad++;
+        if (ab->sample_rate != 44100 + 100 * ab->rate_segment) r->bad++;
+        buffer_set_release(r->bs, ab);
+    }
+    return NULL;
+}
+
+START_TEST(test_buffer_set_swaps_under_readers)
+{
+    buffer_set_t bs;
+    buffer_set_init(&bs);
+    reader_t r = {&bs, 0, 0};
+    pthread_t threads[2];
+    for (int i = 0; i < 2; ++i) pthread_create(&threads[i], NULL, reader, &r);
+    // Writer: a few quanta into the current buffer, then the next rate
+    for (unsigned int segment = 0; segment < 50; ++segment) {
+        ck_assert_int_eq(buffer_set_publish(&bs, new_buffer(44100 + 100 * segment)), (int)segment);
+        for (int i = 0; i < 20; ++i) push(buffer_set_current(&bs), 256, 0);
+    }
+    atomic_store(&r.stop, 1);
+    for (int i = 0; i < 2; ++i) pthread_join(threads[i], NULL);
+    ck_assert_int_eq(r.bad, 0);
+    ck_assert_uint_eq(bs.count, BUFFER_SET_KEEP);
+    buffer_set_free(&bs);
+}
+END_TEST
+
+int main(void)
+{
+    Suite *s = suite_create("BufferSet");
+    TCase *tc_core = tcase_create("Core");
+    SRunner *sr = srunner_create(s);
+
+    tcase_add_test(tc_core, test_buffer_set_keeps_previous_rate_segment);
+    tcase_add_test(tc_core, test_buffer_set_swaps_under_readers);
+    suite_add_tcase(s, tc_core);
+
+    srunner_run_all(sr, CK_NORMAL);
+    int number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+    return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
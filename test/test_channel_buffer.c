@@ -51,11 +51,9 @@ START_TEST(test_channel_buffer_write_and_read)
     // Step 1: Find the index of the most recent sample
     int most_recent_index = num_samples - 1;
 
-    // Step 2: Subtract the offset to get the starting point in the past
-    int start_from_offset = most_recent_index - offset_samples;
-
-    // Step 3: Move back by (num_samples_duration - 1) to get the first sample in the range
-    int first_sample_index = start_from_offset - (num_samples_duration - 1);
+    // Step 2: Subtract the offset to get the starting point in the past,
+    // the read then moves forward in time from there
+    int first_sample_index = most_recent_index - offset_samples;
     int read = channel_buffer_read(&cb, samples_out, offset_seconds, duration_seconds, num_samples_duration);
 
     ck_assert_int_eq(read, num_samples_duration);
@@ -97,8 +95,7 @@ START_TEST(test_channel_buffer_write_and_read_wrap_around)
 
     // The most recent sample is at index total_samples - 1
     int most_recent_index = total_samples - 1;
-    int start_from_offset = most_recent_index - offset_samples;
-    int first_sample_index = start_from_offset - (num_samples_duration - 1);
+    int first_sample_index = most_recent_index - offset_samples;
     for (int i = 0; i < read; ++i) {
         float expected_value = (float)(first_sample_index + i);
         ck_assert_float_eq_tol(samples_out[i], expected_value, 1e-6);
@@ -139,8 +136,7 @@ START_TEST(test_channel_buffer_write_blocks_and_read)
 
     // The most recent sample is at index num_samples - 1
     int most_recent_index = num_samples - 1;
-    int start_from_offset = most_recent_index - offset_samples;
-    int first_sample_index = start_from_offset - (num_samples_duration - 1);
+    int first_sample_index = most_recent_index - offset_samples;
     for (int i = 0; i < read; ++i) {
         float expected_value = (float)(first_sample_index + i);
         ck_assert_float_eq_tol(samples_out[i], expected_value, 1e-6);
@@ -0,0 +1,144 @@
+#include <check.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include "../src/channel-buffer.h"
+#include "../src/compressed-history.h"
+
+#define RATE 8000
+
+// 24 bit sine with a little deterministic noise, exact in float
+static float signal_value(uint64_t pos)
+{
+    int32_t v = (int32_t)(sin((double)pos * 0.01) * 4000000.0) + (int32_t)((pos * 2654435761u) >> 26);
+    return (float)v / 8388608.0f;
+}
+
+static void write_signal(channel_buffer_t *cb, uint64_t *pos, int frames)
+{
+    float block[256];
+    for (int f = 0; f < frames; f += 256) {
+        for (int i = 0; i < 256; ++i) block[i] = signal_value(*pos + i);
+        channel_buffer_write(cb, block, 256);
+        *pos += 256;
+        // The daemon compresses every few hundred ms, well inside the ring
+        if (*pos % 4096 == 0) channel_buffer_compress(cb);
+    }
+}
+
+static void assert_frames(const float *samples, uint64_t start, uint32_t count)
+{
+    for (uint32_t i = 0; i < count; ++i) {
+        ck_assert_msg(samples[i] == signal_value(start + i), "frame %llu differs", (unsigned long long)(start + i));
+    }
+}
+
+START_TEST(test_history_reads_beyond_the_ring)
+{
+    channel_buffer_t cb;
+    channel_buffer_init(&cb, RATE, 1); // 8192 frames of ring
+    ck_assert_int_eq(channel_buffer_enable_history(&cb, 1 << 20), 0);
+    uint64_t pos = 0;
+    write_signal(&cb, &pos, 10 * RATE);
+
+    // Entirely older than the ring
+    float *samples = malloc(sizeof(float) * 20000);
+    ck_assert_int_eq(channel_buffer_read_frames(&cb, samples, 1000, 20000), 0);
+    assert_frames(samples, 1000, 20000);
+
+    // Straddling history and ring
+    uint64_t start = pos - 12000;
+    ck_assert_int_eq(channel_buffer_read_frames(&cb, samples, start, 12000), 0);
+    assert_frames(samples, start, 12000);
+
+    // Relative reads go through the same path
+    ck_assert_int_eq(channel_buffer_read(&cb, samples, 9.0f, 1.0f, 20000), RATE);
+    assert_frames(samples, pos - 1 - 9 * RATE, RATE);
+
+    free(samples);
+    channel_buffer_free(&cb);
+}
+END_TEST
+
+START_TEST(test_history_compresses)
+{
+    channel_buffer_t cb;
+    channel_buffer_init(&cb, RATE, 1);
+    ck_assert_int_eq(channel_buffer_enable_history(&cb, 1 << 20), 0);
+    uint64_t pos = 0;
+    write_signal(&cb, &pos, 10 * RATE);
+    uint64_t start, end;
+    compressed_history_range(cb.history, &start, &end);
+    ck_assert_uint_eq(start, 0);
+    ck_assert_uint_ge(end, pos - COMPRESSED_HISTORY_BLOCK_FRAMES);
+    ck_assert_uint_lt(cb.history->stored_bytes, (end - start) * sizeof(float) * 6 / 10);
+    channel_buffer_free(&cb);
+}
+END_TEST
+
+START_TEST(test_history_evicts_oldest_blocks)
+{
+    channel_buffer_t cb;
+    channel_buffer_init(&cb, RATE, 1);
+    ck_assert_int_eq(channel_buffer_enable_history(&cb, 64 * 1024), 0);
+    uint64_t pos = 0;
+    write_signal(&cb, &pos, 60 * RATE);
+
+    uint64_t start, end;
+    compressed_history_range(cb.history, &start, &end);
+    ck_assert_uint_gt(start, 0);
+    ck_assert_uint_le(cb.history->stored_bytes, 64 * 1024);
+    ck_assert_uint_eq(cb.history->dropped_frames, 0);
+
+    float samples[1024];
+    ck_assert_int_eq(channel_buffer_read_frames(&cb, samples, start - 1024, 1024), -1);
+    ck_assert_int_eq(channel_buffer_read_frames(&cb, samples, start, 1024), 0);
+    assert_frames(samples, start, 1024);
+    channel_buffer_free(&cb);
+}
+END_TEST
+
+START_TEST(test_history_restarts_after_falling_behind)
+{
+    channel_buffer_t cb;
+    channel_buffer_init(&cb, RATE, 1);
+    ck_assert_int_eq(channel_buffer_enable_history(&cb, 1 << 20), 0);
+    float block[256];
+    uint64_t pos = 0;
+    for (; pos < 5 * RATE; pos += 256) {
+        for (int i = 0; i < 256; ++i) block[i] = signal_value(pos + i);
+        channel_buffer_write(&cb, block, 256);
+    }
+    // The writer lapped the ring before the first compress
+    channel_buffer_compress(&cb);
+    ck_assert_uint_gt(cb.history->dropped_frames, 0);
+    write_signal(&cb, &pos, RATE);
+
+    uint64_t start, end;
+    compressed_history_range(cb.history, &start, &end);
+    ck_assert_uint_gt(end, start);
+    float samples[1024];
+    ck_assert_int_eq(channel_buffer_read_frames(&cb, samples, start, 1024), 0);
+    assert_frames(samples, start, 1024);
+    channel_buffer_free(&cb);
+}
+END_TEST
+
+int main(void)
+{
+    Suite *s = suite_create("CompressedHistory");
+    TCase *tc_core = tcase_create("Core");
+    SRunner *sr = srunner_create(s);
+
+    tcase_add_test(tc_core, test_history_reads_beyond_the_ring);
+    tcase_add_test(tc_core, test_history_compresses);
+    tcase_add_test(tc_core, test_history_evicts_oldest_blocks);
+    tcase_add_test(tc_core, test_history_restarts_after_falling_behind);
+    suite_add_tcase(s, tc_core);
+
+    srunner_run_all(sr, CK_NORMAL);
+    int number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+    return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,121 @@
+#include <check.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include "../src/audio-buffer.h"
+#include "../src/export-queue.h"
+
+#define QUANTUM 256
+
+static void push(audio_buffer_t *ab) {
+    float samples[QUANTUM] = {0};
+    float *planes[1] = {samples};
+    audio_buffer_push_frames(ab, planes, QUANTUM, 0);
+}
+
+START_TEST(test_export_queue_orders_and_bounds_stops)
+{
+    audio_buffer_t ab;
+    audio_buffer_init(&ab, 1, 48000, 1);
+    export_queue_t q;
+    export_queue_init(&q);
+
+    // Stops pile up while the worker is busy instead of being dropped
+    for (int i = 0; i < EXPORT_QUEUE_CAPACITY; ++i) {
+        push(&ab);
+        ck_assert_int_eq(export_queue_stop(&q, &ab), i + 1);
+    }
+    ck_assert_int_eq(export_queue_stop(&q, &ab), -1);
+    ck_assert_uint_eq(q.dropped, 1);
+    ck_assert_uint_eq(q.max_depth, EXPORT_QUEUE_CAPACITY);
+
+    export_job_t job;
+    uint64_t until = 0;
+    for (int i = 0; i < EXPORT_QUEUE_CAPACITY; ++i) {
+        ck_assert_int_eq(export_queue_next(&q, &ab, 0, &job, &until), 1);
+        ck_assert_uint_eq(job.stop_frame, (uint64_t)(i + 1) * QUANTUM);
+        ck_assert(job.queued_at <= export_queue_now());
+    }
+    ck_assert_uint_eq(export_queue_depth(&q), 0);
+
+    // Nothing queued: the worker gets the write position to encode up to
+    push(&ab);
+    ck_assert_int_eq(export_queue_next(&q, &ab, 10, &job, &until), 0);
+    ck_assert_uint_eq(until, audio_buffer_write_position(&ab));
+
+    // Closing drains what is left, then ends the worker
+    ck_assert_int_eq(export_queue_stop(&q, &ab), 1);
+    export_queue_close(&q);
+    ck_assert_int_eq(export_queue_stop(&q, &ab), -1);
+    ck_assert_int_eq(export_queue_next(&q, &ab, 10, &job, &until), 1);
+    ck_assert_int_eq(export_queue_next(&q, &ab, 10, &job, &until), -1);
+    export_queue_free(&q);
+    audio_buffer_free(&ab);
+}
+END_TEST
+
+typedef struct {
+    export_queue_t *q;
+    audio_buffer_t *ab;
+    uint64_t last_until;
+    uint64_t stops[64];
+    int num_stops;
+    int bad;
+} worker_t;
+
+static void *worker(void *arg) {
+    worker_t *w = (worker_t *)arg;
+    export_job_t job;
+    uint64_t until;
+    int ret;
+    while ((ret = export_queue_next(w->q, w->ab, 1, &job, &until)) >= 0) {
+        if (ret == 0) {
+            w->last_until = until;
+            continue;
+        }
+        // A stop is never behind a position the worker already encoded to
+        if (job.stop_frame < w->last_until) w->bad++;
+        if (w->num_stops < 64) w->stops[w->num_stops++] = job.stop_frame;
+    }
+    return NULL;
+}
+
+START_TEST(test_export_queue_worker_never_passes_a_stop)
+{
+    audio_buffer_t ab;
+    audio_buffer_init(&ab, 1, 48000, 10);
+    export_queue_t q;
+    export_queue_init(&q);
+    worker_t w = {&q, &ab, 0, {0}, 0, 0};
+    pthread_t thread;
+    pthread_create(&thread, NULL, worker, &w);
+    // Capture keeps going on this thread while stops are queued
+    int stops = 0;
+    for (int i = 0; i < 20000; ++i) {
+        push(&ab);
+        if (i % 500 == 0 && export_queue_stop(&q, &ab) > 0) stops++;
+    }
+    export_queue_close(&q);
+    pthread_join(thread, NULL);
+    ck_assert_int_eq(w.bad, 0);
+    ck_assert_int_eq(w.num_stops, stops);
+    for (int i = 1; i < w.num_stops; ++i) ck_assert_uint_gt(w.stops[i], w.stops[i - 1]);
+    export_queue_free(&q);
+    audio_buffer_free(&ab);
+}
+END_TEST
+
+int main(void)
+{
+    Suite *s = suite_create("ExportQueue");
+    TCase *tc_core = tcase_create("Core");
+    SRunner *sr = srunner_create(s);
+
+    tcase_add_test(tc_core, test_export_queue_orders_and_bounds_stops);
+    tcase_add_test(tc_core, test_export_queue_worker_never_passes_a_stop);
+    suite_add_tcase(s, tc_core);
+
+    srunner_run_all(sr, CK_NORMAL);
+    int number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+    return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,109 @@
+#include <check.h>
+#include <stdlib.h>
+#include <math.h>
+#include "../src/glitch-map.h"
+
+#define FRAMES 48000
+#define CHANNELS 2
+
+static float performance(int frame, int ch)
+{
+    return 0.5f * sinf((float)frame * 0.01f + (float)ch);
+}
+
+// Stereo recording and a take with a zeroed packet, a dropout just after it
+// and a repeated buffer; elsewhere they differ by requantization only
+static void make_signals(float *take, float *rec)
+{
+    for (int i = 0; i < FRAMES; ++i) {
+        for (int ch = 0; ch < CHANNELS; ++ch) {
+            rec[i * CHANNELS + ch] = performance(i, ch);
+            take[i * CHANNELS + ch] = performance(i, ch) + (i & 1 ? 1.0f : -1.0f) / 8388608.0f;
+        }
+    }
+    for (int i = 10000; i < 10100; ++i) take[i * CHANNELS] = take[i * CHANNELS + 1] = 0.0f;
+    for (int i = 10200; i < 10230; ++i) take[i * CHANNELS] = take[i * CHANNELS + 1] = 0.0f;
+    for (int i = 30000; i < 30256; ++i) {
+        take[i * CHANNELS] = take[(i - 256) * CHANNELS];
+        take[i * CHANNELS + 1] = take[(i - 256) * CHANNELS + 1];
+    }
+}
+
+START_TEST(test_glitch_map_finds_dropouts_and_repeats)
+{
+    float *take = malloc(sizeof(float) * FRAMES * CHANNELS);
+    float *rec = malloc(sizeof(float) * FRAMES * CHANNELS);
+    make_signals(take, rec);
+    glitch_map_t gm;
+    ck_assert_int_eq(glitch_map_init(&gm, 0.0f, 0), 0);
+    // Chunks that do not line up with the windows
+    for (int start = 0; start < FRAMES; start += 1000) {
+        ck_assert_int_eq(glitch_map_feed(&gm, (uint64_t)start, take + start * CHANNELS, CHANNELS, rec + start * CHANNELS,
+                                         CHANNELS, CHANNELS, 1000), 0);
+    }
+    ck_assert_int_eq(glitch_map_finish(&gm), 0);
+    ck_assert_uint_eq(gm.compared_frames, FRAMES);
+
+    // The two dropouts are within the merge gap of each other
+    ck_assert_uint_eq(gm.count, 2);
+    const glitch_t *g = &gm.glitches[0];
+    ck_assert_uint_eq(g->start_frame, 10000 / GLITCH_MAP_WINDOW * GLITCH_MAP_WINDOW);
+    ck_assert_uint_eq(g->end_frame, (10230 + GLITCH_MAP_WINDOW - 1) / GLITCH_MAP_WINDOW * GLITCH_MAP_WINDOW);
+    ck_assert_uint_eq(g->type, GLITCH_ZEROED);
+    ck_assert(g->max_diff > 0.4f && g->max_diff <= 0.5f);
+    ck_assert(g->rms_diff > 0.0f && g->rms_diff < g->max_diff);
+
+    g = &gm.glitches[1];
+    ck_assert_uint_le(g->start_frame, 30000);
+    ck_assert_uint_gt(g->start_frame, 30000 - GLITCH_MAP_WINDOW);
+    ck_assert_uint_ge(g->end_frame, 30256);
+    ck_assert_uint_lt(g->end_frame, 30256 + GLITCH_MAP_WINDOW);
+    ck_assert_uint_eq(g->type, GLITCH_DIFFERENT);
+    ck_assert_uint_eq(glitch_map_frames(&gm), (gm.glitches[0].end_frame - gm.glitches[0].start_frame) +
+                                             (gm.glitches[1].end_frame - gm.glitches[1].start_frame));
+    glitch_map_free(&gm);
+    free(take);
+    free(rec);
+}
+END_TEST
+
+START_TEST(test_glitch_map_merge_gap_and_threshold)
+{
+    float *take = malloc(sizeof(float) * FRAMES * CHANNELS);
+    float *rec = malloc(sizeof(float) * FRAMES * CHANNELS);
+    make_signals(take, rec);
+    glitch_map_t gm;
+
+    // Without merging the two dropouts are separate glitches
+    ck_assert_int_eq(glitch_map_init(&gm, 0.0f, 1), 0);
+    glitch_map_feed(&gm, 0, take, CHANNELS, rec, CHANNELS, CHANNELS, FRAMES);
+    glitch_map_finish(&gm);
+    ck_assert_uint_eq(gm.count, 3);
+    glitch_map_free(&gm);
+
+    // Above the loudest difference nothing is reported
+    ck_assert_int_eq(glitch_map_init(&gm, 1.5f, 0), 0);
+    glitch_map_feed(&gm, 0, take, CHANNELS, rec, CHANNELS, CHANNELS, FRAMES);
+    glitch_map_finish(&gm);
+    ck_assert_uint_eq(gm.count, 0);
+    glitch_map_free(&gm);
+    free(take);
+    free(rec);
+}
+END_TEST
+
+int main(void)
+{
+    Suite *s = suite_create("GlitchMap");
+    TCase *tc_core = tcase_create("Core");
+    SRunner *sr = srunner_create(s);
+
+    tcase_add_test(tc_core, test_glitch_map_finds_dropouts_and_repeats);
+    tcase_add_test(tc_core, test_glitch_map_merge_gap_and_threshold);
+    suite_add_tcase(s, tc_core);
+
+    srunner_run_all(sr, CK_NORMAL);
+    int number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+    return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,78 @@
+#include <check.h>
+#include <stdlib.h>
+#include "../src/http-request.h"
+
+START_TEST(test_http_parse_range_forms)
+{
+    uint64_t first = 0, last = 0;
+    ck_assert_int_eq(http_parse_range("bytes=0-99", 1000, &first, &last), 0);
+    ck_assert_uint_eq(first, 0);
+    ck_assert_uint_eq(last, 99);
+    // Open ended and past the end are clipped to the resource
+    ck_assert_int_eq(http_parse_range("bytes=500-", 1000, &first, &last), 0);
+    ck_assert_uint_eq(first, 500);
+    ck_assert_uint_eq(last, 999);
+    ck_assert_int_eq(http_parse_range("bytes=900-5000", 1000, &first, &last), 0);
+    ck_assert_uint_eq(last, 999);
+    // Suffix ranges
+    ck_assert_int_eq(http_parse_range("bytes=-100", 1000, &first, &last), 0);
+    ck_assert_uint_eq(first, 900);
+    ck_assert_uint_eq(last, 999);
+    ck_assert_int_eq(http_parse_range("bytes=-5000", 1000, &first, &last), 0);
+    ck_assert_uint_eq(first, 0);
+
+    // Served whole
+    ck_assert_int_eq(http_parse_range(NULL, 1000, &first, &last), 1);
+    ck_assert_int_eq(http_parse_range("items=0-1", 1000, &first, &last), 1);
+    ck_assert_int_eq(http_parse_range("bytes=0-1,5-9", 1000, &first, &last), 1);
+    ck_assert_int_eq(http_parse_range("bytes=9-5", 1000, &first, &last), 1);
+    ck_assert_int_eq(http_parse_range("bytes=x-5", 1000, &first, &last), 1);
+
+    // Not satisfiable
+    ck_assert_int_eq(http_parse_range("bytes=1000-", 1000, &first, &last), -1);
+    ck_assert_int_eq(http_parse_range("bytes=-0", 1000, &first, &last), -1);
+}
+END_TEST
+
+START_TEST(test_http_parse_numbers_and_channels)
+{
+    uint64_t v = 0;
+    ck_assert_int_eq(http_parse_u64("172800000", &v), 0);
+    ck_assert_uint_eq(v, 172800000);
+    ck_assert_int_eq(http_parse_u64("18446744073709551615", &v), 0);
+    ck_assert_uint_eq(v, UINT64_MAX);
+    ck_assert_int_eq(http_parse_u64("18446744073709551616", &v), -1);
+    ck_assert_int_eq(http_parse_u64("12a", &v), -1);
+    ck_assert_int_eq(http_parse_u64("", &v), -1);
+    ck_assert_int_eq(http_parse_u64(NULL, &v), -1);
+
+    unsigned int ch[8];
+    ck_assert_int_eq(http_parse_channels("1,3-4", 4, ch, 8), 3);
+    ck_assert_uint_eq(ch[0], 0);
+    ck_assert_uint_eq(ch[1], 2);
+    ck_assert_uint_eq(ch[2], 3);
+    ck_assert_int_eq(http_parse_channels("2", 2, ch, 8), 1);
+    ck_assert_uint_eq(ch[0], 1);
+    ck_assert_int_eq(http_parse_channels("0", 4, ch, 8), -1);
+    ck_assert_int_eq(http_parse_channels("5", 4, ch, 8), -1);
+    ck_assert_int_eq(http_parse_channels("1,", 4, ch, 8), -1);
+    ck_assert_int_eq(http_parse_channels("3-1", 4, ch, 8), -1);
+    ck_assert_int_eq(http_parse_channels("1-4", 4, ch, 3), -1);
+}
+END_TEST
+
+int main(void)
+{
+    Suite *s = suite_create("HttpRequest");
+    TCase *tc_core = tcase_create("Core");
+    SRunner *sr = srunner_create(s);
+
+    tcase_add_test(tc_core, test_http_parse_range_forms);
+    tcase_add_test(tc_core, test_http_parse_numbers_and_channels);
+    suite_add_tcase(s, tc_core);
+
+    srunner_run_all(sr, CK_NORMAL);
+    int number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+    return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
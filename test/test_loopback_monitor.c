@@ -0,0 +1,217 @@
+#include <check.h>
+#include <stdlib.h>
+#include <math.h>
+#include "../src/loopback-monitor.h"
+
+#define RATE 48000
+#define CHANNELS 2
+#define QUANTUM 480
+#define BLOCKS 100
+#define FRAMES (BLOCKS * QUANTUM)
+#define LATENCY 1000
+// Long enough to run through a one second capture ring several times
+#define LONG_BLOCKS 400
+
+// What left through the outputs, markers included, channel after channel
+static float sent[CHANNELS][LONG_BLOCKS * QUANTUM];
+
+static float performance(int frame, int ch)
+{
+    return 0.5f * sinf((float)frame * 0.01f + (float)ch);
+}
+
+// Returns frames [frame, frame + n) of the return: the outputs delayed by
+// latency_at(frame), with the frames in [drop_start, drop_end) lost
+typedef struct {
+    int switch_frame;      // Return frame the latency changes at, FRAMES if never
+    int second_latency;
+    int drop_start, drop_end;
+} hop_t;
+
+static void make_return(const hop_t *hop, int frame, float ret[CHANNELS][QUANTUM])
+{
+    for (int i = 0; i < QUANTUM; ++i) {
+        int f = frame + i;
+        int src = f - (f < hop->switch_frame ? LATENCY : hop->second_latency);
+        for (int ch = 0; ch < CHANNELS; ++ch) {
+            ret[ch][i] = src >= 0 && !(f >= hop->drop_start && f < hop->drop_end) ? sent[ch][src] : 0.0f;
+        }
+    }
+}
+
+// Blocks [first, end), record starts on the given blocks; polls every ten
+// blocks like the daemon. Without a monitor only the capture runs.
+static void run_blocks(loopback_monitor_t *lm, audio_buffer_t *capture, const hop_t *hop, int start1, int start2, int first, int end)
+{
+    for (int block = first; block < end; ++block) {
+        int frame = block * QUANTUM;
+        for (int ch = 0; ch < CHANNELS; ++ch) {
+            for (int i = 0; i < QUANTUM; ++i) sent[ch][frame + i] = performance(frame + i, ch);
+        }
+        float *in[CHANNELS] = {&sent[0][frame], &sent[1][frame]};
+        // The marker is injected in place, so the outputs carry it too
+        if (block == start1 || block == start2) {
+            audio_buffer_push_frames_marked(capture, in, QUANTUM, MARKER_RECORD_START, AUDIO_BUFFER_ALL_CHANNELS);
+        } else {
+            audio_buffer_push_frames(capture, in, QUANTUM, 0);
+        }
+        if (!lm) continue;
+        float ret[CHANNELS][QUANTUM];
+        make_return(hop, frame, ret);
+        float *planes[CHANNELS] = {ret[0], ret[1]};
+        loopback_monitor_push(lm, planes, QUANTUM);
+        if (block % 10 == 9) loopback_monitor_poll(lm);
+    }
+}
+
+static void run(loopback_monitor_t *lm, audio_buffer_t *capture, const hop_t *hop, int start1, int start2)
+{
+    run_blocks(lm, capture, hop, start1, start2, 0, BLOCKS);
+}
+
+START_TEST(test_loopback_monitor_finds_dropout)
+{
+    audio_buffer_t capture;
+    audio_buffer_init(&capture, CHANNELS, RATE, 10);
+    loopback_monitor_t lm;
+    ck_assert_int_eq(loopback_monitor_init(&lm, &capture, 0), 0);
+    int64_t latency;
+    uint64_t until;
+    loopback_monitor_status(&lm, &latency, &until);
+    ck_assert(latency == LOOPBACK_MONITOR_UNALIGNED);
+
+    // 200 frames of capture frame 20000 on never come back
+    hop_t hop = {FRAMES, LATENCY, 20000 + LATENCY, 20200 + LATENCY};
+    run(&lm, &capture, &hop, 10, -1);
+
+    loopback_monitor_status(&lm, &latency, &until);
+    ck_assert_int_eq(latency, LATENCY);
+    ck_assert_uint_eq(lm.alignments, 1);
+    ck_assert_uint_ge(until, FRAMES - LATENCY - LOOPBACK_MONITOR_HORIZON_FRAMES - LOOPBACK_MONITOR_CHUNK_FRAMES);
+    ck_assert_uint_le(until, FRAMES - LATENCY);
+
+    glitch_t g[4];
+    uint32_t next = 0;
+    ck_assert_uint_eq(loopback_monitor_new_glitches(&lm, &next, g, 4), 1);
+    ck_assert_uint_eq(next, 1);
+    ck_assert_uint_le(g[0].start_frame, 20000);
+    ck_assert_uint_gt(g[0].start_frame, 20000 - GLITCH_MAP_WINDOW);
+    ck_assert_uint_ge(g[0].end_frame, 20200);
+    ck_assert_uint_lt(g[0].end_frame, 20200 + GLITCH_MAP_WINDOW);
+    ck_assert_uint_eq(g[0].type, GLITCH_ZEROED);
+    ck_assert_uint_eq(loopback_monitor_new_glitches(&lm, &next, g, 4), 0);
+
+    ck_assert_uint_eq(loopback_monitor_glitches_in(&lm, 19000, 21000, g, 4), 1);
+    ck_assert_uint_eq(loopback_monitor_glitches_in(&lm, 0, 19000, g, 4), 0);
+    ck_assert_uint_eq(loopback_monitor_glitches_in(&lm, 21000, FRAMES, g, 4), 0);
+    loopback_monitor_free(&lm);
+    audio_buffer_free(&capture);
+}
+END_TEST
+
+START_TEST(test_loopback_monitor_follows_latency_change)
+{
+    audio_buffer_t capture;
+    audio_buffer_init(&capture, CHANNELS, RATE, 10);
+    loopback_monitor_t lm;
+    ck_assert_int_eq(loopback_monitor_init(&lm, &capture, 0), 0);
+
+    // The hop gets 500 frames slower just before the second record start
+    // comes back, the return repeats those 500 frames
+    int second = 60 * QUANTUM;
+    hop_t hop = {second + LATENCY, LATENCY + 500, FRAMES, FRAMES};
+    run(&lm, &capture, &hop, 10, 60);
+
+    int64_t latency;
+    uint64_t until;
+    loopback_monitor_status(&lm, &latency, &until);
+    ck_assert_int_eq(latency, LATENCY + 500);
+    ck_assert_uint_eq(lm.alignments, 2);
+    glitch_t g[4];
+    // The repeat is a glitch of the old alignment, nothing after it is
+    ck_assert_uint_eq(loopback_monitor_glitches_in(&lm, 0, second, g, 4), 0);
+    ck_assert_uint_eq(loopback_monitor_glitches_in(&lm, second, second + 500, g, 4), 1);
+    ck_assert_uint_eq(g[0].type, GLITCH_DIFFERENT);
+    ck_assert_uint_eq(loopback_monitor_glitches_in(&lm, second + 500 + GLITCH_MAP_WINDOW, FRAMES, g, 4), 0);
+    loopback_monitor_free(&lm);
+    audio_buffer_free(&capture);
+}
+END_TEST
+
+START_TEST(test_loopback_monitor_forgets_what_the_capture_lost)
+{
+    // A one second capture ring, run for four seconds
+    audio_buffer_t capture;
+    audio_buffer_init(&capture, CHANNELS, RATE, 1);
+    loopback_monitor_t lm;
+    ck_assert_int_eq(loopback_monitor_init(&lm, &capture, 0), 0);
+    hop_t hop = {LONG_BLOCKS * QUANTUM, LATENCY, 20000 + LATENCY, 20200 + LATENCY};
+    run_blocks(&lm, &capture, &hop, 10, -1, 0, LONG_BLOCKS);
+
+    // The glitch was found, and forgotten once its frames left the capture
+    ck_assert_uint_ge(audio_buffer_oldest_frame(&capture), 20200);
+    ck_assert_uint_eq(loopback_monitor_poll(&lm), 1);
+    ck_assert_uint_eq(lm.glitches_dropped, 1);
+    ck_assert_uint_eq(lm.map.count, 0);
+    glitch_t g[4];
+    ck_assert_uint_eq(loopback_monitor_glitches_in(&lm, 0, LONG_BLOCKS * QUANTUM, g, 4), 0);
+    uint32_t next = 0;
+    ck_assert_uint_eq(loopback_monitor_new_glitches(&lm, &next, g, 4), 0);
+    ck_assert_uint_eq(next, 1);
+    // The record start marker was used and not kept
+    ck_assert_uint_eq(lm.alignments, 1);
+    ck_assert_uint_eq(lm.detector.num_matches, 0);
+    loopback_monitor_free(&lm);
+    audio_buffer_free(&capture);
+}
+END_TEST
+
+START_TEST(test_loopback_monitor_starts_after_the_capture)
+{
+    audio_buffer_t capture;
+    audio_buffer_init(&capture, CHANNELS, RATE, 10);
+    hop_t hop = {FRAMES, LATENCY, 20000 + LATENCY, 20200 + LATENCY};
+    // The daemon sets the monitor up once the capture is already running,
+    // here seven quanta in: far more than the hop's latency
+    run_blocks(NULL, &capture, &hop, -1, -1, 0, 7);
+    loopback_monitor_t lm;
+    ck_assert_int_eq(loopback_monitor_init(&lm, &capture, 0), 0);
+    run_blocks(&lm, &capture, &hop, 10, -1, 7, BLOCKS);
+
+    int64_t latency;
+    uint64_t until;
+    loopback_monitor_status(&lm, &latency, &until);
+    ck_assert_int_eq(atomic_load(&lm.origin), 7 * QUANTUM);
+    ck_assert_int_eq(latency, LATENCY);
+    ck_assert_uint_eq(lm.alignments, 1);
+    ck_assert_uint_le(until, FRAMES - LATENCY);
+
+    // The dropout is found on its own capture frames
+    glitch_t g[4];
+    ck_assert_uint_eq(loopback_monitor_glitches_in(&lm, 0, FRAMES, g, 4), 1);
+    ck_assert_uint_le(g[0].start_frame, 20000);
+    ck_assert_uint_gt(g[0].start_frame, 20000 - GLITCH_MAP_WINDOW);
+    ck_assert_uint_ge(g[0].end_frame, 20200);
+    ck_assert_uint_lt(g[0].end_frame, 20200 + GLITCH_MAP_WINDOW);
+    loopback_monitor_free(&lm);
+    audio_buffer_free(&capture);
+}
+END_TEST
+
+int main(void)
+{
+    Suite *s = suite_create("LoopbackMonitor");
+    TCase *tc_core = tcase_create("Core");
+    SRunner *sr = srunner_create(s);
+
+    tcase_add_test(tc_core, test_loopback_monitor_finds_dropout);
+    tcase_add_test(tc_core, test_loopback_monitor_follows_latency_change);
+    tcase_add_test(tc_core, test_loopback_monitor_forgets_what_the_capture_lost);
+    tcase_add_test(tc_core, test_loopback_monitor_starts_after_the_capture);
+    suite_add_tcase(s, tc_core);
+
+    srunner_run_all(sr, CK_NORMAL);
+    int number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+    return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
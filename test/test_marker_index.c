@@ -0,0 +1,154 @@
+#include <check.h>
+#include <stdlib.h>
+#include "../src/marker-index.h"
+
+static void add(marker_index_t *mi, uint32_t type, uint64_t frame, uint32_t take)
+{
+    marker_t m = {frame, 0x3, take, type, 48000, type == MARKER_TICK ? (uint32_t)frame / 1000 : 0};
+    ck_assert_int_eq(marker_index_append(mi, &m), 0);
+}
+
+START_TEST(test_marker_index_append_and_search)
+{
+    marker_index_t mi;
+    ck_assert_int_eq(marker_index_init(&mi, 4, 4), 0);
+    add(&mi, MARKER_RECORD_START, 100, 1);
+    add(&mi, MARKER_PUNCH_IN, 200, 1);
+    add(&mi, MARKER_PUNCH_OUT, 200, 1);
+    add(&mi, MARKER_LOOP, 500, 1);
+    ck_assert_uint_eq(marker_index_count(&mi), 4);
+
+    // Full: the append is refused and counted, nothing is overwritten
+    marker_t extra = {600, 1, 1, MARKER_LOOP, 48000, 0};
+    ck_assert_int_eq(marker_index_append(&mi, &extra), -1);
+    ck_assert_uint_eq(atomic_load(&mi.dropped), 1);
+    ck_assert_uint_eq(atomic_load(&mi.record_starts_dropped), 0);
+    ck_assert_int_eq(marker_index_full(&mi), 1);
+    ck_assert_uint_eq(mi.markers[3].frame, 500);
+
+    ck_assert_uint_eq(marker_index_lower_bound(&mi, 0), 0);
+    ck_assert_uint_eq(marker_index_lower_bound(&mi, 100), 0);
+    ck_assert_uint_eq(marker_index_lower_bound(&mi, 101), 1);
+    ck_assert_uint_eq(marker_index_lower_bound(&mi, 200), 1);
+    ck_assert_uint_eq(marker_index_lower_bound(&mi, 501), 4);
+    marker_index_free(&mi);
+}
+END_TEST
+
+START_TEST(test_marker_index_segments_punch_and_loop)
+{
+    marker_index_t mi;
+    ck_assert_int_eq(marker_index_init(&mi, 64, 64), 0);
+    // An earlier take that must not show up
+    add(&mi, MARKER_RECORD_START, 10, 1);
+    add(&mi, MARKER_LOOP, 50, 1);
+    // The take being stopped: record, punch in and out, then two loop passes
+    add(&mi, MARKER_RECORD_START, 1000, 2);
+    add(&mi, MARKER_PUNCH_IN, 2000, 2);
+    add(&mi, MARKER_PUNCH_OUT, 3000, 2);
+    // Ticks split nothing, not even while punched out
+    add(&mi, MARKER_TICK, 3000, 2);
+    add(&mi, MARKER_TICK, 3500, 2);
+    add(&mi, MARKER_LOOP, 4000, 2);
+    add(&mi, MARKER_LOOP, 5000, 2);
+    add(&mi, MARKER_TICK, 5500, 2);
+    // After the stop
+    add(&mi, MARKER_RECORD_START, 9000, 3);
+
+    marker_segment_t seg[8];
+    ck_assert_uint_eq(marker_index_segments(&mi, 6000, seg, 8), 4);
+    const uint64_t expected[4][3] = {
+        {1000, 2000, MARKER_RECORD_START},
+        {2000, 3000, MARKER_PUNCH_IN},
+        {4000, 5000, MARKER_LOOP},
+        {5000, 6000, MARKER_LOOP},
+    };
+    for (int i = 0; i < 4; ++i) {
+        ck_assert_uint_eq(seg[i].start_frame, expected[i][0]);
+        ck_assert_uint_eq(seg[i].end_frame, expected[i][1]);
+        ck_assert_uint_eq(seg[i].type, expected[i][2]);
+        ck_assert_uint_eq(seg[i].take_id, 2);
+        ck_assert_uint_eq(seg[i].channel_mask, 0x3);
+    }
+
+    // Counted even when there is no room to store them all
+    ck_assert_uint_eq(marker_index_segments(&mi, 6000, seg, 2), 4);
+    ck_assert_uint_eq(seg[1].start_frame, 2000);
+
+    // A punch out right before the stop leaves nothing open
+    ck_assert_uint_eq(marker_index_segments(&mi, 3500, seg, 8), 2);
+    // Nothing recorded yet
+    ck_assert_uint_eq(marker_index_segments(&mi, 5, seg, 8), 0);
+    marker_index_free(&mi);
+}
+END_TEST
+
+START_TEST(test_marker_index_ticks_keep_to_their_ring)
+{
+    marker_index_t mi;
+    ck_assert_int_eq(marker_index_init(&mi, 2, 4), 0);
+    add(&mi, MARKER_RECORD_START, 0, 1);
+    for (uint64_t f = 100; f <= 500; f += 100) add(&mi, MARKER_TICK, f, 1);
+    add(&mi, MARKER_LOOP, 550, 1);
+    for (uint64_t f = 600; f <= 1000; f += 100) add(&mi, MARKER_TICK, f, 1);
+
+    // Ten ticks went in, the ring holds the last four and the index none
+    ck_assert_uint_eq(marker_index_count(&mi), 2);
+    ck_assert_uint_eq(marker_index_tick_count(&mi), 10);
+    marker_t m;
+    ck_assert_int_eq(marker_index_tick(&mi, 5, &m), -1);
+    ck_assert_int_eq(marker_index_tick(&mi, 6, &m), 0);
+    ck_assert_uint_eq(m.frame, 700);
+    ck_assert_uint_eq(m.sequence, 0);
+    ck_assert_int_eq(marker_index_tick(&mi, 10, &m), -1);
+    ck_assert_uint_eq(marker_index_tick_lower_bound(&mi, 0), 6);
+    ck_assert_uint_eq(marker_index_tick_lower_bound(&mi, 801), 8);
+    ck_assert_uint_eq(marker_index_tick_lower_bound(&mi, 1001), 10);
+
+    // Markers and the ticks still held, in frame order
+    const uint64_t all[] = {0, 550, 700, 800, 900, 1000};
+    marker_cursor_t cursor = marker_index_cursor(&mi, 0);
+    for (int i = 0; i < 6; ++i) {
+        ck_assert_int_eq(marker_index_next(&mi, &cursor, &m), 0);
+        ck_assert_uint_eq(m.frame, all[i]);
+        ck_assert_uint_eq(m.type, i == 0 ? MARKER_RECORD_START : i == 1 ? MARKER_LOOP : MARKER_TICK);
+    }
+    ck_assert_int_eq(marker_index_next(&mi, &cursor, &m), -1);
+    cursor = marker_index_cursor(&mi, 750);
+    ck_assert_int_eq(marker_index_next(&mi, &cursor, &m), 0);
+    ck_assert_uint_eq(m.frame, 800);
+
+    // A cursor the ring laps skips to the oldest tick still held
+    cursor = marker_index_cursor(&mi, 600);
+    add(&mi, MARKER_TICK, 1100, 1);
+    add(&mi, MARKER_TICK, 1200, 1);
+    ck_assert_int_eq(marker_index_next(&mi, &cursor, &m), 0);
+    ck_assert_uint_eq(m.frame, 900);
+
+    // Only the two boundary markers filled the index; a record start that
+    // finds it full is counted as such
+    ck_assert_int_eq(marker_index_full(&mi), 1);
+    marker_t start = {2000, 0x3, 2, MARKER_RECORD_START, 48000, 0};
+    ck_assert_int_eq(marker_index_append(&mi, &start), -1);
+    ck_assert_uint_eq(atomic_load(&mi.dropped), 1);
+    ck_assert_uint_eq(atomic_load(&mi.record_starts_dropped), 1);
+    marker_index_free(&mi);
+}
+END_TEST
+
+int main(void)
+{
+    Suite *s = suite_create("MarkerIndex");
+    TCase *tc_core = tcase_create("Core");
+    SRunner *sr = srunner_create(s);
+
+    tcase_add_test(tc_core, test_marker_index_append_and_search);
+    tcase_add_test(tc_core, test_marker_index_segments_punch_and_loop);
+    tcase_add_test(tc_core, test_marker_index_ticks_keep_to_their_ring);
+    suite_add_tcase(s, tc_core);
+
+    srunner_run_all(sr, CK_NORMAL);
+    int number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+    return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
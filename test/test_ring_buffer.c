@@ -1,6 +1,8 @@
 #include <check.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <pthread.h>
+#include <sched.h>
 #include "../src/ring-buffer.h"
 
 START_TEST(test_ringbuffer_init_and_free)
@@ -10,8 +12,9 @@ START_TEST(test_ringbuffer_init_and_free)
     ringbuffer_float_init(&rb, size);
     ck_assert_ptr_nonnull(rb.buffer);
     ck_assert_int_eq(rb.size, size);
-    ck_assert_int_eq(rb.start, 0);
-    ck_assert_int_eq(rb.end, size - 1);
+    // Exactly what was asked for, nothing rounded up
+    ck_assert_int_eq(rb.capacity, size);
+    ck_assert_uint_eq(ringbuffer_float_write_position(&rb), 0);
     ringbuffer_float_free(&rb);
     ck_assert_ptr_null(rb.buffer);
 }
@@ -98,6 +101,180 @@ START_TEST(test_ringbuffer_wrap_around_with_offset)
 }
 END_TEST
 
+START_TEST(test_ringbuffer_write_block_wrap)
+{
+    ringbuffer_float_t rb;
+    ringbuffer_float_init(&rb, 8);
+
+    // 5 + 6 samples: the second block is split at the wrap point
+    float first[5] = {1.0f, 2.0f, 3.0f, 4.0f, 5.0f};
+    float second[6] = {6.0f, 7.0f, 8.0f, 9.0f, 10.0f, 11.0f};
+    ringbuffer_float_write_block(&rb, first, 5);
+    ringbuffer_float_write_block(&rb, second, 6);
+    ck_assert_uint_eq(ringbuffer_float_write_position(&rb), 11);
+
+    for (int32_t i = 0; i < 8; ++i) {
+        float v = 0.0f;
+        ringbuffer_float_get_value(&rb, &v, i);
+        ck_assert_float_eq_tol(v, (float)(11 - i), 1e-6);
+    }
+
+    // Reading forward across the wrap point gives the samples in order
+    float out[6];
+    ringbuffer_float_read_block(&rb, out, 5, 6);
+    for (int i = 0; i < 6; ++i) {
+        ck_assert_float_eq_tol(out[i], (float)(6 + i), 1e-6);
+    }
+
+    ringbuffer_float_free(&rb);
+}
+END_TEST
+
+START_TEST(test_ringbuffer_write_block_larger_than_capacity)
+{
+    ringbuffer_float_t rb;
+    ringbuffer_float_init(&rb, 4);
+
+    float values[10];
+    for (int i = 0; i < 10; ++i) values[i] = (float)i;
+    ringbuffer_float_write_block(&rb, values, 10);
+
+    // Only the newest capacity samples are kept
+    for (int32_t i = 0; i < 4; ++i) {
+        float v = 0.0f;
+        ringbuffer_float_get_value(&rb, &v, i);
+        ck_assert_float_eq_tol(v, (float)(9 - i), 1e-6);
+    }
+
+    // The next block lands right after them
+    float more[3] = {10.0f, 11.0f, 12.0f};
+    ringbuffer_float_write_block(&rb, more, 3);
+    float got[4];
+    ck_assert_int_eq(ringbuffer_float_read(&rb, got, 9, 4), 0);
+    for (int i = 0; i < 4; ++i) ck_assert_float_eq_tol(got[i], (float)(9 + i), 1e-6);
+
+    ringbuffer_float_free(&rb);
+}
+END_TEST
+
+START_TEST(test_ringbuffer_block_matches_single_writes)
+{
+    ringbuffer_float_t single, block;
+    ringbuffer_float_init(&single, 100);
+    ringbuffer_float_init(&block, 100);
+
+    float values[300];
+    for (int i = 0; i < 300; ++i) values[i] = (float)i * 0.5f;
+    for (int i = 0; i < 300; ++i) ringbuffer_float_write(&single, &values[i]);
+    for (int i = 0; i < 300; i += 32) {
+        uint32_t n = (i + 32 <= 300) ? 32 : (uint32_t)(300 - i);
+        ringbuffer_float_write_block(&block, &values[i], n);
+    }
+
+    ck_assert_uint_eq(ringbuffer_float_write_position(&single), ringbuffer_float_write_position(&block));
+    for (int32_t i = 0; i < 100; ++i) {
+        float a = 0.0f, b = 0.0f;
+        ringbuffer_float_get_value(&single, &a, i);
+        ringbuffer_float_get_value(&block, &b, i);
+        ck_assert_float_eq_tol(a, b, 1e-9);
+    }
+
+    ringbuffer_float_free(&single);
+    ringbuffer_float_free(&block);
+}
+END_TEST
+
+START_TEST(test_ringbuffer_read_absolute)
+{
+    ringbuffer_float_t rb;
+    ringbuffer_float_init(&rb, 8);
+
+    float values[20];
+    for (int i = 0; i < 20; ++i) values[i] = (float)i;
+    ringbuffer_float_write_block(&rb, values, 12);
+
+    float out[4];
+    ck_assert_int_eq(ringbuffer_float_read(&rb, out, 6, 4), 0);
+    for (int i = 0; i < 4; ++i) ck_assert_float_eq_tol(out[i], (float)(6 + i), 1e-6);
+
+    // Not written yet
+    ck_assert_int_eq(ringbuffer_float_read(&rb, out, 10, 4), -1);
+    // Already overwritten
+    ck_assert_int_eq(ringbuffer_float_read(&rb, out, 3, 4), -1);
+
+    ringbuffer_float_write_block(&rb, &values[12], 8);
+    ck_assert_int_eq(ringbuffer_float_read(&rb, out, 6, 4), -1);
+    ck_assert_int_eq(ringbuffer_float_read(&rb, out, 16, 4), 0);
+    for (int i = 0; i < 4; ++i) ck_assert_float_eq_tol(out[i], (float)(16 + i), 1e-6);
+
+    ringbuffer_float_free(&rb);
+}
+END_TEST
+
+START_TEST(test_ringbuffer_position_is_lock_free)
+{
+    // The RT writer only ever touches these two atomics; if they needed a
+    // lock the capture path could block
+    ringbuffer_float_t rb;
+    ringbuffer_float_init(&rb, 16);
+    ck_assert(atomic_is_lock_free(&rb.write_pos));
+    ck_assert(atomic_is_lock_free(&rb.write_claim));
+    ringbuffer_float_free(&rb);
+}
+END_TEST
+
+#define CONCURRENT_BLOCK 32
+#define CONCURRENT_READS 20000
+
+static atomic_int concurrent_stop;
+
+static void *ramp_writer(void *arg)
+{
+    ringbuffer_float_t *rb = (ringbuffer_float_t *)arg;
+    float block[CONCURRENT_BLOCK];
+    uint64_t pos = 0;
+    while (!atomic_load(&concurrent_stop)) {
+        for (int i = 0; i < CONCURRENT_BLOCK; ++i) block[i] = (float)((pos + i) & 0xFFFFF);
+        ringbuffer_float_write_block(rb, block, CONCURRENT_BLOCK);
+        pos += CONCURRENT_BLOCK;
+        // Like the RT thread, give up the CPU between quanta
+        sched_yield();
+    }
+    return NULL;
+}
+
+START_TEST(test_ringbuffer_concurrent_reader_never_sees_torn_data)
+{
+    // A small ring and long reads make the writer lap the reader often
+    ringbuffer_float_t rb;
+    ringbuffer_float_init(&rb, 4096);
+    atomic_store(&concurrent_stop, 0);
+    pthread_t writer;
+    pthread_create(&writer, NULL, ramp_writer, &rb);
+
+    while (ringbuffer_float_write_position(&rb) < 4096) sched_yield();
+
+    float out[1024];
+    int good = 0;
+    for (int iteration = 0; iteration < CONCURRENT_READS; ++iteration) {
+        uint64_t pos = ringbuffer_float_write_position(&rb);
+        // Alternate between reads next to the write head and reads close to
+        // the oldest retained sample, which the writer regularly laps
+        uint64_t back = (iteration & 1) ? 4000 : 1024;
+        uint64_t start = pos - back;
+        if (ringbuffer_float_read(&rb, out, start, 1024) < 0) continue;
+        for (int i = 0; i < 1024; ++i) {
+            ck_assert_float_eq(out[i], (float)((start + i) & 0xFFFFF));
+        }
+        good++;
+    }
+    atomic_store(&concurrent_stop, 1);
+    pthread_join(writer, NULL);
+    ck_assert_int_gt(good, 0);
+    ringbuffer_float_free(&rb);
+}
+END_TEST
+
 int main(void)
 {
     Suite *s = suite_create("RingBuffer");
@@ -108,6 +285,12 @@ int main(void)
     tcase_add_test(tc_core, test_ringbuffer_write_read);
     tcase_add_test(tc_core, test_ringbuffer_wrap_around);
     tcase_add_test(tc_core, test_ringbuffer_wrap_around_with_offset);
+    tcase_add_test(tc_core, test_ringbuffer_write_block_wrap);
+    tcase_add_test(tc_core, test_ringbuffer_write_block_larger_than_capacity);
+    tcase_add_test(tc_core, test_ringbuffer_block_matches_single_writes);
+    tcase_add_test(tc_core, test_ringbuffer_read_absolute);
+    tcase_add_test(tc_core, test_ringbuffer_position_is_lock_free);
+    tcase_add_test(tc_core, test_ringbuffer_concurrent_reader_never_sees_torn_data);
     suite_add_tcase(s, tc_core);
 
     srunner_run_all(sr, CK_NORMAL);
@@ -0,0 +1,235 @@
+#include <check.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#include "../src/rt-events.h"
+
+#define RATE 48000
+#define CHANNELS 2
+#define QUANTUM 480
+// Graph clock of quantum q: 10 ms each, starting at 1 s
+#define QUANTUM_NS(q) (1000000000ull + (uint64_t)(q) * 10000000ull)
+
+static float performance(uint64_t frame, int ch)
+{
+    return 0.25f + 0.001f * (float)(frame % 100) + (float)ch * 0.1f;
+}
+
+// Push quanta first..last-1 of a steady performance
+static void run(rt_events_t *ev, audio_buffer_t *ab, int first, int last, int recording)
+{
+    for (int q = first; q < last; ++q) {
+        float planes[CHANNELS][QUANTUM];
+        for (int ch = 0; ch < CHANNELS; ++ch) {
+            for (int i = 0; i < QUANTUM; ++i) planes[ch][i] = performance((uint64_t)q * QUANTUM + i, ch);
+        }
+        float *in[CHANNELS] = {planes[0], planes[1]};
+        rt_events_process(ev, ab, in, QUANTUM, QUANTUM_NS(q), recording);
+    }
+}
+
+static void check_pattern(audio_buffer_t *ab, int ch, uint64_t frame, const float *pattern, int length)
+{
+    float got[SYNC_MARKER_TICK_LENGTH];
+    ck_assert_int_eq(audio_buffer_read_range(ab, (unsigned int)ch, got, frame, frame + length), 0);
+    for (int i = 0; i < length; ++i) ck_assert_msg(got[i] == pattern[i], "frame %llu + %d", (unsigned long long)frame, i);
+}
+
+static void check_performance(audio_buffer_t *ab, int ch, uint64_t frame)
+{
+    float got;
+    ck_assert_int_eq(audio_buffer_read_range(ab, (unsigned int)ch, &got, frame, frame + 1), 0);
+    ck_assert(got == performance(frame, ch));
+}
+
+START_TEST(test_rt_events_exact_frames)
+{
+    audio_buffer_t ab;
+    audio_buffer_init(&ab, CHANNELS, RATE, 10);
+    rt_events_t ev;
+    rt_events_init(&ev, 0.0);
+    // Two markers inside one quantum, one too close behind the first, one
+    // across a quantum boundary and one on the second channel only
+    rt_event_t events[] = {
+        {MARKER_RECORD_START, RT_EVENT_AT_FRAME, 1000, AUDIO_BUFFER_ALL_CHANNELS},
+        {MARKER_PUNCH_IN, RT_EVENT_AT_FRAME, 1005, AUDIO_BUFFER_ALL_CHANNELS},
+        {MARKER_LOOP, RT_EVENT_AT_FRAME, 1200, AUDIO_BUFFER_ALL_CHANNELS},
+        {MARKER_PUNCH_OUT, RT_EVENT_AT_FRAME, 1910, 0x2},
+    };
+    for (int i = 0; i < 4; ++i) ck_assert_int_eq(rt_events_push(&ev, &events[i]), 0);
+    run(&ev, &ab, 0, 10, 1);
+
+    const marker_index_t *mi = &ab.markers;
+    ck_assert_uint_eq(marker_index_count(mi), 4);
+    uint64_t frames[] = {1000, 1000 + SYNC_MARKER_LENGTH, 1200, 1910};
+    for (int i = 0; i < 4; ++i) {
+        ck_assert_uint_eq(mi->markers[i].frame, frames[i]);
+        ck_assert_uint_eq(mi->markers[i].type, events[i].type);
+    }
+    ck_assert_uint_eq(audio_buffer_sync_frame(&ab), 1000);
+    for (int i = 0; i < 3; ++i) {
+        for (int ch = 0; ch < CHANNELS; ++ch) {
+            check_pattern(&ab, ch, frames[i], sync_marker_pattern_for(events[i].type), SYNC_MARKER_LENGTH);
+        }
+    }
+    check_pattern(&ab, 1, 1910, sync_marker_pattern_for(MARKER_PUNCH_OUT), SYNC_MARKER_LENGTH);
+    // Nothing else is touched
+    check_performance(&ab, 0, 999);
+    check_performance(&ab, 0, 1016 + SYNC_MARKER_LENGTH);
+    check_performance(&ab, 0, 1199);
+    check_performance(&ab, 0, 1200 + SYNC_MARKER_LENGTH);
+    check_performance(&ab, 1, 1909);
+    check_performance(&ab, 1, 1910 + SYNC_MARKER_LENGTH);
+    check_performance(&ab, 0, 1915);
+    ck_assert_uint_eq(atomic_load(&ev.late), 0);
+    audio_buffer_free(&ab);
+}
+END_TEST
+
+START_TEST(test_rt_events_monotonic_time)
+{
+    audio_buffer_t ab;
+    audio_buffer_init(&ab, CHANNELS, RATE, 10);
+    rt_events_t ev;
+    rt_events_init(&ev, 0.0);
+    run(&ev, &ab, 0, 2, 1);
+    // 25 ms and a frame after the first quantum is frame 1201; queued while
+    // quantum 2 runs, it is placed in quantum 3
+    rt_event_t e = {MARKER_RECORD_START, RT_EVENT_AT_NSEC, (int64_t)(QUANTUM_NS(0) + 25000000ull + 20834ull), AUDIO_BUFFER_ALL_CHANNELS};
+    ck_assert_int_eq(rt_events_push(&ev, &e), 0);
+    // Long gone: placed at once and counted as late
+    rt_event_t old = {MARKER_LOOP, RT_EVENT_AT_NSEC, (int64_t)QUANTUM_NS(0), AUDIO_BUFFER_ALL_CHANNELS};
+    ck_assert_int_eq(rt_events_push(&ev, &old), 0);
+    // Right away: the first frame of the next quantum
+    rt_event_t now = {MARKER_PUNCH_IN, RT_EVENT_NOW, 0, AUDIO_BUFFER_ALL_CHANNELS};
+    ck_assert_int_eq(rt_events_push(&ev, &now), 0);
+    run(&ev, &ab, 2, 5, 1);
+
+    const marker_index_t *mi = &ab.markers;
+    ck_assert_uint_eq(marker_index_count(mi), 3);
+    ck_assert_uint_eq(mi->markers[0].type, MARKER_LOOP);
+    ck_assert_uint_eq(mi->markers[0].frame, 2 * QUANTUM);
+    ck_assert_uint_eq(mi->markers[1].type, MARKER_PUNCH_IN);
+    ck_assert_uint_eq(mi->markers[1].frame, 2 * QUANTUM + SYNC_MARKER_LENGTH);
+    ck_assert_uint_eq(mi->markers[2].type, MARKER_RECORD_START);
+    ck_assert_uint_eq(mi->markers[2].frame, 1201);
+    ck_assert_uint_eq(atomic_load(&ev.late), 1);
+    audio_buffer_free(&ab);
+}
+END_TEST
+
+START_TEST(test_rt_events_ticks)
+{
+    audio_buffer_t ab;
+    audio_buffer_init(&ab, CHANNELS, RATE, 10);
+    rt_events_t ev;
+    // Every 500 frames, which is not a multiple of the quantum
+    rt_events_init(&ev, 500.0 / RATE);
+    rt_event_t e = {MARKER_RECORD_START, RT_EVENT_AT_FRAME, 470, AUDIO_BUFFER_ALL_CHANNELS};
+    rt_events_push(&ev, &e);
+    run(&ev, &ab, 0, 10, 1);
+    run(&ev, &ab, 10, 12, 0);
+
+    const marker_index_t *mi = &ab.markers;
+    // 4800 frames while recording: the record start and ticks 1 to 8
+    ck_assert_uint_eq(marker_index_count(mi), 1);
+    ck_assert_uint_eq(marker_index_tick_count(mi), 8);
+    check_pattern(&ab, 0, 470, sync_marker_pattern, SYNC_MARKER_LENGTH);
+    for (uint32_t k = 1; k <= 8; ++k) {
+        marker_t tick_marker;
+        ck_assert_int_eq(marker_index_tick(mi, k - 1, &tick_marker), 0);
+        const marker_t *m = &tick_marker;
+        ck_assert_uint_eq(m->type, MARKER_TICK);
+        ck_assert_uint_eq(m->frame, 470 + 500 * k);
+        ck_assert_uint_eq(m->sequence, k);
+        float tick[SYNC_MARKER_TICK_LENGTH];
+        sync_marker_tick(k, tick);
+        check_pattern(&ab, 1, m->frame, tick, SYNC_MARKER_TICK_LENGTH);
+        check_performance(&ab, 1, m->frame - 1);
+        check_performance(&ab, 1, m->frame + SYNC_MARKER_TICK_LENGTH);
+        audio_buffer_read_range(&ab, 0, tick, m->frame, m->frame + SYNC_MARKER_TICK_LENGTH);
+        ck_assert_int_eq(sync_marker_tick_sequence(tick, 1, 1.0f), (int32_t)k);
+    }
+    audio_buffer_free(&ab);
+}
+END_TEST
+
+START_TEST(test_rt_events_full_ring)
+{
+    audio_buffer_t ab;
+    audio_buffer_init(&ab, CHANNELS, RATE, 10);
+    rt_events_t ev;
+    rt_events_init(&ev, 0.0);
+    rt_event_t e = {MARKER_LOOP, RT_EVENT_AT_FRAME, 100000, AUDIO_BUFFER_ALL_CHANNELS};
+    for (int i = 0; i < RT_EVENTS_CAPACITY; ++i) ck_assert_int_eq(rt_events_push(&ev, &e), 0);
+    ck_assert_int_eq(rt_events_push(&ev, &e), -1);
+    // Waiting in the pending list frees the ring
+    run(&ev, &ab, 0, 1, 1);
+    ck_assert_uint_eq(ev.num_pending, RT_EVENTS_CAPACITY);
+    ck_assert_int_eq(rt_events_push(&ev, &e), 0);
+    run(&ev, &ab, 1, 2, 1);
+    ck_assert_uint_eq(ev.num_pending, RT_EVENTS_CAPACITY);
+    ck_assert_uint_eq(marker_index_count(&ab.markers), 0);
+    audio_buffer_free(&ab);
+}
+END_TEST
+
+#define PRODUCED 2000
+
+static void *producer(void *arg)
+{
+    rt_events_t *ev = arg;
+    for (int i = 0; i < PRODUCED; ) {
+        rt_event_t e = {MARKER_LOOP, RT_EVENT_AT_FRAME, 1000 + 100 * (int64_t)i, AUDIO_BUFFER_ALL_CHANNELS};
+        if (rt_events_push(ev, &e) == 0) ++i;
+    }
+    return NULL;
+}
+
+START_TEST(test_rt_events_across_threads)
+{
+    audio_buffer_t ab;
+    audio_buffer_init(&ab, CHANNELS, RATE, 10);
+    rt_events_t ev;
+    rt_events_init(&ev, 0.0);
+    pthread_t thread;
+    pthread_create(&thread, NULL, producer, &ev);
+    // The ring fills up and drains again; the producer only finishes once
+    // the RT side has taken most of its events
+    for (int q = 0; q < 100000 && marker_index_count(&ab.markers) < PRODUCED; ++q) {
+        run(&ev, &ab, q, q + 1, 1);
+        sched_yield();
+    }
+    pthread_join(thread, NULL);
+
+    // Late ones land on the first frame of a quantum, and never out of order
+    const marker_index_t *mi = &ab.markers;
+    ck_assert_uint_eq(marker_index_count(mi), PRODUCED);
+    uint64_t late = atomic_load(&ev.late);
+    for (uint32_t i = 0; i < PRODUCED; ++i) {
+        if (i > 0) ck_assert_uint_gt(mi->markers[i].frame, mi->markers[i - 1].frame);
+        if (late == 0) ck_assert_uint_eq(mi->markers[i].frame, 1000 + 100 * i);
+    }
+    audio_buffer_free(&ab);
+}
+END_TEST
+
+int main(void)
+{
+    Suite *s = suite_create("RtEvents");
+    TCase *tc_core = tcase_create("Core");
+    SRunner *sr = srunner_create(s);
+
+    tcase_add_test(tc_core, test_rt_events_exact_frames);
+    tcase_add_test(tc_core, test_rt_events_monotonic_time);
+    tcase_add_test(tc_core, test_rt_events_ticks);
+    tcase_add_test(tc_core, test_rt_events_full_ring);
+    tcase_add_test(tc_core, test_rt_events_across_threads);
+    suite_add_tcase(s, tc_core);
+
+    srunner_run_all(sr, CK_NORMAL);
+    int number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+    return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
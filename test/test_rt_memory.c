@@ -0,0 +1,96 @@
+#include <check.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "../src/rt-memory.h"
+#include "../src/audio-buffer.h"
+
+START_TEST(test_rt_memory_prefault)
+{
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t bytes = 64 * page + 100;
+    rt_memory_t info;
+
+    // A plain mapping is faulted in lazily
+    uint8_t *lazy = rt_memory_alloc(bytes, 0, &info);
+    ck_assert_ptr_nonnull(lazy);
+    ck_assert_uint_eq(info.bytes, 65 * page);
+    ck_assert_uint_eq(rt_memory_resident_pages(lazy, info.bytes), 0);
+    rt_memory_free(lazy, &info);
+
+    uint8_t *p = rt_memory_alloc(bytes, RT_MEMORY_PREFAULT | RT_MEMORY_LOCK, &info);
+    ck_assert_ptr_nonnull(p);
+    ck_assert(info.got & RT_MEMORY_PREFAULT);
+    ck_assert_uint_eq(rt_memory_resident_pages(p, info.bytes), 65);
+    // mlock is up to RLIMIT_MEMLOCK, but is reported either way
+    if (info.got & RT_MEMORY_LOCK) ck_assert_uint_eq(info.locked, info.bytes);
+    else ck_assert_uint_eq(info.locked, 0);
+    for (size_t i = 0; i < bytes; ++i) ck_assert_uint_eq(p[i], 0);
+    rt_memory_free(p, &info);
+
+    // Preparing existing memory keeps its contents
+    uint8_t *heap = malloc(bytes);
+    for (size_t i = 0; i < bytes; ++i) heap[i] = (uint8_t)i;
+    rt_memory_prepare(heap, bytes, RT_MEMORY_PREFAULT, &info);
+    ck_assert_uint_eq(rt_memory_resident_pages(heap, bytes), (((uintptr_t)heap + bytes + page - 1) / page) - (uintptr_t)heap / page);
+    for (size_t i = 0; i < bytes; ++i) ck_assert_uint_eq(heap[i], (uint8_t)i);
+    free(heap);
+}
+END_TEST
+
+START_TEST(test_rt_memory_huge_pages_fall_back)
+{
+    // Explicit huge pages need a reserved pool; without one THP is used instead
+    rt_memory_t info;
+    float *p = rt_memory_alloc(3 * 1024 * 1024, RT_MEMORY_HUGETLB | RT_MEMORY_PREFAULT, &info);
+    ck_assert_ptr_nonnull(p);
+    ck_assert_uint_eq(info.bytes, 2 * RT_MEMORY_HUGE_PAGE_BYTES);
+    ck_assert(info.got & RT_MEMORY_PREFAULT);
+    p[info.bytes / sizeof(float) - 1] = 1.0f;
+    rt_memory_free(p, &info);
+}
+END_TEST
+
+START_TEST(test_audio_buffer_init_rt)
+{
+    audio_buffer_t ab;
+    rt_memory_t info;
+    ck_assert_int_eq(audio_buffer_init_rt(&ab, 2, 48000, 2, RT_MEMORY_PREFAULT | RT_MEMORY_THP, &info), 0);
+    ck_assert(info.got & RT_MEMORY_PREFAULT);
+    for (unsigned int ch = 0; ch < 2; ++ch) {
+        ringbuffer_float_t *rb = &ab.channels[ch].buffer;
+        size_t bytes = sizeof(float) * rb->capacity;
+        size_t page = (size_t)sysconf(_SC_PAGESIZE);
+        ck_assert_uint_ge(rb->memory.bytes, bytes);
+        ck_assert_uint_eq(rt_memory_resident_pages(rb->buffer, bytes), (bytes + page - 1) / page);
+    }
+
+    // Behaves like a malloced buffer
+    float a[256], b[256], out[256];
+    for (int i = 0; i < 256; ++i) {
+        a[i] = (float)i;
+        b[i] = (float)-i;
+    }
+    float *planes[2] = {a, b};
+    audio_buffer_push_frames(&ab, planes, 256, 0);
+    ck_assert_int_eq(audio_buffer_read_range(&ab, 1, out, 0, 256), 0);
+    for (int i = 0; i < 256; ++i) ck_assert_float_eq(out[i], b[i]);
+    audio_buffer_free(&ab);
+}
+END_TEST
+
+int main(void)
+{
+    Suite *s = suite_create("RtMemory");
+    TCase *tc_core = tcase_create("Core");
+    SRunner *sr = srunner_create(s);
+
+    tcase_add_test(tc_core, test_rt_memory_prefault);
+    tcase_add_test(tc_core, test_rt_memory_huge_pages_fall_back);
+    tcase_add_test(tc_core, test_audio_buffer_init_rt);
+    suite_add_tcase(s, tc_core);
+
+    srunner_run_all(sr, CK_NORMAL);
+    int number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+    return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
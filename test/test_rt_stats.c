@@ -0,0 +1,90 @@
+#include <check.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../src/rt-stats.h"
+
+START_TEST(test_rt_histogram_buckets)
+{
+    // Small values are exact, every bucket's max is one below the next bucket
+    for (uint64_t v = 0; v < 16; ++v) ck_assert_uint_eq(rt_histogram_bucket(v), v);
+    for (uint32_t i = 0; i + 1 < RT_HISTOGRAM_BUCKETS; ++i) {
+        uint64_t max = rt_histogram_bucket_max(i);
+        ck_assert_uint_eq(rt_histogram_bucket(max), i);
+        ck_assert_uint_eq(rt_histogram_bucket(max + 1), i + 1);
+    }
+    // Relative width stays within 1/16
+    for (uint64_t v = 16; v < (1ull << 40); v = v * 3 + 7) {
+        uint32_t i = rt_histogram_bucket(v);
+        uint64_t lo = rt_histogram_bucket_max(i - 1) + 1, hi = rt_histogram_bucket_max(i);
+        ck_assert(lo <= v && v <= hi);
+        ck_assert_uint_le((hi - lo + 1) * 16, lo);
+    }
+    ck_assert_uint_eq(rt_histogram_bucket(UINT64_MAX), RT_HISTOGRAM_BUCKETS - 1);
+}
+END_TEST
+
+START_TEST(test_rt_histogram_quantiles)
+{
+    rt_histogram_t *h = calloc(1, sizeof(*h));
+    for (uint64_t v = 1; v <= 1000; ++v) rt_histogram_record(h, v * 1000);
+    ck_assert_uint_eq(atomic_load(&h->total), 1000);
+    ck_assert_uint_eq(atomic_load(&h->max), 1000000);
+    ck_assert_uint_eq(atomic_load(&h->sum), 500500000);
+    uint64_t p50 = rt_histogram_quantile(h, 0.5), p99 = rt_histogram_quantile(h, 0.99);
+    ck_assert(p50 >= 500000 && p50 <= 500000 * 17 / 16);
+    ck_assert(p99 >= 990000 && p99 <= 1000000);
+    ck_assert_uint_eq(rt_histogram_quantile(h, 1.0), 1000000);
+    ck_assert_uint_eq(rt_histogram_count_below(h, 1 << 16), 65);
+    free(h);
+}
+END_TEST
+
+START_TEST(test_rt_stats_prometheus)
+{
+    rt_stats_t *s = calloc(1, sizeof(*s));
+    rt_stats_record_callback(s, 1000000, 5333333, 256, 1);
+    rt_stats_record_callback(s, 6000000, 5333333, 256, 1);
+    rt_stats_record_callback(s, 2000000, 5333333, 256, 0);
+    rt_counter_add(&s->skipped_pushes, 1);
+    ck_assert_uint_eq(rt_counter_get(&s->overruns), 1);
+    ck_assert_uint_eq(rt_counter_get(&s->frames_captured), 512);
+
+    size_t need = rt_stats_format_prometheus(s, 2, NULL, 0);
+    char *text = malloc(need + 1);
+    ck_assert_uint_eq(rt_stats_format_prometheus(s, 2, text, need + 1), need);
+    ck_assert_uint_eq(strlen(text), need);
+    ck_assert_ptr_nonnull(strstr(text, "# TYPE pwghost_callback_seconds histogram\n"));
+    ck_assert_ptr_nonnull(strstr(text, "pwghost_callback_seconds_bucket{le=\"+Inf\"} 3\n"));
+    ck_assert_ptr_nonnull(strstr(text, "pwghost_callback_seconds_bucket{le=\"0.001048576\"} 1\n"));
+    ck_assert_ptr_nonnull(strstr(text, "pwghost_callback_seconds_sum 0.009\n"));
+    ck_assert_ptr_nonnull(strstr(text, "pwghost_callback_load_bucket{le=\"1\"} 2\n"));
+    ck_assert_ptr_nonnull(strstr(text, "pwghost_overruns_total 1\n"));
+    ck_assert_ptr_nonnull(strstr(text, "pwghost_frames_captured_total 512\n"));
+    ck_assert_ptr_nonnull(strstr(text, "pwghost_skipped_pushes_total 1\n"));
+    ck_assert_ptr_nonnull(strstr(text, "pwghost_export_queue_depth 2\n"));
+
+    // Truncated like snprintf
+    char small[32];
+    ck_assert_uint_eq(rt_stats_format_prometheus(s, 2, small, sizeof(small)), need);
+    ck_assert_uint_eq(strlen(small), sizeof(small) - 1);
+    free(text);
+    free(s);
+}
+END_TEST
+
+int main(void)
+{
+    Suite *s = suite_create("RtStats");
+    TCase *tc_core = tcase_create("Core");
+    SRunner *sr = srunner_create(s);
+
+    tcase_add_test(tc_core, test_rt_histogram_buckets);
+    tcase_add_test(tc_core, test_rt_histogram_quantiles);
+    tcase_add_test(tc_core, test_rt_stats_prometheus);
+    suite_add_tcase(s, tc_core);
+
+    srunner_run_all(sr, CK_NORMAL);
+    int number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+    return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,181 @@
+#include <check.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sndfile.h>
+#include "../src/audio-buffer.h"
+#include "../src/spool.h"
+
+#define SPOOL_TEST_DIR "_out/test_spool"
+
+// Exact 24 bit values, so exported files can be compared sample by sample
+static float ramp_value(uint64_t pos, int channel)
+{
+    float v = (float)(pos % 100000) / 8388608.0f;
+    return channel ? -v : v;
+}
+
+static void push_ramp(audio_buffer_t *ab, uint64_t *pos, int frames)
+{
+    float block[2][128];
+    float *planes[2] = {block[0], block[1]};
+    for (int f = 0; f < frames; f += 128) {
+        for (int i = 0; i < 128; ++i) {
+            block[0][i] = ramp_value(*pos + i, 0);
+            block[1][i] = ramp_value(*pos + i, 1);
+        }
+        audio_buffer_push_frames(ab, planes, 128, 0);
+        *pos += 128;
+    }
+}
+
+START_TEST(test_spool_keeps_history_beyond_ram)
+{
+    mkdir("_out", 0700);
+    audio_buffer_t ab;
+    audio_buffer_init(&ab, 2, 8000, 1); // 1 s of RAM, 8192 frames of ring
+    spool_t spool;
+    ck_assert_int_eq(spool_init(&spool, ab.channels, 2, 8000, SPOOL_TEST_DIR, 10), 0);
+    ck_assert_uint_eq(spool.capacity, 131072);
+
+    // 5 s of audio, flushed more often than the RAM ring wraps
+    uint64_t pos = 0;
+    for (int i = 0; i < 10; ++i) {
+        push_ramp(&ab, &pos, 4096);
+        spool_flush(&spool);
+    }
+    ck_assert_uint_eq(atomic_load(&spool.flushed_pos), 40960);
+    ck_assert_uint_eq(atomic_load(&spool.overruns), 0);
+
+    // The start is long gone from RAM but still on disk
+    float out[256];
+    ck_assert_int_lt(channel_buffer_read_frames(&ab.channels[1], out, 100, 256), 0);
+    ck_assert_int_eq(spool_read(&spool, 1, out, 100, 256), 0);
+    for (int i = 0; i < 256; ++i) ck_assert_float_eq(out[i], ramp_value(100 + i, 1));
+
+    // Not flushed yet
+    push_ramp(&ab, &pos, 128);
+    ck_assert_int_lt(spool_read(&spool, 0, out, 40960, 128), 0);
+
+    spool_free(&spool);
+    audio_buffer_free(&ab);
+}
+END_TEST
+
+START_TEST(test_spool_header_describes_file)
+{
+    mkdir("_out", 0700);
+    audio_buffer_t ab;
+    audio_buffer_init(&ab, 2, 8000, 1);
+    spool_t spool;
+    ck_assert_int_eq(spool_init(&spool, ab.channels, 2, 8000, SPOOL_TEST_DIR, 2), 0);
+    uint64_t pos = 0;
+    push_ramp(&ab, &pos, 1024);
+    spool_flush(&spool);
+    spool_free(&spool);
+
+    // Everything needed to recover the audio is in the file itself
+    FILE *f = fopen(SPOOL_TEST_DIR "/ch02.f32", "rb");
+    ck_assert_ptr_nonnull(f);
+    spool_header_t header;
+    ck_assert_int_eq(fread(&header, sizeof(header), 1, f), 1);
+    ck_assert(memcmp(header.magic, SPOOL_MAGIC, 8) == 0);
+    ck_assert_int_eq(header.sample_rate, 8000);
+    ck_assert_int_eq(header.channel, 1);
+    ck_assert_int_eq(header.num_channels, 2);
+    ck_assert_uint_eq(header.capacity, 16384);
+    ck_assert_uint_eq(header.flushed_pos, 1024);
+    float v;
+    fseek(f, SPOOL_HEADER_BYTES + 10 * sizeof(float), SEEK_SET);
+    ck_assert_int_eq(fread(&v, sizeof(v), 1, f), 1);
+    ck_assert_float_eq(v, ramp_value(10, 1));
+    fclose(f);
+    audio_buffer_free(&ab);
+}
+END_TEST
+
+START_TEST(test_spool_overrun_writes_silence)
+{
+    mkdir("_out", 0700);
+    audio_buffer_t ab;
+    audio_buffer_init(&ab, 2, 8000, 1);
+    spool_t spool;
+    ck_assert_int_eq(spool_init(&spool, ab.channels, 2, 8000, SPOOL_TEST_DIR, 10), 0);
+
+    // Three RAM rings worth of audio without a flush
+    uint64_t pos = 0;
+    push_ramp(&ab, &pos, 3 * 8192);
+    spool_flush(&spool);
+    ck_assert_uint_gt(atomic_load(&spool.overruns), 0);
+
+    float out[128];
+    ck_assert_int_eq(spool_read(&spool, 0, out, 0, 128), 0);
+    for (int i = 0; i < 128; ++i) ck_assert_float_eq(out[i], 0.0f);
+    ck_assert_int_eq(spool_read(&spool, 0, out, 3 * 8192 - 128, 128), 0);
+    for (int i = 0; i < 128; ++i) ck_assert_float_eq(out[i], ramp_value(3 * 8192 - 128 + i, 0));
+
+    spool_free(&spool);
+    audio_buffer_free(&ab);
+}
+END_TEST
+
+START_TEST(test_spool_export_reads_across_tiers)
+{
+    mkdir("_out", 0700);
+    audio_buffer_t ab;
+    audio_buffer_init(&ab, 2, 8000, 1);
+    spool_t spool;
+    ck_assert_int_eq(spool_init(&spool, ab.channels, 2, 8000, SPOOL_TEST_DIR, 10), 0);
+    audio_buffer_attach_spool(&ab, &spool);
+
+    // 4 s flushed, then 0.5 s only in RAM
+    uint64_t pos = 0;
+    for (int i = 0; i < 8; ++i) {
+        push_ramp(&ab, &pos, 4096);
+        spool_flush(&spool);
+    }
+    push_ramp(&ab, &pos, 4096);
+
+    // 3 s of audio that starts on disk and ends in RAM
+    audio_export_stats_t stats;
+    int ret = audio_buffer_write_channels_to_wav(&ab, 0, 2, 3.5f, 3.0f, "_out/test_spool_export.wav", &stats);
+    ck_assert_int_eq(ret, 0);
+    ck_assert_uint_eq(stats.frames, 24000);
+
+    SF_INFO sfinfo = {0};
+    SNDFILE *infile = sf_open("_out/test_spool_export.wav", SFM_READ, &sfinfo);
+    ck_assert_ptr_nonnull(infile);
+    float *data = (float *)malloc(sizeof(float) * sfinfo.frames * 2);
+    sf_read_float(infile, data, sfinfo.frames * 2);
+    sf_close(infile);
+    uint64_t first = pos - 1 - (uint64_t)(3.5f * 8000);
+    for (int i = 0; i < sfinfo.frames; ++i) {
+        ck_assert_float_eq_tol(data[i * 2], ramp_value(first + i, 0), 1e-9);
+        ck_assert_float_eq_tol(data[i * 2 + 1], ramp_value(first + i, 1), 1e-9);
+    }
+    free(data);
+
+    spool_free(&spool);
+    audio_buffer_free(&ab);
+}
+END_TEST
+
+int main(void)
+{
+    Suite *s = suite_create("Spool");
+    TCase *tc_core = tcase_create("Core");
+    SRunner *sr = srunner_create(s);
+
+    tcase_add_test(tc_core, test_spool_keeps_history_beyond_ram);
+    tcase_add_test(tc_core, test_spool_header_describes_file);
+    tcase_add_test(tc_core, test_spool_overrun_writes_silence);
+    tcase_add_test(tc_core, test_spool_export_reads_across_tiers);
+    suite_add_tcase(s, tc_core);
+
+    srunner_run_all(sr, CK_NORMAL);
+    int number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+    return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
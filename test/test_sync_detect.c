@@ -0,0 +1,192 @@
+#include <check.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include "../src/sync-detect.h"
+#include "../src/sync-marker.h"
+
+#define RATE 48000
+
+static uint32_t lcg_state = 99;
+static float noise(void)
+{
+    lcg_state = lcg_state * 1664525u + 1013904223u;
+    return (float)(lcg_state >> 8) / 16777216.0f - 0.5f;
+}
+
+// Something like music: a few partials plus a little noise
+static float *make_audio(size_t frames)
+{
+    float *x = malloc(sizeof(float) * frames);
+    for (size_t i = 0; i < frames; ++i) {
+        x[i] = 0.3f * sinf((float)i * 0.0123f) + 0.1f * sinf((float)i * 0.31f) + 0.01f * noise();
+    }
+    return x;
+}
+
+static void put_marker(float *x, size_t at, size_t stride, float gain)
+{
+    for (int i = 0; i < SYNC_MARKER_LENGTH; ++i) x[(at + i) * stride] = sync_marker_pattern[i] * gain;
+}
+
+START_TEST(test_sync_detect_exact_marker)
+{
+    size_t n = 10 * RATE;
+    float *x = make_audio(n);
+    put_marker(x, 123457, 1, 1.0f);
+    sync_detect_match_t m[4];
+    ck_assert_int_eq(sync_detect(x, n, 1, m, 4), 1);
+    ck_assert_int_eq(m[0].frame, 123457);
+    ck_assert(m[0].confidence > 0.999f);
+    ck_assert(fabsf(m[0].gain - 1.0f) < 1e-3f);
+    free(x);
+}
+END_TEST
+
+START_TEST(test_sync_detect_survives_gain_and_dither)
+{
+    size_t n = 10 * RATE;
+    float *x = make_audio(n);
+    put_marker(x, 5000, 1, 0.05f);
+    put_marker(x, 300000, 1, 20.0f);
+    // 24 bit requantization with TPDF dither of everything
+    for (size_t i = 0; i < n; ++i) x[i] = rintf(x[i] * 8388608.0f + noise() + noise()) / 8388608.0f;
+    sync_detect_match_t m[4];
+    ck_assert_int_eq(sync_detect(x, n, 1, m, 4), 2);
+    ck_assert_int_eq(m[0].frame, 5000);
+    ck_assert_int_eq(m[1].frame, 300000);
+    ck_assert(fabsf(m[1].gain - 20.0f) < 0.1f);
+    free(x);
+}
+END_TEST
+
+START_TEST(test_sync_detect_finds_every_occurrence_across_blocks)
+{
+    size_t n = 5 * RATE;
+    float *x = make_audio(n);
+    // At the very start, around FFT block edges, and at the very end
+    size_t at[] = {0, SYNC_DETECT_FFT_SIZE - 20, 2 * SYNC_DETECT_FFT_SIZE - 31, 77777, n - SYNC_MARKER_LENGTH};
+    size_t count = sizeof(at) / sizeof(at[0]);
+    for (size_t i = 0; i < count; ++i) put_marker(x, at[i], 1, 1.0f);
+
+    sync_detect_match_t m[8];
+    ck_assert_int_eq(sync_detect(x, n, 1, m, 8), (int64_t)count);
+    for (size_t i = 0; i < count; ++i) ck_assert_int_eq(m[i].frame, (int64_t)at[i]);
+
+    // Streaming in awkward pieces finds the same
+    sync_detector_t d;
+    ck_assert_int_eq(sync_detector_init(&d, sync_marker_pattern, SYNC_MARKER_LENGTH, 0.0f), 0);
+    for (size_t pos = 0; pos < n; ) {
+        size_t piece = 1 + (pos * 7919) % 3001;
+        if (piece > n - pos) piece = n - pos;
+        sync_detector_feed(&d, x + pos, piece, 1);
+        pos += piece;
+    }
+    sync_detector_finish(&d);
+    ck_assert_uint_eq(d.num_matches, count);
+    for (size_t i = 0; i < count; ++i) ck_assert_int_eq(d.matches[i].frame, (int64_t)at[i]);
+    sync_detector_free(&d);
+    free(x);
+}
+END_TEST
+
+START_TEST(test_sync_detect_no_false_positives)
+{
+    size_t n = 30 * RATE;
+    float *x = make_audio(n);
+    // Loud noise bursts and digital silence as well
+    for (size_t i = RATE; i < 2 * RATE; ++i) x[i] = noise();
+    for (size_t i = 3 * RATE; i < 4 * RATE; ++i) x[i] = 0.0f;
+    sync_detect_match_t m[1];
+    ck_assert_int_eq(sync_detect(x, n, 1, m, 1), 0);
+    free(x);
+}
+END_TEST
+
+START_TEST(test_sync_detect_interleaved_channel)
+{
+    size_t n = RATE;
+    float *x = calloc(n * 2, sizeof(float));
+    for (size_t i = 0; i < n * 2; ++i) x[i] = 0.2f * noise();
+    put_marker(x + 1, 4321, 2, 1.0f);
+    sync_detect_match_t m[2];
+    ck_assert_int_eq(sync_detect(x + 1, n, 2, m, 2), 1);
+    ck_assert_int_eq(m[0].frame, 4321);
+    ck_assert_int_eq(sync_detect(x, n, 2, m, 2), 0);
+    free(x);
+}
+END_TEST
+
+START_TEST(test_sync_detect_long_pattern)
+{
+    // The engine is not tied to the 16 sample marker
+    float pattern[300];
+    for (int i = 0; i < 300; ++i) pattern[i] = noise();
+    size_t n = 2 * RATE;
+    float *x = make_audio(n);
+    for (int i = 0; i < 300; ++i) x[50000 + i] = 0.5f * pattern[i] + 0.001f * noise();
+    sync_detector_t d;
+    ck_assert_int_eq(sync_detector_init(&d, pattern, 300, 0.95f), 0);
+    sync_detector_feed(&d, x, n, 1);
+    sync_detector_finish(&d);
+    ck_assert_uint_eq(d.num_matches, 1);
+    ck_assert_int_eq(d.matches[0].frame, 50000);
+    ck_assert(fabsf(d.matches[0].gain - 0.5f) < 0.01f);
+    sync_detector_free(&d);
+    free(x);
+    ck_assert_int_eq(sync_detector_init(&d, pattern, SYNC_DETECT_FFT_SIZE, 0.0f), -1);
+}
+END_TEST
+
+START_TEST(test_sync_detect_ticks)
+{
+    size_t n = 2 * RATE;
+    float *x = make_audio(n);
+    float tick[SYNC_MARKER_TICK_LENGTH];
+    uint32_t sequences[] = {1, 2, 0xbeef, 0x1ffff};
+    for (size_t i = 0; i < 4; ++i) {
+        sync_marker_tick(sequences[i], tick);
+        for (int j = 0; j < SYNC_MARKER_TICK_LENGTH; ++j) x[10000 + i * 20000 + j] = tick[j] * 3.0f;
+    }
+    // Only the tick pattern finds them, and the bits never pass for a marker
+    sync_detect_match_t m[8];
+    ck_assert_int_eq(sync_detect(x, n, 1, m, 8), 0);
+    sync_detector_t d;
+    ck_assert_int_eq(sync_detector_init(&d, sync_marker_pattern_for(SYNC_MARKER_TICK), SYNC_MARKER_LENGTH, 0.0f), 0);
+    sync_detector_feed(&d, x, n, 1);
+    sync_detector_finish(&d);
+    ck_assert_uint_eq(d.num_matches, 4);
+    for (size_t i = 0; i < 4; ++i) {
+        ck_assert_int_eq(d.matches[i].frame, (int64_t)(10000 + i * 20000));
+        int32_t sequence = sync_marker_tick_sequence(x + d.matches[i].frame, 1, d.matches[i].gain);
+        ck_assert_int_eq(sequence, (int32_t)(sequences[i] & 0xffff));
+    }
+    // A bit cut short by the quantum end is not guessed
+    x[10000 + SYNC_MARKER_TICK_LENGTH - 1] = 0.0f;
+    ck_assert_int_eq(sync_marker_tick_sequence(x + 10000, 1, d.matches[0].gain), -1);
+    sync_detector_free(&d);
+    free(x);
+}
+END_TEST
+
+int main(void)
+{
+    Suite *s = suite_create("SyncDetect");
+    TCase *tc_core = tcase_create("Core");
+    SRunner *sr = srunner_create(s);
+
+    tcase_add_test(tc_core, test_sync_detect_exact_marker);
+    tcase_add_test(tc_core, test_sync_detect_survives_gain_and_dither);
+    tcase_add_test(tc_core, test_sync_detect_finds_every_occurrence_across_blocks);
+    tcase_add_test(tc_core, test_sync_detect_no_false_positives);
+    tcase_add_test(tc_core, test_sync_detect_interleaved_channel);
+    tcase_add_test(tc_core, test_sync_detect_long_pattern);
+    tcase_add_test(tc_core, test_sync_detect_ticks);
+    suite_add_tcase(s, tc_core);
+
+    srunner_run_all(sr, CK_NORMAL);
+    int number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+    return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
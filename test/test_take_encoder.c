@@ -0,0 +1,184 @@
+#include <check.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <math.h>
+#include "../src/audio-buffer.h"
+#include "../src/take-encoder.h"
+
+#define RATE 48000
+#define QUANTUM 480
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+// One quantum of a different tone per channel; marker is a marker_type_t
+// or -1 for none
+static void push(audio_buffer_t *ab, int marker, uint64_t mask) {
+    static float a[QUANTUM], b[QUANTUM];
+    float *planes[2] = {a, b};
+    uint64_t w = audio_buffer_write_position(ab);
+    for (int i = 0; i < QUANTUM; ++i) {
+        a[i] = 0.4f * sinf((float)(w + i) * 0.01f);
+        b[i] = 0.3f * sinf((float)(w + i) * 0.037f);
+    }
+    if (marker < 0) audio_buffer_push_frames(ab, planes, QUANTUM, 0);
+    else audio_buffer_push_frames_marked(ab, planes, QUANTUM, (marker_type_t)marker, mask);
+}
+
+static int same_file(const char *a, const char *b) {
+    FILE *fa = fopen(a, "rb"), *fb = fopen(b, "rb");
+    int same = fa && fb;
+    while (same) {
+        int ca = fgetc(fa), cb = fgetc(fb);
+        if (ca != cb) same = 0;
+        if (ca == EOF || cb == EOF) break;
+    }
+    if (fa) fclose(fa);
+    if (fb) fclose(fb);
+    return same;
+}
+
+// Record start, punch in and out on channel 2, a loop pass, then stop. The
+// encoder follows along and its files must equal a one shot export.
+static void run_take(int split, unsigned int expected_files) {
+    audio_buffer_t ab;
+    audio_buffer_init(&ab, 2, RATE, 60);
+    take_encoder_t te;
+    ck_assert_int_eq(take_encoder_init(&te, &ab, "_out", split, 4800), 0);
+    for (int block = 0; block < 400; ++block) {
+        int marker = -1;
+        uint64_t mask = AUDIO_BUFFER_ALL_CHANNELS;
+        if (block == 10) marker = MARKER_RECORD_START;
+        if (block == 100) { marker = MARKER_PUNCH_IN; mask = 0x2; }
+        if (block == 200) { marker = MARKER_PUNCH_OUT; mask = 0x2; }
+        if (block == 300) marker = MARKER_LOOP;
+        push(&ab, marker, mask);
+        if (block % 7 == 0) take_encoder_poll(&te, UINT64_MAX);
+    }
+    uint64_t stop = audio_buffer_write_position(&ab);
+    ck_assert_uint_eq(take_encoder_finish(&te, stop), expected_files);
+    ck_assert_uint_le(te.tail_frames, 7 * QUANTUM * expected_files);
+
+    audio_export_segment_t ref[8];
+    char names[8][64];
+    for (unsigned int i = 0; i < te.num_files; ++i) {
+        take_encoder_file_t *f = &te.files[i];
+        ck_assert_int_eq(f->result, 0);
+        ck_assert_ptr_null(f->file);
+        snprintf(names[i], sizeof(names[i]), "_out/test_take_ref%u.wav", i);
+        ref[i] = (audio_export_segment_t){f->start_frame, f->end_frame, f->first_channel, f->num_channels, names[i], {0, 0, 0.0}, 0};
+    }
+    ck_assert_uint_eq(te.files[0].start_frame, 10 * QUANTUM - 4800);
+    ck_assert_uint_eq(te.files[te.num_files - 1].end_frame, stop);
+    ck_assert_int_eq(audio_buffer_write_segments_to_wav(&ab, ref, te.num_files), 0);
+    for (unsigned int i = 0; i < te.num_files; ++i) {
+        ck_assert_uint_eq(te.files[i].stats.frames, ref[i].stats.frames);
+        ck_assert_msg(same_file(te.files[i].path, names[i]), "%s differs from the export", te.files[i].path);
+        unlink(te.files[i].path);
+    }
+    take_encoder_reset(&te);
+    // The finished take is not picked up again
+    push(&ab, -1, 0);
+    ck_assert_uint_eq(take_encoder_poll(&te, UINT64_MAX), 0);
+    ck_assert_uint_eq(take_encoder_finish(&te, audio_buffer_write_position(&ab)), 0);
+    take_encoder_free(&te);
+    audio_buffer_free(&ab);
+}
+
+START_TEST(test_take_encoder_matches_export)
+{
+    run_take(0, 3);
+}
+END_TEST
+
+START_TEST(test_take_encoder_split_matches_export)
+{
+    // Both channels for the record start and loop, channel 2 for the punch
+    run_take(1, 5);
+}
+END_TEST
+
+START_TEST(test_take_encoder_new_take_drops_unfinished)
+{
+    audio_buffer_t ab;
+    audio_buffer_init(&ab, 2, RATE, 10);
+    take_encoder_t te;
+    ck_assert_int_eq(take_encoder_init(&te, &ab, "_out", 0, 0), 0);
+    push(&ab, MARKER_RECORD_START, AUDIO_BUFFER_ALL_CHANNELS);
+    push(&ab, -1, 0);
+    ck_assert_uint_eq(take_encoder_poll(&te, UINT64_MAX), 2 * QUANTUM);
+    char first[1024];
+    strcpy(first, te.files[0].path);
+    ck_assert_int_eq(access(first, F_OK), 0);
+
+    push(&ab, MARKER_RECORD_START, AUDIO_BUFFER_ALL_CHANNELS);
+    ck_assert_uint_eq(take_encoder_poll(&te, UINT64_MAX), QUANTUM);
+    ck_assert_int_ne(access(first, F_OK), 0);
+    ck_assert_uint_eq(te.num_files, 1);
+    ck_assert_uint_eq(te.files[0].start_frame, 2 * QUANTUM);
+    take_encoder_free(&te);
+    ck_assert_int_ne(access(first, F_OK), 0);
+    audio_buffer_free(&ab);
+}
+END_TEST
+
+START_TEST(test_take_encoder_stop_latency_is_independent_of_length)
+{
+    // Five minutes of stereo, polled every quarter second like the daemon
+    audio_buffer_t ab;
+    audio_buffer_init(&ab, 2, RATE, 6 * 60);
+    take_encoder_t te;
+    ck_assert_int_eq(take_encoder_init(&te, &ab, "_out", 0, 4800), 0);
+    push(&ab, -1, 0);
+    push(&ab, MARKER_RECORD_START, AUDIO_BUFFER_ALL_CHANNELS);
+    int blocks = 5 * 60 * RATE / QUANTUM;
+    int poll_blocks = RATE / 4 / QUANTUM;
+    for (int block = 0; block < blocks; ++block) {
+        push(&ab, -1, 0);
+        if (block % poll_blocks == 0) take_encoder_poll(&te, UINT64_MAX);
+    }
+    uint64_t stop = audio_buffer_write_position(&ab);
+    double t0 = now_seconds();
+    ck_assert_uint_eq(take_encoder_finish(&te, stop), 1);
+    double finish = now_seconds() - t0;
+    ck_assert_uint_le(te.tail_frames, (uint64_t)poll_blocks * QUANTUM);
+    ck_assert_uint_eq(te.files[0].stats.frames, stop - te.files[0].start_frame);
+
+    audio_export_stats_t stats;
+    t0 = now_seconds();
+    ck_assert_int_eq(audio_buffer_write_range_to_wav(&ab, 0, 2, te.files[0].start_frame, stop, "_out/test_take_full.wav", &stats), 0);
+    double full = now_seconds() - t0;
+    printf("Stop to ready for a 5 min take: %.2f ms (full export %.2f ms, %llu tail frames)\n",
+        finish * 1000.0, full * 1000.0, (unsigned long long)te.tail_frames);
+    ck_assert_msg(same_file(te.files[0].path, "_out/test_take_full.wav"), "encoded take differs from the export");
+    unlink(te.files[0].path);
+    take_encoder_reset(&te);
+    take_encoder_free(&te);
+    audio_buffer_free(&ab);
+}
+END_TEST
+
+int main(void)
+{
+    Suite *s = suite_create("TakeEncoder");
+    TCase *tc_core = tcase_create("Core");
+    SRunner *sr = srunner_create(s);
+
+    tcase_set_timeout(tc_core, 60);
+    tcase_add_test(tc_core, test_take_encoder_matches_export);
+    tcase_add_test(tc_core, test_take_encoder_split_matches_export);
+    tcase_add_test(tc_core, test_take_encoder_new_take_drops_unfinished);
+    tcase_add_test(tc_core, test_take_encoder_stop_latency_is_independent_of_length);
+    suite_add_tcase(s, tc_core);
+
+    srunner_run_all(sr, CK_NORMAL);
+    int number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+    return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,403 @@
+#include <check.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <sys/stat.h>
+#include <sndfile.h>
+#include "../src/take-patch.h"
+#include "../src/sync-marker.h"
+
+#define TAKE_PATH "_out/test_take_patch_take.wav"
+#define REC_PATH "_out/test_take_patch_rec.wav"
+#define TAKE_SYNC 5000
+#define REC_SYNC 1200
+
+// Performance audio, exact in 24 bit. Take and recording see the same
+// performance shifted by TAKE_SYNC - REC_SYNC.
+static float performance(int64_t t, int ch)
+{
+    int32_t v = (int32_t)(sin((double)t * 0.013 + ch) * 3000000.0);
+    return (float)v / 8388608.0f;
+}
+
+// The take has a dropout every 3000 frames, the recording is clean
+static float take_value(int64_t frame, int ch)
+{
+    if (frame % 3000 < 64) return 0.0f;
+    return performance(frame, ch);
+}
+
+static float rec_value(int64_t frame, int ch)
+{
+    return performance(frame + TAKE_SYNC - REC_SYNC, ch);
+}
+
+static void make_wav(const char *path, int format, int channels, int frames, int sync, float (*value)(int64_t, int))
+{
+    mkdir("_out", 0700);
+    SF_INFO info = {0};
+    info.samplerate = 48000;
+    info.channels = channels;
+    info.format = SF_FORMAT_WAV | format;
+    SNDFILE *f = sf_open(path, SFM_WRITE, &info);
+    ck_assert_ptr_nonnull(f);
+    float *data = malloc(sizeof(float) * frames * channels);
+    for (int i = 0; i < frames; ++i) {
+        for (int ch = 0; ch < channels; ++ch) {
+            float v = value(i, ch);
+            if (i >= sync && i < sync + SYNC_MARKER_LENGTH) v = sync_marker_pattern[i - sync];
+            data[i * channels + ch] = v;
+        }
+    }
+    sf_writef_float(f, data, frames);
+    sf_close(f);
+    free(data);
+}
+
+static float *read_all(const char *path, wav_file_t *info)
+{
+    ck_assert_int_eq(wav_file_open(info, path, 0), 0);
+    float *data = malloc(sizeof(float) * info->frames * info->channels);
+    wav_file_read_frames(info, data, 0, (uint32_t)info->frames);
+    wav_file_close(info);
+    return data;
+}
+
+static int run_patch(const take_patch_options_t *options, take_patch_result_t *result)
+{
+    wav_file_t take, rec;
+    ck_assert_int_eq(wav_file_open(&take, TAKE_PATH, 1), 0);
+    ck_assert_int_eq(wav_file_open(&rec, REC_PATH, 0), 0);
+    int ret = take_patch(&take, &rec, options, result);
+    wav_file_close(&rec);
+    ck_assert_int_eq(wav_file_close(&take), 0);
+    return ret;
+}
+
+START_TEST(test_take_patch_same_format_copies_samples)
+{
+    make_wav(TAKE_PATH, SF_FORMAT_PCM_24, 2, 30000, TAKE_SYNC, take_value);
+    make_wav(REC_PATH, SF_FORMAT_PCM_24, 2, 40000, REC_SYNC, rec_value);
+    take_patch_options_t options = {0};
+    take_patch_result_t result;
+    ck_assert_int_eq(run_patch(&options, &result), TAKE_PATCH_OK);
+    ck_assert_int_eq(result.take_sync, TAKE_SYNC);
+    ck_assert_int_eq(result.rec_sync, REC_SYNC);
+    ck_assert_uint_eq(result.frames, 30000 - TAKE_SYNC);
+    ck_assert_int_eq(result.copied_raw, 1);
+    ck_assert(result.diff_max > 0.1);
+    ck_assert(result.diff_mean > 0.0);
+
+    wav_file_t info;
+    float *take = read_all(TAKE_PATH, &info);
+    for (int i = 0; i < 30000; ++i) {
+        for (int ch = 0; ch < 2; ++ch) {
+            float expected = i < TAKE_SYNC ? take_value(i, ch) : performance(i, ch);
+            if (i >= TAKE_SYNC && i < TAKE_SYNC + SYNC_MARKER_LENGTH) expected = sync_marker_pattern[i - TAKE_SYNC];
+            ck_assert_msg(fabsf(take[i * 2 + ch] - expected) < 1e-6f, "frame %d ch %d", i, ch);
+        }
+    }
+    free(take);
+
+    // Patching again finds nothing left to fix
+    ck_assert_int_eq(run_patch(&options, &result), TAKE_PATCH_OK);
+    ck_assert(result.diff_max == 0.0);
+}
+END_TEST
+
+START_TEST(test_take_patch_dry_run_leaves_take_alone)
+{
+    make_wav(TAKE_PATH, SF_FORMAT_PCM_24, 2, 30000, TAKE_SYNC, take_value);
+    make_wav(REC_PATH, SF_FORMAT_PCM_24, 2, 40000, REC_SYNC, rec_value);
+    take_patch_options_t options = {.dry_run = 1};
+    take_patch_result_t result;
+    ck_assert_int_eq(run_patch(&options, &result), TAKE_PATCH_OK);
+    ck_assert(result.diff_max > 0.1);
+    wav_file_t info;
+    float *take = read_all(TAKE_PATH, &info);
+    ck_assert(take[(TAKE_SYNC + 1000) * 2] == 0.0f); // Dropout at 6000 still there
+    free(take);
+}
+END_TEST
+
+START_TEST(test_take_patch_converts_other_formats)
+{
+    // Mono 16 bit take, stereo float recording: only the first channel is used
+    make_wav(TAKE_PATH, SF_FORMAT_PCM_16, 1, 30000, TAKE_SYNC, take_value);
+    make_wav(REC_PATH, SF_FORMAT_FLOAT, 2, 40000, REC_SYNC, rec_value);
+    take_patch_options_t options = {0};
+    take_patch_result_t result;
+    int ret = run_patch(&options, &result);
+    // The marker is below 16 bit resolution, too coarse to reach the threshold
+    ck_assert_int_eq(ret, TAKE_PATCH_NO_SYNC_IN_TAKE);
+
+    make_wav(TAKE_PATH, SF_FORMAT_PCM_24, 1, 30000, TAKE_SYNC, take_value);
+    ck_assert_int_eq(run_patch(&options, &result), TAKE_PATCH_OK);
+    ck_assert_int_eq(result.copied_raw, 0);
+    ck_assert_uint_eq(result.channels, 1);
+    wav_file_t info;
+    float *take = read_all(TAKE_PATH, &info);
+    for (int i = TAKE_SYNC + SYNC_MARKER_LENGTH; i < 30000; ++i) {
+        ck_assert_msg(fabsf(take[i] - performance(i, 0)) < 1.5f / 8388608.0f, "frame %d", i);
+    }
+    free(take);
+}
+END_TEST
+
+START_TEST(test_take_patch_extra_take_channels_untouched)
+{
+    make_wav(TAKE_PATH, SF_FORMAT_PCM_24, 2, 30000, TAKE_SYNC, take_value);
+    make_wav(REC_PATH, SF_FORMAT_FLOAT, 1, 40000, REC_SYNC, rec_value);
+    take_patch_options_t options = {0};
+    take_patch_result_t result;
+    ck_assert_int_eq(run_patch(&options, &result), TAKE_PATCH_OK);
+    wav_file_t info;
+    float *take = read_all(TAKE_PATH, &info);
+    ck_assert(fabsf(take[6000 * 2] - performance(6000, 0)) < 1e-6f);
+    ck_assert(take[6000 * 2 + 1] == 0.0f);
+    free(take);
+}
+END_TEST
+
+START_TEST(test_take_patch_short_recording_keeps_tail)
+{
+    make_wav(TAKE_PATH, SF_FORMAT_PCM_24, 2, 30000, TAKE_SYNC, take_value);
+    make_wav(REC_PATH, SF_FORMAT_PCM_24, 2, 10000, REC_SYNC, rec_value);
+    take_patch_options_t options = {0};
+    take_patch_result_t result;
+    ck_assert_int_eq(run_patch(&options, &result), TAKE_PATCH_OK);
+    ck_assert_uint_eq(result.frames, 10000 - REC_SYNC);
+    wav_file_t info;
+    float *take = read_all(TAKE_PATH, &info);
+    ck_assert(fabsf(take[12000 * 2] - performance(12000, 0)) < 1e-6f);
+    ck_assert(take[15000 * 2] == 0.0f); // Past the recording: the take's own dropout
+    free(take);
+}
+END_TEST
+
+START_TEST(test_take_patch_burn_marker)
+{
+    make_wav(TAKE_PATH, SF_FORMAT_PCM_24, 2, 30000, TAKE_SYNC, take_value);
+    make_wav(REC_PATH, SF_FORMAT_PCM_24, 2, 40000, REC_SYNC, rec_value);
+    take_patch_options_t options = {.burn_marker = 1};
+    take_patch_result_t result;
+    ck_assert_int_eq(run_patch(&options, &result), TAKE_PATCH_OK);
+    wav_file_t info;
+    float *take = read_all(TAKE_PATH, &info);
+    for (int i = 0; i < SYNC_MARKER_LENGTH; ++i) {
+        ck_assert(fabsf(take[(TAKE_SYNC + i) * 2] - sync_marker_pattern[i] * 10000.0f) < 1e-3f);
+    }
+    free(take);
+}
+END_TEST
+
+START_TEST(test_take_patch_known_recording_sync)
+{
+    make_wav(TAKE_PATH, SF_FORMAT_PCM_24, 2, 30000, TAKE_SYNC, take_value);
+    make_wav(REC_PATH, SF_FORMAT_PCM_24, 2, 40000, REC_SYNC, rec_value);
+    // As read from the recording's sidecar: the recording is not searched
+    take_patch_options_t options = {.have_rec_sync = 1, .rec_sync = REC_SYNC};
+    take_patch_result_t result;
+    ck_assert_int_eq(run_patch(&options, &result), TAKE_PATCH_OK);
+    ck_assert_int_eq(result.rec_sync, REC_SYNC);
+    ck_assert_uint_eq(result.frames, 30000 - TAKE_SYNC);
+    wav_file_t info;
+    float *take = read_all(TAKE_PATH, &info);
+    ck_assert(fabsf(take[6000 * 2] - performance(6000, 0)) < 1e-6f);
+    free(take);
+
+    options.rec_sync = 40000;
+    ck_assert_int_eq(run_patch(&options, &result), TAKE_PATCH_NO_SYNC_IN_RECORDING);
+}
+END_TEST
+
+START_TEST(test_take_patch_glitches_only)
+{
+    make_wav(TAKE_PATH, SF_FORMAT_PCM_24, 2, 30000, TAKE_SYNC, take_value);
+    make_wav(REC_PATH, SF_FORMAT_PCM_24, 2, 40000, REC_SYNC, rec_value);
+    glitch_map_t gm;
+    ck_assert_int_eq(glitch_map_init(&gm, 0.0f, 0), 0);
+    take_patch_options_t options = {.glitches_only = 1, .glitch_map = &gm};
+    take_patch_result_t result;
+    ck_assert_int_eq(run_patch(&options, &result), TAKE_PATCH_OK);
+    // One glitch per dropout after the marker, 6000 to 27000
+    ck_assert_uint_eq(result.glitches, 8);
+    ck_assert_uint_eq(gm.count, 8);
+    for (uint32_t i = 0; i < gm.count; ++i) {
+        const glitch_t *g = &gm.glitches[i];
+        ck_assert_uint_le(g->start_frame, 6000 + 3000 * i);
+        ck_assert_uint_ge(g->end_frame, 6064 + 3000 * i);
+        ck_assert_uint_le(g->end_frame - g->start_frame, 2 * GLITCH_MAP_WINDOW);
+        ck_assert_uint_eq(g->type, GLITCH_ZEROED);
+    }
+    // Only the glitches and their crossfades were written
+    ck_assert_uint_eq(result.frames, result.glitch_frames + 8 * 2 * TAKE_PATCH_CROSSFADE_FRAMES);
+    ck_assert_uint_lt(result.frames, 30000 - TAKE_SYNC);
+    glitch_map_free(&gm);
+
+    wav_file_t info;
+    float *take = read_all(TAKE_PATH, &info);
+    for (int i = TAKE_SYNC + SYNC_MARKER_LENGTH; i < 30000; ++i) {
+        for (int ch = 0; ch < 2; ++ch) {
+            ck_assert_msg(fabsf(take[i * 2 + ch] - performance(i, ch)) < 1.5f / 8388608.0f, "frame %d ch %d", i, ch);
+        }
+    }
+    free(take);
+
+    // Nothing left to patch
+    options.glitch_map = NULL;
+    ck_assert_int_eq(run_patch(&options, &result), TAKE_PATCH_OK);
+    ck_assert_uint_eq(result.glitches, 0);
+    ck_assert_uint_eq(result.frames, 0);
+}
+END_TEST
+
+START_TEST(test_take_patch_glitches_from_sidecar)
+{
+    make_wav(TAKE_PATH, SF_FORMAT_PCM_24, 2, 30000, TAKE_SYNC, take_value);
+    make_wav(REC_PATH, SF_FORMAT_PCM_24, 2, 40000, REC_SYNC, rec_value);
+    // The daemon checked up to take frame 16000 and reported the dropouts
+    // at 6000 and 12000 only, in recording frames
+    int64_t shift = TAKE_SYNC - REC_SYNC;
+    glitch_t reported[2] = {
+        {6000 - shift, 6064 - shift, 0.5f, 0.3f, GLITCH_ZEROED},
+        {12000 - shift, 12064 - shift, 0.5f, 0.3f, GLITCH_ZEROED},
+    };
+    glitch_map_t gm;
+    ck_assert_int_eq(glitch_map_init(&gm, 0.0f, 0), 0);
+    take_patch_options_t options = {.glitches_only = 1, .glitch_map = &gm, .have_rec_glitches = 1,
+                                    .rec_glitches = reported, .num_rec_glitches = 2, .rec_checked_until = 16000 - shift};
+    take_patch_result_t result;
+    ck_assert_int_eq(run_patch(&options, &result), TAKE_PATCH_OK);
+    ck_assert_uint_eq(result.checked_frames, 16000 - TAKE_SYNC - SYNC_MARKER_LENGTH);
+    // The two reported ones as they were, then the four compared after 16000
+    ck_assert_uint_eq(gm.count, 6);
+    ck_assert_uint_eq(gm.glitches[0].start_frame, 6000);
+    ck_assert_uint_eq(gm.glitches[0].end_frame, 6064);
+    ck_assert_uint_eq(gm.glitches[1].start_frame, 12000);
+    for (uint32_t i = 2; i < gm.count; ++i) ck_assert_uint_le(gm.glitches[i].start_frame, 18000 + 3000 * (i - 2));
+    ck_assert_uint_ge(gm.glitches[2].start_frame, 16000);
+    glitch_map_free(&gm);
+
+    // The checked part was not compared again: the dropouts the daemon did
+    // not report are still there
+    wav_file_t info;
+    float *take = read_all(TAKE_PATH, &info);
+    for (int i = 6000; i < 30000; i += 3000) {
+        int reported_or_compared = i == 6000 || i == 12000 || i >= 16000;
+        ck_assert_msg((take[i * 2] == 0.0f) != reported_or_compared, "frame %d", i);
+    }
+    free(take);
+}
+END_TEST
+
+// Tick test: ticks every TICK_FRAMES after the marker. The take lost
+// DROPPED frames between the first and second tick, so from the second on
+// it runs DROPPED frames ahead of the sync marker's alignment.
+#define TICK_FRAMES 8000
+#define DROPPED 480
+
+// Stream position s (0 is the marker) with the ticks in it
+static float ticked(int64_t s, int ch)
+{
+    if (s > 0 && s % TICK_FRAMES < SYNC_MARKER_TICK_LENGTH) {
+        float tick[SYNC_MARKER_TICK_LENGTH];
+        sync_marker_tick((uint32_t)(s / TICK_FRAMES), tick);
+        return tick[s % TICK_FRAMES];
+    }
+    return performance(s, ch);
+}
+
+static float ticked_take_value(int64_t frame, int ch)
+{
+    int64_t s = frame - TAKE_SYNC;
+    return ticked(s < TICK_FRAMES + 2000 ? s : s + DROPPED, ch);
+}
+
+static float ticked_rec_value(int64_t frame, int ch)
+{
+    return ticked(frame - REC_SYNC, ch);
+}
+
+START_TEST(test_take_patch_aligns_each_tick_interval)
+{
+    make_wav(TAKE_PATH, SF_FORMAT_PCM_24, 2, 40000, TAKE_SYNC, ticked_take_value);
+    make_wav(REC_PATH, SF_FORMAT_PCM_24, 2, 40000, REC_SYNC, ticked_rec_value);
+    take_patch_options_t options = {.dry_run = 1, .no_ticks = 1};
+    take_patch_result_t result;
+    // On the sync marker alone everything after the drop is off
+    ck_assert_int_eq(run_patch(&options, &result), TAKE_PATCH_OK);
+    ck_assert_uint_eq(result.ticks, 0);
+    ck_assert(result.diff_max > 0.1);
+
+    // Ticks at 8000, 16000, 24000 and 32000 after the marker, found in the recording
+    options.no_ticks = 0;
+    options.dry_run = 0;
+    ck_assert_int_eq(run_patch(&options, &result), TAKE_PATCH_OK);
+    ck_assert_uint_eq(result.ticks, 4);
+    ck_assert_int_eq(result.max_shift, -DROPPED);
+    ck_assert(result.drift_ppm < 0.0);
+
+    wav_file_t info;
+    float *take = read_all(TAKE_PATH, &info);
+    int64_t second = TAKE_SYNC + 2 * TICK_FRAMES - DROPPED;
+    for (int64_t i = TAKE_SYNC; i < 40000; ++i) {
+        // Each interval holds the recording from its own tick on
+        float expected = ticked(i < second ? i - TAKE_SYNC : i - TAKE_SYNC + DROPPED, 0);
+        if (i < TAKE_SYNC + SYNC_MARKER_LENGTH) expected = sync_marker_pattern[i - TAKE_SYNC];
+        ck_assert_msg(fabsf(take[i * 2] - expected) < 1e-6f, "frame %d", (int)i);
+    }
+    free(take);
+
+    // The same ticks given as if read from the sidecar
+    take_patch_tick_t ticks[4];
+    for (uint32_t i = 0; i < 4; ++i) ticks[i] = (take_patch_tick_t){REC_SYNC + (i + 1) * TICK_FRAMES, i + 1};
+    options.rec_ticks = ticks;
+    options.num_rec_ticks = 4;
+    ck_assert_int_eq(run_patch(&options, &result), TAKE_PATCH_OK);
+    ck_assert_uint_eq(result.ticks, 4);
+    ck_assert(result.diff_max == 0.0);
+}
+END_TEST
+
+START_TEST(test_take_patch_rate_mismatch)
+{
+    make_wav(TAKE_PATH, SF_FORMAT_PCM_24, 1, 30000, TAKE_SYNC, take_value);
+    make_wav(REC_PATH, SF_FORMAT_PCM_24, 1, 40000, REC_SYNC, rec_value);
+    wav_file_t take, rec;
+    ck_assert_int_eq(wav_file_open(&take, TAKE_PATH, 0), 0);
+    ck_assert_int_eq(wav_file_open(&rec, REC_PATH, 0), 0);
+    rec.sample_rate = 44100;
+    take_patch_options_t options = {.dry_run = 1};
+    take_patch_result_t result;
+    ck_assert_int_eq(take_patch(&take, &rec, &options, &result), TAKE_PATCH_RATE_MISMATCH);
+    wav_file_close(&take);
+    wav_file_close(&rec);
+}
+END_TEST
+
+int main(void)
+{
+    Suite *s = suite_create("TakePatch");
+    TCase *tc_core = tcase_create("Core");
+    SRunner *sr = srunner_create(s);
+
+    tcase_add_test(tc_core, test_take_patch_same_format_copies_samples);
+    tcase_add_test(tc_core, test_take_patch_dry_run_leaves_take_alone);
+    tcase_add_test(tc_core, test_take_patch_converts_other_formats);
+    tcase_add_test(tc_core, test_take_patch_extra_take_channels_untouched);
+    tcase_add_test(tc_core, test_take_patch_short_recording_keeps_tail);
+    tcase_add_test(tc_core, test_take_patch_burn_marker);
+    tcase_add_test(tc_core, test_take_patch_known_recording_sync);
+    tcase_add_test(tc_core, test_take_patch_glitches_only);
+    tcase_add_test(tc_core, test_take_patch_glitches_from_sidecar);
+    tcase_add_test(tc_core, test_take_patch_aligns_each_tick_interval);
+    tcase_add_test(tc_core, test_take_patch_rate_mismatch);
+    suite_add_tcase(s, tc_core);
+
+    srunner_run_all(sr, CK_NORMAL);
+    int number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+    return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
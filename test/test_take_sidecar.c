@@ -0,0 +1,126 @@
+#include <check.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include "../src/take-sidecar.h"
+#include "../src/take-patch.h"
+
+#define RATE 48000
+#define QUANTUM 480
+#define WAV_PATH "_out/test_take_sidecar.wav"
+#define JSON_PATH "_out/test_take_sidecar.json"
+
+static char *read_text(const char *path) {
+    FILE *f = fopen(path, "r");
+    ck_assert_ptr_nonnull(f);
+    static char text[8192];
+    size_t n = fread(text, 1, sizeof(text) - 1, f);
+    text[n] = '\0';
+    fclose(f);
+    return text;
+}
+
+START_TEST(test_take_sidecar_path)
+{
+    char path[64];
+    take_sidecar_path(path, sizeof(path), "dir/rec20250101-120000_seg02.wav");
+    ck_assert_str_eq(path, "dir/rec20250101-120000_seg02.json");
+    take_sidecar_path(path, sizeof(path), "take.w64");
+    ck_assert_str_eq(path, "take.w64.json");
+}
+END_TEST
+
+START_TEST(test_take_sidecar_write)
+{
+    mkdir("_out", 0755);
+    audio_buffer_t ab;
+    audio_buffer_init(&ab, 4, RATE, 10);
+    float zeros[QUANTUM] = {0};
+    float *planes[4] = {zeros, zeros, zeros, zeros};
+    uint64_t clock = 1000000, nsec = 5000000000ULL;
+    uint64_t time;
+    ck_assert_int_eq(audio_buffer_time_at_frame(&ab, 0, &time), -1);
+    for (int block = 0; block < 100; ++block) {
+        uint64_t pos = audio_buffer_write_position(&ab);
+        audio_buffer_set_clock(&ab, clock + pos);
+        audio_buffer_set_time(&ab, nsec + pos * 1000000000ULL / RATE);
+        if (block == 10) audio_buffer_push_frames_marked(&ab, planes, QUANTUM, MARKER_RECORD_START, AUDIO_BUFFER_ALL_CHANNELS);
+        else if (block == 50) audio_buffer_push_frames_marked(&ab, planes, QUANTUM, MARKER_PUNCH_IN, 0x6);
+        else if (block == 60 || block == 70) audio_buffer_push_frames_tick(&ab, planes, QUANTUM, (uint32_t)(block - 50) / 10);
+        else audio_buffer_push_frames(&ab, planes, QUANTUM, 0);
+    }
+    ck_assert_int_eq(audio_buffer_time_at_frame(&ab, RATE, &time), 0);
+    ck_assert_uint_eq(time, nsec + 1000000000ULL);
+
+    // Second segment of the take, channels 2 and 3, starting 4800 frames early
+    uint64_t sync = 50 * QUANTUM;
+    take_sidecar_t sc = {.start_frame = sync - 4800, .end_frame = 80 * QUANTUM, .sync_frame = sync, .sync_type = MARKER_PUNCH_IN,
+                         .take_id = 1, .segment = 1, .first_channel = 1, .num_channels = 2};
+    ck_assert_int_eq(take_sidecar_write(WAV_PATH, &ab, &sc), 0);
+    const char *json = read_text(JSON_PATH);
+    ck_assert_ptr_nonnull(strstr(json, "\"version\":1,\"wav\":\"test_take_sidecar.wav\",\"sample_rate\":48000,"));
+    ck_assert_ptr_nonnull(strstr(json, "\"channels\":[2,3],\"start_frame\":19200,\"end_frame\":38400,\"frames\":19200,"));
+    ck_assert_ptr_nonnull(strstr(json, "\"sync\":{\"frame\":24000,\"offset\":4800,\"type\":\"punch_in\"},"
+                                       "\"clock_position\":1019200,\"monotonic_ns\":5400000000,"));
+    // Only the punch-in and the ticks lie inside the file, the record start is before it
+    ck_assert_ptr_null(strstr(json, "record_start"));
+    ck_assert_ptr_nonnull(strstr(json, "\"markers\":[{\"frame\":24000,\"offset\":4800,\"type\":\"punch_in\",\"take\":1,"
+                                       "\"channel_mask\":6,\"clock_position\":1024000,\"monotonic_ns\":5500000000},"
+                                       "{\"frame\":28800,\"offset\":9600,\"type\":\"tick\",\"sequence\":1,\"take\":1,"));
+    ck_assert_ptr_nonnull(strstr(json, "{\"frame\":33600,\"offset\":14400,\"type\":\"tick\",\"sequence\":2,\"take\":1,"));
+    ck_assert_ptr_nonnull(strstr(json, "\"clock_position\":1033600,\"monotonic_ns\":5700000000}]}"));
+    ck_assert_ptr_null(strstr(json, "loopback"));
+    struct stat st;
+    ck_assert_int_eq(stat(JSON_PATH ".part", &st), -1);
+
+    // A checked return adds its latency and the glitches inside the file
+    glitch_t glitch = {30000, 30256, 0.5f, 0.25f, GLITCH_ZEROED};
+    sc.loopback = 1;
+    sc.loopback_latency = 1024;
+    sc.compared_until = 40000;
+    sc.glitches = &glitch;
+    sc.num_glitches = 1;
+    ck_assert_int_eq(take_sidecar_write(WAV_PATH, &ab, &sc), 0);
+    json = read_text(JSON_PATH);
+    ck_assert_ptr_nonnull(strstr(json, "\"monotonic_ns\":5700000000}],\"loopback\":{\"latency\":1024,\"compared_until\":40000,"
+                                       "\"glitches\":[{\"start_frame\":30000,\"end_frame\":30256,\"offset\":10800,"
+                                       "\"type\":\"zeroed\",\"max_diff\":0.5,\"rms_diff\":0.25}]}}"));
+
+    // The patchers find the marker without reading the audio
+    ck_assert_int_eq(take_patch_sidecar_sync(WAV_PATH, RATE), 4800);
+    ck_assert_int_eq(take_patch_sidecar_sync(WAV_PATH, 44100), -1);
+    take_patch_tick_t ticks[1];
+    ck_assert_uint_eq(take_patch_sidecar_ticks(WAV_PATH, RATE, ticks, 1), 2);
+    ck_assert_int_eq(ticks[0].frame, 9600);
+    ck_assert_uint_eq(ticks[0].sequence, 1);
+    ck_assert_uint_eq(take_patch_sidecar_ticks(WAV_PATH, 44100, ticks, 1), 0);
+    // And the glitches the return check found, in file frames
+    glitch_t glitches[2];
+    int64_t checked_until = 0;
+    ck_assert_int_eq(take_patch_sidecar_glitches(WAV_PATH, RATE, glitches, 2, &checked_until), 1);
+    ck_assert_int_eq(checked_until, 40000 - 19200);
+    ck_assert_uint_eq(glitches[0].start_frame, 10800);
+    ck_assert_uint_eq(glitches[0].end_frame, 11056);
+    ck_assert_uint_eq(glitches[0].type, GLITCH_ZEROED);
+    ck_assert(glitches[0].max_diff == 0.5f && glitches[0].rms_diff == 0.25f);
+    ck_assert_int_eq(take_patch_sidecar_glitches(WAV_PATH, 44100, glitches, 2, &checked_until), -1);
+    audio_buffer_free(&ab);
+}
+END_TEST
+
+int main(void)
+{
+    Suite *s = suite_create("TakeSidecar");
+    TCase *tc_core = tcase_create("Core");
+    SRunner *sr = srunner_create(s);
+
+    tcase_add_test(tc_core, test_take_sidecar_path);
+    tcase_add_test(tc_core, test_take_sidecar_write);
+    suite_add_tcase(s, tc_core);
+
+    srunner_run_all(sr, CK_NORMAL);
+    int number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+    return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
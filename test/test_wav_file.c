@@ -0,0 +1,206 @@
+#include <check.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "../src/wav-file.h"
+
+#define TEST_DIR "_out"
+
+static void put16(FILE *f, uint16_t v) { fputc(v & 0xFF, f); fputc(v >> 8, f); }
+static void put32(FILE *f, uint32_t v) { put16(f, (uint16_t)v); put16(f, (uint16_t)(v >> 16)); }
+static void put64(FILE *f, uint64_t v) { put32(f, (uint32_t)v); put32(f, (uint32_t)(v >> 32)); }
+
+// Write a WAV file by hand, so RF64 and extensible headers can be covered.
+// Sample i of the data is the integer ramp value (i % 200) - 100, scaled to the format.
+static void write_wav(const char *path, uint16_t tag, int bits, int channels, uint32_t frames, int rf64, int extensible)
+{
+    mkdir(TEST_DIR, 0700);
+    FILE *f = fopen(path, "wb");
+    ck_assert_ptr_nonnull(f);
+    uint32_t bytes = (uint32_t)(bits / 8);
+    uint32_t data_size = frames * channels * bytes;
+    uint32_t fmt_size = extensible ? 40 : 16;
+    fwrite(rf64 ? "RF64" : "RIFF", 1, 4, f);
+    put32(f, rf64 ? 0xFFFFFFFFu : 4 + 12 + 8 + fmt_size + 8 + data_size);
+    fwrite("WAVE", 1, 4, f);
+    if (rf64) {
+        fwrite("ds64", 1, 4, f);
+        put32(f, 28);
+        put64(f, 0);
+        put64(f, data_size);
+        put64(f, frames);
+        put32(f, 0);
+    }
+    // An unknown chunk with an odd size, to exercise padding
+    fwrite("LIST", 1, 4, f);
+    put32(f, 3);
+    fwrite("abc\0", 1, 4, f);
+    fwrite("fmt ", 1, 4, f);
+    put32(f, fmt_size);
+    put16(f, extensible ? 0xFFFE : tag);
+    put16(f, (uint16_t)channels);
+    put32(f, 48000);
+    put32(f, 48000 * channels * bytes);
+    put16(f, (uint16_t)(channels * bytes));
+    put16(f, (uint16_t)bits);
+    if (extensible) {
+        put16(f, 22);
+        put16(f, (uint16_t)bits);
+        put32(f, 0);
+        put16(f, tag);
+        fwrite("\x00\x00\x00\x00\x10\x00\x80\x00\x00\xAA\x00\x38\x9B\x71", 1, 14, f);
+    }
+    fwrite("data", 1, 4, f);
+    put32(f, rf64 ? 0xFFFFFFFFu : data_size);
+    for (uint32_t i = 0; i < frames * channels; ++i) {
+        int32_t v = (int32_t)(i % 200) - 100;
+        if (tag == 3) {
+            float x = (float)v / 128.0f;
+            uint32_t u;
+            memcpy(&u, &x, 4);
+            put32(f, u);
+        } else if (bits == 16) {
+            put16(f, (uint16_t)v);
+        } else if (bits == 24) {
+            put16(f, (uint16_t)v);
+            fputc((v >> 16) & 0xFF, f);
+        } else {
+            put32(f, (uint32_t)v);
+        }
+    }
+    fclose(f);
+}
+
+static float expected_value(uint16_t tag, int bits, uint32_t i)
+{
+    int32_t v = (int32_t)(i % 200) - 100;
+    if (tag == 3) return (float)v / 128.0f;
+    return (float)((double)v / (double)(1u << (bits - 1)));
+}
+
+static void check_format(uint16_t tag, int bits, wav_sample_format_t format, int rf64, int extensible)
+{
+    const char *path = TEST_DIR "/test_wav_file.wav";
+    write_wav(path, tag, bits, 3, 1000, rf64, extensible);
+    wav_file_t wav;
+    ck_assert_int_eq(wav_file_open(&wav, path, 1), 0);
+    ck_assert_int_eq(wav.format, format);
+    ck_assert_uint_eq(wav.channels, 3);
+    ck_assert_uint_eq(wav.sample_rate, 48000);
+    ck_assert_uint_eq(wav.frames, 1000);
+    ck_assert_int_eq(wav.rf64, rf64);
+
+    float frames[3 * 10];
+    wav_file_read_frames(&wav, frames, 500, 10);
+    for (uint32_t i = 0; i < 30; ++i) ck_assert(frames[i] == expected_value(tag, bits, 1500 + i));
+    float channel[10];
+    wav_file_read_channel(&wav, 2, channel, 500, 10);
+    for (uint32_t i = 0; i < 10; ++i) ck_assert(channel[i] == expected_value(tag, bits, (500 + i) * 3 + 2));
+
+    // Written values read back the same, neighbouring channels are untouched
+    float patch[10];
+    for (int i = 0; i < 10; ++i) patch[i] = (float)(i - 5) / 16.0f;
+    wav_file_write_channel(&wav, 1, patch, 10, 10);
+    ck_assert_int_eq(wav_file_close(&wav), 0);
+    ck_assert_int_eq(wav_file_open(&wav, path, 0), 0);
+    wav_file_read_frames(&wav, frames, 10, 10);
+    for (uint32_t i = 0; i < 10; ++i) {
+        ck_assert(frames[i * 3] == expected_value(tag, bits, (10 + i) * 3));
+        ck_assert(frames[i * 3 + 1] == patch[i]);
+        ck_assert(frames[i * 3 + 2] == expected_value(tag, bits, (10 + i) * 3 + 2));
+    }
+    wav_file_close(&wav);
+}
+
+START_TEST(test_wav_file_pcm16)
+{
+    check_format(1, 16, WAV_SAMPLE_PCM16, 0, 0);
+}
+END_TEST
+
+START_TEST(test_wav_file_pcm24)
+{
+    check_format(1, 24, WAV_SAMPLE_PCM24, 0, 0);
+}
+END_TEST
+
+START_TEST(test_wav_file_pcm32)
+{
+    check_format(1, 32, WAV_SAMPLE_PCM32, 0, 0);
+}
+END_TEST
+
+START_TEST(test_wav_file_float)
+{
+    check_format(3, 32, WAV_SAMPLE_FLOAT32, 0, 0);
+}
+END_TEST
+
+START_TEST(test_wav_file_rf64)
+{
+    check_format(1, 24, WAV_SAMPLE_PCM24, 1, 0);
+}
+END_TEST
+
+START_TEST(test_wav_file_extensible)
+{
+    check_format(3, 32, WAV_SAMPLE_FLOAT32, 0, 1);
+    check_format(1, 24, WAV_SAMPLE_PCM24, 1, 1);
+}
+END_TEST
+
+START_TEST(test_wav_file_rejects_other_files)
+{
+    const char *path = TEST_DIR "/test_wav_file_bad.wav";
+    mkdir(TEST_DIR, 0700);
+    FILE *f = fopen(path, "wb");
+    fputs("this is not a wav file at all", f);
+    fclose(f);
+    wav_file_t wav;
+    ck_assert_int_eq(wav_file_open(&wav, path, 0), -2);
+    ck_assert_int_eq(wav_file_open(&wav, TEST_DIR "/does_not_exist.wav", 0), -1);
+    // 8 bit PCM is not supported
+    write_wav(path, 1, 8, 1, 10, 0, 0);
+    ck_assert_int_eq(wav_file_open(&wav, path, 0), -3);
+}
+END_TEST
+
+START_TEST(test_wav_file_truncated_data)
+{
+    const char *path = TEST_DIR "/test_wav_file_short.wav";
+    write_wav(path, 1, 24, 2, 1000, 0, 0);
+    // Cut the file mid frame, as if REAPER were still writing it
+    struct stat st;
+    stat(path, &st);
+    ck_assert_int_eq(truncate(path, st.st_size - 3 * 100 - 2), 0);
+    wav_file_t wav;
+    ck_assert_int_eq(wav_file_open(&wav, path, 0), 0);
+    ck_assert_uint_eq(wav.frames, 949);
+    wav_file_close(&wav);
+}
+END_TEST
+
+int main(void)
+{
+    Suite *s = suite_create("WavFile");
+    TCase *tc_core = tcase_create("Core");
+    SRunner *sr = srunner_create(s);
+
+    tcase_add_test(tc_core, test_wav_file_pcm16);
+    tcase_add_test(tc_core, test_wav_file_pcm24);
+    tcase_add_test(tc_core, test_wav_file_pcm32);
+    tcase_add_test(tc_core, test_wav_file_float);
+    tcase_add_test(tc_core, test_wav_file_rf64);
+    tcase_add_test(tc_core, test_wav_file_extensible);
+    tcase_add_test(tc_core, test_wav_file_rejects_other_files);
+    tcase_add_test(tc_core, test_wav_file_truncated_data);
+    suite_add_tcase(s, tc_core);
+
+    srunner_run_all(sr, CK_NORMAL);
+    int number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+    return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
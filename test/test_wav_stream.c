@@ -0,0 +1,157 @@
+#include <check.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include "../src/audio-buffer.h"
+#include "../src/wav-stream.h"
+#include "../src/wav-file.h"
+
+#define RATE 48000
+
+// Two seconds of a distinct ramp on each of three channels
+static void fill(audio_buffer_t *ab) {
+    audio_buffer_init(ab, 3, RATE, 4);
+    float a[1000], b[1000], c[1000];
+    float *planes[3] = {a, b, c};
+    for (int block = 0; block < 96; ++block) {
+        for (int i = 0; i < 1000; ++i) {
+            int n = block * 1000 + i;
+            a[i] = 0.5f * sinf(n * 0.001f);
+            b[i] = 0.25f * cosf(n * 0.003f);
+            c[i] = (float)(n % 977) / 2000.0f;
+        }
+        audio_buffer_push_frames(ab, planes, 1000, 0);
+    }
+}
+
+// Read the whole stream in awkward read sizes so chunk and header
+// boundaries fall mid-read
+static uint8_t *read_all(wav_stream_t *ws) {
+    uint8_t *out = malloc(ws->total_bytes);
+    uint64_t offset = 0;
+    size_t sizes[] = {7, 4093, 65536, 1, 30011};
+    int i = 0;
+    while (offset < ws->total_bytes) {
+        ssize_t n = wav_stream_read(ws, offset, out + offset, sizes[i++ % 5]);
+        ck_assert_int_gt(n, 0);
+        offset += (uint64_t)n;
+    }
+    ck_assert_int_eq(wav_stream_read(ws, offset, out, 16), 0);
+    return out;
+}
+
+START_TEST(test_wav_stream_matches_buffer)
+{
+    audio_buffer_t ab;
+    fill(&ab);
+    unsigned int channels[2] = {2, 0};
+    wav_stream_t ws;
+    ck_assert_int_eq(wav_stream_init(&ws, &ab, 12345, 80001, channels, 2), 0);
+    ck_assert_uint_eq(ws.total_bytes, 44 + (80001 - 12345) * 2 * 3);
+    uint8_t *bytes = read_all(&ws);
+
+    const char *path = "_out/test_wav_stream.wav";
+    FILE *f = fopen(path, "wb");
+    ck_assert_ptr_nonnull(f);
+    ck_assert_uint_eq(fwrite(bytes, 1, ws.total_bytes, f), ws.total_bytes);
+    fclose(f);
+
+    wav_file_t wav;
+    ck_assert_int_eq(wav_file_open(&wav, path, 0), 0);
+    ck_assert_uint_eq(wav.channels, 2);
+    ck_assert_uint_eq(wav.sample_rate, RATE);
+    ck_assert_uint_eq(wav.bytes_per_sample, 3);
+    ck_assert_uint_eq(wav.frames, 80001 - 12345);
+
+    uint64_t frames = wav.frames;
+    float *got = malloc(sizeof(float) * frames);
+    float *want = malloc(sizeof(float) * frames);
+    for (unsigned int ch = 0; ch < 2; ++ch) {
+        wav_file_read_channel(&wav, ch, got, 0, (uint32_t)frames);
+        ck_assert_int_eq(audio_buffer_read_range(&ab, channels[ch], want, 12345, 80001), 0);
+        for (uint64_t i = 0; i < frames; ++i) {
+            ck_assert_float_eq_tol(got[i], want[i], 1.0f / 8388607.0f);
+        }
+    }
+    wav_file_close(&wav);
+    free(got);
+    free(want);
+
+    // Random access gives the same bytes as the sequential read
+    srand(1);
+    uint8_t piece[5000];
+    for (int i = 0; i < 200; ++i) {
+        uint64_t offset = (uint64_t)rand() % ws.total_bytes;
+        size_t len = 1 + (size_t)rand() % sizeof(piece);
+        ssize_t n = wav_stream_read(&ws, offset, piece, len);
+        uint64_t expect = ws.total_bytes - offset < len ? ws.total_bytes - offset : len;
+        ck_assert_int_eq(n, (ssize_t)expect);
+        ck_assert_int_eq(memcmp(piece, bytes + offset, (size_t)n), 0);
+    }
+    free(bytes);
+    wav_stream_free(&ws);
+    audio_buffer_free(&ab);
+}
+END_TEST
+
+START_TEST(test_wav_stream_rejects_unheld_ranges)
+{
+    audio_buffer_t ab;
+    fill(&ab);
+    unsigned int channels[1] = {1};
+    wav_stream_t ws;
+    uint64_t w = audio_buffer_write_position(&ab);
+    ck_assert_int_eq(wav_stream_init(&ws, &ab, 0, w + 1, channels, 1), -3);
+    ck_assert_int_eq(wav_stream_init(&ws, &ab, 100, 100, channels, 1), -3);
+    unsigned int bad[1] = {3};
+    ck_assert_int_eq(wav_stream_init(&ws, &ab, 0, 100, bad, 1), -1);
+
+    // The ring holds 4 s, so pushing 4 s more loses the first frames
+    float zeros[1000] = {0};
+    float *planes[3] = {zeros, zeros, zeros};
+    for (int i = 0; i < 4 * RATE / 1000; ++i) audio_buffer_push_frames(&ab, planes, 1000, 0);
+    ck_assert_uint_gt(audio_buffer_oldest_frame(&ab), 0);
+    ck_assert_int_eq(wav_stream_init(&ws, &ab, 0, 1000, channels, 1), -3);
+    uint64_t oldest = audio_buffer_oldest_frame(&ab);
+    ck_assert_int_eq(wav_stream_init(&ws, &ab, oldest, oldest + 1000, channels, 1), 0);
+    wav_stream_free(&ws);
+    audio_buffer_free(&ab);
+}
+END_TEST
+
+START_TEST(test_wav_stream_odd_data_is_padded)
+{
+    audio_buffer_t ab;
+    fill(&ab);
+    unsigned int channels[1] = {0};
+    wav_stream_t ws;
+    ck_assert_int_eq(wav_stream_init(&ws, &ab, 0, 5, channels, 1), 0);
+    ck_assert_uint_eq(ws.data_bytes, 15);
+    ck_assert_uint_eq(ws.total_bytes, 44 + 16);
+    uint8_t *bytes = read_all(&ws);
+    ck_assert_int_eq(memcmp(bytes, "RIFF", 4), 0);
+    ck_assert_uint_eq(bytes[4] | bytes[5] << 8, 44 + 16 - 8);
+    ck_assert_uint_eq(bytes[44 + 15], 0);
+    free(bytes);
+    wav_stream_free(&ws);
+    audio_buffer_free(&ab);
+}
+END_TEST
+
+int main(void)
+{
+    Suite *s = suite_create("WavStream");
+    TCase *tc_core = tcase_create("Core");
+    SRunner *sr = srunner_create(s);
+
+    tcase_add_test(tc_core, test_wav_stream_matches_buffer);
+    tcase_add_test(tc_core, test_wav_stream_rejects_unheld_ranges);
+    tcase_add_test(tc_core, test_wav_stream_odd_data_is_padded);
+    suite_add_tcase(s, tc_core);
+
+    srunner_run_all(sr, CK_NORMAL);
+    int number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+    return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}